@@ -0,0 +1,144 @@
+//***************************************************************************************
+// CollisionBVHTests.cpp
+//
+// Builds the tree over a row of unit boxes and sweeps a sphere into one of them
+// across a face, an edge and a corner, past an edge and after moving an item.
+//***************************************************************************************
+
+#include "Test.h"
+
+#include "CollisionBVH.h"
+
+using namespace DirectX;
+
+namespace
+{
+	const UINT RowCount = 8;
+	const float RowSpacing = 8.0f;
+	const float Radius = 0.5f;
+
+	// The swept boxes are far enough apart that a sweep near one never reaches
+	// the next.
+	XMFLOAT3 RowCenter(UINT item)
+	{
+		return XMFLOAT3(0.0f, 0.0f, RowSpacing * item);
+	}
+
+	void BuildRow(CollisionBVH& bvh)
+	{
+		BoundingBox boxes[RowCount];
+		for(UINT i = 0; i < RowCount; ++i)
+			boxes[i] = BoundingBox(RowCenter(i), XMFLOAT3(1.0f, 1.0f, 1.0f));
+
+		bvh.Build(boxes, RowCount);
+	}
+
+	// Sweeps from center + offset along delta.
+	bool Sweep(const CollisionBVH& bvh, const XMFLOAT3& center, const XMFLOAT3& offset,
+		const XMFLOAT3& delta, CollisionBVH::SweepHit& hit)
+	{
+		XMFLOAT3 start(center.x + offset.x, center.y + offset.y, center.z + offset.z);
+		return bvh.SweepSphere(start, delta, Radius, hit);
+	}
+
+	bool Near(float a, float b)
+	{
+		return fabsf(a - b) < 1e-4f;
+	}
+
+	bool Near(const XMFLOAT3& a, float x, float y, float z)
+	{
+		return Near(a.x, x) && Near(a.y, y) && Near(a.z, z);
+	}
+}
+
+TEST(BuildSplitsTheRow)
+{
+	CollisionBVH bvh;
+	BuildRow(bvh);
+
+	CHECK(bvh.ItemCount() == RowCount);
+	CHECK(bvh.NodeCount() > 1);
+}
+
+TEST(SweepSphereHitsFace)
+{
+	CollisionBVH bvh;
+	BuildRow(bvh);
+
+	// Touches the x = -1 face once the center reaches x = -1.5.
+	CollisionBVH::SweepHit hit;
+	CHECK(Sweep(bvh, RowCenter(3), XMFLOAT3(-5.0f, 0.0f, 0.0f), XMFLOAT3(10.0f, 0.0f, 0.0f), hit));
+	CHECK(hit.Item == 3);
+	CHECK(Near(hit.Time, 0.35f));
+	CHECK(Near(hit.Normal, -1.0f, 0.0f, 0.0f));
+}
+
+TEST(SweepSphereHitsEdge)
+{
+	CollisionBVH bvh;
+	BuildRow(bvh);
+
+	// Heads straight at the edge x = z = -1 and touches it a radius away.
+	CollisionBVH::SweepHit hit;
+	CHECK(Sweep(bvh, RowCenter(3), XMFLOAT3(-5.0f, 0.0f, -5.0f), XMFLOAT3(10.0f, 0.0f, 10.0f), hit));
+	CHECK(hit.Item == 3);
+	CHECK(Near(hit.Time, (4.0f - Radius / sqrtf(2.0f)) / 10.0f));
+
+	float n = 1.0f / sqrtf(2.0f);
+	CHECK(Near(hit.Normal, -n, 0.0f, -n));
+}
+
+TEST(SweepSphereHitsCorner)
+{
+	CollisionBVH bvh;
+	BuildRow(bvh);
+
+	// Heads straight at the corner (-1, -1, -1).
+	CollisionBVH::SweepHit hit;
+	CHECK(Sweep(bvh, RowCenter(3), XMFLOAT3(-5.0f, -5.0f, -5.0f), XMFLOAT3(10.0f, 10.0f, 10.0f), hit));
+	CHECK(hit.Item == 3);
+	CHECK(Near(hit.Time, (4.0f - Radius / sqrtf(3.0f)) / 10.0f));
+
+	float n = 1.0f / sqrtf(3.0f);
+	CHECK(Near(hit.Normal, -n, -n, -n));
+}
+
+TEST(SweepSphereMissesPastEdge)
+{
+	CollisionBVH bvh;
+	BuildRow(bvh);
+
+	// Cuts through the corner of the box grown by the radius but passes the
+	// rounded edge x = z = -1 at 0.55, just out of reach.
+	const float d = -2.0f - 0.55f * sqrtf(2.0f);
+	CollisionBVH::SweepHit hit;
+	CHECK(!Sweep(bvh, RowCenter(3), XMFLOAT3(d - 1.5f, 0.0f, 1.5f), XMFLOAT3(4.0f, 0.0f, -4.0f), hit));
+	CHECK(hit.Time == 1.0f);
+
+	// And nowhere near the row at all.
+	CHECK(!bvh.SweepSphere(XMFLOAT3(10.0f, 0.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, 50.0f), Radius, hit));
+}
+
+TEST(RefitMovesItemBounds)
+{
+	CollisionBVH bvh;
+	BuildRow(bvh);
+
+	// Take item 5 out of the row.
+	const XMFLOAT3 moved(20.0f, 0.0f, 0.0f);
+	bvh.SetItemBounds(5, BoundingBox(moved, XMFLOAT3(1.0f, 1.0f, 1.0f)));
+	bvh.Refit();
+
+	UINT items[RowCount] = {};
+	CHECK(bvh.Query(BoundingBox(moved, XMFLOAT3(0.5f, 0.5f, 0.5f)), items, RowCount) == 1);
+	CHECK(items[0] == 5);
+	CHECK(!bvh.Overlaps(BoundingBox(RowCenter(5), XMFLOAT3(0.5f, 0.5f, 0.5f))));
+	CHECK(bvh.Overlaps(BoundingSphere(RowCenter(4), 0.5f)));
+
+	CollisionBVH::SweepHit hit;
+	CHECK(!Sweep(bvh, RowCenter(5), XMFLOAT3(-5.0f, 0.0f, 0.0f), XMFLOAT3(10.0f, 0.0f, 0.0f), hit));
+	CHECK(Sweep(bvh, moved, XMFLOAT3(-5.0f, 0.0f, 0.0f), XMFLOAT3(10.0f, 0.0f, 0.0f), hit));
+	CHECK(hit.Item == 5);
+	CHECK(Near(hit.Time, 0.35f));
+}
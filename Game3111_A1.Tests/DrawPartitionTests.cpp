@@ -0,0 +1,270 @@
+//***************************************************************************************
+// DrawPartitionTests.cpp
+//
+// PartitionDraws and RecordDrawList against a recorder that logs its commands.
+//***************************************************************************************
+
+#include "Test.h"
+
+#include "DrawPartition.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace
+{
+	typedef std::vector<std::vector<DrawRange>> DrawLists;
+
+	struct Command
+	{
+		enum Kind { Begin, SetSegment, Draw, End } What;
+		std::uint32_t Segment;
+		std::uint32_t First;
+		std::uint32_t Count;
+		bool Flag; // Begin: firstList, End: lastList
+	};
+
+	class LogRecorder : public DrawListRecorder
+	{
+	public:
+		void Begin(std::uint32_t segment, bool firstList)override { Log.push_back({ Command::Begin, segment, 0, 0, firstList }); }
+		void SetSegment(std::uint32_t segment)override { Log.push_back({ Command::SetSegment, segment, 0, 0, false }); }
+		void Draw(std::uint32_t segment, std::uint32_t first, std::uint32_t count)override { Log.push_back({ Command::Draw, segment, first, count, false }); }
+		void End(bool lastList)override { Log.push_back({ Command::End, 0, 0, 0, lastList }); }
+
+		std::vector<Command> Log;
+	};
+
+	struct Draw
+	{
+		std::uint32_t Segment;
+		std::uint32_t Index;
+	};
+
+	std::uint32_t DrawCount(const std::vector<DrawRange>& ranges)
+	{
+		std::uint32_t count = 0;
+		for(const DrawRange& range : ranges)
+			count += range.Count;
+		return count;
+	}
+
+	// Every range lies inside its segment, the ranges of all lists together
+	// cover the sorted sequence once and in order, and list sizes are even.
+	void CheckPartition(const std::uint32_t* segmentDraws, std::uint32_t segmentCount,
+		std::uint32_t maxLists, std::uint32_t minDrawsPerList, const DrawLists& lists)
+	{
+		std::uint32_t total = 0;
+		for(std::uint32_t s = 0; s < segmentCount; ++s)
+			total += segmentDraws[s];
+
+		CHECK(!lists.empty());
+		CHECK(lists.size() <= maxLists);
+
+		std::uint32_t segment = 0;
+		std::uint32_t next = 0;
+		std::uint32_t smallest = total;
+		std::uint32_t largest = 0;
+		for(const std::vector<DrawRange>& ranges : lists)
+		{
+			for(const DrawRange& range : ranges)
+			{
+				CHECK(range.Count > 0);
+				CHECK(range.Segment < segmentCount);
+				CHECK(range.First + range.Count <= segmentDraws[range.Segment]);
+
+				// A range continues where the previous one stopped, or starts the
+				// next non-empty segment once that one is used up.
+				if(range.Segment != segment)
+				{
+					CHECK(range.Segment > segment);
+					CHECK(next == segmentDraws[segment]);
+					for(std::uint32_t s = segment + 1; s < range.Segment; ++s)
+						CHECK(segmentDraws[s] == 0);
+					segment = range.Segment;
+					next = 0;
+				}
+				CHECK(range.First == next);
+				next += range.Count;
+			}
+
+			std::uint32_t count = DrawCount(ranges);
+			smallest = count < smallest ? count : smallest;
+			largest = count > largest ? count : largest;
+		}
+
+		if(total > 0)
+		{
+			CHECK(next == segmentDraws[segment]);
+			for(std::uint32_t s = segment + 1; s < segmentCount; ++s)
+				CHECK(segmentDraws[s] == 0);
+		}
+
+		CHECK(largest - smallest <= 1);
+		if(lists.size() > 1)
+			CHECK(smallest >= minDrawsPerList);
+	}
+
+	// Records the lists in reverse order, the way worker threads may finish
+	// them, and returns the commands in submission order.
+	std::vector<Command> RecordAll(const DrawLists& lists)
+	{
+		std::vector<LogRecorder> recorders(lists.size());
+		for(std::uint32_t i = (std::uint32_t)lists.size(); i-- > 0; )
+			RecordDrawList(lists, i, recorders[i]);
+
+		std::vector<Command> submitted;
+		for(const LogRecorder& recorder : recorders)
+			submitted.insert(submitted.end(), recorder.Log.begin(), recorder.Log.end());
+		return submitted;
+	}
+
+	// Replays the submitted commands, tracking the bound segment, and returns
+	// the draws in the order the GPU would execute them.
+	std::vector<Draw> Replay(const std::vector<Command>& commands, std::uint32_t listCount)
+	{
+		std::vector<Draw> draws;
+		std::uint32_t lists = 0;
+		std::uint32_t bound = 0;
+		bool open = false;
+		for(const Command& c : commands)
+		{
+			switch(c.What)
+			{
+			case Command::Begin:
+				CHECK(!open);
+				CHECK(c.Flag == (lists == 0));
+				open = true;
+				bound = c.Segment;
+				break;
+			case Command::SetSegment:
+				CHECK(open);
+				CHECK(c.Segment != bound);
+				bound = c.Segment;
+				break;
+			case Command::Draw:
+				CHECK(open);
+				CHECK(c.Segment == bound);
+				for(std::uint32_t i = 0; i < c.Count; ++i)
+					draws.push_back({ c.Segment, c.First + i });
+				break;
+			case Command::End:
+				CHECK(open);
+				CHECK(c.Flag == (lists + 1 == listCount));
+				open = false;
+				++lists;
+				break;
+			}
+		}
+
+		CHECK(!open);
+		CHECK(lists == listCount);
+		return draws;
+	}
+
+	void CheckRecordedOrder(const std::uint32_t* segmentDraws, std::uint32_t segmentCount, const DrawLists& lists)
+	{
+		std::vector<Draw> draws = Replay(RecordAll(lists), (std::uint32_t)lists.size());
+
+		std::size_t d = 0;
+		for(std::uint32_t s = 0; s < segmentCount; ++s)
+		{
+			for(std::uint32_t i = 0; i < segmentDraws[s]; ++i, ++d)
+			{
+				CHECK(d < draws.size());
+				if(d < draws.size())
+					CHECK(draws[d].Segment == s && draws[d].Index == i);
+			}
+		}
+		CHECK(d == draws.size());
+	}
+}
+
+TEST(PartitionDrawsSplitsEvenlyAcrossSegments)
+{
+	const std::uint32_t segmentDraws[] = { 700, 0, 3, 260, 0, 41 };
+	DrawLists lists;
+	PartitionDraws(segmentDraws, 6, 8, 128, lists);
+
+	CHECK(lists.size() == 7);
+	CheckPartition(segmentDraws, 6, 8, 128, lists);
+}
+
+TEST(PartitionDrawsHonoursListLimits)
+{
+	const std::uint32_t segmentDraws[] = { 5000, 17, 900 };
+	DrawLists lists;
+
+	PartitionDraws(segmentDraws, 3, 8, 256, lists);
+	CHECK(lists.size() == 8);
+	CheckPartition(segmentDraws, 3, 8, 256, lists);
+
+	// Fewer draws than one full list still get one list.
+	const std::uint32_t few[] = { 10, 20 };
+	PartitionDraws(few, 2, 8, 256, lists);
+	CHECK(lists.size() == 1);
+	CHECK(lists[0].size() == 2);
+	CheckPartition(few, 2, 8, 256, lists);
+}
+
+TEST(PartitionDrawsSweep)
+{
+	DrawLists lists;
+	for(std::uint32_t seed = 1; seed <= 200; ++seed)
+	{
+		std::uint32_t state = seed * 2654435761u;
+		std::uint32_t segmentDraws[5];
+		for(std::uint32_t& draws : segmentDraws)
+		{
+			state = state * 1664525u + 1013904223u;
+			draws = (state >> 8) % 4 == 0 ? 0 : (state >> 12) % 600;
+		}
+
+		std::uint32_t maxLists = 1 + seed % 8;
+		std::uint32_t minDrawsPerList = seed % 5 == 0 ? 0 : 1 + seed % 300;
+		PartitionDraws(segmentDraws, 5, maxLists, minDrawsPerList, lists);
+		CheckPartition(segmentDraws, 5, maxLists, minDrawsPerList, lists);
+		CheckRecordedOrder(segmentDraws, 5, lists);
+	}
+}
+
+TEST(EmptyFrameRecordsOneList)
+{
+	const std::uint32_t segmentDraws[] = { 0, 0, 0 };
+	DrawLists lists;
+	PartitionDraws(segmentDraws, 3, 8, 256, lists);
+
+	CHECK(lists.size() == 1);
+	CHECK(lists[0].empty());
+
+	LogRecorder recorder;
+	RecordDrawList(lists, 0, recorder);
+	CHECK(recorder.Log.size() == 2);
+	CHECK(recorder.Log[0].What == Command::Begin && recorder.Log[0].Segment == 0 && recorder.Log[0].Flag);
+	CHECK(recorder.Log[1].What == Command::End && recorder.Log[1].Flag);
+}
+
+TEST(RecordedListsReplaySortedSequence)
+{
+	const std::uint32_t segmentDraws[] = { 300, 0, 257, 12, 600 };
+	DrawLists lists;
+	PartitionDraws(segmentDraws, 5, 4, 64, lists);
+
+	CHECK(lists.size() == 4);
+	CheckRecordedOrder(segmentDraws, 5, lists);
+
+	// Each list binds the segment its first range draws from, and only changes
+	// pipeline where a segment boundary falls inside the list.
+	for(std::uint32_t l = 0; l < lists.size(); ++l)
+	{
+		LogRecorder recorder;
+		RecordDrawList(lists, l, recorder);
+		CHECK(recorder.Log.front().What == Command::Begin);
+		CHECK(recorder.Log.front().Segment == lists[l].front().Segment);
+
+		std::size_t changes = 0;
+		for(const Command& c : recorder.Log)
+			changes += c.What == Command::SetSegment ? 1 : 0;
+		CHECK(changes == lists[l].size() - 1);
+	}
+}
@@ -0,0 +1,126 @@
+//***************************************************************************************
+// OcclusionBufferTests.cpp
+//
+// Rasterizes one known occluder, a wall in front of a camera at the origin
+// looking down +z, and checks IsVisible for boxes around it.
+//***************************************************************************************
+
+#include "Test.h"
+
+#include "OcclusionBuffer.h"
+#include "WorkerPool.h"
+
+using namespace DirectX;
+
+namespace
+{
+	const std::uint32_t BufferWidth = 256;
+	const std::uint32_t BufferHeight = 128;
+
+	// Its near face, z = 9.5, spans x, y in [-5, 5]: the full height of the
+	// view and x / z within +-0.53 of the +-0.83 the view covers.
+	BoundingBox WallBox()
+	{
+		return BoundingBox(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(0.5f, 0.5f, 0.5f));
+	}
+
+	XMMATRIX WallWorld()
+	{
+		return XMMatrixScaling(10.0f, 10.0f, 1.0f) * XMMatrixTranslation(0.0f, 0.0f, 10.0f);
+	}
+
+	void RasterizeWall(OcclusionBuffer& buffer, WorkerPool* pool)
+	{
+		// The camera sits at the origin, so the view matrix is the identity.
+		buffer.Begin(XMMatrixPerspectiveFovLH(XM_PIDIV4, (float)BufferWidth / BufferHeight, 1.0f, 100.0f));
+		buffer.AddOccluder(WallBox(), WallWorld());
+		buffer.Rasterize(pool);
+	}
+
+	BoundingBox Box(float x, float y, float z, float ex, float ey, float ez)
+	{
+		return BoundingBox(XMFLOAT3(x, y, z), XMFLOAT3(ex, ey, ez));
+	}
+}
+
+TEST(OccluderCoversItsScreenRectangle)
+{
+	OcclusionBuffer buffer(BufferWidth, BufferHeight);
+	RasterizeWall(buffer, nullptr);
+
+	CHECK(buffer.OccluderTriangleCount() > 0);
+
+	// The wall's near face is at depth (z - n) f / ((f - n) z) with n = 1, f = 100.
+	float nearDepth = (9.5f - 1.0f) * 100.0f / (99.0f * 9.5f);
+	float centre = buffer.Depth(BufferWidth / 2, BufferHeight / 2);
+	CHECK(centre > nearDepth - 1e-3f && centre < nearDepth + 1e-3f);
+	CHECK(buffer.Depth(BufferWidth / 2, 0) < 1.0f);
+
+	// Left and right of the wall nothing was drawn.
+	CHECK(buffer.Depth(0, BufferHeight / 2) == 1.0f);
+	CHECK(buffer.Depth(BufferWidth - 1, BufferHeight / 2) == 1.0f);
+}
+
+TEST(BoxBehindOccluderIsHidden)
+{
+	OcclusionBuffer buffer(BufferWidth, BufferHeight);
+	RasterizeWall(buffer, nullptr);
+
+	CHECK(!buffer.IsVisible(Box(0.0f, 0.0f, 20.0f, 1.0f, 1.0f, 1.0f)));
+	CHECK(!buffer.IsVisible(Box(-3.0f, 2.0f, 40.0f, 2.0f, 2.0f, 2.0f)));
+
+	// Just behind the wall, still inside its outline.
+	CHECK(!buffer.IsVisible(Box(0.0f, 0.0f, 11.5f, 2.0f, 2.0f, 0.5f)));
+}
+
+TEST(BoxBesideOrInFrontOfOccluderIsVisible)
+{
+	OcclusionBuffer buffer(BufferWidth, BufferHeight);
+	RasterizeWall(buffer, nullptr);
+
+	// Beside the wall: x / z in [0.62, 0.79], past the wall's edge.
+	CHECK(buffer.IsVisible(Box(14.0f, 0.0f, 20.0f, 1.0f, 1.0f, 1.0f)));
+	CHECK(buffer.IsVisible(Box(-14.0f, 0.0f, 20.0f, 1.0f, 1.0f, 1.0f)));
+
+	// Behind the wall but overlapping its edge.
+	CHECK(buffer.IsVisible(Box(11.0f, 0.0f, 20.0f, 1.0f, 1.0f, 1.0f)));
+
+	// Between the camera and the wall.
+	CHECK(buffer.IsVisible(Box(0.0f, 0.0f, 5.0f, 1.0f, 1.0f, 1.0f)));
+}
+
+TEST(BoxStraddlingNearPlaneIsVisible)
+{
+	OcclusionBuffer buffer(BufferWidth, BufferHeight);
+	RasterizeWall(buffer, nullptr);
+
+	CHECK(buffer.IsVisible(Box(0.0f, 0.0f, 1.0f, 0.5f, 0.5f, 0.5f)));
+
+	// Reaches from in front of the near plane to far behind the wall.
+	CHECK(buffer.IsVisible(Box(0.0f, 0.0f, 15.0f, 0.5f, 0.5f, 14.5f)));
+
+	// Reaches from behind the camera to behind the wall.  The corners behind
+	// the camera project, flipped, inside the wall's outline with a depth
+	// beyond 1, so only the near plane test keeps this box.
+	CHECK(buffer.IsVisible(Box(0.0f, 0.0f, 5.0f, 0.5f, 0.5f, 15.0f)));
+}
+
+TEST(BandedRasterizationMatchesSingleThread)
+{
+	OcclusionBuffer single(BufferWidth, BufferHeight);
+	RasterizeWall(single, nullptr);
+
+	WorkerPool pool(3);
+	OcclusionBuffer banded(BufferWidth, BufferHeight);
+	RasterizeWall(banded, &pool);
+
+	bool same = true;
+	for(std::uint32_t y = 0; y < BufferHeight; ++y)
+	{
+		for(std::uint32_t x = 0; x < BufferWidth; ++x)
+			same = same && single.Depth(x, y) == banded.Depth(x, y);
+	}
+	CHECK(same);
+	CHECK(!banded.IsVisible(Box(0.0f, 0.0f, 20.0f, 1.0f, 1.0f, 1.0f)));
+	CHECK(banded.IsVisible(Box(14.0f, 0.0f, 20.0f, 1.0f, 1.0f, 1.0f)));
+}
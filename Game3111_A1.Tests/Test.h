@@ -0,0 +1,41 @@
+//***************************************************************************************
+// Test.h
+//
+// Minimal test registry for Game3111_A1.Tests.  TEST defines a test case that
+// registers itself before main runs; CHECK reports a failed expression and
+// lets the case continue.  TestMain.cpp runs every case and returns the number
+// of cases that failed.
+//***************************************************************************************
+
+#pragma once
+
+#include <vector>
+
+namespace Test
+{
+	typedef void (*Function)();
+
+	struct Case
+	{
+		const char* Name;
+		Function Run;
+	};
+
+	std::vector<Case>& Cases();
+
+	// Records a failed CHECK against the case that is running.
+	void Fail(const char* file, int line, const char* expression);
+
+	struct Registrar
+	{
+		Registrar(const char* name, Function run) { Cases().push_back({ name, run }); }
+	};
+}
+
+#define TEST(name) \
+	static void name(); \
+	static Test::Registrar name##Registrar(#name, name); \
+	static void name()
+
+#define CHECK(expression) \
+	do { if(!(expression)) Test::Fail(__FILE__, __LINE__, #expression); } while(false)
@@ -0,0 +1,41 @@
+//***************************************************************************************
+// TestMain.cpp
+//***************************************************************************************
+
+#include "Test.h"
+
+#include <cstdio>
+
+namespace
+{
+	int gCaseFailures = 0;
+}
+
+std::vector<Test::Case>& Test::Cases()
+{
+	static std::vector<Case> cases;
+	return cases;
+}
+
+void Test::Fail(const char* file, int line, const char* expression)
+{
+	std::printf("%s(%d): CHECK(%s) failed\n", file, line, expression);
+	++gCaseFailures;
+}
+
+int main()
+{
+	int failedCases = 0;
+	for(const Test::Case& c : Test::Cases())
+	{
+		gCaseFailures = 0;
+		c.Run();
+
+		std::printf("%s %s\n", gCaseFailures == 0 ? "[ pass ]" : "[ FAIL ]", c.Name);
+		if(gCaseFailures > 0)
+			++failedCases;
+	}
+
+	std::printf("%d of %d cases failed\n", failedCases, (int)Test::Cases().size());
+	return failedCases;
+}
@@ -126,6 +126,16 @@ void Camera::SetLens(float fovY, float aspect, float zn, float zf)
 
 	XMMATRIX P = XMMatrixPerspectiveFovLH(mFovY, mAspect, mNearZ, mFarZ);
 	XMStoreFloat4x4(&mProj, P);
+
+	// P only has _11, _22, _33, _34 = 1 and _43 set, which gives the inverse
+	// directly instead of going through a general 4x4 inverse.
+	mInvProj = XMFLOAT4X4(
+		1.0f / mProj(0, 0), 0.0f, 0.0f, 0.0f,
+		0.0f, 1.0f / mProj(1, 1), 0.0f, 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f / mProj(3, 2),
+		0.0f, 0.0f, 1.0f, -mProj(2, 2) / mProj(3, 2));
+
+	++mRevision;
 }
 
 void Camera::LookAt(FXMVECTOR pos, FXMVECTOR target, FXMVECTOR worldUp)
@@ -164,6 +174,17 @@ XMMATRIX Camera::GetProj()const
 	return XMLoadFloat4x4(&mProj);
 }
 
+XMMATRIX Camera::GetInvView()const
+{
+	assert(!mViewDirty);
+	return XMLoadFloat4x4(&mInvView);
+}
+
+XMMATRIX Camera::GetInvProj()const
+{
+	return XMLoadFloat4x4(&mInvProj);
+}
+
 
 XMFLOAT4X4 Camera::GetView4x4f()const
 {
@@ -294,7 +315,16 @@ void Camera::UpdateViewMatrix()
 		mView(2, 3) = 0.0f;
 		mView(3, 3) = 1.0f;
 
+		// The view matrix is a rigid transform, so its inverse is the camera's
+		// basis in the rows and its position in the last row.
+		mInvView = XMFLOAT4X4(
+			mRight.x, mRight.y, mRight.z, 0.0f,
+			mUp.x, mUp.y, mUp.z, 0.0f,
+			mLook.x, mLook.y, mLook.z, 0.0f,
+			mPosition.x, mPosition.y, mPosition.z, 1.0f);
+
 		mViewDirty = false;
+		++mRevision;
 	}
 }
 
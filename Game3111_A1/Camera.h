@@ -62,6 +62,14 @@ public:
 	DirectX::XMFLOAT4X4 GetView4x4f()const;
 	DirectX::XMFLOAT4X4 GetProj4x4f()const;
 
+	// Inverses of the View/Proj matrices, built in closed form alongside them.
+	DirectX::XMMATRIX GetInvView()const;
+	DirectX::XMMATRIX GetInvProj()const;
+
+	// Changes whenever the view or projection matrix is rebuilt, so data
+	// derived from them only has to be recomputed when it differs.
+	std::uint32_t GetRevision()const { return mRevision; }
+
 	// Strafe/Walk the camera a distance d.
 	void Strafe(float d);
 	void Walk(float d);
@@ -95,10 +103,13 @@ private:
 	float mFarWindowHeight = 0.0f;
 
 	bool mViewDirty = true;
+	std::uint32_t mRevision = 0;
 
-	// Cache View/Proj matrices.
+	// Cache View/Proj matrices and their inverses.
 	DirectX::XMFLOAT4X4 mView = MathHelper::Identity4x4();
 	DirectX::XMFLOAT4X4 mProj = MathHelper::Identity4x4();
+	DirectX::XMFLOAT4X4 mInvView = MathHelper::Identity4x4();
+	DirectX::XMFLOAT4X4 mInvProj = MathHelper::Identity4x4();
 };
 
 #endif // CAMERA_H
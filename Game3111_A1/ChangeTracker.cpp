@@ -0,0 +1,58 @@
+//***************************************************************************************
+// ChangeTracker.cpp
+//***************************************************************************************
+
+#include "ChangeTracker.h"
+
+ChangeTracker::ChangeTracker(int frameResourceCount)
+	: mFrames(frameResourceCount)
+{
+}
+
+void ChangeTracker::Resize(UINT count)
+{
+	const UINT oldCount = mCount;
+	mCount = count;
+
+	for(FrameList& frame : mFrames)
+	{
+		frame.Queued.resize((count + 63) / 64, 0);
+
+		if(count < oldCount)
+		{
+			// Drop queued entries that no longer exist and their stale bits.
+			frame.List.erase(std::remove_if(frame.List.begin(), frame.List.end(),
+				[count](UINT index) { return index >= count; }), frame.List.end());
+
+			if(count % 64 != 0)
+				frame.Queued.back() &= (1ull << (count % 64)) - 1;
+		}
+	}
+
+	for(UINT i = oldCount; i < count; ++i)
+		MarkDirty(i);
+}
+
+void ChangeTracker::MarkDirty(UINT index)
+{
+	assert(index < mCount);
+
+	const std::uint64_t bit = 1ull << (index % 64);
+	for(FrameList& frame : mFrames)
+	{
+		std::uint64_t& word = frame.Queued[index / 64];
+		if((word & bit) == 0)
+		{
+			word |= bit;
+			frame.List.push_back(index);
+		}
+	}
+}
+
+void ChangeTracker::Clear(int frameIndex)
+{
+	FrameList& frame = mFrames[frameIndex];
+	for(UINT index : frame.List)
+		frame.Queued[index / 64] &= ~(1ull << (index % 64));
+	frame.List.clear();
+}
@@ -0,0 +1,47 @@
+//***************************************************************************************
+// ChangeTracker.h
+//
+// Per-frame-resource dirty lists for data mirrored into the frame resources'
+// constant buffers.  Each FrameResource has its own copy of the constants, so
+// a change has to reach all of them: marking an entry appends it once to the
+// list of every frame resource, and the update for a frame resource only
+// visits the entries on its own list.  Per-frame cost follows what changed,
+// not how many entries exist.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+
+class ChangeTracker
+{
+public:
+	explicit ChangeTracker(int frameResourceCount = gNumFrameResources);
+
+	// Grows or shrinks the tracked range to [0, count).  Added entries start
+	// dirty in every frame resource so their first constants get written.
+	void Resize(UINT count);
+
+	// Queues index for every frame resource that does not have it queued yet.
+	void MarkDirty(UINT index);
+
+	// Entries to upload into frame resource frameIndex, in the order they were
+	// first marked.  Call Clear(frameIndex) once they have been written.
+	const std::vector<UINT>& Dirty(int frameIndex)const { return mFrames[frameIndex].List; }
+
+	void Clear(int frameIndex);
+
+	UINT Size()const { return mCount; }
+
+private:
+	struct FrameList
+	{
+		// Entries queued for this frame resource, and one bit per entry so
+		// marking twice does not queue twice.
+		std::vector<UINT> List;
+		std::vector<std::uint64_t> Queued;
+	};
+
+	std::vector<FrameList> mFrames;
+	UINT mCount = 0;
+};
@@ -0,0 +1,606 @@
+//***************************************************************************************
+// CollisionBVH.cpp
+//***************************************************************************************
+
+#include "CollisionBVH.h"
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+	// Number of centroid bins the SAH evaluates per axis.
+	const int SahBins = 12;
+
+	// Cost of visiting a node relative to testing one item box.
+	const float SahTraversalCost = 1.0f;
+
+	struct Aabb
+	{
+		XMFLOAT3 Min = { +FLT_MAX, +FLT_MAX, +FLT_MAX };
+		XMFLOAT3 Max = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+		void Grow(const XMFLOAT3& pmin, const XMFLOAT3& pmax)
+		{
+			Min.x = std::min<float>(Min.x, pmin.x);
+			Min.y = std::min<float>(Min.y, pmin.y);
+			Min.z = std::min<float>(Min.z, pmin.z);
+			Max.x = std::max<float>(Max.x, pmax.x);
+			Max.y = std::max<float>(Max.y, pmax.y);
+			Max.z = std::max<float>(Max.z, pmax.z);
+		}
+
+		// Half the surface area, which is all the SAH needs.
+		float HalfArea()const
+		{
+			if(Max.x < Min.x)
+				return 0.0f;
+
+			float dx = Max.x - Min.x;
+			float dy = Max.y - Min.y;
+			float dz = Max.z - Min.z;
+			return dx*dy + dy*dz + dz*dx;
+		}
+	};
+
+	float Component(const XMFLOAT3& v, int axis)
+	{
+		return (&v.x)[axis];
+	}
+
+	bool BoxesOverlap(const XMFLOAT3& aMin, const XMFLOAT3& aMax, const XMFLOAT3& bMin, const XMFLOAT3& bMax)
+	{
+		return aMin.x <= bMax.x && aMax.x >= bMin.x &&
+			aMin.y <= bMax.y && aMax.y >= bMin.y &&
+			aMin.z <= bMax.z && aMax.z >= bMin.z;
+	}
+
+	bool SphereOverlapsBox(const XMFLOAT3& center, float radiusSq, const XMFLOAT3& bMin, const XMFLOAT3& bMax)
+	{
+		float distSq = 0.0f;
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			float c = Component(center, axis);
+			float d = std::max<float>(std::max<float>(Component(bMin, axis) - c, 0.0f), c - Component(bMax, axis));
+			distSq += d*d;
+		}
+
+		return distSq <= radiusSq;
+	}
+
+	// Entry time of the segment start + t*delta, t in [0, tMax], into the box.
+	// A segment starting inside enters at 0.
+	bool SegmentEntersBox(const XMFLOAT3& start, const XMFLOAT3& delta,
+		const XMFLOAT3& bMin, const XMFLOAT3& bMax, float tMax, float& tEnter)
+	{
+		float t0 = 0.0f;
+		float t1 = tMax;
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			float s = Component(start, axis);
+			float d = Component(delta, axis);
+			float lo = Component(bMin, axis);
+			float hi = Component(bMax, axis);
+
+			if(fabsf(d) < 1e-8f)
+			{
+				if(s < lo || s > hi)
+					return false;
+				continue;
+			}
+
+			float inv = 1.0f / d;
+			float ta = (lo - s) * inv;
+			float tb = (hi - s) * inv;
+			if(ta > tb)
+				std::swap(ta, tb);
+
+			t0 = std::max<float>(t0, ta);
+			t1 = std::min<float>(t1, tb);
+			if(t0 > t1)
+				return false;
+		}
+
+		tEnter = t0;
+		return true;
+	}
+
+	// Entry time of a segment starting outside the sphere.
+	bool SegmentEntersSphere(const XMFLOAT3& start, const XMFLOAT3& delta,
+		const XMFLOAT3& center, float radius, float tMax, float& t)
+	{
+		float mx = start.x - center.x;
+		float my = start.y - center.y;
+		float mz = start.z - center.z;
+
+		float a = delta.x*delta.x + delta.y*delta.y + delta.z*delta.z;
+		float b = mx*delta.x + my*delta.y + mz*delta.z;
+		float c = mx*mx + my*my + mz*mz - radius*radius;
+		if(b >= 0.0f || a < 1e-12f)
+			return false;
+
+		float disc = b*b - a*c;
+		if(disc < 0.0f)
+			return false;
+
+		t = std::max<float>(0.0f, (-b - sqrtf(disc)) / a);
+		return t <= tMax;
+	}
+
+	// Entry time into the capsule of the given radius around the box edge that
+	// runs along axis from edgeStart for length units.
+	bool SegmentEntersEdge(const XMFLOAT3& start, const XMFLOAT3& delta,
+		const XMFLOAT3& edgeStart, int axis, float length, float radius, float tMax, float& t)
+	{
+		bool found = false;
+
+		// Side of the cylinder, a 2D circle test in the plane across the edge.
+		int a1 = (axis + 1) % 3;
+		int a2 = (axis + 2) % 3;
+		float mx = Component(start, a1) - Component(edgeStart, a1);
+		float my = Component(start, a2) - Component(edgeStart, a2);
+		float dx = Component(delta, a1);
+		float dy = Component(delta, a2);
+
+		float a = dx*dx + dy*dy;
+		float b = mx*dx + my*dy;
+		float c = mx*mx + my*my - radius*radius;
+		if(a > 1e-12f && b < 0.0f && c > 0.0f)
+		{
+			float disc = b*b - a*c;
+			if(disc >= 0.0f)
+			{
+				float tc = (-b - sqrtf(disc)) / a;
+				float along = Component(start, axis) + tc*Component(delta, axis) - Component(edgeStart, axis);
+				if(tc <= tMax && along >= 0.0f && along <= length)
+				{
+					t = tc;
+					found = true;
+				}
+			}
+		}
+
+		// Rounded ends.
+		XMFLOAT3 edgeEnd = edgeStart;
+		(&edgeEnd.x)[axis] += length;
+
+		float ts;
+		if(SegmentEntersSphere(start, delta, edgeStart, radius, found ? t : tMax, ts))
+		{
+			t = ts;
+			found = true;
+		}
+		if(SegmentEntersSphere(start, delta, edgeEnd, radius, found ? t : tMax, ts))
+		{
+			t = ts;
+			found = true;
+		}
+
+		return found;
+	}
+
+	// Swept sphere against one box, i.e. the segment against the box grown by
+	// radius with rounded edges and corners.  The start is outside that shape.
+	bool SweepSphereBox(const XMFLOAT3& start, const XMFLOAT3& delta, float radius,
+		const XMFLOAT3& bMin, const XMFLOAT3& bMax, float tMax, float& t)
+	{
+		XMFLOAT3 eMin(bMin.x - radius, bMin.y - radius, bMin.z - radius);
+		XMFLOAT3 eMax(bMax.x + radius, bMax.y + radius, bMax.z + radius);
+
+		float tEnter;
+		if(!SegmentEntersBox(start, delta, eMin, eMax, tMax, tEnter))
+			return false;
+
+		// Which sides of the original box the entry point lies outside of.  Past
+		// a single face the grown box is exact, past two or three it entered a
+		// rounded edge or corner region and needs the exact test.
+		int below = 0;
+		int above = 0;
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			float p = Component(start, axis) + tEnter*Component(delta, axis);
+			if(p < Component(bMin, axis))
+				below |= 1 << axis;
+			else if(p > Component(bMax, axis))
+				above |= 1 << axis;
+		}
+
+		int mask = below | above;
+		int outsideCount = (mask & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1);
+		if(outsideCount <= 1)
+		{
+			t = tEnter;
+			return true;
+		}
+
+		// Test the edges touching the region: the single edge for an edge region,
+		// the three edges meeting at the corner for a corner region.
+		bool found = false;
+		float best = tMax;
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			if(outsideCount == 2 && (mask & (1 << axis)) != 0)
+				continue;
+
+			XMFLOAT3 edgeStart;
+			for(int j = 0; j < 3; ++j)
+				(&edgeStart.x)[j] = (above & (1 << j)) ? Component(bMax, j) : Component(bMin, j);
+			(&edgeStart.x)[axis] = Component(bMin, axis);
+
+			float te;
+			if(SegmentEntersEdge(start, delta, edgeStart, axis,
+				Component(bMax, axis) - Component(bMin, axis), radius, best, te))
+			{
+				best = te;
+				found = true;
+			}
+		}
+
+		t = best;
+		return found;
+	}
+
+	// Unit vector from the closest point of the box towards p.  For p inside the
+	// box, the normal of the nearest face.
+	XMFLOAT3 BoxNormalTowards(const XMFLOAT3& p, const XMFLOAT3& bMin, const XMFLOAT3& bMax)
+	{
+		XMFLOAT3 n;
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			float c = Component(p, axis);
+			(&n.x)[axis] = c - std::min<float>(std::max<float>(c, Component(bMin, axis)), Component(bMax, axis));
+		}
+
+		float lenSq = n.x*n.x + n.y*n.y + n.z*n.z;
+		if(lenSq > 1e-12f)
+		{
+			float invLen = 1.0f / sqrtf(lenSq);
+			return XMFLOAT3(n.x*invLen, n.y*invLen, n.z*invLen);
+		}
+
+		int bestAxis = 0;
+		float bestDepth = FLT_MAX;
+		float bestSign = 1.0f;
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			float c = Component(p, axis);
+			float toMin = c - Component(bMin, axis);
+			float toMax = Component(bMax, axis) - c;
+			if(toMin < bestDepth) { bestDepth = toMin; bestAxis = axis; bestSign = -1.0f; }
+			if(toMax < bestDepth) { bestDepth = toMax; bestAxis = axis; bestSign = +1.0f; }
+		}
+
+		n = XMFLOAT3(0.0f, 0.0f, 0.0f);
+		(&n.x)[bestAxis] = bestSign;
+		return n;
+	}
+}
+
+void CollisionBVH::Build(const BoundingBox* boxes, UINT count)
+{
+	mNodes.clear();
+	mItemMin.resize(count);
+	mItemMax.resize(count);
+	mItems.resize(count);
+	mSlots.resize(count);
+	mCentroids.resize(count);
+
+	for(UINT i = 0; i < count; ++i)
+	{
+		const BoundingBox& box = boxes[i];
+		mItemMin[i] = XMFLOAT3(box.Center.x - box.Extents.x, box.Center.y - box.Extents.y, box.Center.z - box.Extents.z);
+		mItemMax[i] = XMFLOAT3(box.Center.x + box.Extents.x, box.Center.y + box.Extents.y, box.Center.z + box.Extents.z);
+		mCentroids[i] = box.Center;
+		mItems[i] = i;
+	}
+
+	if(count > 0)
+	{
+		// A binary tree over n items never needs more than 2n - 1 nodes.
+		mNodes.reserve(2 * count - 1);
+		mNodes.push_back(Node());
+		BuildNode(0, 0, count, 0);
+	}
+
+	for(UINT slot = 0; slot < count; ++slot)
+		mSlots[mItems[slot]] = slot;
+
+	std::vector<XMFLOAT3>().swap(mCentroids);
+}
+
+void CollisionBVH::BuildNode(UINT nodeIndex, UINT first, UINT count, UINT depth)
+{
+	mNodes[nodeIndex].First = first;
+	mNodes[nodeIndex].Count = count;
+	UpdateNodeBounds(mNodes[nodeIndex]);
+
+	if(count == 1 || depth >= MaxDepth)
+		return;
+
+	Aabb nodeBounds;
+	nodeBounds.Min = mNodes[nodeIndex].Min;
+	nodeBounds.Max = mNodes[nodeIndex].Max;
+
+	Aabb centroidBounds;
+	for(UINT slot = first; slot < first + count; ++slot)
+		centroidBounds.Grow(mCentroids[slot], mCentroids[slot]);
+
+	// Binned SAH: drop the centroids into SahBins buckets along each axis and
+	// sweep the bucket boundaries for the cheapest split.
+	float bestCost = FLT_MAX;
+	int bestAxis = -1;
+	int bestSplit = 0;
+
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		float cmin = Component(centroidBounds.Min, axis);
+		float extent = Component(centroidBounds.Max, axis) - cmin;
+		if(extent <= 0.0f)
+			continue;
+
+		Aabb binBounds[SahBins];
+		UINT binCounts[SahBins] = {};
+		float scale = SahBins / extent;
+
+		for(UINT slot = first; slot < first + count; ++slot)
+		{
+			int bin = std::min<int>(SahBins - 1, (int)((Component(mCentroids[slot], axis) - cmin) * scale));
+			binBounds[bin].Grow(mItemMin[slot], mItemMax[slot]);
+			++binCounts[bin];
+		}
+
+		// rightCost[i] is the cost of everything in bins (i, SahBins).
+		float rightCost[SahBins];
+		UINT rightCount[SahBins];
+		Aabb right;
+		UINT rightItems = 0;
+		for(int i = SahBins - 1; i > 0; --i)
+		{
+			right.Grow(binBounds[i].Min, binBounds[i].Max);
+			rightItems += binCounts[i];
+			rightCost[i - 1] = right.HalfArea() * rightItems;
+			rightCount[i - 1] = rightItems;
+		}
+
+		Aabb left;
+		UINT leftItems = 0;
+		for(int i = 0; i < SahBins - 1; ++i)
+		{
+			left.Grow(binBounds[i].Min, binBounds[i].Max);
+			leftItems += binCounts[i];
+			if(leftItems == 0 || rightCount[i] == 0)
+				continue;
+
+			float cost = left.HalfArea() * leftItems + rightCost[i];
+			if(cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = i;
+			}
+		}
+	}
+
+	// Every centroid in the same spot, nothing to split on.
+	if(bestAxis < 0)
+		return;
+
+	float parentArea = nodeBounds.HalfArea();
+	float leafCost = parentArea * count;
+	float splitCost = parentArea * SahTraversalCost + bestCost;
+	if(count <= MaxLeafItems && splitCost >= leafCost)
+		return;
+
+	// Partition the slots so the items left of the split come first.
+	float cmin = Component(centroidBounds.Min, bestAxis);
+	float scale = SahBins / (Component(centroidBounds.Max, bestAxis) - cmin);
+
+	UINT mid = first;
+	for(UINT slot = first; slot < first + count; ++slot)
+	{
+		int bin = std::min<int>(SahBins - 1, (int)((Component(mCentroids[slot], bestAxis) - cmin) * scale));
+		if(bin <= bestSplit)
+		{
+			std::swap(mItemMin[slot], mItemMin[mid]);
+			std::swap(mItemMax[slot], mItemMax[mid]);
+			std::swap(mItems[slot], mItems[mid]);
+			std::swap(mCentroids[slot], mCentroids[mid]);
+			++mid;
+		}
+	}
+
+	UINT leftCount = mid - first;
+	UINT left = (UINT)mNodes.size();
+	mNodes.push_back(Node());
+	mNodes.push_back(Node());
+
+	mNodes[nodeIndex].First = left;
+	mNodes[nodeIndex].Count = 0;
+
+	BuildNode(left, first, leftCount, depth + 1);
+	BuildNode(left + 1, mid, count - leftCount, depth + 1);
+}
+
+void CollisionBVH::UpdateNodeBounds(Node& node)const
+{
+	Aabb bounds;
+	for(UINT slot = node.First; slot < node.First + node.Count; ++slot)
+		bounds.Grow(mItemMin[slot], mItemMax[slot]);
+
+	node.Min = bounds.Min;
+	node.Max = bounds.Max;
+}
+
+void CollisionBVH::SetItemBounds(UINT item, const BoundingBox& box)
+{
+	assert(item < mSlots.size());
+
+	UINT slot = mSlots[item];
+	mItemMin[slot] = XMFLOAT3(box.Center.x - box.Extents.x, box.Center.y - box.Extents.y, box.Center.z - box.Extents.z);
+	mItemMax[slot] = XMFLOAT3(box.Center.x + box.Extents.x, box.Center.y + box.Extents.y, box.Center.z + box.Extents.z);
+}
+
+void CollisionBVH::Refit()
+{
+	// Children are always stored after their parent, so walking the array
+	// backwards visits every node after its children.
+	for(size_t i = mNodes.size(); i-- > 0; )
+	{
+		Node& node = mNodes[i];
+		if(node.Count > 0)
+		{
+			UpdateNodeBounds(node);
+		}
+		else
+		{
+			Aabb bounds;
+			bounds.Grow(mNodes[node.First].Min, mNodes[node.First].Max);
+			bounds.Grow(mNodes[node.First + 1].Min, mNodes[node.First + 1].Max);
+			node.Min = bounds.Min;
+			node.Max = bounds.Max;
+		}
+	}
+}
+
+template<typename Overlap>
+UINT CollisionBVH::Traverse(Overlap overlap, UINT* items, UINT maxItems)const
+{
+	if(mNodes.empty() || maxItems == 0)
+		return 0;
+
+	UINT stack[MaxDepth + 2];
+	UINT stackSize = 0;
+	stack[stackSize++] = 0;
+
+	UINT found = 0;
+	while(stackSize > 0)
+	{
+		const Node& node = mNodes[stack[--stackSize]];
+		if(!overlap(node.Min, node.Max))
+			continue;
+
+		if(node.Count == 0)
+		{
+			stack[stackSize++] = node.First;
+			stack[stackSize++] = node.First + 1;
+			continue;
+		}
+
+		for(UINT slot = node.First; slot < node.First + node.Count; ++slot)
+		{
+			if(!overlap(mItemMin[slot], mItemMax[slot]))
+				continue;
+
+			if(items != nullptr)
+				items[found] = mItems[slot];
+
+			if(++found == maxItems)
+				return found;
+		}
+	}
+
+	return found;
+}
+
+bool CollisionBVH::Overlaps(const BoundingBox& box)const
+{
+	return Query(box, nullptr, 1) > 0;
+}
+
+bool CollisionBVH::Overlaps(const BoundingSphere& sphere)const
+{
+	XMFLOAT3 center = sphere.Center;
+	float radiusSq = sphere.Radius * sphere.Radius;
+
+	auto overlap = [&](const XMFLOAT3& bMin, const XMFLOAT3& bMax)
+	{
+		return SphereOverlapsBox(center, radiusSq, bMin, bMax);
+	};
+
+	return Traverse(overlap, nullptr, 1) > 0;
+}
+
+UINT CollisionBVH::Query(const BoundingBox& box, UINT* items, UINT maxItems)const
+{
+	XMFLOAT3 qMin(box.Center.x - box.Extents.x, box.Center.y - box.Extents.y, box.Center.z - box.Extents.z);
+	XMFLOAT3 qMax(box.Center.x + box.Extents.x, box.Center.y + box.Extents.y, box.Center.z + box.Extents.z);
+
+	auto overlap = [&](const XMFLOAT3& bMin, const XMFLOAT3& bMax)
+	{
+		return BoxesOverlap(qMin, qMax, bMin, bMax);
+	};
+
+	return Traverse(overlap, items, maxItems);
+}
+
+bool CollisionBVH::SweepSphere(const XMFLOAT3& start, const XMFLOAT3& delta, float radius, SweepHit& hit)const
+{
+	if(mNodes.empty())
+		return false;
+
+	const float radiusSq = radius * radius;
+
+	bool found = false;
+	float best = 1.0f;
+
+	UINT stack[MaxDepth + 2];
+	UINT stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while(stackSize > 0)
+	{
+		const Node& node = mNodes[stack[--stackSize]];
+
+		// The grown node box contains the grown boxes of everything below it.
+		XMFLOAT3 nMin(node.Min.x - radius, node.Min.y - radius, node.Min.z - radius);
+		XMFLOAT3 nMax(node.Max.x + radius, node.Max.y + radius, node.Max.z + radius);
+		float tNode;
+		if(!SegmentEntersBox(start, delta, nMin, nMax, best, tNode))
+			continue;
+
+		if(node.Count == 0)
+		{
+			stack[stackSize++] = node.First;
+			stack[stackSize++] = node.First + 1;
+			continue;
+		}
+
+		for(UINT slot = node.First; slot < node.First + node.Count; ++slot)
+		{
+			const XMFLOAT3& bMin = mItemMin[slot];
+			const XMFLOAT3& bMax = mItemMax[slot];
+
+			if(SphereOverlapsBox(start, radiusSq, bMin, bMax))
+			{
+				// Already touching: block only the part of the move going inwards.
+				XMFLOAT3 n = BoxNormalTowards(start, bMin, bMax);
+				if(n.x*delta.x + n.y*delta.y + n.z*delta.z < 0.0f && (!found || best > 0.0f))
+				{
+					best = 0.0f;
+					hit.Normal = n;
+					hit.Item = mItems[slot];
+					found = true;
+				}
+				continue;
+			}
+
+			float t;
+			if(SweepSphereBox(start, delta, radius, bMin, bMax, best, t) && (!found || t < best))
+			{
+				XMFLOAT3 p(start.x + t*delta.x, start.y + t*delta.y, start.z + t*delta.z);
+				best = t;
+				hit.Normal = BoxNormalTowards(p, bMin, bMax);
+				hit.Item = mItems[slot];
+				found = true;
+			}
+		}
+	}
+
+	if(found)
+		hit.Time = best;
+
+	return found;
+}
@@ -0,0 +1,108 @@
+//***************************************************************************************
+// CollisionBVH.h
+//
+// Static bounding volume hierarchy over the world-space boxes of the collidable
+// render items.  The tree is built once with a binned surface area heuristic and
+// answers box and sphere overlap queries in roughly logarithmic time.  Items that
+// move update their box with SetItemBounds and the node bounds are refit in one
+// bottom-up pass; the topology is kept, so large moves slowly degrade the tree
+// until the next Build.
+//
+// SweepSphere moves a sphere along a segment and reports the first wall it
+// touches, which is what the camera and any other agents use to slide along
+// walls instead of stopping dead or tunnelling through thin ones.
+//***************************************************************************************
+
+#pragma once
+
+#include <windows.h>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <vector>
+
+class CollisionBVH
+{
+public:
+
+	// Leaves hold at most this many items.
+	static const UINT MaxLeafItems = 4;
+
+	// Deepest level Build will create, queries keep a stack of this size.
+	static const UINT MaxDepth = 48;
+
+	// First contact found by SweepSphere.  Time is the fraction of the move
+	// completed at contact and Normal points from the item towards the sphere.
+	struct SweepHit
+	{
+		float Time = 1.0f;
+		DirectX::XMFLOAT3 Normal = { 0.0f, 0.0f, 0.0f };
+		UINT Item = 0;
+	};
+
+	///<summary>
+	/// Builds the tree over boxes[0...count).  Queries report items by their
+	/// index into this array.
+	///</summary>
+	void Build(const DirectX::BoundingBox* boxes, UINT count);
+
+	// Replaces the box of one item.  Call Refit once the moved items are updated.
+	void SetItemBounds(UINT item, const DirectX::BoundingBox& box);
+
+	// Recomputes every node box from the current item boxes.
+	void Refit();
+
+	// True if any item box overlaps the query volume.  Touching counts as overlap.
+	bool Overlaps(const DirectX::BoundingBox& box)const;
+	bool Overlaps(const DirectX::BoundingSphere& sphere)const;
+
+	///<summary>
+	/// Writes the indices of the items whose boxes overlap box to items, stopping
+	/// after maxItems, and returns the number written.  Does not allocate.
+	///</summary>
+	UINT Query(const DirectX::BoundingBox& box, UINT* items, UINT maxItems)const;
+
+	///<summary>
+	/// Sweeps a sphere of the given radius from start to start + delta and fills
+	/// hit with the earliest item box it touches.  A sphere that already overlaps
+	/// a box only reports it when delta points further into it, so it can always
+	/// back out.  Does not allocate or modify the tree, so any number of agents
+	/// can query it, from any thread.
+	///</summary>
+	bool SweepSphere(const DirectX::XMFLOAT3& start, const DirectX::XMFLOAT3& delta,
+		float radius, SweepHit& hit)const;
+
+	UINT ItemCount()const { return (UINT)mItemMin.size(); }
+	UINT NodeCount()const { return (UINT)mNodes.size(); }
+
+private:
+	// Children of an interior node are stored next to each other at First and
+	// First + 1.  A leaf owns the Count item slots starting at First.
+	struct Node
+	{
+		DirectX::XMFLOAT3 Min;
+		UINT First;
+		DirectX::XMFLOAT3 Max;
+		UINT Count;
+	};
+
+	void BuildNode(UINT nodeIndex, UINT first, UINT count, UINT depth);
+	void UpdateNodeBounds(Node& node)const;
+
+	// Depth-first walk visiting the nodes and items for which overlap(min, max) holds.
+	template<typename Overlap>
+	UINT Traverse(Overlap overlap, UINT* items, UINT maxItems)const;
+
+private:
+	std::vector<Node> mNodes;
+
+	// Item boxes in leaf order, so a leaf reads a contiguous range.
+	std::vector<DirectX::XMFLOAT3> mItemMin;
+	std::vector<DirectX::XMFLOAT3> mItemMax;
+
+	// mItems[slot] is the caller's index of the item in that slot, mSlots the inverse.
+	std::vector<UINT> mItems;
+	std::vector<UINT> mSlots;
+
+	// Build scratch, item centroids in slot order.
+	std::vector<DirectX::XMFLOAT3> mCentroids;
+};
@@ -0,0 +1,75 @@
+//***************************************************************************************
+// DrawPartition.cpp
+//***************************************************************************************
+
+#include "DrawPartition.h"
+
+void PartitionDraws(const std::uint32_t* segmentDraws, std::uint32_t segmentCount,
+	std::uint32_t maxLists, std::uint32_t minDrawsPerList, std::vector<std::vector<DrawRange>>& lists)
+{
+	std::uint64_t total = 0;
+	for(std::uint32_t s = 0; s < segmentCount; ++s)
+		total += segmentDraws[s];
+
+	std::uint64_t listCount = minDrawsPerList > 0 ? total / minDrawsPerList : total;
+	if(listCount > maxLists)
+		listCount = maxLists;
+	if(listCount == 0)
+		listCount = 1;
+
+	lists.resize((std::size_t)listCount);
+
+	std::uint32_t segment = 0;
+	std::uint32_t offset = 0;
+	for(std::uint64_t l = 0; l < listCount; ++l)
+	{
+		std::vector<DrawRange>& ranges = lists[(std::size_t)l];
+		ranges.clear();
+
+		// Spread the remainder so list sizes differ by at most one draw.
+		std::uint64_t wanted = total * (l + 1) / listCount - total * l / listCount;
+		while(wanted > 0 && segment < segmentCount)
+		{
+			std::uint32_t available = segmentDraws[segment] - offset;
+			if(available == 0)
+			{
+				++segment;
+				offset = 0;
+				continue;
+			}
+
+			std::uint32_t take = available < wanted ? available : (std::uint32_t)wanted;
+
+			DrawRange range;
+			range.Segment = segment;
+			range.First = offset;
+			range.Count = take;
+			ranges.push_back(range);
+
+			offset += take;
+			wanted -= take;
+		}
+	}
+}
+
+void RecordDrawList(const std::vector<std::vector<DrawRange>>& lists, std::uint32_t listIndex,
+	DrawListRecorder& recorder)
+{
+	const std::vector<DrawRange>& ranges = lists[listIndex];
+	std::uint32_t segment = ranges.empty() ? 0 : ranges[0].Segment;
+
+	recorder.Begin(segment, listIndex == 0);
+
+	for(const DrawRange& range : ranges)
+	{
+		if(range.Segment != segment)
+		{
+			recorder.SetSegment(range.Segment);
+			segment = range.Segment;
+		}
+
+		recorder.Draw(range.Segment, range.First, range.Count);
+	}
+
+	recorder.End(listIndex + 1 == lists.size());
+}
@@ -0,0 +1,67 @@
+//***************************************************************************************
+// DrawPartition.h
+//
+// Splits a frame's draws into command lists that can be recorded in parallel.
+// The draws come as consecutive segments (one per PSO, e.g. the sorted visible
+// list of a render layer) and every list receives a contiguous run of the
+// overall sequence, so submitting the lists in order replays the draws in
+// exactly their sorted order.
+//
+// RecordDrawList turns one list's ranges into commands through the
+// DrawListRecorder interface; the renderer implements it over a D3D12 command
+// list, the tests in Game3111_A1.Tests over a log.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Draws [First, First + Count) of segment Segment.
+struct DrawRange
+{
+	std::uint32_t Segment;
+	std::uint32_t First;
+	std::uint32_t Count;
+};
+
+///<summary>
+/// Partitions the segmentDraws[0..segmentCount) draws into at most maxLists
+/// lists of near-equal size, each at least minDrawsPerList draws long unless
+/// there are fewer draws in total.  There is always at least one list, empty
+/// if there is nothing to draw, so the frame's begin and end commands have a
+/// list to go in.  Empty segments produce no ranges.  lists is resized to the
+/// list count; the inner vectors keep their capacity across frames.
+///</summary>
+void PartitionDraws(const std::uint32_t* segmentDraws, std::uint32_t segmentCount,
+	std::uint32_t maxLists, std::uint32_t minDrawsPerList, std::vector<std::vector<DrawRange>>& lists);
+
+// Receives the commands of one command list from RecordDrawList.
+class DrawListRecorder
+{
+public:
+	virtual ~DrawListRecorder() = default;
+
+	// Opens the list with the PSO of segment bound.  The first list of the
+	// frame also prepares the render target.
+	virtual void Begin(std::uint32_t segment, bool firstList) = 0;
+
+	// Binds the PSO of segment.
+	virtual void SetSegment(std::uint32_t segment) = 0;
+
+	// Records draws [first, first + count) of segment.
+	virtual void Draw(std::uint32_t segment, std::uint32_t first, std::uint32_t count) = 0;
+
+	// Closes the list.  The last list of the frame also hands the render
+	// target back for presenting.
+	virtual void End(bool lastList) = 0;
+};
+
+///<summary>
+/// Records list listIndex of lists, as built by PartitionDraws: opens it with
+/// the PSO of its first segment (segment 0 for an empty list), binds a new PSO
+/// only where the segment changes and draws the ranges in order.
+///</summary>
+void RecordDrawList(const std::vector<std::vector<DrawRange>>& lists, std::uint32_t listIndex,
+	DrawListRecorder& recorder);
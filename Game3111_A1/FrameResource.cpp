@@ -1,15 +1,24 @@
 #include "FrameResource.h"
 
-FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount)
+FrameResource::FrameResource(ID3D12Device* device, UINT objectCount, UINT materialCount, UINT recordListCount, UINT localLightCount)
 {
     ThrowIfFailed(device->CreateCommandAllocator(
         D3D12_COMMAND_LIST_TYPE_DIRECT,
         IID_PPV_ARGS(CmdListAlloc.GetAddressOf())));
 
+    RecordCmdListAllocs.resize(recordListCount);
+    for(auto& alloc : RecordCmdListAllocs)
+    {
+        ThrowIfFailed(device->CreateCommandAllocator(
+            D3D12_COMMAND_LIST_TYPE_DIRECT,
+            IID_PPV_ARGS(alloc.GetAddressOf())));
+    }
+
     //  FrameCB = std::make_unique<UploadBuffer<FrameConstants>>(device, 1, true);
-    PassCB = std::make_unique<UploadBuffer<PassConstants>>(device, passCount, true);
+    LightCB = std::make_unique<UploadBuffer<LightConstants>>(device, 1, true);
     MaterialCB = std::make_unique<UploadBuffer<MaterialConstants>>(device, materialCount, true);
     ObjectCB = std::make_unique<UploadBuffer<ObjectConstants>>(device, objectCount, true);
+    LocalLightBuffer = std::make_unique<UploadBuffer<Light>>(device, localLightCount, false);
 }
 
 FrameResource::~FrameResource()
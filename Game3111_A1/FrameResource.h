@@ -34,14 +34,27 @@ struct PassConstants
     float TotalTime = 0.0f;
     float DeltaTime = 0.0f;
 
+    // Cluster layout, see LightClusters and ClusterIndex in LightingUtil.hlsl.
+    DirectX::XMUINT3 ClusterCounts = { 0, 0, 0 };
+    float cbPassPad2 = 0.0f;
+    DirectX::XMFLOAT2 ClusterTileScale = { 0.0f, 0.0f };
+    float ClusterDepthScale = 0.0f;
+    float ClusterDepthBias = 0.0f;
+};
+
+// Lights that stay the same from frame to frame, kept out of PassConstants so
+// they are only uploaded when the scene's lights change.
+struct LightConstants
+{
     DirectX::XMFLOAT4 AmbientLight = { 0.0f, 0.0f, 0.0f, 1.0f };
 
-    // Indices [0, NUM_DIR_LIGHTS) are directional lights;
-    // indices [NUM_DIR_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHTS) are point lights;
-    // indices [NUM_DIR_LIGHTS+NUM_POINT_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHT+NUM_SPOT_LIGHTS)
-    // are spot lights for a maximum of MaxLights per object.
+    // Indices [0, DirLightCount) are directional lights.  Point and spot
+    // lights come from the frame resource's light clusters.
     Light Lights[MaxLights];
+
+    UINT DirLightCount = 0;
 };
+
 struct MaterialData
 {
     DirectX::XMFLOAT4 DiffuseAlbedo = { 1.0f, 1.0f, 1.0f, 1.0f };
@@ -64,13 +77,21 @@ struct Vertex
     DirectX::XMFLOAT2 TexC;
 };
 
+// Billboard center and size, expanded into a quad by the tree sprite
+// geometry shader.
+struct TreeSpriteVertex
+{
+    DirectX::XMFLOAT3 Pos;
+    DirectX::XMFLOAT2 Size;
+};
+
 // Stores the resources needed for the CPU to build the command lists
 // for a frame.  
 struct FrameResource
 {
 public:
 
-    FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount);
+    FrameResource(ID3D12Device* device, UINT objectCount, UINT materialCount, UINT recordListCount, UINT localLightCount);
     FrameResource(const FrameResource& rhs) = delete;
     FrameResource& operator=(const FrameResource& rhs) = delete;
     ~FrameResource();
@@ -79,13 +100,33 @@ public:
     // So each frame needs their own allocator.
     Microsoft::WRL::ComPtr<ID3D12CommandAllocator> CmdListAlloc;
 
+    // Allocators of the extra command lists recorded in parallel with the main
+    // one, one per list since an allocator can only back one recording list.
+    std::vector<Microsoft::WRL::ComPtr<ID3D12CommandAllocator>> RecordCmdListAllocs;
+
     // We cannot update a cbuffer until the GPU is done processing the commands
-    // that reference it.  So each frame needs their own cbuffers.
+    // that reference it.  So each frame needs their own cbuffers.  These keep
+    // their contents from frame to frame and are only written where something
+    // changed.
    // std::unique_ptr<UploadBuffer<FrameConstants>> FrameCB = nullptr;
-    std::unique_ptr<UploadBuffer<PassConstants>> PassCB = nullptr;
+    std::unique_ptr<UploadBuffer<LightConstants>> LightCB = nullptr;
     std::unique_ptr<UploadBuffer<MaterialConstants>> MaterialCB = nullptr;
     std::unique_ptr<UploadBuffer<ObjectConstants>> ObjectCB = nullptr;
 
+    // Point and spot lights, read by the pixel shaders as a StructuredBuffer
+    // together with the light lists of the clusters.
+    std::unique_ptr<UploadBuffer<Light>> LocalLightBuffer = nullptr;
+
+    // Data rewritten every frame lives in the upload ring, see UploadRing.
+    // These are where this frame's pass constants, the per-instance constants
+    // of the instanced draws and the light lists of the clusters (see
+    // LightClusters) went.  The streamed tree sprites are pointed to by the
+    // tree sprite geometry itself.
+    D3D12_GPU_VIRTUAL_ADDRESS PassCBAddress = 0;
+    D3D12_GPU_VIRTUAL_ADDRESS InstanceDataAddress = 0;
+    D3D12_GPU_VIRTUAL_ADDRESS LightClusterAddress = 0;
+    D3D12_GPU_VIRTUAL_ADDRESS LightIndexAddress = 0;
+
     // Fence value to mark commands up to this fence point.  This lets us
     // check if these frame resources are still in use by the GPU.
     UINT64 Fence = 0;
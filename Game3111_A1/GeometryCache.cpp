@@ -0,0 +1,218 @@
+//***************************************************************************************
+// GeometryCache.cpp
+//***************************************************************************************
+
+#include "GeometryCache.h"
+#include "MappedFile.h"
+
+namespace
+{
+	// File layout:
+	//   CacheHeader
+	//   CacheSubmesh[SubmeshCount]   (MeshGeometry::DrawArgs)
+	//   CacheSubmesh[BatchCount]     (MeshGeometry::Batches, unnamed)
+	//   vertex payload (VertexBufferByteSize bytes)
+	//   index payload  (IndexBufferByteSize bytes)
+	// Every record is fixed size so loading never parses strings.
+
+	const char CacheMagic[4] = { 'G', 'E', 'O', 'C' };
+
+	struct CacheHeader
+	{
+		char Magic[4];
+		std::uint32_t Version;
+		std::uint64_t Key;
+		std::uint32_t VertexByteStride;
+		std::uint32_t VertexBufferByteSize;
+		std::uint32_t IndexFormat;
+		std::uint32_t IndexBufferByteSize;
+		std::uint32_t SubmeshCount;
+		std::uint32_t BatchCount;
+	};
+
+	struct CacheSubmesh
+	{
+		char Name[48];
+		std::uint32_t IndexCount;
+		std::uint32_t StartIndexLocation;
+		std::int32_t BaseVertexLocation;
+		std::uint32_t FirstBatch;
+		std::uint32_t BatchCount;
+		DirectX::XMFLOAT3 BoundsCenter;
+		DirectX::XMFLOAT3 BoundsExtents;
+		DirectX::XMFLOAT3 SphereCenter;
+		float SphereRadius;
+	};
+
+	CacheSubmesh ToCacheSubmesh(const SubmeshGeometry& submesh)
+	{
+		CacheSubmesh entry = {};
+		entry.IndexCount = submesh.IndexCount;
+		entry.StartIndexLocation = submesh.StartIndexLocation;
+		entry.BaseVertexLocation = submesh.BaseVertexLocation;
+		entry.FirstBatch = submesh.FirstBatch;
+		entry.BatchCount = submesh.BatchCount;
+		entry.BoundsCenter = submesh.Bounds.Center;
+		entry.BoundsExtents = submesh.Bounds.Extents;
+		entry.SphereCenter = submesh.Sphere.Center;
+		entry.SphereRadius = submesh.Sphere.Radius;
+		return entry;
+	}
+
+	SubmeshGeometry FromCacheSubmesh(const CacheSubmesh& entry)
+	{
+		SubmeshGeometry submesh;
+		submesh.IndexCount = entry.IndexCount;
+		submesh.StartIndexLocation = entry.StartIndexLocation;
+		submesh.BaseVertexLocation = entry.BaseVertexLocation;
+		submesh.FirstBatch = entry.FirstBatch;
+		submesh.BatchCount = entry.BatchCount;
+		submesh.Bounds.Center = entry.BoundsCenter;
+		submesh.Bounds.Extents = entry.BoundsExtents;
+		submesh.Sphere.Center = entry.SphereCenter;
+		submesh.Sphere.Radius = entry.SphereRadius;
+		return submesh;
+	}
+}
+
+GeometryCache::Key& GeometryCache::Key::Add(const void* data, size_t byteSize)
+{
+	const BYTE* bytes = static_cast<const BYTE*>(data);
+	for(size_t i = 0; i < byteSize; ++i)
+	{
+		mHash ^= bytes[i];
+		mHash *= 1099511628211ull;
+	}
+
+	return *this;
+}
+
+GeometryCache::Key& GeometryCache::Key::Add(const std::string& str)
+{
+	// Include the length so ("ab","c") and ("a","bc") hash differently.
+	Add(static_cast<std::uint32_t>(str.size()));
+	return Add(str.data(), str.size());
+}
+
+bool GeometryCache::Load(const std::wstring& filename, std::uint64_t key, MeshGeometry& geo)
+{
+	MappedFile file(filename);
+	if(file.Data() == nullptr || file.Size() < sizeof(CacheHeader))
+		return false;
+
+	CacheHeader header;
+	memcpy(&header, file.Data(), sizeof(CacheHeader));
+
+	if(memcmp(header.Magic, CacheMagic, sizeof(CacheMagic)) != 0 ||
+		header.Version != Version ||
+		header.Key != key)
+	{
+		return false;
+	}
+
+	const size_t tableOffset = sizeof(CacheHeader);
+	const size_t recordCount = (size_t)header.SubmeshCount + header.BatchCount;
+	const size_t vertexOffset = tableOffset + recordCount * sizeof(CacheSubmesh);
+	const size_t indexOffset = vertexOffset + header.VertexBufferByteSize;
+	const size_t expectedSize = indexOffset + header.IndexBufferByteSize;
+	if(file.Size() != expectedSize)
+		return false;
+
+	Microsoft::WRL::ComPtr<ID3DBlob> vertexBlob;
+	Microsoft::WRL::ComPtr<ID3DBlob> indexBlob;
+	if(FAILED(D3DCreateBlob(header.VertexBufferByteSize, &vertexBlob)) ||
+		FAILED(D3DCreateBlob(header.IndexBufferByteSize, &indexBlob)))
+	{
+		return false;
+	}
+
+	CopyMemory(vertexBlob->GetBufferPointer(), file.Data() + vertexOffset, header.VertexBufferByteSize);
+	CopyMemory(indexBlob->GetBufferPointer(), file.Data() + indexOffset, header.IndexBufferByteSize);
+
+	std::unordered_map<std::string, SubmeshGeometry> drawArgs;
+	std::vector<SubmeshGeometry> batches;
+	batches.reserve(header.BatchCount);
+
+	const CacheSubmesh* table = reinterpret_cast<const CacheSubmesh*>(file.Data() + tableOffset);
+	for(size_t i = 0; i < recordCount; ++i)
+	{
+		CacheSubmesh entry;
+		memcpy(&entry, &table[i], sizeof(CacheSubmesh));
+		entry.Name[sizeof(entry.Name) - 1] = '\0';
+
+		SubmeshGeometry submesh = FromCacheSubmesh(entry);
+		if(submesh.BatchCount > 0 && (size_t)submesh.FirstBatch + submesh.BatchCount > header.BatchCount)
+			return false;
+
+		if(i < header.SubmeshCount)
+			drawArgs[entry.Name] = submesh;
+		else
+			batches.push_back(submesh);
+	}
+
+	geo.VertexBufferCPU = vertexBlob;
+	geo.IndexBufferCPU = indexBlob;
+	geo.VertexByteStride = header.VertexByteStride;
+	geo.VertexBufferByteSize = header.VertexBufferByteSize;
+	geo.IndexFormat = static_cast<DXGI_FORMAT>(header.IndexFormat);
+	geo.IndexBufferByteSize = header.IndexBufferByteSize;
+	geo.DrawArgs = std::move(drawArgs);
+	geo.Batches = std::move(batches);
+
+	return true;
+}
+
+bool GeometryCache::Save(const std::wstring& filename, std::uint64_t key, const MeshGeometry& geo)
+{
+	if(geo.VertexBufferCPU == nullptr || geo.IndexBufferCPU == nullptr)
+		return false;
+
+	CacheHeader header = {};
+	memcpy(header.Magic, CacheMagic, sizeof(CacheMagic));
+	header.Version = Version;
+	header.Key = key;
+	header.VertexByteStride = geo.VertexByteStride;
+	header.VertexBufferByteSize = geo.VertexBufferByteSize;
+	header.IndexFormat = static_cast<std::uint32_t>(geo.IndexFormat);
+	header.IndexBufferByteSize = geo.IndexBufferByteSize;
+	header.SubmeshCount = static_cast<std::uint32_t>(geo.DrawArgs.size());
+	header.BatchCount = static_cast<std::uint32_t>(geo.Batches.size());
+
+	std::vector<CacheSubmesh> table;
+	table.reserve(geo.DrawArgs.size() + geo.Batches.size());
+	for(auto& e : geo.DrawArgs)
+	{
+		CacheSubmesh entry = ToCacheSubmesh(e.second);
+		if(e.first.size() >= sizeof(entry.Name))
+			return false;
+
+		memcpy(entry.Name, e.first.c_str(), e.first.size());
+		table.push_back(entry);
+	}
+
+	for(auto& batch : geo.Batches)
+		table.push_back(ToCacheSubmesh(batch));
+
+	// Write to a temporary file first so a crash mid-write never leaves a
+	// truncated cache behind that passes the header check.
+	std::wstring tempFilename = filename + L".tmp";
+	{
+		std::ofstream fout(tempFilename, std::ios::binary | std::ios::trunc);
+		if(!fout)
+			return false;
+
+		fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		fout.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(CacheSubmesh));
+		fout.write(static_cast<const char*>(geo.VertexBufferCPU->GetBufferPointer()), geo.VertexBufferByteSize);
+		fout.write(static_cast<const char*>(geo.IndexBufferCPU->GetBufferPointer()), geo.IndexBufferByteSize);
+
+		if(!fout)
+		{
+			fout.close();
+			DeleteFileW(tempFilename.c_str());
+			return false;
+		}
+	}
+
+	return MoveFileExW(tempFilename.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+}
@@ -0,0 +1,48 @@
+//***************************************************************************************
+// GeometryCache.h
+//
+// Versioned binary cache for procedurally generated MeshGeometry.  The packed
+// vertex/index payload and the SubmeshGeometry table are written to disk once,
+// keyed by a hash of the generator calls that produced them.  Later runs map the
+// file and copy the payload straight into the VertexBufferCPU/IndexBufferCPU
+// blobs, so startup no longer depends on the tessellation level.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+
+class GeometryCache
+{
+public:
+
+	// Bump whenever the file layout or the meaning of the cached data changes.
+	static const std::uint32_t Version = 3;
+
+	///<summary>
+	/// 64-bit FNV-1a hash of everything that influences the generated geometry.
+	/// Feed it the generator descriptions, counts and any post-process tags.
+	///</summary>
+	class Key
+	{
+	public:
+		Key& Add(const void* data, size_t byteSize);
+		Key& Add(const std::string& str);
+		Key& Add(float v) { return Add(&v, sizeof(v)); }
+		Key& Add(std::uint32_t v) { return Add(&v, sizeof(v)); }
+
+		std::uint64_t Hash()const { return mHash; }
+
+	private:
+		std::uint64_t mHash = 14695981039346656037ull;
+	};
+
+	// Fills the CPU side of geo (blobs, strides, formats, DrawArgs, Batches) from the
+	// cache file.  Returns false if the file is missing, stale or malformed;
+	// geo is left untouched in that case.
+	static bool Load(const std::wstring& filename, std::uint64_t key, MeshGeometry& geo);
+
+	// Writes the CPU side of geo to the cache file.  Failures are not fatal,
+	// the geometry is simply regenerated on the next run.
+	static bool Save(const std::wstring& filename, std::uint64_t key, const MeshGeometry& geo);
+};
@@ -4,92 +4,487 @@
 
 #include "GeometryGenerator.h"
 #include <algorithm>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 
 using namespace DirectX;
 
-GeometryGenerator::MeshData GeometryGenerator::CreateBox(float width, float height, float depth, uint32 numSubdivisions)
+namespace
 {
-    MeshData meshData;
+	// Compile-time tables for the fixed low-poly shapes, in unit space.  Sloped
+	// faces store the unnormalized cross product of their unit-space edges;
+	// EmitUnitShape rescales it so the normal stays perpendicular to the face
+	// after non-uniform scaling.
 
-    //
-	// Create the vertices.
-	//
+	using UnitVertex = GeometryGenerator::UnitVertex;
+	using uint16 = GeometryGenerator::uint16;
 
-	Vertex v[24];
-
-	float w2 = 0.5f*width;
-	float h2 = 0.5f*height;
-	float d2 = 0.5f*depth;
-    
-	// Fill in the front face vertex data.
-	v[0] = Vertex(-w2, -h2, -d2, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
-	v[1] = Vertex(-w2, +h2, -d2, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	v[2] = Vertex(+w2, +h2, -d2, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f);
-	v[3] = Vertex(+w2, -h2, -d2, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f);
-
-	// Fill in the back face vertex data.
-	v[4] = Vertex(-w2, -h2, +d2, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 1.0f);
-	v[5] = Vertex(+w2, -h2, +d2, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
-	v[6] = Vertex(+w2, +h2, +d2, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	v[7] = Vertex(-w2, +h2, +d2, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f);
-
-	// Fill in the top face vertex data.
-	v[8]  = Vertex(-w2, +h2, -d2, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
-	v[9]  = Vertex(-w2, +h2, +d2, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	v[10] = Vertex(+w2, +h2, +d2, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f);
-	v[11] = Vertex(+w2, +h2, -d2, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f);
-
-	// Fill in the bottom face vertex data.
-	v[12] = Vertex(-w2, -h2, -d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f, 1.0f);
-	v[13] = Vertex(+w2, -h2, -d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
-	v[14] = Vertex(+w2, -h2, +d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	v[15] = Vertex(-w2, -h2, +d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f);
-
-	// Fill in the left face vertex data.
-	v[16] = Vertex(-w2, -h2, +d2, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f);
-	v[17] = Vertex(-w2, +h2, +d2, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f);
-	v[18] = Vertex(-w2, +h2, -d2, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f);
-	v[19] = Vertex(-w2, -h2, -d2, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 1.0f, 1.0f);
-
-	// Fill in the right face vertex data.
-	v[20] = Vertex(+w2, -h2, -d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f);
-	v[21] = Vertex(+w2, +h2, -d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f);
-	v[22] = Vertex(+w2, +h2, +d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f);
-	v[23] = Vertex(+w2, -h2, +d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f);
-
-	meshData.Vertices.assign(&v[0], &v[24]);
- 
-	//
-	// Create the indices.
-	//
+	constexpr UnitVertex BoxVertices[] =
+	{
+		// Front face.
+		{ { -0.5f, -0.5f, -0.5f }, { 0.0f, 0.0f, -1.0f }, { 1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f } },
+		{ { -0.5f, 0.5f, -0.5f }, { 0.0f, 0.0f, -1.0f }, { 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f } },
+		{ { 0.5f, 0.5f, -0.5f }, { 0.0f, 0.0f, -1.0f }, { 1.0f, 0.0f, 0.0f }, { 1.0f, 0.0f } },
+		{ { 0.5f, -0.5f, -0.5f }, { 0.0f, 0.0f, -1.0f }, { 1.0f, 0.0f, 0.0f }, { 1.0f, 1.0f } },
+
+		// Back face.
+		{ { -0.5f, -0.5f, 0.5f }, { 0.0f, 0.0f, 1.0f }, { -1.0f, 0.0f, 0.0f }, { 1.0f, 1.0f } },
+		{ { 0.5f, -0.5f, 0.5f }, { 0.0f, 0.0f, 1.0f }, { -1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f } },
+		{ { 0.5f, 0.5f, 0.5f }, { 0.0f, 0.0f, 1.0f }, { -1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f } },
+		{ { -0.5f, 0.5f, 0.5f }, { 0.0f, 0.0f, 1.0f }, { -1.0f, 0.0f, 0.0f }, { 1.0f, 0.0f } },
+
+		// Top face.
+		{ { -0.5f, 0.5f, -0.5f }, { 0.0f, 1.0f, 0.0f }, { 1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f } },
+		{ { -0.5f, 0.5f, 0.5f }, { 0.0f, 1.0f, 0.0f }, { 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f } },
+		{ { 0.5f, 0.5f, 0.5f }, { 0.0f, 1.0f, 0.0f }, { 1.0f, 0.0f, 0.0f }, { 1.0f, 0.0f } },
+		{ { 0.5f, 0.5f, -0.5f }, { 0.0f, 1.0f, 0.0f }, { 1.0f, 0.0f, 0.0f }, { 1.0f, 1.0f } },
+
+		// Bottom face.
+		{ { -0.5f, -0.5f, -0.5f }, { 0.0f, -1.0f, 0.0f }, { -1.0f, 0.0f, 0.0f }, { 1.0f, 1.0f } },
+		{ { 0.5f, -0.5f, -0.5f }, { 0.0f, -1.0f, 0.0f }, { -1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f } },
+		{ { 0.5f, -0.5f, 0.5f }, { 0.0f, -1.0f, 0.0f }, { -1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f } },
+		{ { -0.5f, -0.5f, 0.5f }, { 0.0f, -1.0f, 0.0f }, { -1.0f, 0.0f, 0.0f }, { 1.0f, 0.0f } },
+
+		// Left face.
+		{ { -0.5f, -0.5f, 0.5f }, { -1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, -1.0f }, { 0.0f, 1.0f } },
+		{ { -0.5f, 0.5f, 0.5f }, { -1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, -1.0f }, { 0.0f, 0.0f } },
+		{ { -0.5f, 0.5f, -0.5f }, { -1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, -1.0f }, { 1.0f, 0.0f } },
+		{ { -0.5f, -0.5f, -0.5f }, { -1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, -1.0f }, { 1.0f, 1.0f } },
+
+		// Right face.
+		{ { 0.5f, -0.5f, -0.5f }, { 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 0.0f, 1.0f } },
+		{ { 0.5f, 0.5f, -0.5f }, { 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f } },
+		{ { 0.5f, 0.5f, 0.5f }, { 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 1.0f, 0.0f } },
+		{ { 0.5f, -0.5f, 0.5f }, { 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 1.0f, 1.0f } }
+	};
+
+	constexpr uint16 BoxIndices[] =
+	{
+		0, 1, 2,    0, 2, 3,    // front
+		4, 5, 6,    4, 6, 7,    // back
+		8, 9, 10,   8, 10, 11,  // top
+		12, 13, 14, 12, 14, 15, // bottom
+		16, 17, 18, 16, 18, 19, // left
+		20, 21, 22, 20, 22, 23  // right
+	};
+
+	constexpr UnitVertex PrismVertices[] =
+	{
+		// Front face.
+		{ { -0.5f, -0.5f, -0.5f }, { 0.0f, 0.0f, -1.0f }, { 1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f } },
+		{ { 0.0f, 0.5f, -0.5f }, { 0.0f, 0.0f, -1.0f }, { 1.0f, 0.0f, 0.0f }, { 0.5f, 0.0f } },
+		{ { 0.5f, -0.5f, -0.5f }, { 0.0f, 0.0f, -1.0f }, { 1.0f, 0.0f, 0.0f }, { 1.0f, 1.0f } },
+
+		// Back face.
+		{ { -0.5f, -0.5f, 0.5f }, { 0.0f, 0.0f, 1.0f }, { -1.0f, 0.0f, 0.0f }, { 1.0f, 1.0f } },
+		{ { 0.5f, -0.5f, 0.5f }, { 0.0f, 0.0f, 1.0f }, { -1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f } },
+		{ { 0.0f, 0.5f, 0.5f }, { 0.0f, 0.0f, 1.0f }, { -1.0f, 0.0f, 0.0f }, { 0.0f, 0.5f } },
+
+		// Bottom face.
+		{ { -0.5f, -0.5f, -0.5f }, { 0.0f, -1.0f, 0.0f }, { -1.0f, 0.0f, 0.0f }, { 1.0f, 1.0f } },
+		{ { 0.5f, -0.5f, -0.5f }, { 0.0f, -1.0f, 0.0f }, { -1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f } },
+		{ { 0.5f, -0.5f, 0.5f }, { 0.0f, -1.0f, 0.0f }, { -1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f } },
+		{ { -0.5f, -0.5f, 0.5f }, { 0.0f, -1.0f, 0.0f }, { -1.0f, 0.0f, 0.0f }, { 1.0f, 0.0f } },
+
+		// Left face.
+		{ { -0.5f, -0.5f, 0.5f }, { -1.0f, 0.5f, 0.0f }, { 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f } },
+		{ { 0.0f, 0.5f, 0.5f }, { -1.0f, 0.5f, 0.0f }, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f } },
+		{ { 0.0f, 0.5f, -0.5f }, { -1.0f, 0.5f, 0.0f }, { 0.0f, 0.0f, 0.0f }, { 1.0f, 0.0f } },
+		{ { -0.5f, -0.5f, -0.5f }, { -1.0f, 0.5f, 0.0f }, { 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f } },
+
+		// Right face.
+		{ { 0.5f, -0.5f, -0.5f }, { 1.0f, 0.5f, 0.0f }, { 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f } },
+		{ { 0.0f, 0.5f, -0.5f }, { 1.0f, 0.5f, 0.0f }, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f } },
+		{ { 0.0f, 0.5f, 0.5f }, { 1.0f, 0.5f, 0.0f }, { 0.0f, 0.0f, 0.0f }, { 1.0f, 0.0f } },
+		{ { 0.5f, -0.5f, 0.5f }, { 1.0f, 0.5f, 0.0f }, { 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f } }
+	};
+
+	constexpr uint16 PrismIndices[] =
+	{
+		0, 1, 2,                // front
+		3, 4, 5,                // back
+		9, 6, 7,    7, 8, 9,    // bottom
+		11, 12, 13, 13, 10, 11, // left
+		16, 17, 14, 14, 15, 16  // right
+	};
+
+	constexpr UnitVertex PyramidVertices[] =
+	{
+		// Front face.
+		{ { -0.5f, -0.5f, -0.5f }, { 0.0f, 0.5f, -1.0f }, { 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f } },
+		{ { 0.0f, 0.5f, 0.0f }, { 0.0f, 0.5f, -1.0f }, { 0.0f, 0.0f, 0.0f }, { 0.5f, 0.0f } },
+		{ { 0.5f, -0.5f, -0.5f }, { 0.0f, 0.5f, -1.0f }, { 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f } },
+
+		// Back face.
+		{ { -0.5f, -0.5f, 0.5f }, { 0.0f, 0.5f, 1.0f }, { 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f } },
+		{ { 0.5f, -0.5f, 0.5f }, { 0.0f, 0.5f, 1.0f }, { 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f } },
+		{ { 0.0f, 0.5f, 0.0f }, { 0.0f, 0.5f, 1.0f }, { 0.0f, 0.0f, 0.0f }, { 0.5f, 0.0f } },
+
+		// Bottom face.
+		{ { -0.5f, -0.5f, -0.5f }, { 0.0f, -1.0f, 0.0f }, { -1.0f, 0.0f, 0.0f }, { 1.0f, 1.0f } },
+		{ { 0.5f, -0.5f, -0.5f }, { 0.0f, -1.0f, 0.0f }, { -1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f } },
+		{ { 0.5f, -0.5f, 0.5f }, { 0.0f, -1.0f, 0.0f }, { -1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f } },
+		{ { -0.5f, -0.5f, 0.5f }, { 0.0f, -1.0f, 0.0f }, { -1.0f, 0.0f, 0.0f }, { 1.0f, 0.0f } },
+
+		// Left face.
+		{ { -0.5f, -0.5f, 0.5f }, { -1.0f, 0.5f, 0.0f }, { 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f } },
+		{ { 0.0f, 0.5f, 0.0f }, { -1.0f, 0.5f, 0.0f }, { 0.0f, 0.0f, 0.0f }, { 0.5f, 0.0f } },
+		{ { -0.5f, -0.5f, -0.5f }, { -1.0f, 0.5f, 0.0f }, { 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f } },
+
+		// Right face.
+		{ { 0.5f, -0.5f, 0.5f }, { 1.0f, 0.5f, 0.0f }, { 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f } },
+		{ { 0.5f, -0.5f, -0.5f }, { 1.0f, 0.5f, 0.0f }, { 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f } },
+		{ { 0.0f, 0.5f, 0.0f }, { 1.0f, 0.5f, 0.0f }, { 0.0f, 0.0f, 0.0f }, { 0.5f, 0.0f } }
+	};
+
+	constexpr uint16 PyramidIndices[] =
+	{
+		0, 1, 2,                // front
+		3, 4, 5,                // back
+		9, 6, 7,    7, 8, 9,    // bottom
+		10, 11, 12,             // left
+		13, 14, 15              // right
+	};
+
+	constexpr UnitVertex WedgeVertices[] =
+	{
+		// Bottom face.
+		{ { -0.5f, -0.5f, -0.5f }, { 0.0f, -1.0f, 0.0f }, { -1.0f, 0.0f, 0.0f }, { 1.0f, 1.0f } },
+		{ { 0.5f, -0.5f, -0.5f }, { 0.0f, -1.0f, 0.0f }, { -1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f } },
+		{ { 0.5f, -0.5f, 0.5f }, { 0.0f, -1.0f, 0.0f }, { -1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f } },
+		{ { -0.5f, -0.5f, 0.5f }, { 0.0f, -1.0f, 0.0f }, { -1.0f, 0.0f, 0.0f }, { 1.0f, 0.0f } },
+
+		// Front face.
+		{ { -0.5f, -0.5f, -0.5f }, { 0.0f, 0.0f, -1.0f }, { 1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f } },
+		{ { 0.5f, 0.5f, -0.5f }, { 0.0f, 0.0f, -1.0f }, { 1.0f, 0.0f, 0.0f }, { 1.0f, 0.0f } },
+		{ { 0.5f, -0.5f, -0.5f }, { 0.0f, 0.0f, -1.0f }, { 1.0f, 0.0f, 0.0f }, { 1.0f, 1.0f } },
+
+		// Back face.
+		{ { 0.5f, 0.5f, 0.5f }, { 0.0f, 0.0f, 1.0f }, { -1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f } },
+		{ { -0.5f, -0.5f, 0.5f }, { 0.0f, 0.0f, 1.0f }, { -1.0f, 0.0f, 0.0f }, { 1.0f, 1.0f } },
+		{ { 0.5f, -0.5f, 0.5f }, { 0.0f, 0.0f, 1.0f }, { -1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f } },
+
+		// Top (sloped) face.
+		{ { -0.5f, -0.5f, 0.5f }, { -1.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f } },
+		{ { 0.5f, 0.5f, 0.5f }, { -1.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f } },
+		{ { 0.5f, 0.5f, -0.5f }, { -1.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f }, { 1.0f, 0.0f } },
+		{ { -0.5f, -0.5f, -0.5f }, { -1.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f } },
+
+		// Right face.
+		{ { 0.5f, 0.5f, -0.5f }, { 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f } },
+		{ { 0.5f, 0.5f, 0.5f }, { 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 1.0f, 0.0f } },
+		{ { 0.5f, -0.5f, 0.5f }, { 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 1.0f, 1.0f } },
+		{ { 0.5f, -0.5f, -0.5f }, { 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 0.0f, 1.0f } }
+	};
+
+	constexpr uint16 WedgeIndices[] =
+	{
+		0, 1, 2,    2, 3, 0,    // bottom
+		4, 5, 6,                // front
+		7, 8, 9,                // back
+		10, 11, 12, 12, 13, 10, // top
+		14, 15, 16, 16, 17, 14  // right
+	};
+
+	template<size_t NumVertices, size_t NumIndices>
+	constexpr GeometryGenerator::UnitShape MakeUnitShape(
+		const UnitVertex (&vertices)[NumVertices], const uint16 (&indices)[NumIndices])
+	{
+		static_assert(NumVertices <= GeometryGenerator::MaxUnitShapeVertices, "raise MaxUnitShapeVertices");
+		return { vertices, (GeometryGenerator::uint32)NumVertices, indices, (GeometryGenerator::uint32)NumIndices };
+	}
+
+	constexpr GeometryGenerator::UnitShape UnitBox     = MakeUnitShape(BoxVertices, BoxIndices);
+	constexpr GeometryGenerator::UnitShape UnitPrism   = MakeUnitShape(PrismVertices, PrismIndices);
+	constexpr GeometryGenerator::UnitShape UnitPyramid = MakeUnitShape(PyramidVertices, PyramidIndices);
+	constexpr GeometryGenerator::UnitShape UnitWedge   = MakeUnitShape(WedgeVertices, WedgeIndices);
+
+	// sin/cos of the sliceCount+1 ring angles j*2pi/sliceCount, shared by every
+	// revolved primitive with that slice count.  Entries are stored four to an
+	// XMVECTOR (padded past the seam) so rings can be emitted four vertices at a
+	// time; the seam entry repeats entry 0 exactly so the ring closes cleanly.
+	struct RingTable
+	{
+		std::vector<XMVECTOR> Cos;
+		std::vector<XMVECTOR> Sin;
+		std::vector<XMVECTOR> U; // j/sliceCount, the texture u of each ring vertex.
+	};
 
-	uint32 i[36];
+	const RingTable& GetRingTable(GeometryGenerator::uint32 sliceCount)
+	{
+		static std::mutex tableMutex;
+		static std::unordered_map<GeometryGenerator::uint32, std::unique_ptr<RingTable>> tables;
+
+		std::lock_guard<std::mutex> lock(tableMutex);
 
-	// Fill in the front face index data
-	i[0] = 0; i[1] = 1; i[2] = 2;
-	i[3] = 0; i[4] = 2; i[5] = 3;
+		std::unique_ptr<RingTable>& table = tables[sliceCount];
+		if(table != nullptr)
+			return *table;
 
-	// Fill in the back face index data
-	i[6] = 4; i[7]  = 5; i[8]  = 6;
-	i[9] = 4; i[10] = 6; i[11] = 7;
+		table = std::make_unique<RingTable>();
 
-	// Fill in the top face index data
-	i[12] = 8; i[13] =  9; i[14] = 10;
-	i[15] = 8; i[16] = 10; i[17] = 11;
+		const GeometryGenerator::uint32 blockCount = (sliceCount + 1 + 3) / 4;
+		table->Cos.resize(blockCount);
+		table->Sin.resize(blockCount);
+		table->U.resize(blockCount);
 
-	// Fill in the bottom face index data
-	i[18] = 12; i[19] = 13; i[20] = 14;
-	i[21] = 12; i[22] = 14; i[23] = 15;
+		const XMVECTOR laneOffsets = XMVectorSet(0.0f, 1.0f, 2.0f, 3.0f);
+		const XMVECTOR dTheta = XMVectorReplicate(XM_2PI / sliceCount);
+		const XMVECTOR du = XMVectorReplicate(1.0f / sliceCount);
 
-	// Fill in the left face index data
-	i[24] = 16; i[25] = 17; i[26] = 18;
-	i[27] = 16; i[28] = 18; i[29] = 19;
+		for(GeometryGenerator::uint32 b = 0; b < blockCount; ++b)
+		{
+			XMVECTOR j = XMVectorAdd(XMVectorReplicate(4.0f*b), laneOffsets);
+			XMVectorSinCos(&table->Sin[b], &table->Cos[b], XMVectorMultiply(j, dTheta));
+			table->U[b] = XMVectorMultiply(j, du);
+		}
 
-	// Fill in the right face index data
-	i[30] = 20; i[31] = 21; i[32] = 22;
-	i[33] = 20; i[34] = 22; i[35] = 23;
+		// Close the seam exactly rather than trusting sin/cos(2pi).
+		const GeometryGenerator::uint32 seamBlock = sliceCount / 4;
+		const GeometryGenerator::uint32 seamLane = sliceCount % 4;
+		XMVECTORU32 seamMask = { { { 0, 0, 0, 0 } } };
+		seamMask.u[seamLane] = 0xFFFFFFFF;
+		table->Cos[seamBlock] = XMVectorSelect(table->Cos[seamBlock], XMVectorSplatX(table->Cos[0]), seamMask);
+		table->Sin[seamBlock] = XMVectorSelect(table->Sin[seamBlock], XMVectorSplatX(table->Sin[0]), seamMask);
+		table->U[seamBlock] = XMVectorSelect(table->U[seamBlock], XMVectorReplicate(1.0f), seamMask);
 
-	meshData.Indices32.assign(&i[0], &i[36]);
+		return *table;
+	}
+
+	// Scatters one block of four SoA lanes into up to four vertices.
+	void StoreRingBlock(
+		FXMVECTOR px, FXMVECTOR py, FXMVECTOR pz,
+		GXMVECTOR nx, HXMVECTOR ny, HXMVECTOR nz,
+		CXMVECTOR tx, CXMVECTOR tz,
+		CXMVECTOR u, CXMVECTOR v,
+		GeometryGenerator::uint32 count, GeometryGenerator::Vertex* dst)
+	{
+		XMFLOAT4A lanes[10];
+		XMStoreFloat4A(&lanes[0], px);
+		XMStoreFloat4A(&lanes[1], py);
+		XMStoreFloat4A(&lanes[2], pz);
+		XMStoreFloat4A(&lanes[3], nx);
+		XMStoreFloat4A(&lanes[4], ny);
+		XMStoreFloat4A(&lanes[5], nz);
+		XMStoreFloat4A(&lanes[6], tx);
+		XMStoreFloat4A(&lanes[7], tz);
+		XMStoreFloat4A(&lanes[8], u);
+		XMStoreFloat4A(&lanes[9], v);
+
+		const float* f[10];
+		for(int k = 0; k < 10; ++k)
+			f[k] = &lanes[k].x;
+
+		for(GeometryGenerator::uint32 k = 0; k < count; ++k)
+		{
+			GeometryGenerator::Vertex& vertex = dst[k];
+			vertex.Position = XMFLOAT3(f[0][k], f[1][k], f[2][k]);
+			vertex.Normal = XMFLOAT3(f[3][k], f[4][k], f[5][k]);
+			vertex.TangentU = XMFLOAT3(f[6][k], 0.0f, f[7][k]);
+			vertex.TexC = XMFLOAT2(f[8][k], f[9][k]);
+		}
+	}
+
+	// Writes the sliceCount+1 vertices of a ring of the given radius at height y.
+	// Every revolved surface here has a normal of the form
+	// (normalXZ*cos, normalY, normalXZ*sin) along a ring, and a tangent of
+	// tangentSign*(-sin, 0, cos).
+	void EmitRing(const RingTable& ring, GeometryGenerator::uint32 sliceCount,
+		float radius, float y, float normalXZ, float normalY, float tangentSign, float texV,
+		GeometryGenerator::Vertex* dst)
+	{
+		const XMVECTOR r = XMVectorReplicate(radius);
+		const XMVECTOR py = XMVectorReplicate(y);
+		const XMVECTOR nxz = XMVectorReplicate(normalXZ);
+		const XMVECTOR ny = XMVectorReplicate(normalY);
+		const XMVECTOR ts = XMVectorReplicate(tangentSign);
+		const XMVECTOR v = XMVectorReplicate(texV);
+
+		const GeometryGenerator::uint32 vertexCount = sliceCount + 1;
+		for(GeometryGenerator::uint32 j = 0; j < vertexCount; j += 4)
+		{
+			const XMVECTOR c = ring.Cos[j / 4];
+			const XMVECTOR s = ring.Sin[j / 4];
+
+			StoreRingBlock(
+				XMVectorMultiply(r, c), py, XMVectorMultiply(r, s),
+				XMVectorMultiply(nxz, c), ny, XMVectorMultiply(nxz, s),
+				XMVectorNegate(XMVectorMultiply(ts, s)), XMVectorMultiply(ts, c),
+				ring.U[j / 4], v,
+				std::min<GeometryGenerator::uint32>(4, vertexCount - j), dst + j);
+		}
+	}
+
+	// Writes the rim of a flat cap.  Texture coordinates are the planar x/z
+	// position scaled by the height, as the cylinder caps always did.
+	void EmitCapRing(const RingTable& ring, GeometryGenerator::uint32 sliceCount,
+		float radius, float y, float normalY, float height,
+		GeometryGenerator::Vertex* dst)
+	{
+		const XMVECTOR r = XMVectorReplicate(radius);
+		const XMVECTOR py = XMVectorReplicate(y);
+		const XMVECTOR ny = XMVectorReplicate(normalY);
+		const XMVECTOR invHeight = XMVectorReplicate(1.0f / height);
+		const XMVECTOR half = XMVectorReplicate(0.5f);
+		const XMVECTOR zero = XMVectorZero();
+		const XMVECTOR one = XMVectorReplicate(1.0f);
+
+		const GeometryGenerator::uint32 vertexCount = sliceCount + 1;
+		for(GeometryGenerator::uint32 j = 0; j < vertexCount; j += 4)
+		{
+			const XMVECTOR x = XMVectorMultiply(r, ring.Cos[j / 4]);
+			const XMVECTOR z = XMVectorMultiply(r, ring.Sin[j / 4]);
+
+			StoreRingBlock(
+				x, py, z,
+				zero, ny, zero,
+				one, zero,
+				XMVectorMultiplyAdd(x, invHeight, half), XMVectorMultiplyAdd(z, invHeight, half),
+				std::min<GeometryGenerator::uint32>(4, vertexCount - j), dst + j);
+		}
+	}
+
+	// 1/length of (a, b), or 0 for a degenerate ring so its normals stay zero.
+	float InvLength(float a, float b)
+	{
+		float lengthSq = a*a + b*b;
+		return lengthSq > 0.0f ? 1.0f / sqrtf(lengthSq) : 0.0f;
+	}
+}
+
+GeometryGenerator::MeshData GeometryGenerator::CreateShape(const ShapeDesc& desc)
+{
+	const float* p = desc.Params;
+	const uint32* n = desc.Counts;
+
+	switch(desc.Type)
+	{
+	case ShapeType::Box:             return CreateBox(p[0], p[1], p[2], n[0]);
+	case ShapeType::Sphere:          return CreateSphere(p[0], n[0], n[1]);
+	case ShapeType::Geosphere:       return CreateGeosphere(p[0], n[0]);
+	case ShapeType::Torus:           return CreateTorus(p[0], p[1], n[0], n[1]);
+	case ShapeType::Cone:            return CreateCone(p[0], p[1], n[0], n[1]);
+	case ShapeType::Wedge:           return CreateWedge(p[0], p[1], p[2]);
+	case ShapeType::Cylinder:        return CreateCylinder(p[0], p[1], p[2], n[0], n[1]);
+	case ShapeType::Diamond:         return CreateDiamond(p[0], p[1], p[2], p[3], n[0], n[1]);
+	case ShapeType::Grid:            return CreateGrid(p[0], p[1], n[0], n[1]);
+	case ShapeType::TriangularPrism: return CreateTriangularPrism(p[0], p[1], p[2]);
+	case ShapeType::Pyramid:         return CreatePyramid(p[0], p[1], p[2]);
+	}
+
+	return MeshData();
+}
+
+std::vector<GeometryGenerator::MeshData> GeometryGenerator::SplitForIndices16(const MeshData& meshData)
+{
+	std::vector<MeshData> batches;
+
+	if(meshData.FitsIndices16())
+	{
+		batches.push_back(meshData);
+		return batches;
+	}
+
+	// remap[v] is the index of source vertex v inside the batch stamped in
+	// owner[v].  Stamping avoids clearing the table for every new batch.
+	const uint32 unassigned = 0xffffffff;
+	std::vector<uint32> remap(meshData.Vertices.size(), 0);
+	std::vector<uint32> owner(meshData.Vertices.size(), unassigned);
+
+	batches.emplace_back();
+	uint32 batchIndex = 0;
+
+	for(size_t t = 0; t + 2 < meshData.Indices32.size(); t += 3)
+	{
+		const uint32* tri = &meshData.Indices32[t];
+
+		// Count how many new vertices this triangle would add to the open batch.
+		uint32 newVertices = 0;
+		for(uint32 k = 0; k < 3; ++k)
+		{
+			bool seenInTri = (k > 0 && tri[k] == tri[0]) || (k > 1 && tri[k] == tri[1]);
+			if(owner[tri[k]] != batchIndex && !seenInTri)
+				++newVertices;
+		}
+
+		if(batches.back().Vertices.size() + newVertices > MaxVertices16)
+		{
+			batches.emplace_back();
+			++batchIndex;
+		}
+
+		MeshData& batch = batches.back();
+		for(uint32 k = 0; k < 3; ++k)
+		{
+			uint32 v = tri[k];
+			if(owner[v] != batchIndex)
+			{
+				owner[v] = batchIndex;
+				remap[v] = (uint32)batch.Vertices.size();
+				batch.Vertices.push_back(meshData.Vertices[v]);
+			}
+
+			batch.Indices32.push_back(remap[v]);
+		}
+	}
+
+	return batches;
+}
+
+const GeometryGenerator::UnitShape* GeometryGenerator::GetUnitShape(ShapeType type)
+{
+	switch(type)
+	{
+	case ShapeType::Box:             return &UnitBox;
+	case ShapeType::TriangularPrism: return &UnitPrism;
+	case ShapeType::Pyramid:         return &UnitPyramid;
+	case ShapeType::Wedge:           return &UnitWedge;
+	default:                         return nullptr;
+	}
+}
+
+void GeometryGenerator::EmitUnitShape(const UnitShape& shape, float width, float height, float depth, Vertex* vertices)
+{
+	XMVECTOR scale = XMVectorSet(width, height, depth, 0.0f);
+
+	// Normals transform by the inverse transpose of the scale.  The cofactor
+	// (h*d, w*d, w*h) is that up to a constant factor and, unlike 1/scale,
+	// stays finite when a dimension is zero.
+	XMVECTOR normalScale = XMVectorSet(height*depth, width*depth, width*height, 0.0f);
+
+	for(uint32 i = 0; i < shape.VertexCount; ++i)
+	{
+		const UnitVertex& src = shape.Vertices[i];
+		Vertex& dst = vertices[i];
+
+		XMVECTOR p = XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(src.Position));
+		XMVECTOR n = XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(src.Normal));
+		XMVECTOR t = XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(src.TangentU));
+
+		XMStoreFloat3(&dst.Position, p*scale);
+		XMStoreFloat3(&dst.Normal, XMVector3Normalize(n*normalScale));
+		XMStoreFloat3(&dst.TangentU, XMVector3Normalize(t*scale));
+		dst.TexC = XMFLOAT2(src.TexC[0], src.TexC[1]);
+	}
+}
+
+GeometryGenerator::MeshData GeometryGenerator::CreateUnitShape(ShapeType type, float width, float height, float depth)
+{
+	const UnitShape* shape = GetUnitShape(type);
+	assert(shape != nullptr);
+
+	MeshData meshData;
+	meshData.Vertices.resize(shape->VertexCount);
+	EmitUnitShape(*shape, width, height, depth, meshData.Vertices.data());
+	meshData.Indices32.assign(shape->Indices, shape->Indices + shape->IndexCount);
+
+	return meshData;
+}
+
+GeometryGenerator::MeshData GeometryGenerator::CreateBox(float width, float height, float depth, uint32 numSubdivisions)
+{
+    MeshData meshData = CreateUnitShape(ShapeType::Box, width, height, depth);
 
     // Put a cap on the number of subdivisions.
     numSubdivisions = std::min<uint32>(numSubdivisions, 6u);
@@ -100,8 +495,6 @@ GeometryGenerator::MeshData GeometryGenerator::CreateBox(float width, float heig
     return meshData;
 }
 
-
-
 GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32 sliceCount, uint32 stackCount)
 {
     MeshData meshData;
@@ -119,41 +512,24 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
 	meshData.Vertices.push_back( topVertex );
 
 	float phiStep   = XM_PI/stackCount;
-	float thetaStep = 2.0f*XM_PI/sliceCount;
+
+	const RingTable& ring = GetRingTable(sliceCount);
+	uint32 ringVertexCount = sliceCount + 1;
+
+	meshData.Vertices.resize(1 + (stackCount-1)*ringVertexCount);
 
 	// Compute vertices for each stack ring (do not count the poles as rings).
+	// The normal is the unit position, (sin(phi)cos(theta), cos(phi), sin(phi)sin(theta)),
+	// and the tangent is dP/dtheta, which normalizes to (-sin(theta), 0, cos(theta)).
 	for(uint32 i = 1; i <= stackCount-1; ++i)
 	{
 		float phi = i*phiStep;
 
-		// Vertices of ring.
-        for(uint32 j = 0; j <= sliceCount; ++j)
-		{
-			float theta = j*thetaStep;
-
-			Vertex v;
-
-			// spherical to cartesian
-			v.Position.x = radius*sinf(phi)*cosf(theta);
-			v.Position.y = radius*cosf(phi);
-			v.Position.z = radius*sinf(phi)*sinf(theta);
+		float sinPhi, cosPhi;
+		XMScalarSinCos(&sinPhi, &cosPhi, phi);
 
-			// Partial derivative of P with respect to theta
-			v.TangentU.x = -radius*sinf(phi)*sinf(theta);
-			v.TangentU.y = 0.0f;
-			v.TangentU.z = +radius*sinf(phi)*cosf(theta);
-
-			XMVECTOR T = XMLoadFloat3(&v.TangentU);
-			XMStoreFloat3(&v.TangentU, XMVector3Normalize(T));
-
-			XMVECTOR p = XMLoadFloat3(&v.Position);
-			XMStoreFloat3(&v.Normal, XMVector3Normalize(p));
-
-			v.TexC.x = theta / XM_2PI;
-			v.TexC.y = phi / XM_PI;
-
-			meshData.Vertices.push_back( v );
-		}
+		EmitRing(ring, sliceCount, radius*sinPhi, radius*cosPhi, sinPhi, cosPhi, 1.0f, phi / XM_PI,
+			&meshData.Vertices[1 + (i-1)*ringVertexCount]);
 	}
 
 	meshData.Vertices.push_back( bottomVertex );
@@ -177,7 +553,6 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
 	// Offset the indices to the index of the first vertex in the first ring.
 	// This is just skipping the top pole vertex.
     uint32 baseIndex = 1;
-    uint32 ringVertexCount = sliceCount + 1;
 	for(uint32 i = 0; i < stackCount-2; ++i)
 	{
 		for(uint32 j = 0; j < sliceCount; ++j)
@@ -451,173 +826,12 @@ void GeometryGenerator::Subdivide(MeshData& meshData)
 
 GeometryGenerator::MeshData GeometryGenerator::CreateTriangularPrism(float baseWidth, float height, float depth)
 {
-	MeshData meshData;
-
-	//
-	// Create the vertices.
-	//
-
-	Vertex v[18];
-
-	float w2 = 0.5f * baseWidth;
-	float h2 = 0.5f * height;
-	float d2 = 0.5f * depth;
-
-	// Fill in the front face vertex data.
-	v[0] = Vertex(-w2, -h2, -d2, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
-	v[1] = Vertex(0.0f, +h2, -d2, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.0f);
-	v[2] = Vertex(+w2, -h2, -d2, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f);
-
-	// Fill in the back face vertex data.
-	v[3] = Vertex(-w2, -h2, +d2, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 1.0f);
-	v[4] = Vertex(+w2, -h2, +d2, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
-	v[5] = Vertex(0.0f, +h2, +d2, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.5f);
-
-	// Fill in the bottom face vertex data.
-	v[6] = Vertex(-w2, -h2, -d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f, 1.0f);
-	v[7] = Vertex(+w2, -h2, -d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
-	v[8] = Vertex(+w2, -h2, +d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	v[9] = Vertex(-w2, -h2, +d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f);
-
-	// Fill in the left face vertex data.
-	XMFLOAT3 LNormal = getNormal({ -w2, -h2, d2 }, { 0.0f, +h2, +d2 }, { 0.0f, +h2, -d2 });
-	v[10] = Vertex(-w2, -h2, +d2, LNormal.x,  LNormal.y, LNormal.z, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f);
-	v[11] = Vertex(0.0f, +h2, +d2, LNormal.x, LNormal.y, LNormal.z, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	v[12] = Vertex(0.0f, +h2, -d2, LNormal.x, LNormal.y, LNormal.z, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f);
-	v[13] = Vertex(-w2, -h2, -d2, LNormal.x, LNormal.y, LNormal.z, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f);
-
-
-	// Fill in the right face vertex data.
-	XMFLOAT3 RNormal = getNormal({ +w2, -h2, d2 }, { 0.0f, +h2, -d2 }, { 0.0f, +h2, +d2 });
-	v[14] = Vertex(+w2, -h2, -d2,  RNormal.x, RNormal.y, RNormal.z, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f);
-	v[15] = Vertex(0.0f, +h2, -d2, RNormal.x, RNormal.y, RNormal.z, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	v[16] = Vertex(0.0f, +h2, +d2, RNormal.x, RNormal.y, RNormal.z, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f);
-	v[17] = Vertex(+w2, -h2, +d2, RNormal.x, RNormal.y, RNormal.z,  0.0f, 0.0f, 0.0f, 1.0f, 1.0f);
-
-	meshData.Vertices.assign(&v[0], &v[18]);
-
-	//front face
-	meshData.Indices32.push_back(0);
-	meshData.Indices32.push_back(1);
-	meshData.Indices32.push_back(2);
-	//back face
-	meshData.Indices32.push_back(3);
-	meshData.Indices32.push_back(4);
-	meshData.Indices32.push_back(5);
-	//bottom face
-	meshData.Indices32.push_back(9);
-	meshData.Indices32.push_back(6);
-	meshData.Indices32.push_back(7);
-	meshData.Indices32.push_back(7);
-	meshData.Indices32.push_back(8);
-	meshData.Indices32.push_back(9);
-	//left face
-	meshData.Indices32.push_back(11);
-	meshData.Indices32.push_back(12);
-	meshData.Indices32.push_back(13);
-	meshData.Indices32.push_back(13);
-	meshData.Indices32.push_back(10);
-	meshData.Indices32.push_back(11);
-	//right face
-	meshData.Indices32.push_back(16);
-	meshData.Indices32.push_back(17);
-	meshData.Indices32.push_back(14);
-	meshData.Indices32.push_back(14);
-	meshData.Indices32.push_back(15);
-	meshData.Indices32.push_back(16);
-
-	return meshData;
+	return CreateUnitShape(ShapeType::TriangularPrism, baseWidth, height, depth);
 }
 
 GeometryGenerator::MeshData GeometryGenerator::CreatePyramid(float baseWidth, float height, float depth)
 {
-	MeshData meshData;
-
-	//
-	// Create the vertices.
-	//
-
-	Vertex v[16];
-
-	float w2 = 0.5f * baseWidth;
-	float h2 = 0.5f * height;
-	float d2 = 0.5f * depth;
-
-	// Fill in the front face vertex data.
-	XMFLOAT3 FNormal = getNormal({ -w2, -h2, -d2 }, { 0.0f, +h2, 0.0f }, { +w2, -h2, -d2 });
-	v[0] = Vertex(-w2, -h2, -d2,    FNormal.x, FNormal.y, FNormal.z, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f);
-	v[1] = Vertex(0.0f, +h2, 0.0f,  FNormal.x, FNormal.y, FNormal.z, 0.0f, 0.0f, 0.0f, 0.5f, 0.0f);
-	v[2] = Vertex(+w2, -h2, -d2,    FNormal.x, FNormal.y, FNormal.z, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f);
-
-	// Fill in the back face vertex data.
-	XMFLOAT3 BNormal = getNormal({ -w2, -h2, +d2 }, { +w2, -h2, +d2 }, { 0.0f, +h2, 0.0f });
-	v[3] = Vertex(-w2, -h2, +d2,   BNormal.x, BNormal.y, BNormal.z, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f);
-	v[4] = Vertex(+w2, -h2, +d2,   BNormal.x, BNormal.y, BNormal.z, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f);
-	v[5] = Vertex(0.0f, +h2, 0.0f, BNormal.x, BNormal.y, BNormal.z, 0.0f, 0.0f, 0.0f, 0.5f, 0.0f);
-
-	// Fill in the bottom face vertex data.
-	v[6] = Vertex(-w2, -h2, -d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f, 1.0f);
-	v[7] = Vertex(+w2, -h2, -d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
-	v[8] = Vertex(+w2, -h2, +d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	v[9] = Vertex(-w2, -h2, +d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f);
-
-	// Fill in the left face vertex data.
-	XMFLOAT3 LNormal = getNormal({ -w2, -h2, +d2 }, { 0.0f, +h2, 0.0f }, { -w2, -h2, -d2 });
-	v[10] = Vertex(-w2, -h2, +d2,   LNormal.x, LNormal.y, LNormal.z, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f);
-	v[11] = Vertex(0.0f, +h2, 0.0f, LNormal.x, LNormal.y, LNormal.z, 0.0f, 0.0f, 0.0f, 0.5f, 0.0f);
-	v[12] = Vertex(-w2, -h2, -d2,   LNormal.x, LNormal.y, LNormal.z, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f);
-
-	// Fill in the right face vertex data.
-	XMFLOAT3 RNormal = getNormal({ +w2, -h2, +d2 }, { +w2, -h2, -d2 }, { 0.0f, +h2, 0.0f });
-	v[13] = Vertex(+w2, -h2, +d2,   RNormal.x, RNormal.y, RNormal.z,   0.0f, 0.0f, 0.0f, 1.0f, 1.0f);
-	v[14] = Vertex(+w2, -h2, -d2,   RNormal.x, RNormal.y, RNormal.z,   0.0f, 0.0f, 0.0f, 0.0f, 1.0f);
-	v[15] = Vertex(0.0f, +h2, 0.0f, RNormal.x, RNormal.y, RNormal.z,   0.0f, 0.0f, 0.0f, 0.5f, 0.0f);
-	
-
-	meshData.Vertices.assign(&v[0], &v[16]);
-
-	//front face
-	meshData.Indices32.push_back(0);
-	meshData.Indices32.push_back(1);
-	meshData.Indices32.push_back(2);
-	//back face
-	meshData.Indices32.push_back(3);
-	meshData.Indices32.push_back(4);
-	meshData.Indices32.push_back(5);
-	//bottom face
-	meshData.Indices32.push_back(9);
-	meshData.Indices32.push_back(6);
-	meshData.Indices32.push_back(7);
-	meshData.Indices32.push_back(7);
-	meshData.Indices32.push_back(8);
-	meshData.Indices32.push_back(9);
-	//left face
-	meshData.Indices32.push_back(10);
-	meshData.Indices32.push_back(11);
-	meshData.Indices32.push_back(12);
-	//right face
-	meshData.Indices32.push_back(13);
-	meshData.Indices32.push_back(14);
-	meshData.Indices32.push_back(15);
-	
-
-	return meshData;
-}
-
-XMFLOAT3 GeometryGenerator::getNormal(XMFLOAT3 p0, XMFLOAT3 p1, XMFLOAT3 p2)
-{
-	XMVECTOR v0 = XMLoadFloat3(&p0);
-	XMVECTOR v1 = XMLoadFloat3(&p1);
-	XMVECTOR v2 = XMLoadFloat3(&p2);
-	XMVECTOR u = v1 - v0;
-	XMVECTOR v = v2 - v0;
-
-	XMVECTOR normal = XMVector3Normalize(XMVector3Cross(u, v));
-
-	XMFLOAT3 result;  
-	XMStoreFloat3(&result, normal);
-
-	return result;
+	return CreateUnitShape(ShapeType::Pyramid, baseWidth, height, depth);
 }
 
 GeometryGenerator::Vertex GeometryGenerator::MidPoint(const Vertex& v0, const Vertex& v1)
@@ -649,91 +863,11 @@ GeometryGenerator::Vertex GeometryGenerator::MidPoint(const Vertex& v0, const Ve
 
     return v;
 }
-GeometryGenerator::MeshData GeometryGenerator::CreateWedge(float width, float height, float depth) {
-
-	MeshData  meshData;
-	Vertex v[18];
-	float w2 = 0.5f * width;
-	float h2 = 0.5f * height;
-	float d2 = 0.5f * depth;
-
-	XMFLOAT3 tangent;
-	XMFLOAT3 normal;
-
-	// bottom face
-	// Fill in the bottom face vertex data.
-	//use cube to find the 8 corresponding params. the first 3 should be mapped proper. 
-
-	//bottom 
-	v[0] = Vertex(-w2, -h2, -d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f, 1.0f);
-	v[1] = Vertex(+w2, -h2, -d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
-	v[2] = Vertex(+w2, -h2, +d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	v[3] = Vertex(-w2, -h2, +d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f);
-
-	//front
-	v[4] = Vertex(-w2, -h2, -d2, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
-	v[5] = Vertex(w2, +h2, -d2, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f);
-	v[6] = Vertex(w2, -h2, -d2, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f);
-
-	//back face
-	v[7] = Vertex(w2, h2, d2, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	v[8] = Vertex(-w2, -h2, d2, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 1.0f);
-	v[9] = Vertex(+w2, -h2, d2, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
-
-	//top/left face
-	normal = getNormal({ -w2, -h2, d2 }, { +w2, h2, d2 }, { +w2, h2, -d2 });
-	v[10] = Vertex(-w2, -h2, d2, normal.x, normal.y, -normal.z, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f);
-	v[11] = Vertex(+w2, h2, d2,  normal.x, normal.y, -normal.z, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	v[12] = Vertex(+w2, h2, -d2, normal.x, normal.y, -normal.z, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f);
-	v[13] = Vertex(-w2, -h2, -d2,normal.x, normal.y, -normal.z, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f);
-
-	//right face 
-	v[14] = Vertex(w2, +h2, -d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f);
-	v[15] = Vertex(w2, h2, d2,   1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f);
-	v[16] = Vertex(w2, -h2, +d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f);
-	v[17] = Vertex(w2, -h2, -d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f);
-
-	meshData.Vertices.assign(&v[0], &v[18]);
-	
-
-	//bottom face
-	meshData.Indices32.push_back(0);
-	meshData.Indices32.push_back(1);
-	meshData.Indices32.push_back(2);
-	meshData.Indices32.push_back(2);
-	meshData.Indices32.push_back(3);
-	meshData.Indices32.push_back(0);
-
-
-	//left face
-	meshData.Indices32.push_back(4);
-	meshData.Indices32.push_back(5);
-	meshData.Indices32.push_back(6);
-	//right face
-	meshData.Indices32.push_back(7);
-	meshData.Indices32.push_back(8);
-	meshData.Indices32.push_back(9);
-	
-
-	//top
-	meshData.Indices32.push_back(10);
-	meshData.Indices32.push_back(11);
-	meshData.Indices32.push_back(12);
-	meshData.Indices32.push_back(12);
-	meshData.Indices32.push_back(13);
-	meshData.Indices32.push_back(10);
-
-	//back
-	meshData.Indices32.push_back(14);
-	meshData.Indices32.push_back(15);
-	meshData.Indices32.push_back(16);
-	meshData.Indices32.push_back(16);
-	meshData.Indices32.push_back(17);
-	meshData.Indices32.push_back(14);
-
-
-	return meshData;
+GeometryGenerator::MeshData GeometryGenerator::CreateWedge(float width, float height, float depth)
+{
+	return CreateUnitShape(ShapeType::Wedge, width, height, depth);
 }
+
 GeometryGenerator::MeshData GeometryGenerator::CreateGeosphere(float radius, uint32 numSubdivisions)
 {
     MeshData meshData;
@@ -818,90 +952,41 @@ GeometryGenerator::MeshData GeometryGenerator::CreateTorus(float tubeRadius, flo
 	//
 
 	float phiStep = XM_PI / stackCount;
-	float thetaStep = 2.0f * XM_PI / sliceCount;
-
-	// Compute vertices for each stack ring. outer rings
-	for (uint32 i = 0; i <= stackCount - 1; ++i)
-	{
-		float phi = i * phiStep;
-
-		// Vertices of ring.
-		for (uint32 j = 0; j <= sliceCount; ++j)
-		{
-			float theta = j * thetaStep;
 
-			Vertex v;
-
-			float c = cosf(theta);
-			float s = sinf(theta);
-
-			// spherical to cartesian. combines the ring radius and the spherical curve of the donut
-			v.Position.x = ringRadius * c + tubeRadius * sinf(phi) * c;
-			v.Position.y = tubeRadius * cosf(phi);
-			v.Position.z = ringRadius * s + tubeRadius * sinf(phi) * s;
-
-			// Partial derivative of P with respect to theta
-			v.TangentU.x = -(ringRadius + tubeRadius * sinf(phi)) * sinf(theta);
-			v.TangentU.y = 0.0f;
-			v.TangentU.z = (ringRadius + tubeRadius * sinf(phi)) * cosf(theta);
-
-			XMVECTOR TangentV = { tubeRadius * cos(phi) * c, tubeRadius * cos(phi) * s, tubeRadius * sin(phi) };
-
-			XMVECTOR T = XMLoadFloat3(&v.TangentU);
-
-			XMStoreFloat3(&v.TangentU, XMVector3Normalize(T));
-
-			XMVECTOR p = XMLoadFloat3(&v.Position);
-			XMStoreFloat3(&v.Normal, XMVector3Normalize(p));
-
-			v.TexC.x = theta / XM_2PI;
-			v.TexC.y = phi / XM_PI;
+	const RingTable& ring = GetRingTable(sliceCount);
+	uint32 ringVertexCount = sliceCount + 1;
 
-			meshData.Vertices.push_back(v);
-		}
-	}
+	meshData.Vertices.resize(2 * stackCount * ringVertexCount);
 
-	// Compute vertices for each stack ring. inner rings
+	// Every ring is a circle of radius ringRadius +/- tubeRadius*sin(phi) at
+	// height +/- tubeRadius*cos(phi).  The normal is the normalized position
+	// (negated for the inner rings) and the tangent is dP/dtheta normalized.
 	for (uint32 i = 0; i <= stackCount - 1; ++i)
 	{
 		float phi = i * phiStep;
 
-		// Vertices of ring.
-		for (uint32 j = 0; j <= sliceCount; ++j)
-		{
-			float theta = j * thetaStep;
-
-			Vertex v;
-
-			float c = cosf(theta);
-			float s = sinf(theta);
-
-			// spherical to cartesian
-			v.Position.x = ringRadius * c - tubeRadius * sinf(phi) * c;
-			v.Position.y = tubeRadius * -cosf(phi);
-			v.Position.z = ringRadius * s - tubeRadius * sinf(phi) * s;
-
-			// Partial derivative of P with respect to theta
-			v.TangentU.x = -(ringRadius - tubeRadius * sinf(phi)) * s;
-			v.TangentU.y = 0.0f;
-			v.TangentU.z = (ringRadius - tubeRadius * sinf(phi)) * c;
-
-			XMVECTOR T = XMLoadFloat3(&v.TangentU);
-			XMStoreFloat3(&v.TangentU, XMVector3Normalize(T));
-
-			XMVECTOR p = XMLoadFloat3(&v.Position);
-			XMStoreFloat3(&v.Normal, XMVector3Normalize(-p));
-
-			v.TexC.x = theta / XM_2PI;
-			v.TexC.y = phi / XM_PI;
-
-			meshData.Vertices.push_back(v);
-		}
+		float sinPhi, cosPhi;
+		XMScalarSinCos(&sinPhi, &cosPhi, phi);
+
+		// Outer rings.
+		float r = ringRadius + tubeRadius * sinPhi;
+		float y = tubeRadius * cosPhi;
+		float invLength = InvLength(r, y);
+		float tangentSign = r > 0.0f ? 1.0f : (r < 0.0f ? -1.0f : 0.0f);
+		EmitRing(ring, sliceCount, r, y, r * invLength, y * invLength, tangentSign, phi / XM_PI,
+			&meshData.Vertices[i * ringVertexCount]);
+
+		// Inner rings.
+		r = ringRadius - tubeRadius * sinPhi;
+		y = -tubeRadius * cosPhi;
+		invLength = InvLength(r, y);
+		tangentSign = r > 0.0f ? 1.0f : (r < 0.0f ? -1.0f : 0.0f);
+		EmitRing(ring, sliceCount, r, y, -r * invLength, -y * invLength, tangentSign, phi / XM_PI,
+			&meshData.Vertices[(stackCount + i) * ringVertexCount]);
 	}
 
 	//
 	// Compute indices for outer stacks, ring vertex count used to loop back around to the first vertices in the ring
-	uint32 ringVertexCount = sliceCount + 1 ;
 	for (uint32 i = 0; i < stackCount; ++i)
 	{
 		for (uint32 j = 0; j < sliceCount; ++j)
@@ -967,64 +1052,47 @@ GeometryGenerator::MeshData GeometryGenerator::CreateCylinder(float bottomRadius
 
 	uint32 ringCount = stackCount+1;
 
+	// Add one because we duplicate the first and last vertex per ring
+	// since the texture coordinates are different.
+	uint32 ringVertexCount = sliceCount+1;
+
+	// Cylinder can be parameterized as follows, where we introduce v
+	// parameter that goes in the same direction as the v tex-coord
+	// so that the bitangent goes in the same direction as the v tex-coord.
+	//   Let r0 be the bottom radius and let r1 be the top radius.
+	//   y(v) = h - hv for v in [0,1].
+	//   r(v) = r1 + (r0-r1)v
+	//
+	//   x(t, v) = r(v)*cos(t)
+	//   y(t, v) = h - hv
+	//   z(t, v) = r(v)*sin(t)
+	// 
+	//  dx/dt = -r(v)*sin(t)
+	//  dy/dt = 0
+	//  dz/dt = +r(v)*cos(t)
+	//
+	//  dx/dv = (r0-r1)*cos(t)
+	//  dy/dv = -h
+	//  dz/dv = (r0-r1)*sin(t)
+	//
+	// The tangent (-sin(t), 0, cos(t)) is unit length, and T x B works out to
+	// (h*cos(t), r0-r1, h*sin(t)), whose length is the same for every vertex.
+	float dr = bottomRadius-topRadius;
+	float invLength = InvLength(height, dr);
+
+	const RingTable& ring = GetRingTable(sliceCount);
+	meshData.Vertices.resize(ringCount*ringVertexCount);
+
 	// Compute vertices for each stack ring starting at the bottom and moving up.
 	for(uint32 i = 0; i < ringCount; ++i)
 	{
 		float y = -0.5f*height + i*stackHeight;
 		float r = bottomRadius + i*radiusStep;
 
-		// vertices of ring
-		float dTheta = 2.0f*XM_PI/sliceCount;
-		for(uint32 j = 0; j <= sliceCount; ++j)
-		{
-			Vertex vertex;
-
-			float c = cosf(j*dTheta);
-			float s = sinf(j*dTheta);
-
-			vertex.Position = XMFLOAT3(r*c, y, r*s);
-
-			vertex.TexC.x = (float)j/sliceCount;
-			vertex.TexC.y = 1.0f - (float)i/stackCount;
-
-			// Cylinder can be parameterized as follows, where we introduce v
-			// parameter that goes in the same direction as the v tex-coord
-			// so that the bitangent goes in the same direction as the v tex-coord.
-			//   Let r0 be the bottom radius and let r1 be the top radius.
-			//   y(v) = h - hv for v in [0,1].
-			//   r(v) = r1 + (r0-r1)v
-			//
-			//   x(t, v) = r(v)*cos(t)
-			//   y(t, v) = h - hv
-			//   z(t, v) = r(v)*sin(t)
-			// 
-			//  dx/dt = -r(v)*sin(t)
-			//  dy/dt = 0
-			//  dz/dt = +r(v)*cos(t)
-			//
-			//  dx/dv = (r0-r1)*cos(t)
-			//  dy/dv = -h
-			//  dz/dv = (r0-r1)*sin(t)
-
-			// This is unit length.
-			vertex.TangentU = XMFLOAT3(-s, 0.0f, c);
-
-			float dr = bottomRadius-topRadius;
-			XMFLOAT3 bitangent(dr*c, -height, dr*s);
-
-			XMVECTOR T = XMLoadFloat3(&vertex.TangentU);
-			XMVECTOR B = XMLoadFloat3(&bitangent);
-			XMVECTOR N = XMVector3Normalize(XMVector3Cross(T, B));
-			XMStoreFloat3(&vertex.Normal, N);
-
-			meshData.Vertices.push_back(vertex);
-		}
+		EmitRing(ring, sliceCount, r, y, height*invLength, dr*invLength, 1.0f, 1.0f - (float)i/stackCount,
+			&meshData.Vertices[i*ringVertexCount]);
 	}
 
-	// Add one because we duplicate the first and last vertex per ring
-	// since the texture coordinates are different.
-	uint32 ringVertexCount = sliceCount+1;
-
 	// Compute indices for each stack.
 	for(uint32 i = 0; i < stackCount; ++i)
 	{
@@ -1057,40 +1125,25 @@ GeometryGenerator::MeshData GeometryGenerator::CreateDiamond(float midRadius, fl
 
 	uint32 ringCount = stackCount +1;
 
+	// Add one because we duplicate the first and last vertex per ring
+	// since the texture coordinates are different.
+	uint32 ringVertexCount = sliceCount + 1;
+
+	const RingTable& ring = GetRingTable(sliceCount);
+	meshData.Vertices.resize(2 * ringCount * ringVertexCount);
+
+	// Normals follow the cylinder derivation, see CreateCylinder.
+	float bottomInvLength = InvLength(bottomHeight, -midRadius);
+	float topInvLength = InvLength(topHeight, midRadius - topRadius);
+
 	//for middle and bottom
 	for (uint32 i = 0; i < ringCount; ++i)
 	{
 		float y = -h + i * bottomHeight ;
 		float r = 0.0f + i * midRadius;
 
-		// vertices of ring
-		float dTheta = 2.0f * XM_PI / sliceCount;
-		for (uint32 j = 0; j <= sliceCount; ++j)
-		{
-			Vertex vertex;
-
-			float c = cosf(j * dTheta);
-			float s = sinf(j * dTheta);
-
-			vertex.Position = XMFLOAT3(r * c, y, r * s);
-
-			vertex.TexC.x = (float)j / sliceCount;
-			vertex.TexC.y = 1.0f - (float)i / stackCount;
-
-
-			// This is unit length.
-			vertex.TangentU = XMFLOAT3(-s, 0.0f, c);
-
-			float dr = -midRadius;
-			XMFLOAT3 bitangent(dr * c, -bottomHeight, dr * s);
-
-			XMVECTOR T = XMLoadFloat3(&vertex.TangentU);
-			XMVECTOR B = XMLoadFloat3(&bitangent);
-			XMVECTOR N = XMVector3Normalize(XMVector3Cross(T, B));
-			XMStoreFloat3(&vertex.Normal, N);
-
-			meshData.Vertices.push_back(vertex);
-		}
+		EmitRing(ring, sliceCount, r, y, bottomHeight * bottomInvLength, -midRadius * bottomInvLength, 1.0f,
+			1.0f - (float)i / stackCount, &meshData.Vertices[i * ringVertexCount]);
 	}
 	// Compute vertices for middle ring, then top.
 	for (uint32 i = 0; i < ringCount; ++i)
@@ -1098,41 +1151,10 @@ GeometryGenerator::MeshData GeometryGenerator::CreateDiamond(float midRadius, fl
 		float y = -h + bottomHeight + i * topHeight;
 		float r = midRadius + i * radiusStep;
 
-		// vertices of ring
-		float dTheta = 2.0f * XM_PI / sliceCount;
-		for (uint32 j = 0; j <= sliceCount; ++j)
-		{
-			Vertex vertex;
-
-			float c = cosf(j * dTheta);
-			float s = sinf(j * dTheta);
-
-			vertex.Position = XMFLOAT3(r * c, y, r * s);
-
-			vertex.TexC.x = (float)(j) / sliceCount;
-			vertex.TexC.y = 1.0f - (float)i / stackCount;
-
-
-			// This is unit length.
-			vertex.TangentU = XMFLOAT3(-s, 0.0f, c);
-
-			float dr = midRadius - topRadius;
-			XMFLOAT3 bitangent(dr * c, -topHeight, dr * s);
-
-			XMVECTOR T = XMLoadFloat3(&vertex.TangentU);
-			XMVECTOR B = XMLoadFloat3(&bitangent);
-			XMVECTOR N = XMVector3Normalize(XMVector3Cross(T, B));
-			XMStoreFloat3(&vertex.Normal, N);
-
-			meshData.Vertices.push_back(vertex);
-		}
+		EmitRing(ring, sliceCount, r, y, topHeight * topInvLength, (midRadius - topRadius) * topInvLength, 1.0f,
+			1.0f - (float)i / stackCount, &meshData.Vertices[(ringCount + i) * ringVertexCount]);
 	}
 
-
-	// Add one because we duplicate the first and last vertex per ring
-	// since the texture coordinates are different.
-	uint32 ringVertexCount = sliceCount + 1;
-
 	// Compute indices for each stack.
 	for (uint32 i = 0; i < 3; ++i)
 	{
@@ -1160,21 +1182,12 @@ void GeometryGenerator::BuildCylinderTopCap(float bottomRadius, float topRadius,
 	uint32 baseIndex = (uint32)meshData.Vertices.size();
 
 	float y = 0.5f*height;
-	float dTheta = 2.0f*XM_PI/sliceCount;
 
 	// Duplicate cap ring vertices because the texture coordinates and normals differ.
-	for(uint32 i = 0; i <= sliceCount; ++i)
-	{
-		float x = topRadius*cosf(i*dTheta);
-		float z = topRadius*sinf(i*dTheta);
-
-		// Scale down by the height to try and make top cap texture coord area
-		// proportional to base.
-		float u = x/height + 0.5f;
-		float v = z/height + 0.5f;
-
-		meshData.Vertices.push_back( Vertex(x, y, z, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v) );
-	}
+	// Texture coordinates are scaled down by the height to try and make top cap
+	// texture coord area proportional to base.
+	meshData.Vertices.resize(baseIndex + sliceCount + 1);
+	EmitCapRing(GetRingTable(sliceCount), sliceCount, topRadius, y, 1.0f, height, &meshData.Vertices[baseIndex]);
 
 	// Cap center vertex.
 	meshData.Vertices.push_back( Vertex(0.0f, y, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f) );
@@ -1201,19 +1214,8 @@ void GeometryGenerator::BuildCylinderBottomCap(float bottomRadius, float topRadi
 	float y = -0.5f*height;
 
 	// vertices of ring
-	float dTheta = 2.0f*XM_PI/sliceCount;
-	for(uint32 i = 0; i <= sliceCount; ++i)
-	{
-		float x = bottomRadius*cosf(i*dTheta);
-		float z = bottomRadius*sinf(i*dTheta);
-
-		// Scale down by the height to try and make top cap texture coord area
-		// proportional to base.
-		float u = x/height + 0.5f;
-		float v = z/height + 0.5f;
-
-		meshData.Vertices.push_back( Vertex(x, y, z, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v) );
-	}
+	meshData.Vertices.resize(baseIndex + sliceCount + 1);
+	EmitCapRing(GetRingTable(sliceCount), sliceCount, bottomRadius, y, -1.0f, height, &meshData.Vertices[baseIndex]);
 
 	// Cap center vertex.
 	meshData.Vertices.push_back( Vertex(0.0f, y, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f) );
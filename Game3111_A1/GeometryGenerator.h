@@ -14,6 +14,7 @@
 
 #pragma once
 
+#include <cassert>
 #include <cstdint>
 #include <DirectXMath.h>
 #include <vector>
@@ -53,13 +54,26 @@ public:
         DirectX::XMFLOAT2 TexC;
 	};
 
+	// Largest vertex count a mesh can have and still be drawn with 16-bit indices.
+	static const uint32 MaxVertices16 = 65536;
+
 	struct MeshData
 	{
 		std::vector<Vertex> Vertices;
         std::vector<uint32> Indices32;
 
+		// True if every index can be stored in 16 bits without truncation.
+		bool FitsIndices16()const
+		{
+			return Vertices.size() <= MaxVertices16;
+		}
+
+		// Only valid when FitsIndices16() holds; use SplitForIndices16 first
+		// for larger meshes.
         std::vector<uint16>& GetIndices16()
         {
+			assert(FitsIndices16());
+
 			if(mIndices16.empty())
 			{
 				mIndices16.resize(Indices32.size());
@@ -74,6 +88,88 @@ public:
 		std::vector<uint16> mIndices16;
 	};
 
+	enum class ShapeType : uint32
+	{
+		Box,
+		Sphere,
+		Geosphere,
+		Torus,
+		Cone,
+		Wedge,
+		Cylinder,
+		Diamond,
+		Grid,
+		TriangularPrism,
+		Pyramid
+	};
+
+	///<summary>
+	/// Plain description of a single generator call.  Params holds the float
+	/// arguments and Counts the integer arguments, both in the order the matching
+	/// Create* function takes them.  Being plain data, a ShapeDesc can be hashed
+	/// to key the on-disk geometry cache.
+	///</summary>
+	struct ShapeDesc
+	{
+		ShapeType Type = ShapeType::Box;
+		float Params[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		uint32 Counts[2] = { 0, 0 };
+	};
+
+	///<summary>
+	/// Dispatches to the Create* function described by desc.
+	///</summary>
+	MeshData CreateShape(const ShapeDesc& desc);
+
+	///<summary>
+	/// Vertex of a fixed low-poly shape in unit space (a 1x1x1 bounding box
+	/// centered at the origin).  Normals are stored unnormalized; they are
+	/// rescaled and normalized when the shape is emitted at a given size.
+	///</summary>
+	struct UnitVertex
+	{
+		float Position[3];
+		float Normal[3];
+		float TangentU[3];
+		float TexC[2];
+	};
+
+	///<summary>
+	/// View of one of the compile-time unit shape tables.  The tables are static
+	/// arrays, so reading them never allocates.
+	///</summary>
+	struct UnitShape
+	{
+		const UnitVertex* Vertices;
+		uint32 VertexCount;
+		const uint16* Indices;
+		uint32 IndexCount;
+	};
+
+	// Upper bound on UnitShape::VertexCount, for stack-sized emit buffers.
+	static const uint32 MaxUnitShapeVertices = 24;
+
+	///<summary>
+	/// Returns the unit table for Box, TriangularPrism, Pyramid or Wedge, or
+	/// nullptr for shapes that depend on tessellation counts.
+	///</summary>
+	static const UnitShape* GetUnitShape(ShapeType type);
+
+	///<summary>
+	/// Writes shape.VertexCount vertices scaled to width x height x depth into
+	/// vertices.  Does not allocate; the indices can be read straight from
+	/// shape.Indices.
+	///</summary>
+	static void EmitUnitShape(const UnitShape& shape, float width, float height, float depth, Vertex* vertices);
+
+	///<summary>
+	/// Splits a triangle list into batches that each reference at most
+	/// MaxVertices16 vertices, so every batch can use 16-bit indices.  Vertices
+	/// shared across a batch boundary are duplicated.  A mesh that already fits
+	/// is returned as a single batch.
+	///</summary>
+	std::vector<MeshData> SplitForIndices16(const MeshData& meshData);
+
 	///<summary>
 	/// Creates a box centered at the origin with the given dimensions, where each
     /// face has m rows and n columns of vertices.
@@ -141,7 +237,7 @@ public:
 	MeshData CreatePyramid(float baseWidth, float height, float depth);
 
 private:
-	DirectX::XMFLOAT3 getNormal(DirectX::XMFLOAT3 p0, DirectX::XMFLOAT3 p1, DirectX::XMFLOAT3 p2);
+	MeshData CreateUnitShape(ShapeType type, float width, float height, float depth);
 
     Vertex MidPoint(const Vertex& v0, const Vertex& v1);
     void BuildCylinderTopCap(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, MeshData& meshData);
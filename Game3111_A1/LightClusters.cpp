@@ -0,0 +1,245 @@
+//***************************************************************************************
+// LightClusters.cpp
+//***************************************************************************************
+
+#include "LightClusters.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+
+LightClusters::LightClusters(std::uint32_t maxLightIndices)
+	: mMaxIndices(maxLightIndices)
+{
+	static_assert(TileCountX % 4 == 0, "clusters are tested four at a time along x");
+
+	const size_t blocks = ClusterCount / 4;
+	mMinX.resize(blocks);
+	mMinY.resize(blocks);
+	mMinZ.resize(blocks);
+	mMaxX.resize(blocks);
+	mMaxY.resize(blocks);
+	mMaxZ.resize(blocks);
+	mClusters.resize(ClusterCount);
+
+	SetProjection(XMMatrixPerspectiveFovLH(XM_PIDIV4, 1.0f, mNearZ, mFarZ), mNearZ, mFarZ);
+}
+
+void LightClusters::SetProjection(FXMMATRIX proj, float nearZ, float farZ)
+{
+	XMFLOAT4X4 p;
+	XMStoreFloat4x4(&p, proj);
+	mProjX = p._11;
+	mProjY = p._22;
+	mNearZ = nearZ;
+	mFarZ = farZ;
+
+	const float logRatio = logf(farZ / nearZ);
+	mDepthScale = SliceCount / logRatio;
+	mDepthBias = -(float)SliceCount * logf(nearZ) / logRatio;
+
+	for(std::uint32_t z = 0; z < SliceCount; ++z)
+	{
+		const float zNear = nearZ * powf(farZ / nearZ, (float)z / SliceCount);
+		const float zFar = nearZ * powf(farZ / nearZ, (float)(z + 1) / SliceCount);
+
+		for(std::uint32_t y = 0; y < TileCountY; ++y)
+		{
+			// NDC y runs up, tiles are counted down from the top.
+			const float ndcTop = 1.0f - 2.0f * y / TileCountY;
+			const float ndcBottom = 1.0f - 2.0f * (y + 1) / TileCountY;
+
+			for(std::uint32_t x = 0; x < TileCountX; ++x)
+			{
+				const float ndcLeft = 2.0f * x / TileCountX - 1.0f;
+				const float ndcRight = 2.0f * (x + 1) / TileCountX - 1.0f;
+
+				// The tile's side planes pass through the eye, so its extremes
+				// lie on the near or the far face of the slice.
+				const std::uint32_t c = (z * TileCountY + y) * TileCountX + x;
+				float* minX = &mMinX[c >> 2].x;
+				float* minY = &mMinY[c >> 2].x;
+				float* minZ = &mMinZ[c >> 2].x;
+				float* maxX = &mMaxX[c >> 2].x;
+				float* maxY = &mMaxY[c >> 2].x;
+				float* maxZ = &mMaxZ[c >> 2].x;
+				minX[c & 3] = std::min<float>(ndcLeft * zNear, ndcLeft * zFar) / mProjX;
+				maxX[c & 3] = std::max<float>(ndcRight * zNear, ndcRight * zFar) / mProjX;
+				minY[c & 3] = std::min<float>(ndcBottom * zNear, ndcBottom * zFar) / mProjY;
+				maxY[c & 3] = std::max<float>(ndcTop * zNear, ndcTop * zFar) / mProjY;
+				minZ[c & 3] = zNear;
+				maxZ[c & 3] = zFar;
+			}
+		}
+	}
+}
+
+std::uint32_t LightClusters::SliceOf(float z)const
+{
+	const float slice = floorf(logf(std::max<float>(z, mNearZ)) * mDepthScale + mDepthBias);
+	return (std::uint32_t)std::min<float>(std::max<float>(slice, 0.0f), SliceCount - 1.0f);
+}
+
+void LightClusters::Assign(const ClusterLight* lights, std::uint32_t lightCount, FXMMATRIX view)
+{
+	mEntries.clear();
+	for(std::uint32_t i = 0; i < lightCount; ++i)
+		AssignLight(i, lights[i], view);
+
+	// Counting sort of the pairs by cluster.  Lights were visited in order, so
+	// every list comes out in ascending light order.
+	for(LightCluster& cluster : mClusters)
+		cluster.Count = 0;
+	for(const Entry& entry : mEntries)
+		++mClusters[entry.Cluster].Count;
+
+	std::uint32_t offset = 0;
+	for(LightCluster& cluster : mClusters)
+	{
+		cluster.Offset = offset;
+		cluster.Count = std::min<std::uint32_t>(cluster.Count, mMaxIndices - offset);
+		offset += cluster.Count;
+	}
+	mDroppedCount = (std::uint32_t)mEntries.size() - offset;
+
+	mIndices.resize(offset);
+	mFilled.assign(ClusterCount, 0);
+	for(const Entry& entry : mEntries)
+	{
+		const LightCluster& cluster = mClusters[entry.Cluster];
+		std::uint32_t& filled = mFilled[entry.Cluster];
+		if(filled < cluster.Count)
+			mIndices[cluster.Offset + filled++] = entry.Light;
+	}
+}
+
+void LightClusters::AssignLight(std::uint32_t index, const ClusterLight& light, FXMMATRIX view)
+{
+	XMFLOAT3 center;
+	XMStoreFloat3(&center, XMVector3TransformCoord(XMLoadFloat3(&light.Position), view));
+	const float range = light.Range;
+
+	// Depth range of the bounding sphere, clipped to the frustum.
+	const float zMin = std::max<float>(center.z - range, mNearZ);
+	const float zMax = std::min<float>(center.z + range, mFarZ);
+	if(range <= 0.0f || zMin > zMax)
+		return;
+
+	// Screen range: x / z over the sphere's box is extreme at its nearest or
+	// farthest depth.
+	const float x0 = center.x - range, x1 = center.x + range;
+	const float y0 = center.y - range, y1 = center.y + range;
+	const float ndcLeft = std::min<float>(x0 / zMin, x0 / zMax) * mProjX;
+	const float ndcRight = std::max<float>(x1 / zMin, x1 / zMax) * mProjX;
+	const float ndcBottom = std::min<float>(y0 / zMin, y0 / zMax) * mProjY;
+	const float ndcTop = std::max<float>(y1 / zMin, y1 / zMax) * mProjY;
+	if(ndcLeft > 1.0f || ndcRight < -1.0f || ndcBottom > 1.0f || ndcTop < -1.0f)
+		return;
+
+	auto tile = [](float t, std::uint32_t count)
+	{
+		return (std::uint32_t)std::min<float>(std::max<float>(floorf(t * count), 0.0f), count - 1.0f);
+	};
+	const std::uint32_t firstX = tile(ndcLeft * 0.5f + 0.5f, TileCountX);
+	const std::uint32_t lastX = tile(ndcRight * 0.5f + 0.5f, TileCountX);
+	const std::uint32_t firstY = tile(0.5f - ndcTop * 0.5f, TileCountY);
+	const std::uint32_t lastY = tile(0.5f - ndcBottom * 0.5f, TileCountY);
+	const std::uint32_t firstZ = SliceOf(zMin);
+	const std::uint32_t lastZ = SliceOf(zMax);
+
+	const XMVECTOR cx = XMVectorReplicate(center.x);
+	const XMVECTOR cy = XMVectorReplicate(center.y);
+	const XMVECTOR cz = XMVectorReplicate(center.z);
+	const XMVECTOR rangeSq = XMVectorReplicate(range * range);
+	const XMVECTOR zero = XMVectorZero();
+	const XMVECTOR half = XMVectorReplicate(0.5f);
+
+	// Spot lights also test the bounding sphere of each cluster against the
+	// cone.  Cones wider than a hemisphere are treated as one: the spot falloff
+	// never lights the back half anyway.
+	const bool spot = light.ConeAngle > 0.0f;
+	XMVECTOR dx = zero, dy = zero, dz = zero, coneCos = zero, coneSin = zero;
+	if(spot)
+	{
+		XMFLOAT3 dir;
+		XMStoreFloat3(&dir, XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&light.Direction), view)));
+		dx = XMVectorReplicate(dir.x);
+		dy = XMVectorReplicate(dir.y);
+		dz = XMVectorReplicate(dir.z);
+
+		const float angle = std::min<float>(light.ConeAngle, XM_PIDIV2);
+		coneCos = XMVectorReplicate(cosf(angle));
+		coneSin = XMVectorReplicate(sinf(angle));
+	}
+	const XMVECTOR rangeV = XMVectorReplicate(range);
+
+	for(std::uint32_t z = firstZ; z <= lastZ; ++z)
+	{
+		for(std::uint32_t y = firstY; y <= lastY; ++y)
+		{
+			const std::uint32_t row = (z * TileCountY + y) * TileCountX;
+			for(std::uint32_t x = firstX & ~3u; x <= lastX; x += 4)
+			{
+				const std::uint32_t block = (row + x) >> 2;
+				const XMVECTOR minX = XMLoadFloat4A(&mMinX[block]);
+				const XMVECTOR minY = XMLoadFloat4A(&mMinY[block]);
+				const XMVECTOR minZ = XMLoadFloat4A(&mMinZ[block]);
+				const XMVECTOR maxX = XMLoadFloat4A(&mMaxX[block]);
+				const XMVECTOR maxY = XMLoadFloat4A(&mMaxY[block]);
+				const XMVECTOR maxZ = XMLoadFloat4A(&mMaxZ[block]);
+
+				// Squared distance from the light to each box.
+				XMVECTOR ex = XMVectorMax(XMVectorMax(XMVectorSubtract(minX, cx), XMVectorSubtract(cx, maxX)), zero);
+				XMVECTOR ey = XMVectorMax(XMVectorMax(XMVectorSubtract(minY, cy), XMVectorSubtract(cy, maxY)), zero);
+				XMVECTOR ez = XMVectorMax(XMVectorMax(XMVectorSubtract(minZ, cz), XMVectorSubtract(cz, maxZ)), zero);
+				XMVECTOR distSq = XMVectorMultiply(ex, ex);
+				distSq = XMVectorMultiplyAdd(ey, ey, distSq);
+				distSq = XMVectorMultiplyAdd(ez, ez, distSq);
+				XMVECTOR hit = XMVectorLessOrEqual(distSq, rangeSq);
+
+				if(spot)
+				{
+					// Sphere around the box against the cone: the sphere misses
+					// when it lies beyond the cone's side, past its range or
+					// behind its apex.
+					XMVECTOR sx = XMVectorSubtract(XMVectorMultiply(XMVectorAdd(minX, maxX), half), cx);
+					XMVECTOR sy = XMVectorSubtract(XMVectorMultiply(XMVectorAdd(minY, maxY), half), cy);
+					XMVECTOR sz = XMVectorSubtract(XMVectorMultiply(XMVectorAdd(minZ, maxZ), half), cz);
+					XMVECTOR hx = XMVectorMultiply(XMVectorSubtract(maxX, minX), half);
+					XMVECTOR hy = XMVectorMultiply(XMVectorSubtract(maxY, minY), half);
+					XMVECTOR hz = XMVectorMultiply(XMVectorSubtract(maxZ, minZ), half);
+
+					XMVECTOR radius = XMVectorMultiply(hx, hx);
+					radius = XMVectorMultiplyAdd(hy, hy, radius);
+					radius = XMVectorSqrt(XMVectorMultiplyAdd(hz, hz, radius));
+
+					XMVECTOR lengthSq = XMVectorMultiply(sx, sx);
+					lengthSq = XMVectorMultiplyAdd(sy, sy, lengthSq);
+					lengthSq = XMVectorMultiplyAdd(sz, sz, lengthSq);
+
+					XMVECTOR along = XMVectorMultiply(sx, dx);
+					along = XMVectorMultiplyAdd(sy, dy, along);
+					along = XMVectorMultiplyAdd(sz, dz, along);
+
+					XMVECTOR across = XMVectorSqrt(XMVectorMax(XMVectorNegativeMultiplySubtract(along, along, lengthSq), zero));
+					XMVECTOR sideDist = XMVectorNegativeMultiplySubtract(along, coneSin, XMVectorMultiply(coneCos, across));
+
+					XMVECTOR miss = XMVectorGreater(sideDist, radius);
+					miss = XMVectorOrInt(miss, XMVectorGreater(along, XMVectorAdd(radius, rangeV)));
+					miss = XMVectorOrInt(miss, XMVectorLess(along, XMVectorNegate(radius)));
+					hit = XMVectorAndCInt(hit, miss);
+				}
+
+				XMUINT4 mask;
+				XMStoreUInt4(&mask, hit);
+				const std::uint32_t* laneHit = &mask.x;
+				for(std::uint32_t lane = 0; lane < 4; ++lane)
+				{
+					if(laneHit[lane] != 0 && x + lane >= firstX && x + lane <= lastX)
+						mEntries.push_back({ row + x + lane, index });
+				}
+			}
+		}
+	}
+}
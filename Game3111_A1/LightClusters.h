@@ -0,0 +1,118 @@
+//***************************************************************************************
+// LightClusters.h
+//
+// Clustered light assignment.  The view frustum is cut into a grid of froxels:
+// TileCountX by TileCountY screen tiles, each split into SliceCount depth
+// slices spaced exponentially between the near and far planes.  Every frame
+// the point and spot lights are tested against the view-space bounds of the
+// clusters they can reach, and each cluster gets a compact list of the lights
+// touching it.  The pixel shader finds its cluster from its screen position
+// and view depth and only evaluates that list, so shading cost follows the
+// local light density instead of the total number of lights.
+//
+// Each light only visits the clusters under the screen and depth range of its
+// bounding sphere, and those are tested four at a time, so assignment cost
+// follows the screen area the lights cover.
+//***************************************************************************************
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+
+// Point or spot light as seen by the clustering, in world space.
+struct ClusterLight
+{
+	DirectX::XMFLOAT3 Position;
+	float Range;                 // nothing is lit further away
+	DirectX::XMFLOAT3 Direction; // spot lights only, normalized
+	float ConeAngle;             // half angle of a spot light's cone in radians, 0 for point lights
+};
+
+// Lights of one cluster: LightIndices()[Offset, Offset + Count).  Same layout
+// as the uint2 the shaders read.
+struct LightCluster
+{
+	std::uint32_t Offset;
+	std::uint32_t Count;
+};
+
+class LightClusters
+{
+public:
+	// TileCountX must be a multiple of 4, clusters are tested four at a time along x.
+	static const std::uint32_t TileCountX = 16;
+	static const std::uint32_t TileCountY = 9;
+	static const std::uint32_t SliceCount = 24;
+	static const std::uint32_t ClusterCount = TileCountX * TileCountY * SliceCount;
+
+	// maxLightIndices bounds the total length of the cluster lists.
+	explicit LightClusters(std::uint32_t maxLightIndices = 32768);
+	LightClusters(const LightClusters& rhs) = delete;
+	LightClusters& operator=(const LightClusters& rhs) = delete;
+
+	///<summary>
+	/// Fits the clusters to a left-handed perspective projection such as
+	/// XMMatrixPerspectiveFovLH(..., nearZ, farZ).  Call whenever the lens
+	/// changes.
+	///</summary>
+	void SetProjection(DirectX::FXMMATRIX proj, float nearZ, float farZ);
+
+	///<summary>
+	/// Rebuilds the cluster lists for lights seen through view.  Light indices
+	/// refer to the lights array.  Lists that do not fit in MaxLightIndices are
+	/// cut short; DroppedCount tells how many entries were lost.
+	///</summary>
+	void Assign(const ClusterLight* lights, std::uint32_t lightCount, DirectX::FXMMATRIX view);
+
+	// Cluster of tile (x, y), counted from the top left, and slice z is
+	// Clusters()[(z * TileCountY + y) * TileCountX + x].
+	const LightCluster* Clusters()const { return mClusters.data(); }
+
+	const std::uint32_t* LightIndices()const { return mIndices.data(); }
+	std::uint32_t LightIndexCount()const { return (std::uint32_t)mIndices.size(); }
+	std::uint32_t MaxLightIndices()const { return mMaxIndices; }
+	std::uint32_t DroppedCount()const { return mDroppedCount; }
+
+	// The slice of view depth z is floor(log(z) * DepthScale() + DepthBias()).
+	float DepthScale()const { return mDepthScale; }
+	float DepthBias()const { return mDepthBias; }
+
+private:
+	void AssignLight(std::uint32_t index, const ClusterLight& light, DirectX::FXMMATRIX view);
+	std::uint32_t SliceOf(float z)const;
+
+private:
+	struct Entry
+	{
+		std::uint32_t Cluster;
+		std::uint32_t Light;
+	};
+
+	std::uint32_t mMaxIndices;
+
+	// Projection terms: x and y scale of the view-to-NDC mapping.
+	float mProjX = 1.0f;
+	float mProjY = 1.0f;
+	float mNearZ = 1.0f;
+	float mFarZ = 100.0f;
+	float mDepthScale = 0.0f;
+	float mDepthBias = 0.0f;
+
+	// View-space AABBs of the clusters, four clusters along x per element:
+	// cluster c is lane c % 4 of element c / 4.
+	std::vector<DirectX::XMFLOAT4A> mMinX;
+	std::vector<DirectX::XMFLOAT4A> mMinY;
+	std::vector<DirectX::XMFLOAT4A> mMinZ;
+	std::vector<DirectX::XMFLOAT4A> mMaxX;
+	std::vector<DirectX::XMFLOAT4A> mMaxY;
+	std::vector<DirectX::XMFLOAT4A> mMaxZ;
+
+	// Per frame: the (cluster, light) pairs found, then the lists built from them.
+	std::vector<Entry> mEntries;
+	std::vector<LightCluster> mClusters;
+	std::vector<std::uint32_t> mIndices;
+	std::vector<std::uint32_t> mFilled;
+	std::uint32_t mDroppedCount = 0;
+};
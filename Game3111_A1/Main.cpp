@@ -11,6 +11,21 @@
 #include "GeometryGenerator.h"
 #include "Camera.h"
 #include "FrameResource.h"
+#include "GeometryCache.h"
+#include "CollisionBVH.h"
+#include "RadixSort.h"
+#include "RenderItemStore.h"
+#include "SceneFile.h"
+#include "NameRegistry.h"
+#include "DrawPartition.h"
+#include "WorkerPool.h"
+#include "OcclusionBuffer.h"
+#include "TransformHierarchy.h"
+#include "StaticBatch.h"
+#include "VegetationScatter.h"
+#include "LightClusters.h"
+#include "ObjectConstantBuilder.h"
+#include "UploadRing.h"
 
 
 using Microsoft::WRL::ComPtr;
@@ -33,27 +48,33 @@ enum class RenderLayer : int
 	Count
 };
 
+// Names the scene file uses for each RenderLayer, in enum order.
+const char* const RenderLayerNames[(int)RenderLayer::Count] =
+{
+	"opaque",
+	"transparent",
+	"alphaTested",
+	"treeSprites"
+};
+
 // Lightweight structure stores parameters to draw a shape.  This will
 // vary from app-to-app.
 struct RenderItem
 {
 	RenderItem() = default;
 	RenderItem(const RenderItem& rhs) = delete;
-    // World matrix of the shape that describes the object's local space
-    // relative to the world space, which defines the position, orientation,
-    // and scale of the object in the world.
-    XMFLOAT4X4 World = MathHelper::Identity4x4();
+    // The world matrix, world bounds, dirty counter and last written object
+    // constants live in ShapesApp::mRitemStore at this index.
+    RenderItemStore::Handle StoreHandle = RenderItemStore::InvalidHandle;
+
+	// Leaf of ShapesApp::mTransforms holding the item's transform relative to
+	// its scene node.  Move the item with mTransforms.SetLocal.
+	TransformHierarchy::Node Transform = TransformHierarchy::NoNode;
 
     XMFLOAT4X4 TWorld = MathHelper::Identity4x4();
 
     XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
 
-	// Dirty flag indicating the object data has changed and we need to update the constant buffer.
-	// Because we have an object cbuffer for each FrameResource, we have to apply the
-	// update to each FrameResource.  Thus, when we modify obect data we should set 
-	// NumFramesDirty = gNumFrameResources so that each frame resource gets the update.
-	int NumFramesDirty = gNumFrameResources;
-
 	// Index into GPU constant buffer corresponding to the ObjectCB for this render item.
 	UINT ObjCBIndex = -1;
 
@@ -63,17 +84,177 @@ struct RenderItem
     // Primitive topology.
     D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 
-	std::vector<ObjectConstants> Instances;
-	
+	// Index into ShapesApp::mInstanceGroups when the item is drawn instanced
+	// with others sharing its geometry and material, -1 otherwise.
+	int InstanceGroupIndex = -1;
+
+	// State bits of the draw sort key (layer, geometry, topology, texture,
+	// material), see BuildSortKeys.  The depth bits are added every frame.
+	std::uint64_t SortKey = 0;
+
     // DrawIndexedInstanced parameters.
     UINT IndexCount = 0;
     UINT StartIndexLocation = 0;
     int BaseVertexLocation = 0;
-	BoundingBox bounds;
+
+	// Split submeshes draw Geo->Batches[FirstBatch...] instead of the range above.
+	UINT FirstBatch = 0;
+	UINT BatchCount = 0;
+};
+
+// Render items sharing geometry, submesh and material, drawn with a single
+// DrawIndexedInstanced call.  Each member keeps its own RenderItem for culling
+// and collision; only the draw is shared.
+struct InstanceGroup
+{
+	// Member whose geometry, material and topology the draw uses.
+	RenderItem* Prototype = nullptr;
+
+	// Members that survived culling this frame and where their constants start
+	// in the frame's instance data.
+	std::vector<RenderItem*> Visible;
+	UINT FirstInstance = 0;
+};
+
+// Box rasterized into the OcclusionBuffer: the model-space bounds of an item
+// marked occluder in the scene, placed by a node of ShapesApp::mTransforms.
+// Kept apart from the render items because static ones are merged into
+// batches whose bounds no longer lie inside the walls.
+struct OccluderBox
+{
+	BoundingBox Bounds;
+	TransformHierarchy::Node Transform = TransformHierarchy::NoNode;
+};
+
+// Static items of one material under one transform node, which
+// BuildStaticBatches merges together.
+struct StaticBatchGroup
+{
+	Material* Mat = nullptr;
+	TransformHierarchy::Node Node = TransformHierarchy::NoNode;
+};
+
+// Draw sort key layout, most significant bits first:
+//   63..60  render layer
+//   59..52  geometry
+//   51..49  primitive topology
+//   48..37  diffuse texture (SRV heap index)
+//   36..24  material constant buffer index
+//   23..0   view depth, front to back
+// Sorting on it groups the draws by the state DrawRenderItems binds, and
+// within the same state draws the nearest items first.  There is no pipeline
+// state field: every layer is drawn with one PSO, so the layer stands in for it.
+namespace DrawSortKey
+{
+	const int LayerShift = 60;
+	const int GeometryShift = 52;
+	const int TopologyShift = 49;
+	const int TextureShift = 37;
+	const int MaterialShift = 24;
+	const std::uint64_t DepthMask = (1ull << 24) - 1;
+
+	// Number of values each state field holds.  LoadScene fails the load if
+	// the scene needs more.
+	const UINT LayerLimit = 1 << 4;
+	const UINT GeometryLimit = 1 << 8;
+	const UINT TextureLimit = 1 << 12;
+	const UINT MaterialLimit = 1 << 13;
+}
+
+static_assert((UINT)RenderLayer::Count <= DrawSortKey::LayerLimit, "render layers do not fit the sort key");
+
+// Command list state last bound by DrawRenderItems/DrawInstanceGroups, so
+// consecutive draws sharing it skip the redundant calls, together with how
+// many of each call were actually made this frame.
+struct DrawStateCache
+{
+	const MeshGeometry* Geo = nullptr;
+	D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+	int DiffuseSrvHeapIndex = -1;
+	int MatCBIndex = -1;
+
+	UINT DrawCalls = 0;
+	UINT PipelineChanges = 0;
+	UINT GeometryChanges = 0;
+	UINT TopologyChanges = 0;
+	UINT TextureChanges = 0;
+	UINT MaterialChanges = 0;
+	UINT ObjectChanges = 0;
+
+	// Adds the call counts of another command list's cache, for the frame totals.
+	void AddCounts(const DrawStateCache& other)
+	{
+		DrawCalls += other.DrawCalls;
+		PipelineChanges += other.PipelineChanges;
+		GeometryChanges += other.GeometryChanges;
+		TopologyChanges += other.TopologyChanges;
+		TextureChanges += other.TextureChanges;
+		MaterialChanges += other.MaterialChanges;
+		ObjectChanges += other.ObjectChanges;
+	}
+};
+
+// The runs of draws Draw records, in submission order.  Each is drawn with its
+// own PSO and is split across the recording command lists by PartitionDraws.
+enum class DrawSegment : int
+{
+	Opaque = 0,
+	InstanceGroups,
+	AlphaTested,
+	TreeSprites,
+	Transparent,
+	Count
+};
+
+// Visible list each non-instanced DrawSegment draws from.
+const RenderLayer DrawSegmentLayers[(int)DrawSegment::Count] =
+{
+	RenderLayer::Opaque,
+	RenderLayer::Opaque, // unused, instance groups have their own lists
+	RenderLayer::AlphaTested,
+	RenderLayer::AlphaTestedTreeSprites,
+	RenderLayer::Transparent,
+};
+
+// Command lists recorded in parallel per frame, the main thread's included,
+// and the fewest draws worth handing to another thread.  Below that the cost
+// of waking a worker and submitting one more list outweighs the recording.
+const UINT MaxRecordLists = 8;
+const UINT MinDrawsPerRecordList = 256;
+
+// Side of the xz grid the static batches are cut on, see StaticBatch.h.  Small
+// enough that culling still rejects most of the maze, large enough that the
+// static scenery comes down to a few draws per material.
+const float StaticBatchCellSize = 20.0f;
+
+class ShapesApp;
+
+// Records one of the frame's command lists as RecordDrawList directs it.  Used
+// from a WorkerPool thread: it only reads the frame's state and writes to its
+// own command list, allocator and statistics.
+class CommandListRecorder : public DrawListRecorder
+{
+public:
+	CommandListRecorder(ShapesApp& app, ID3D12GraphicsCommandList* cmdList,
+		ID3D12CommandAllocator* cmdListAlloc, DrawStateCache& state)
+		: mApp(app), mCmdList(cmdList), mCmdListAlloc(cmdListAlloc), mState(state) {}
+
+	void Begin(std::uint32_t segment, bool firstList)override;
+	void SetSegment(std::uint32_t segment)override;
+	void Draw(std::uint32_t segment, std::uint32_t first, std::uint32_t count)override;
+	void End(bool lastList)override;
+
+private:
+	ShapesApp& mApp;
+	ID3D12GraphicsCommandList* mCmdList;
+	ID3D12CommandAllocator* mCmdListAlloc;
+	DrawStateCache& mState;
 };
 
 class ShapesApp : public D3DApp
 {
+	friend class CommandListRecorder;
+
 public:
     ShapesApp(HINSTANCE hInstance);
     ShapesApp(const ShapesApp& rhs) = delete;
@@ -95,9 +276,18 @@ private:
 	void CollisionCheck(const XMVECTOR vc);
     void OnKeyboardInput(const GameTimer& gt);
 	void UpdateCamera(const GameTimer& gt);
+	void UpdateTransforms();
+	void CullRenderItems();
+	bool BuildOcclusionBuffer(const BoundingFrustum& worldFrustum);
     void AnimateMaterials(const GameTimer& gt);
 	void UpdateObjectCBs(const GameTimer& gt);
+	void UpdateInstanceData();
+	void UpdateTreeSprites();
+	void UpdateLightClusters();
+	void SortVisibleRitems();
+	void SortTransparentRitems();
     void UpdateMaterialCBs(const GameTimer& gt);
+	void UpdateLightCB();
 	void UpdateMainPassCB(const GameTimer& gt);
 
     void LoadTextures();
@@ -108,24 +298,35 @@ private:
     void BuildShadersAndInputLayout();
     void BuildShapeGeometry();
 	void BuildTreeSpritesGeometry();
+	void UploadGeometry(MeshGeometry& geo);
     void BuildPSOs();
     void BuildFrameResources();
-    void BuildMaterials();
-	void SetMazeWallCollision(RenderItem& Ritem, float xLen, float yLen, float zLen, float xPos, float yPos, float zPos);
-    void SetRenderItemInfo(RenderItem &Ritem, std::string itemType, XMMATRIX transform, std::string material, RenderLayer layer);
-    void BuildRenderItems();
-    void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
+	void BuildRecordLists();
+    bool LoadScene();
+	void BuildStaticBatches(const std::vector<StaticBatchSource>& sources, const std::vector<UINT8>& occluders,
+		const std::vector<StaticBatchGroup>& groups);
+	void BuildCollisionBVH();
+	void BuildInstanceGroups();
+	void BuildSortKeys();
+	void RecordCommandList(UINT listIndex);
+    void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, DrawStateCache& state, RenderItem* const* ritems, UINT count);
+	void DrawInstanceGroups(ID3D12GraphicsCommandList* cmdList, DrawStateCache& state, UINT firstGroup, UINT groupCount);
+	void SetPipelineState(ID3D12GraphicsCommandList* cmdList, DrawStateCache& state, NameHandle pso);
+	void UpdateWindowCaption();
  
     std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> GetStaticSamplers();
 
 	float GetHillsHeight(float x, float z)const;
 	XMFLOAT3 GetHillsNormal(float x, float z)const;
-	XMFLOAT3 GetTreePosition(float minX, float maxX, float minZ, float maxZ, float treeHeightOffset)const;
+	float GetGroundHeight(float x, float z)const;
 
 private:
 
     std::vector<std::unique_ptr<FrameResource>> mFrameResources;
     FrameResource* mCurrFrameResource = nullptr;
+
+	// Per-frame data of all frame resources, see UploadRing.
+	std::unique_ptr<UploadRing> mUploadRing;
     int mCurrFrameResourceIndex = 0;
 
     UINT mCbvSrvDescriptorSize = 0;
@@ -135,17 +336,48 @@ private:
 
 	ComPtr<ID3D12DescriptorHeap> mSrvDescriptorHeap = nullptr;
 
-	std::unordered_map<std::string, std::unique_ptr<MeshGeometry>> mGeometries;
-	std::unordered_map<std::string, std::unique_ptr<Material>> mMaterials;
-	std::unordered_map<std::string, std::unique_ptr<Texture>> mTextures;
-	std::unordered_map<std::string, ComPtr<ID3DBlob>> mShaders;
-    std::unordered_map<std::string, ComPtr<ID3D12PipelineState>> mPSOs;
+	// Looked up by name only while loading; per-frame code uses the handles below.
+	NameRegistry<std::unique_ptr<MeshGeometry>> mGeometries;
+	NameRegistry<std::unique_ptr<Material>> mMaterials;
+	NameRegistry<std::unique_ptr<Texture>> mTextures;
+	NameRegistry<ComPtr<ID3DBlob>> mShaders;
+	NameRegistry<ComPtr<ID3D12PipelineState>> mPSOs;
+
+	// PSOs bound by Draw, resolved in BuildPSOs.
+	NameHandle mOpaquePSO = InvalidNameHandle;
+	NameHandle mOpaqueInstancedPSO = InvalidNameHandle;
+	NameHandle mTransparentPSO = InvalidNameHandle;
+	NameHandle mAlphaTestedPSO = InvalidNameHandle;
+	NameHandle mTreeSpritesPSO = InvalidNameHandle;
+
+	// PSO of each DrawSegment, resolved in BuildPSOs.
+	NameHandle mSegmentPSOs[(int)DrawSegment::Count];
+
+	// Material scrolled by AnimateMaterials, resolved in LoadScene.
+	NameHandle mWaterMat = InvalidNameHandle;
+
+	// Materials, by handle, whose constants still have to reach each frame
+	// resource's MaterialCB.  Mark a material after changing its fields.
+	ChangeTracker mMaterialChanges;
 
 	std::vector<D3D12_INPUT_ELEMENT_DESC> mStdInputLayout;
 	std::vector<D3D12_INPUT_ELEMENT_DESC> mTreeSpriteInputLayout;
 
 	RenderItem* mWavesRitem = nullptr;
 
+	// Scattered trees, stored chunk by chunk in mTreeSpritesGeo with one
+	// Batches entry per mTreeGrid chunk, and the scene item drawing them; see
+	// UpdateTreeSprites.  mTreeStreamCapacity is the most sprites one frame
+	// can stream, padding included.
+	MeshGeometry* mTreeSpritesGeo = nullptr;
+	RenderItem* mTreeSpritesRitem = nullptr;
+	ScatterGrid mTreeGrid;
+	UINT mTreeStreamCapacity = 0;
+
+	// World bounds of the scene's ground items, see GetGroundHeight.
+	std::vector<BoundingBox> mGroundBoxes;
+	std::vector<UINT> mVisibleTreeChunks;
+
 	// List of all the render items.
 	std::vector<std::unique_ptr<RenderItem>> mAllRitems;
 
@@ -153,21 +385,104 @@ private:
 	// Render items divided by PSO.
 	std::vector<RenderItem*> mRitemLayer[(int)RenderLayer::Count];
 
+	// Per-frame data of every render item, indexed by RenderItem::StoreHandle.
+	RenderItemStore mRitemStore;
+
+	// Scene nodes and render items as one transform hierarchy whose leaves
+	// carry store handles.  Setting a node's local matrix moves everything
+	// under it on the next UpdateTransforms.
+	TransformHierarchy mTransforms;
+
+	// Collision boxes from the scene's collide attributes, and the BVH
+	// BuildCollisionBVH builds over them.
+	std::vector<BoundingBox> mCollisionBoxes;
+	CollisionBVH mCollisionBVH;
+
+	// Opaque render items drawn instanced, see BuildInstanceGroups.  mInstanceCount
+	// is the number of items in all groups, i.e. the instance buffer size.
+	std::vector<InstanceGroup> mInstanceGroups;
 	UINT mInstanceCount = 0;
 	bool mFrustumCullingEnabled = true;
+	bool mOcclusionCullingEnabled = true;
     BoundingFrustum mCamFrustum;
 
+	// mCamFrustum in world space, set by CullRenderItems every frame.  The
+	// frustum tests of CullRenderItems and UpdateTreeSprites only apply while
+	// mFrustumCullingEnabled.
+	BoundingFrustum mWorldFrustum;
+
+	// mRitemLayer after frustum culling, rebuilt every frame by CullRenderItems.
+	std::vector<RenderItem*> mVisibleRitems[(int)RenderLayer::Count];
+	UINT mVisibleCount = 0;
+	UINT mCulledCount = 0;
+	UINT mOccludedCount = 0;
+
+	// Boxes of the items marked occluder in the scene, and the depth buffer
+	// they are rasterized into each frame, see BuildOcclusionBuffer.
+	std::vector<OccluderBox> mOccluders;
+	std::vector<SortEntry> mOccluderEntries;
+	OcclusionBuffer mOcclusionBuffer;
+
+	// Maze cells and portals of the scene, traversed by CullRenderItems.
+	PortalGraph mPortalGraph;
+
+	// Lights of the scene.  The ambient and directional ones are in
+	// mLightConstants, uploaded to the frame resources' LightCB whenever
+	// mLightChanges has them queued; mark entry 0 after changing them.  The
+	// point and spot lights are in every frame resource's LocalLightBuffer, in
+	// the same order as their bounds in mClusterLights, and are assigned to
+	// mLightClusters every frame by UpdateLightClusters.
+	LightConstants mLightConstants;
+	ChangeTracker mLightChanges;
+	std::vector<Light> mLocalLights;
+	std::vector<ClusterLight> mClusterLights;
+	LightClusters mLightClusters;
+
+	// Per-frame scratch of SortVisibleRitems, kept to avoid reallocating.
+	std::vector<SortEntry> mSortEntries;
+	std::vector<SortEntry> mSortScratch;
+	std::vector<RenderItem*> mSortRitems;
+
+	// Store handles of the visible transparent items in last frame's back to
+	// front order, and per store handle the last frame the item was visible in;
+	// see SortTransparentRitems.
+	std::vector<RenderItemStore::Handle> mTransparentOrder;
+	std::vector<UINT> mTransparentSeenFrame;
+	UINT mTransparentFrame = 0;
+
+	// Frame totals of mRecordStats, shown by UpdateWindowCaption.
+	DrawStateCache mDrawState;
+
+	// Threads shared by the occlusion rasterizer and the command list recording.
+	std::unique_ptr<WorkerPool> mWorkerPool;
+
+	// Parallel command list recording, see Draw.  List 0 is mCommandList with
+	// the frame resource's CmdListAlloc; list i > 0 is mRecordCmdLists[i - 1]
+	// with its RecordCmdListAllocs[i - 1].  mRecordRanges and mRecordStats hold
+	// the draws and the bound state of each list this frame.
+	std::vector<ComPtr<ID3D12GraphicsCommandList>> mRecordCmdLists;
+	std::vector<std::vector<DrawRange>> mRecordRanges;
+	std::vector<DrawStateCache> mRecordStats;
+
+	// What the window caption currently shows, see UpdateWindowCaption.
+	DrawStateCache mCaptionStats;
+	UINT mCaptionVisibleCount = UINT_MAX;
+	UINT mCaptionCulledCount = UINT_MAX;
+	UINT mCaptionOccludedCount = UINT_MAX;
+
 	
 
     PassConstants mMainPassCB;
 
+	// Camera revision the matrices in mMainPassCB were built for.
+	std::uint32_t mPassCameraRevision = 0;
+
     UINT mPassCbvOffset = 0;
 
     bool mIsWireframe = false;
 
 	XMFLOAT3 mEyePos = { 0.0f, 0.0f, 0.0f };
 	XMFLOAT4X4 mView = MathHelper::Identity4x4();
-	XMFLOAT4X4 mProj = MathHelper::Identity4x4();
 
     float mTheta = 1.5f*XM_PI;
     float mPhi = 0.2f*XM_PI;
@@ -229,13 +544,19 @@ bool ShapesApp::Initialize()
 	XMStoreFloat3(&mCamera.bounds.Center, mCamera.GetPosition());
 
 
+	// Generated geometry is cached here between runs; see GeometryCache.
+	CreateDirectoryW(L"Cache", nullptr);
+
     LoadTextures();
     BuildRootSignature();
     BuildShadersAndInputLayout();
     BuildShapeGeometry();
-	BuildTreeSpritesGeometry();
-    BuildMaterials();
-    BuildRenderItems();
+    if(!LoadScene())
+        return false;
+	BuildCollisionBVH();
+	BuildInstanceGroups();
+	BuildSortKeys();
+	BuildRecordLists();
     BuildFrameResources();
     BuildDescriptorHeaps();
     BuildPSOs();
@@ -256,17 +577,17 @@ void ShapesApp::OnResize()
     D3DApp::OnResize();
 
 	mCamera.SetLens(0.3f * MathHelper::Pi, AspectRatio(), 1.0f, 100.0f);
+	mLightClusters.SetProjection(mCamera.GetProj(), mCamera.GetNearZ(), mCamera.GetFarZ());
 
 	BoundingFrustum::CreateFromMatrix(mCamFrustum, mCamera.GetProj());
-    // The window resized, so update the aspect ratio and recompute the projection matrix.
-    XMMATRIX P = XMMatrixPerspectiveFovLH(0.2f*MathHelper::Pi, AspectRatio(), 1.0f, 100.0f);
-    XMStoreFloat4x4(&mProj, P);
 }
 
 void ShapesApp::Update(const GameTimer& gt)
 {
     OnKeyboardInput(gt);
 	UpdateCamera(gt);
+	UpdateTransforms();
+	CullRenderItems();
 
     // Cycle through the circular frame resource array.
     mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % gNumFrameResources;
@@ -282,68 +603,48 @@ void ShapesApp::Update(const GameTimer& gt)
         CloseHandle(eventHandle);
     }
 
+	mUploadRing->BeginFrame(mFence->GetCompletedValue());
+
     AnimateMaterials(gt);
 	UpdateObjectCBs(gt);
+	UpdateInstanceData();
+	UpdateTreeSprites();
+	SortVisibleRitems();
     UpdateMaterialCBs(gt);
+	UpdateLightClusters();
+	UpdateLightCB();
 	UpdateMainPassCB(gt);
 
 }
 
 void ShapesApp::Draw(const GameTimer& gt)
 {
-    auto cmdListAlloc = mCurrFrameResource->CmdListAlloc;
-
-    // Reuse the memory associated with command recording.
-    // We can only reset when the associated command lists have finished execution on the GPU.
-    ThrowIfFailed(cmdListAlloc->Reset());
-
-    // A command list can be reset after it has been added to the command queue via ExecuteCommandList.
-    // Reusing the command list reuses memory.
-    ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mPSOs["opaque"].Get()));
-
-    mCommandList->RSSetViewports(1, &mScreenViewport);
-    mCommandList->RSSetScissorRects(1, &mScissorRect);
-
-    // Indicate a state transition on the resource usage.
-    mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
-        D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET));
-
-    // Clear the back buffer and depth buffer.
-    mCommandList->ClearRenderTargetView(CurrentBackBufferView(), Colors::LightSteelBlue, 0, nullptr);
-    mCommandList->ClearDepthStencilView(DepthStencilView(), D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
-
-    // Specify the buffers we are going to render to.
-    mCommandList->OMSetRenderTargets(1, &CurrentBackBufferView(), true, &DepthStencilView());
-
-    ID3D12DescriptorHeap* descriptorHeaps[] = { mSrvDescriptorHeap.Get() };
-    mCommandList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
-
-    mCommandList->SetGraphicsRootSignature(mRootSignature.Get());
-
-    auto passCB = mCurrFrameResource->PassCB->Resource();
-    mCommandList->SetGraphicsRootConstantBufferView(2, passCB->GetGPUVirtualAddress());
-
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
-
-	mCommandList->SetPipelineState(mPSOs["alphaTested"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::AlphaTested]);
-
-	mCommandList->SetPipelineState(mPSOs["treeSprites"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::AlphaTestedTreeSprites]);
-
-	mCommandList->SetPipelineState(mPSOs["transparent"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Transparent]);
-
-    // Indicate a state transition on the resource usage.
-    mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
-        D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
-
-    // Done recording commands.
-    ThrowIfFailed(mCommandList->Close());
-
-    // Add the command list to the queue for execution.
-    ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
-    mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+	// Split the sorted visible draws into contiguous runs, one per command
+	// list, and record the lists in parallel.  Each list binds all of its own
+	// state, so the lists are independent of each other; submitting them in
+	// order replays the draws in exactly the sorted order.
+	std::uint32_t segmentDraws[(int)DrawSegment::Count];
+	for(int s = 0; s < (int)DrawSegment::Count; ++s)
+		segmentDraws[s] = (UINT)mVisibleRitems[(int)DrawSegmentLayers[s]].size();
+	segmentDraws[(int)DrawSegment::InstanceGroups] = (UINT)mInstanceGroups.size();
+
+	PartitionDraws(segmentDraws, (UINT)DrawSegment::Count, (UINT)mRecordCmdLists.size() + 1,
+		MinDrawsPerRecordList, mRecordRanges);
+
+	UINT listCount = (UINT)mRecordRanges.size();
+	mRecordStats.resize(listCount);
+	mWorkerPool->Run(listCount, [this](unsigned i) { RecordCommandList(i); });
+
+	// Add the command lists to the queue for execution.
+	ID3D12CommandList* cmdsLists[MaxRecordLists];
+	cmdsLists[0] = mCommandList.Get();
+	for(UINT i = 1; i < listCount; ++i)
+		cmdsLists[i] = mRecordCmdLists[i - 1].Get();
+	mCommandQueue->ExecuteCommandLists(listCount, cmdsLists);
+
+	mDrawState = DrawStateCache();
+	for(UINT i = 0; i < listCount; ++i)
+		mDrawState.AddCounts(mRecordStats[i]);
 
     // Swap the back and front buffers
     ThrowIfFailed(mSwapChain->Present(0, 0));
@@ -356,6 +657,9 @@ void ShapesApp::Draw(const GameTimer& gt)
     // Because we are on the GPU timeline, the new fence point won't be 
     // set until the GPU finishes processing all the commands prior to this Signal().
     mCommandQueue->Signal(mFence.Get(), mCurrentFence);
+	mUploadRing->EndFrame(mCurrentFence);
+
+	UpdateWindowCaption();
 }
 
 void ShapesApp::OnMouseDown(WPARAM btnState, int x, int y)
@@ -409,22 +713,44 @@ void ShapesApp::OnMouseMove(WPARAM btnState, int x, int y)
 void ShapesApp::CollisionCheck(const XMVECTOR v)
 {
 	//giving cam a bound
-	BoundingBox camBounds;
-	XMStoreFloat3(&camBounds.Center, v);
-	camBounds.Extents = { 1.18f, 1.18f, 1.18f };
+	const float camRadius = 1.18f;
+
+	// Keep the camera this far off the walls so the next sweep does not start touching.
+	const float skinWidth = 0.01f;
+
+	// Each hit removes the part of the move going into the wall and slides the rest
+	// along it.  Three passes are enough to settle into a corner.
+	const int maxSlides = 3;
+
+	XMFLOAT3 pos = mCamera.GetPosition3f();
+	XMFLOAT3 delta;
+	XMStoreFloat3(&delta, v - XMLoadFloat3(&pos));
 
-	for (auto& e : mAllRitems)
+	for (int i = 0; i < maxSlides; ++i)
 	{
-		if (e->bounds.Contains(camBounds) != DISJOINT)
+		float length = sqrtf(delta.x * delta.x + delta.y * delta.y + delta.z * delta.z);
+		if (length < 1e-5f)
+			break;
+
+		CollisionBVH::SweepHit hit;
+		if (!mCollisionBVH.SweepSphere(pos, delta, camRadius, hit))
 		{
-			return;
+			pos = XMFLOAT3(pos.x + delta.x, pos.y + delta.y, pos.z + delta.z);
+			break;
 		}
+
+		// Stop just short of the contact point.
+		float t = std::max<float>(0.0f, hit.Time - skinWidth / length);
+		pos = XMFLOAT3(pos.x + t * delta.x, pos.y + t * delta.y, pos.z + t * delta.z);
+
+		// Slide the remainder along the wall.
+		float remaining = 1.0f - t;
+		XMFLOAT3 rest(delta.x * remaining, delta.y * remaining, delta.z * remaining);
+		float into = rest.x * hit.Normal.x + rest.y * hit.Normal.y + rest.z * hit.Normal.z;
+		delta = XMFLOAT3(rest.x - into * hit.Normal.x, rest.y - into * hit.Normal.y, rest.z - into * hit.Normal.z);
 	}
 
-	XMFLOAT3 pPos;
-	XMStoreFloat3(&pPos, v);
-	mCamera.SetPosition(pPos);
-	
+	mCamera.SetPosition(pos);
 }
 
 void ShapesApp::OnKeyboardInput(const GameTimer& gt)
@@ -469,7 +795,7 @@ void ShapesApp::OnKeyboardInput(const GameTimer& gt)
 	if (GetAsyncKeyState('R') & 0x8000)
 		pPos += mCamera.MoveCamera(speed, pedestal);
 
-	//push cam back to pPos when camera is colliding with other bounding boxes
+	//sweep the cam towards pPos, sliding along any wall in the way
 	if (!XMVector3Equal(pPos, mCamera.GetPosition()))
 	{
 		CollisionCheck(pPos);
@@ -480,6 +806,11 @@ void ShapesApp::OnKeyboardInput(const GameTimer& gt)
         mIsWireframe = true;
     else
         mIsWireframe = false;
+
+	// Hold 2 to draw everything, handy for checking the culling, or 3 to
+	// only turn off the occlusion culling.
+	mFrustumCullingEnabled = (GetAsyncKeyState('2') & 0x8000) == 0;
+	mOcclusionCullingEnabled = (GetAsyncKeyState('3') & 0x8000) == 0;
 	mCamera.UpdateViewMatrix();
 }
 
@@ -503,10 +834,185 @@ void ShapesApp::UpdateCamera(const GameTimer& gt)
 	
 }
 
+// Propagates the transforms changed since the last frame down the hierarchy
+// and moves the render items under them.  Costs nothing while nothing moves.
+void ShapesApp::UpdateTransforms()
+{
+	mTransforms.Update();
+
+	for(UINT slot : mTransforms.Changed())
+	{
+		RenderItemStore::Handle h = mTransforms.Payload(slot);
+		if(h == TransformHierarchy::NoPayload)
+			continue;
+
+		mRitemStore.SetWorld(h, XMLoadFloat4x4(&mTransforms.World(slot)));
+		mRitemStore.Cell[h] = mPortalGraph.CellOf(mRitemStore.GetWorldBounds(h));
+	}
+}
+
+void ShapesApp::CullRenderItems()
+{
+	const RenderItemStore& store = mRitemStore;
+	const UINT itemCount = store.Count();
+
+	for(int i = 0; i < (int)RenderLayer::Count; ++i)
+		mVisibleRitems[i].clear();
+
+	UINT visibleCount = 0;
+	UINT occludedCount = 0;
+
+	// mCamFrustum is in view space, bring it into world space once per frame
+	// instead of moving every box into view space.  The occluder selection
+	// and UpdateTreeSprites use it too, so it is kept current even while
+	// frustum culling is off.
+	BoundingFrustum worldFrustum;
+	mCamFrustum.Transform(worldFrustum, mCamera.GetInvView());
+	mWorldFrustum = worldFrustum;
+
+	XMVECTOR planes[6];
+	worldFrustum.GetPlanes(&planes[0], &planes[1], &planes[2], &planes[3], &planes[4], &planes[5]);
+
+	// Splat the plane components up front so each lane of the SoA test
+	// below works on a different box against the same plane.
+	XMVECTOR planeX[6], planeY[6], planeZ[6], planeW[6];
+	XMVECTOR absX[6], absY[6], absZ[6];
+	for(int p = 0; p < 6; ++p)
+	{
+		planeX[p] = XMVectorSplatX(planes[p]);
+		planeY[p] = XMVectorSplatY(planes[p]);
+		planeZ[p] = XMVectorSplatZ(planes[p]);
+		planeW[p] = XMVectorSplatW(planes[p]);
+		absX[p] = XMVectorAbs(planeX[p]);
+		absY[p] = XMVectorAbs(planeY[p]);
+		absZ[p] = XMVectorAbs(planeZ[p]);
+	}
+
+	// Items that pass the frustum test must also be in a maze cell seen
+	// through the portals, if they are in one, and not be hidden behind
+	// the nearest walls.  Each test has its own toggle.
+	const bool portals = mOcclusionCullingEnabled &&
+		mPortalGraph.Traverse(mCamera.GetPosition3f(), XMMatrixMultiply(mCamera.GetView(), mCamera.GetProj()));
+	const bool occlusion = mOcclusionCullingEnabled && BuildOcclusionBuffer(worldFrustum);
+
+	// The store keeps the world boxes four to an element, so each group of
+	// four items is tested straight from memory in store order.  Store order
+	// matches each layer's order in mRitemLayer.
+	for(UINT first = 0; first < itemCount; first += 4)
+	{
+		const UINT block = first >> 2;
+		XMVECTOR centerX = XMLoadFloat4A(&store.CenterX[block]);
+		XMVECTOR centerY = XMLoadFloat4A(&store.CenterY[block]);
+		XMVECTOR centerZ = XMLoadFloat4A(&store.CenterZ[block]);
+		XMVECTOR extentX = XMLoadFloat4A(&store.ExtentX[block]);
+		XMVECTOR extentY = XMLoadFloat4A(&store.ExtentY[block]);
+		XMVECTOR extentZ = XMLoadFloat4A(&store.ExtentZ[block]);
+
+		// The frustum planes face outwards, so a box is culled as soon as
+		// its center is further in front of one plane than its projected
+		// radius onto that plane's normal.
+		XMVECTOR outside = XMVectorFalseInt();
+		for(int p = 0; mFrustumCullingEnabled && p < 6; ++p)
+		{
+			XMVECTOR dist = XMVectorMultiplyAdd(centerX, planeX[p], planeW[p]);
+			dist = XMVectorMultiplyAdd(centerY, planeY[p], dist);
+			dist = XMVectorMultiplyAdd(centerZ, planeZ[p], dist);
+
+			XMVECTOR radius = XMVectorMultiply(extentX, absX[p]);
+			radius = XMVectorMultiplyAdd(extentY, absY[p], radius);
+			radius = XMVectorMultiplyAdd(extentZ, absZ[p], radius);
+
+			outside = XMVectorOrInt(outside, XMVectorGreater(dist, radius));
+		}
+
+		// Lanes past the last item hold zero boxes, their results are ignored.
+		XMUINT4 mask;
+		XMStoreUInt4(&mask, outside);
+		const std::uint32_t* laneOutside = &mask.x;
+		const UINT count = std::min<UINT>(4, itemCount - first);
+		for(UINT lane = 0; lane < count; ++lane)
+		{
+			if(laneOutside[lane] == 0)
+			{
+				const UINT h = first + lane;
+				if(portals && store.Cell[h] != PortalGraph::NoCell && !mPortalGraph.IsCellVisible(store.Cell[h]))
+				{
+					++occludedCount;
+					continue;
+				}
+
+				if(occlusion && !store.Occluder[h] && !mOcclusionBuffer.IsVisible(store.GetWorldBounds(h)))
+				{
+					++occludedCount;
+					continue;
+				}
+
+				mVisibleRitems[store.Layer[h]].push_back(store.Items[h]);
+				++visibleCount;
+			}
+		}
+	}
+	mVisibleCount = visibleCount;
+	mCulledCount = itemCount - visibleCount;
+	mOccludedCount = occludedCount;
+}
+
+// Rasterizes the occluders in worldFrustum into mOcclusionBuffer, only the
+// MaxOccluders nearest to the camera when there are more: far walls hide
+// little and the near ones cover most of the screen in corridor views.
+// Returns false if there was nothing to rasterize.
+bool ShapesApp::BuildOcclusionBuffer(const BoundingFrustum& worldFrustum)
+{
+	const UINT MaxOccluders = 64;
+
+	XMFLOAT3 eye = mCamera.GetPosition3f();
+
+	mOccluderEntries.clear();
+	for(UINT i = 0; i < (UINT)mOccluders.size(); ++i)
+	{
+		BoundingBox bounds;
+		mOccluders[i].Bounds.Transform(bounds, mTransforms.GetWorld(mOccluders[i].Transform));
+		if(!worldFrustum.Intersects(bounds))
+			continue;
+
+		float dx = bounds.Center.x - eye.x;
+		float dy = bounds.Center.y - eye.y;
+		float dz = bounds.Center.z - eye.z;
+
+		SortEntry entry;
+		entry.Key = FloatSortKey(dx * dx + dy * dy + dz * dz);
+		entry.Value = i;
+		mOccluderEntries.push_back(entry);
+	}
+
+	if(mOccluderEntries.empty())
+		return false;
+
+	if(mOccluderEntries.size() > MaxOccluders)
+	{
+		std::nth_element(mOccluderEntries.begin(), mOccluderEntries.begin() + MaxOccluders, mOccluderEntries.end(),
+			[](const SortEntry& a, const SortEntry& b) { return a.Key < b.Key; });
+		mOccluderEntries.resize(MaxOccluders);
+	}
+
+	mOcclusionBuffer.Begin(XMMatrixMultiply(mCamera.GetView(), mCamera.GetProj()));
+	for(const SortEntry& entry : mOccluderEntries)
+	{
+		const OccluderBox& occluder = mOccluders[entry.Value];
+		mOcclusionBuffer.AddOccluder(occluder.Bounds, mTransforms.GetWorld(occluder.Transform));
+	}
+	mOcclusionBuffer.Rasterize(mWorkerPool.get());
+
+	return true;
+}
+
 void ShapesApp::AnimateMaterials(const GameTimer& gt)
 {
 	// Scroll the water material texture coordinates.
-	auto waterMat = mMaterials["water0"].get();
+	if (mWaterMat == InvalidNameHandle)
+		return;
+
+	auto waterMat = mMaterials[mWaterMat].get();
 
 	float& tu = waterMat->MatTransform(3, 0);
 	float& tv = waterMat->MatTransform(3, 1);
@@ -524,126 +1030,254 @@ void ShapesApp::AnimateMaterials(const GameTimer& gt)
 	waterMat->MatTransform(3, 1) = tv;
 
 	// Material has changed, so need to update cbuffer.
-	waterMat->NumFramesDirty = gNumFrameResources;
+	mMaterialChanges.MarkDirty(mWaterMat);
 }
 
 void ShapesApp::UpdateObjectCBs(const GameTimer& gt)
 {
-	XMMATRIX view = mCamera.GetView();
-	XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
-
+	// Only the items changed since this frame resource was last current are
+	// visited; the change tracker queued them for every frame resource.  The
+	// builder fills their constants in groups of four, straight into ObjectCB.
+	RenderItemStore& store = mRitemStore;
 	auto currObjectCB = mCurrFrameResource->ObjectCB.get();
-	for (auto& e : mAllRitems)
+	ObjectConstantBuilder builder;
+	for (UINT h : store.Changes.Dirty(mCurrFrameResourceIndex))
 	{
-	
-		if (e->NumFramesDirty > 0)
+		builder.Add(store.World[h], store.Items[h]->TexTransform, store.Constants[h],
+			currObjectCB->MappedElement(store.ObjCBIndex[h]));
+	}
+	builder.Flush();
+	store.Changes.Clear(mCurrFrameResourceIndex);
+}
+
+void ShapesApp::UpdateInstanceData()
+{
+	for (auto& group : mInstanceGroups)
+		group.Visible.clear();
+
+	// Move the visible grouped items out of the opaque list into their groups;
+	// what is left in the list is drawn one item at a time.
+	auto& opaque = mVisibleRitems[(int)RenderLayer::Opaque];
+	size_t kept = 0;
+	for (RenderItem* ri : opaque)
+	{
+		if (ri->InstanceGroupIndex >= 0)
+			mInstanceGroups[ri->InstanceGroupIndex].Visible.push_back(ri);
+		else
+			opaque[kept++] = ri;
+	}
+	opaque.resize(kept);
+
+	UINT visibleCount = 0;
+	for (auto& group : mInstanceGroups)
+	{
+		group.FirstInstance = visibleCount;
+		visibleCount += (UINT)group.Visible.size();
+	}
+
+	// Only the visible instances take space in the upload ring.
+	UploadRing::Allocation instances = mUploadRing->Allocate(std::max<UINT>(1, visibleCount) * sizeof(ObjectConstants));
+	mCurrFrameResource->InstanceDataAddress = instances.GpuAddress;
+
+	ObjectConstants* next = reinterpret_cast<ObjectConstants*>(instances.CpuAddress);
+	for (auto& group : mInstanceGroups)
+	{
+		for (RenderItem* ri : group.Visible)
+			memcpy(next++, &mRitemStore.Constants[ri->StoreHandle], sizeof(ObjectConstants));
+	}
+}
+
+void ShapesApp::SortVisibleRitems()
+{
+	// View-space z of the world box centers, scaled to the depth bits.
+	XMFLOAT4X4 view = mCamera.GetView4x4f();
+	const float depthScale = (float)DrawSortKey::DepthMask / mCamera.GetFarZ();
+
+	for (int i = 0; i < (int)RenderLayer::Count; ++i)
+	{
+		// Blending needs the transparent items in back to front order, which
+		// the state-first key would break.
+		if (i == (int)RenderLayer::Transparent)
+		{
+			SortTransparentRitems();
+			continue;
+		}
+
+		auto& visible = mVisibleRitems[i];
+		if (visible.size() < 2)
+			continue;
+
+		mSortEntries.clear();
+		for (size_t k = 0; k < visible.size(); ++k)
 		{
-			XMMATRIX world = XMLoadFloat4x4(&e->World);
-			XMMATRIX tWorld = XMLoadFloat4x4(&e->TWorld);
-			XMMATRIX texTransform = XMLoadFloat4x4(&e->TexTransform);
+			XMFLOAT3 c = mRitemStore.GetWorldCenter(visible[k]->StoreHandle);
+			float z = c.x * view(0, 2) + c.y * view(1, 2) + c.z * view(2, 2) + view(3, 2);
+			float scaled = MathHelper::Clamp(z * depthScale, 0.0f, (float)DrawSortKey::DepthMask);
+
+			SortEntry entry;
+			entry.Key = visible[k]->SortKey | (std::uint64_t)scaled;
+			entry.Value = (std::uint32_t)k;
+			mSortEntries.push_back(entry);
+		}
+
+		RadixSort(mSortEntries, mSortScratch);
+
+		mSortRitems.assign(visible.begin(), visible.end());
+		for (size_t k = 0; k < mSortEntries.size(); ++k)
+			visible[k] = mSortRitems[mSortEntries[k].Value];
+	}
+}
 
-			ObjectConstants objConstants;
-			XMStoreFloat4x4(&objConstants.World, XMMatrixTranspose(world));
-			XMStoreFloat4x4(&objConstants.TWorld, XMMatrixTranspose(MathHelper::InverseTranspose(world)));
-			XMStoreFloat4x4(&objConstants.TexTransform, XMMatrixTranspose(texTransform));
+// Orders the visible transparent items back to front by the view depth of
+// their box centers.  The order of the previous frame is kept and re-keyed
+// with this frame's depths, items that just became visible going last; as
+// the camera moves little between frames that is usually sorted already or
+// close to it, so an insertion sort finishes it.  Only when it has to move
+// too many items does it fall back to the radix sort.
+void ShapesApp::SortTransparentRitems()
+{
+	auto& visible = mVisibleRitems[(int)RenderLayer::Transparent];
 
+	XMFLOAT4X4 view = mCamera.GetView4x4f();
 
-			currObjectCB->CopyData(e->ObjCBIndex, objConstants);
+	// Stamp the visible items, then take them in last frame's order, clearing
+	// the stamp of each one taken so only the newly visible ones keep it.
+	++mTransparentFrame;
+	mTransparentSeenFrame.resize(mRitemStore.Count(), 0);
+	for (RenderItem* ri : visible)
+		mTransparentSeenFrame[ri->StoreHandle] = mTransparentFrame;
 
-			// Next FrameResource need to be updated too.
-			e->NumFramesDirty--;
+	mSortEntries.clear();
+	for (RenderItemStore::Handle h : mTransparentOrder)
+	{
+		if (h < mTransparentSeenFrame.size() && mTransparentSeenFrame[h] == mTransparentFrame)
+		{
+			mTransparentSeenFrame[h] = 0;
 
+			SortEntry entry;
+			entry.Value = h;
+			mSortEntries.push_back(entry);
+		}
+	}
+	for (RenderItem* ri : visible)
+	{
+		if (mTransparentSeenFrame[ri->StoreHandle] == mTransparentFrame)
+		{
+			SortEntry entry;
+			entry.Value = ri->StoreHandle;
+			mSortEntries.push_back(entry);
 		}
 	}
+
+	// Farthest first: complementing the depth key makes ascending order back to front.
+	for (SortEntry& entry : mSortEntries)
+	{
+		XMFLOAT3 c = mRitemStore.GetWorldCenter(entry.Value);
+		float z = c.x * view(0, 2) + c.y * view(1, 2) + c.z * view(2, 2) + view(3, 2);
+		entry.Key = ~FloatSortKey(z);
+	}
+
+	if (!InsertionSortBounded(mSortEntries, mSortEntries.size()))
+		RadixSort(mSortEntries, mSortScratch);
+
+	mTransparentOrder.resize(mSortEntries.size());
+	for (size_t k = 0; k < mSortEntries.size(); ++k)
+	{
+		mTransparentOrder[k] = mSortEntries[k].Value;
+		visible[k] = mRitemStore.Items[mSortEntries[k].Value];
+	}
 }
 
 void ShapesApp::UpdateMaterialCBs(const GameTimer& gt)
 {
 	auto currMaterialCB = mCurrFrameResource->MaterialCB.get();
-	for (auto& e : mMaterials)
+	// Only the materials changed since this frame resource was last current.
+	for (NameHandle h : mMaterialChanges.Dirty(mCurrFrameResourceIndex))
 	{
-		// Only update the cbuffer data if the constants have changed.  If the cbuffer
-		// data changes, it needs to be updated for each FrameResource.
-		Material* mat = e.second.get();
-		if (mat->NumFramesDirty > 0)
-		{
-			XMMATRIX matTransform = XMLoadFloat4x4(&mat->MatTransform);
-
-			MaterialConstants matConstants;
-			matConstants.DiffuseAlbedo = mat->DiffuseAlbedo;
-			matConstants.FresnelR0 = mat->FresnelR0;
-			matConstants.Roughness = mat->Roughness;
-			XMStoreFloat4x4(&matConstants.MatTransform, XMMatrixTranspose(matTransform));
+		Material* mat = mMaterials[h].get();
+		XMMATRIX matTransform = XMLoadFloat4x4(&mat->MatTransform);
 
-			currMaterialCB->CopyData(mat->MatCBIndex, matConstants);
+		MaterialConstants matConstants;
+		matConstants.DiffuseAlbedo = mat->DiffuseAlbedo;
+		matConstants.FresnelR0 = mat->FresnelR0;
+		matConstants.Roughness = mat->Roughness;
+		XMStoreFloat4x4(&matConstants.MatTransform, XMMatrixTranspose(matTransform));
 
-			// Next FrameResource need to be updated too.
-			mat->NumFramesDirty--;
-		}
+		currMaterialCB->CopyData(mat->MatCBIndex, matConstants);
 	}
+	mMaterialChanges.Clear(mCurrFrameResourceIndex);
 }
 
 
+// Uploads the ambient and directional lights to the current frame resource if
+// it has not seen their latest values.
+void ShapesApp::UpdateLightCB()
+{
+	auto currLightCB = mCurrFrameResource->LightCB.get();
+	for(UINT i : mLightChanges.Dirty(mCurrFrameResourceIndex))
+		currLightCB->CopyData(i, mLightConstants);
+	mLightChanges.Clear(mCurrFrameResourceIndex);
+}
+
 void ShapesApp::UpdateMainPassCB(const GameTimer& gt)
 {
-	XMMATRIX view = mCamera.GetView();
-	XMMATRIX proj = mCamera.GetProj();
-
-	XMMATRIX viewProj = XMMatrixMultiply(view, proj);
-	XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
-	XMMATRIX invProj = XMMatrixInverse(&XMMatrixDeterminant(proj), proj);
-	XMMATRIX invViewProj = XMMatrixInverse(&XMMatrixDeterminant(viewProj), viewProj);
-
-	XMStoreFloat4x4(&mMainPassCB.View, XMMatrixTranspose(view));
-	XMStoreFloat4x4(&mMainPassCB.InvView, XMMatrixTranspose(invView));
-	XMStoreFloat4x4(&mMainPassCB.Proj, XMMatrixTranspose(proj));
-	XMStoreFloat4x4(&mMainPassCB.InvProj, XMMatrixTranspose(invProj));
-	XMStoreFloat4x4(&mMainPassCB.ViewProj, XMMatrixTranspose(viewProj));
-	XMStoreFloat4x4(&mMainPassCB.InvViewProj, XMMatrixTranspose(invViewProj));
-	mMainPassCB.EyePosW = mCamera.GetPosition3f();
-	mMainPassCB.RenderTargetSize = XMFLOAT2((float)mClientWidth, (float)mClientHeight);
-	mMainPassCB.InvRenderTargetSize = XMFLOAT2(1.0f / mClientWidth, 1.0f / mClientHeight);
-	mMainPassCB.NearZ = 1.0f;
-	mMainPassCB.FarZ = 1000.0f;
+	// Everything but the time only depends on the camera, the lens and the
+	// client size (which resets the lens), so it is rebuilt only when the
+	// camera's revision moves.  The camera gives the inverses in closed form.
+	if(mPassCameraRevision != mCamera.GetRevision())
+	{
+		mPassCameraRevision = mCamera.GetRevision();
+
+		XMMATRIX view = mCamera.GetView();
+		XMMATRIX proj = mCamera.GetProj();
+		XMMATRIX invView = mCamera.GetInvView();
+		XMMATRIX invProj = mCamera.GetInvProj();
+
+		XMMATRIX viewProj = XMMatrixMultiply(view, proj);
+		XMMATRIX invViewProj = XMMatrixMultiply(invProj, invView);
+
+		XMStoreFloat4x4(&mMainPassCB.View, XMMatrixTranspose(view));
+		XMStoreFloat4x4(&mMainPassCB.InvView, XMMatrixTranspose(invView));
+		XMStoreFloat4x4(&mMainPassCB.Proj, XMMatrixTranspose(proj));
+		XMStoreFloat4x4(&mMainPassCB.InvProj, XMMatrixTranspose(invProj));
+		XMStoreFloat4x4(&mMainPassCB.ViewProj, XMMatrixTranspose(viewProj));
+		XMStoreFloat4x4(&mMainPassCB.InvViewProj, XMMatrixTranspose(invViewProj));
+		mMainPassCB.EyePosW = mCamera.GetPosition3f();
+		mMainPassCB.RenderTargetSize = XMFLOAT2((float)mClientWidth, (float)mClientHeight);
+		mMainPassCB.InvRenderTargetSize = XMFLOAT2(1.0f / mClientWidth, 1.0f / mClientHeight);
+		mMainPassCB.NearZ = mCamera.GetNearZ();
+		mMainPassCB.FarZ = mCamera.GetFarZ();
+
+		mMainPassCB.ClusterCounts = XMUINT3(LightClusters::TileCountX, LightClusters::TileCountY, LightClusters::SliceCount);
+		mMainPassCB.ClusterTileScale = XMFLOAT2((float)LightClusters::TileCountX / mClientWidth,
+			(float)LightClusters::TileCountY / mClientHeight);
+		mMainPassCB.ClusterDepthScale = mLightClusters.DepthScale();
+		mMainPassCB.ClusterDepthBias = mLightClusters.DepthBias();
+	}
+
 	mMainPassCB.TotalTime = gt.TotalTime();
 	mMainPassCB.DeltaTime = gt.DeltaTime();
 
-    //lights
-	mMainPassCB.AmbientLight = { 0.25f, 0.25f, 0.25f, 1.0f };
-    
-	mMainPassCB.Lights[0].Direction = { 0.0f, -1.0f, 0.0f };
-	mMainPassCB.Lights[0].Strength = { 0.8f, 0.5, 0.3f };
-   
-	//Diamond light
-	mMainPassCB.Lights[1].Position = { 0.0f, 6.0f, 0.0f };
-	mMainPassCB.Lights[1].Strength = { 0.0f, 0.0f, 1.5f };
-
-	//castle entry light
-	mMainPassCB.Lights[2].Position = { 0.0f, 5.0f, -20.0f };
-	mMainPassCB.Lights[2].Strength = { 0.0f, 1.0f, 1.0f };
-	
-	//four tower lights
-	mMainPassCB.Lights[3].Position = { 20.0f, 5.0f, 20.0f };
-	mMainPassCB.Lights[3].Strength = { 1.0f, 0.0f, 0.0f };
-	
-    mMainPassCB.Lights[4].Position = { 20.0f, 5.0f, -20.0f };
-	mMainPassCB.Lights[4].Strength = { 0.0f, 1.0f, 0.0f };
-	
-	mMainPassCB.Lights[5].Position = { -20.0f, 5.0f, 20.0f };
-	mMainPassCB.Lights[5].Strength = { 1.0f, 0.0f, 1.0f };
+	UploadRing::Allocation passCB = mUploadRing->Allocate(d3dUtil::CalcConstantBufferByteSize(sizeof(PassConstants)));
+	memcpy(passCB.CpuAddress, &mMainPassCB, sizeof(PassConstants));
+	mCurrFrameResource->PassCBAddress = passCB.GpuAddress;
+}
 
-	mMainPassCB.Lights[6].Position = { -20.0f, 5.0f, -20.0f };
-	mMainPassCB.Lights[6].Strength = { 0.0, 0.0f, 1.0f };
+// Assigns the point and spot lights to the clusters of the current view and
+// uploads the cluster light lists, see LightClusters.
+void ShapesApp::UpdateLightClusters()
+{
+	mLightClusters.Assign(mClusterLights.data(), (std::uint32_t)mClusterLights.size(), mCamera.GetView());
 
-    //spotlight
-    mMainPassCB.Lights[7].Position = { 0.0f, 15.0f, -60.0f };
-    mMainPassCB.Lights[7].Direction = { 0.0f, -1.0f, 0.0f };
-    mMainPassCB.Lights[7].SpotPower =  1.0f;
-    mMainPassCB.Lights[7].Strength = { 2.1f, 2.1f, 2.1f };
-    mMainPassCB.Lights[7].FalloffEnd = 20.0f;
+	UploadRing::Allocation clusters = mUploadRing->Allocate(LightClusters::ClusterCount * sizeof(LightCluster));
+	memcpy(clusters.CpuAddress, mLightClusters.Clusters(), LightClusters::ClusterCount * sizeof(LightCluster));
+	mCurrFrameResource->LightClusterAddress = clusters.GpuAddress;
 
-	auto currPassCB = mCurrFrameResource->PassCB.get();
-	currPassCB->CopyData(0, mMainPassCB);
+	const UINT indexCount = mLightClusters.LightIndexCount();
+	UploadRing::Allocation indices = mUploadRing->Allocate(std::max<UINT>(1, indexCount) * sizeof(std::uint32_t));
+	if(indexCount > 0)
+		memcpy(indices.CpuAddress, mLightClusters.LightIndices(), indexCount * sizeof(std::uint32_t));
+	mCurrFrameResource->LightIndexAddress = indices.GpuAddress;
 }
 
 void ShapesApp::LoadTextures()
@@ -720,24 +1354,24 @@ void ShapesApp::LoadTextures()
 		grassTex->Resource, grassTex->UploadHeap));
 
 
-	mTextures[bricksTex->Name] = std::move(bricksTex);
-	mTextures[stoneTex->Name] = std::move(stoneTex);
-	mTextures[sandTex->Name] = std::move(sandTex);
-	mTextures[waterTex->Name] = std::move(waterTex);
-	mTextures[iceTex->Name] = std::move(iceTex);
-	mTextures[redBrickTex->Name] = std::move(redBrickTex);
-	mTextures[fenceTex->Name] = std::move(fenceTex);
-	mTextures[treeArrayTex->Name] = std::move(treeArrayTex);
-	mTextures[treeTex->Name] = std::move(treeTex);
-	mTextures[grassTex->Name] = std::move(grassTex);
+	mTextures.Add(bricksTex->Name, std::move(bricksTex));
+	mTextures.Add(stoneTex->Name, std::move(stoneTex));
+	mTextures.Add(sandTex->Name, std::move(sandTex));
+	mTextures.Add(waterTex->Name, std::move(waterTex));
+	mTextures.Add(iceTex->Name, std::move(iceTex));
+	mTextures.Add(redBrickTex->Name, std::move(redBrickTex));
+	mTextures.Add(fenceTex->Name, std::move(fenceTex));
+	mTextures.Add(treeArrayTex->Name, std::move(treeArrayTex));
+	mTextures.Add(treeTex->Name, std::move(treeTex));
+	mTextures.Add(grassTex->Name, std::move(grassTex));
 
 	
 
 }
 
-//If we have 3 frame resources and n render items, then we have three 3n object constant
-//buffers and 3 pass constant buffers.Hence we need 3(n + 1) constant buffer views(CBVs).
-//Thus we will need to modify our CBV heap to include the additional descriptors :
+// The heap only holds the texture SRVs.  Object, material, pass and light
+// constants are bound as root CBVs straight from the frame resources and the
+// upload ring, so they need no descriptors however many items there are.
 
 void ShapesApp::BuildDescriptorHeaps()
 {
@@ -755,16 +1389,16 @@ void ShapesApp::BuildDescriptorHeaps()
 	//
 	CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
 
-	auto bricksTex = mTextures["bricksTex"]->Resource;
-	auto stoneTex = mTextures["stoneTex"]->Resource;
-	auto sandTex = mTextures["sandTex"]->Resource;
-	auto redBrickTex = mTextures["redBrickTex"]->Resource;
-	auto waterTex = mTextures["waterTex"]->Resource;
-	auto iceTex = mTextures["iceTex"]->Resource;
-	auto grassTex = mTextures["grassTex"]->Resource;
-	auto fenceTex = mTextures["fenceTex"]->Resource;
-	auto treeArrayTex = mTextures["treeArrayTex"]->Resource;
-	auto treeTex = mTextures["treeTex"]->Resource;
+	auto bricksTex = mTextures.Get("bricksTex")->Resource;
+	auto stoneTex = mTextures.Get("stoneTex")->Resource;
+	auto sandTex = mTextures.Get("sandTex")->Resource;
+	auto redBrickTex = mTextures.Get("redBrickTex")->Resource;
+	auto waterTex = mTextures.Get("waterTex")->Resource;
+	auto iceTex = mTextures.Get("iceTex")->Resource;
+	auto grassTex = mTextures.Get("grassTex")->Resource;
+	auto fenceTex = mTextures.Get("fenceTex")->Resource;
+	auto treeArrayTex = mTextures.Get("treeArrayTex")->Resource;
+	auto treeTex = mTextures.Get("treeTex")->Resource;
 	
 
 	
@@ -878,18 +1512,24 @@ void ShapesApp::BuildRootSignature()
 		0); // register t0
 
 	// Root parameter can be a table, root descriptor or root constants.
-	CD3DX12_ROOT_PARAMETER slotRootParameter[4];
+	CD3DX12_ROOT_PARAMETER slotRootParameter[10];
 
 	// Performance TIP: Order from most frequent to least frequent.
 	slotRootParameter[0].InitAsDescriptorTable(1, &texTable, D3D12_SHADER_VISIBILITY_PIXEL);
     slotRootParameter[1].InitAsConstantBufferView(0); // register b0
 	slotRootParameter[2].InitAsConstantBufferView(1); // register b1
 	slotRootParameter[3].InitAsConstantBufferView(2); // register b2
+	slotRootParameter[4].InitAsShaderResourceView(0, 1, D3D12_SHADER_VISIBILITY_VERTEX); // instance data, register t0 space1
+	slotRootParameter[5].InitAsConstants(1, 3, 0, D3D12_SHADER_VISIBILITY_VERTEX); // first instance, register b3
+	slotRootParameter[6].InitAsShaderResourceView(1, 1, D3D12_SHADER_VISIBILITY_PIXEL); // point and spot lights, register t1 space1
+	slotRootParameter[7].InitAsShaderResourceView(2, 1, D3D12_SHADER_VISIBILITY_PIXEL); // light clusters, register t2 space1
+	slotRootParameter[8].InitAsShaderResourceView(3, 1, D3D12_SHADER_VISIBILITY_PIXEL); // cluster light indices, register t3 space1
+	slotRootParameter[9].InitAsConstantBufferView(4, 0, D3D12_SHADER_VISIBILITY_PIXEL); // ambient and directional lights, register b4
 
 	auto staticSamplers = GetStaticSamplers();
 
 	// A root signature is an array of root parameters.
-	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(4, slotRootParameter,
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(10, slotRootParameter,
 		(UINT)staticSamplers.size(), staticSamplers.data(),
 		D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
@@ -926,13 +1566,20 @@ void ShapesApp::BuildShadersAndInputLayout()
 		"ALPHA_TEST", "1",
 		NULL, NULL
 	};
-	mShaders["standardVS"] = d3dUtil::CompileShader(L"Shaders\\color.hlsl", nullptr, "VS", "vs_5_1");
-	mShaders["opaquePS"] = d3dUtil::CompileShader(L"Shaders\\color.hlsl", defines, "PS", "ps_5_1");
-	mShaders["alphaTestedPS"] = d3dUtil::CompileShader(L"Shaders\\color.hlsl", alphaTestDefines, "PS", "ps_5_1");
 
-	mShaders["treeSpriteVS"] = d3dUtil::CompileShader(L"Shaders\\TreeSprite.hlsl", nullptr, "VS", "vs_5_1");
-	mShaders["treeSpriteGS"] = d3dUtil::CompileShader(L"Shaders\\TreeSprite.hlsl", nullptr, "GS", "gs_5_1");
-	mShaders["treeSpritePS"] = d3dUtil::CompileShader(L"Shaders\\TreeSprite.hlsl", alphaTestDefines, "PS", "ps_5_1");
+	const D3D_SHADER_MACRO instancedDefines[] =
+	{
+		"INSTANCED", "1",
+		NULL, NULL
+	};
+	mShaders.Add("standardVS", d3dUtil::CompileShader(L"Shaders\\color.hlsl", nullptr, "VS", "vs_5_1"));
+	mShaders.Add("instancedVS", d3dUtil::CompileShader(L"Shaders\\color.hlsl", instancedDefines, "VS", "vs_5_1"));
+	mShaders.Add("opaquePS", d3dUtil::CompileShader(L"Shaders\\color.hlsl", defines, "PS", "ps_5_1"));
+	mShaders.Add("alphaTestedPS", d3dUtil::CompileShader(L"Shaders\\color.hlsl", alphaTestDefines, "PS", "ps_5_1"));
+
+	mShaders.Add("treeSpriteVS", d3dUtil::CompileShader(L"Shaders\\TreeSprite.hlsl", nullptr, "VS", "vs_5_1"));
+	mShaders.Add("treeSpriteGS", d3dUtil::CompileShader(L"Shaders\\TreeSprite.hlsl", nullptr, "GS", "gs_5_1"));
+	mShaders.Add("treeSpritePS", d3dUtil::CompileShader(L"Shaders\\TreeSprite.hlsl", alphaTestDefines, "PS", "ps_5_1"));
 	
 	mStdInputLayout =
 	{
@@ -951,353 +1598,377 @@ void ShapesApp::BuildShadersAndInputLayout()
 
 void ShapesApp::BuildShapeGeometry()
 {
-    GeometryGenerator geoGen;
-	GeometryGenerator::MeshData box = geoGen.CreateBox(1.0f, 1.0f, 1.0f, 3);
-	GeometryGenerator::MeshData grid = geoGen.CreateGrid(90, 150 , 60 , 40);
-    GeometryGenerator::MeshData sandDunes = geoGen.CreateGrid(200, 200, 60 * 4, 40);
-	GeometryGenerator::MeshData sphere = geoGen.CreateSphere(0.5f, 20, 20);
-	GeometryGenerator::MeshData cylinder = geoGen.CreateCylinder(0.5f, 0.5f, 2.0f, 20, 20);
-	GeometryGenerator::MeshData cone = geoGen.CreateCone(0.5f, 1.0f, 20, 1);
-    GeometryGenerator::MeshData triPrism = geoGen.CreateTriangularPrism(1, 1, 1);
-    GeometryGenerator::MeshData diamond = geoGen.CreateDiamond(1.0f, 0.0f, 1.0f, 1.0f, 6, 1);
-    GeometryGenerator::MeshData pyramid = geoGen.CreatePyramid(1, 1, 1 );
-	GeometryGenerator::MeshData torus = geoGen.CreateTorus(0.1f, 1.0f, 20, 20);
-	GeometryGenerator::MeshData wedge = geoGen.CreateWedge(1.0f, 1.0f, 2.0f);
-    //GeometryGenerator::MeshData waterGrid = geoGen.CreateBox(1.0f, 1.0f, 1.0f, 3);
-    
+	using ShapeType = GeometryGenerator::ShapeType;
 
-	//
-	// We are concatenating all the geometry into one big vertex/index buffer.  So
-	// define the regions in the buffer each submesh covers.
-	//
+	struct NamedShape
+	{
+		std::string Name;
+		GeometryGenerator::ShapeDesc Desc;
 
-	// Cache the vertex offsets to each object in the concatenated vertex buffer.
-	UINT boxVertexOffset = 0;
-	UINT gridVertexOffset = (UINT)box.Vertices.size();
-    UINT sandDunesVertexOffset = gridVertexOffset + (UINT)grid.Vertices.size();
-    UINT sphereVertexOffset = sandDunesVertexOffset + (UINT)sandDunes.Vertices.size();
-	UINT cylinderVertexOffset = sphereVertexOffset + (UINT)sphere.Vertices.size();
-    UINT coneVertexOffset = cylinderVertexOffset + (UINT)cylinder.Vertices.size();
-    UINT triPrismVertexOffset = coneVertexOffset + (UINT)cone.Vertices.size();
-    UINT diamondVertexOffset = triPrismVertexOffset + (UINT)triPrism.Vertices.size();
-    UINT pyramidVertexOffset = diamondVertexOffset + (UINT)diamond.Vertices.size();
-    UINT torusVertexOffset = pyramidVertexOffset + (UINT)pyramid.Vertices.size();
-    UINT wedgeVertexOffset = torusVertexOffset + (UINT)torus.Vertices.size();
-
-   
-    
-	// Cache the starting index for each object in the concatenated index buffer.
-	UINT boxIndexOffset = 0;
-	UINT gridIndexOffset = (UINT)box.Indices32.size();
-	UINT sandDunesIndexOffset = gridIndexOffset + (UINT)grid.Indices32.size();
-    UINT sphereIndexOffset = sandDunesIndexOffset + (UINT)sandDunes.Indices32.size();
-	UINT cylinderIndexOffset = sphereIndexOffset + (UINT)sphere.Indices32.size();
-    UINT coneIndexOffset = cylinderIndexOffset + (UINT)cylinder.Indices32.size();
-    UINT triPrismIndexOffset = coneIndexOffset + (UINT)cone.Indices32.size();
-    UINT diamondIndexOffset = triPrismIndexOffset + (UINT)triPrism.Indices32.size();
-    UINT pyramidIndexOffset = diamondIndexOffset + (UINT)diamond.Indices32.size();
-    UINT torusIndexOffset = pyramidIndexOffset + (UINT)pyramid.Indices32.size();
-    UINT wedgeIndexOffset = torusIndexOffset + (UINT)torus.Indices32.size(); 
- 
-    
+		// Displace the vertices onto the GetHillsHeight terrain.
+		bool FollowHills = false;
+	};
 
-    // Define the SubmeshGeometry that cover different 
-    // regions of the vertex/index buffers.
+	// Every shape in shapeGeo, in packing order.  This one table drives both the
+	// cache key and the generator, so the two can never drift apart.
+	const std::vector<NamedShape> shapes =
+	{
+		{ "box",       { ShapeType::Box,             { 1.0f, 1.0f, 1.0f },       { 3 } } },
+		{ "grid",      { ShapeType::Grid,            { 90.0f, 150.0f },          { 60, 40 } } },
+		{ "sandDunes", { ShapeType::Grid,            { 200.0f, 200.0f },         { 60 * 4, 40 } }, true },
+		{ "sphere",    { ShapeType::Sphere,          { 0.5f },                   { 20, 20 } } },
+		{ "cylinder",  { ShapeType::Cylinder,        { 0.5f, 0.5f, 2.0f },       { 20, 20 } } },
+		{ "cone",      { ShapeType::Cone,            { 0.5f, 1.0f },             { 20, 1 } } },
+		{ "prism",     { ShapeType::TriangularPrism, { 1.0f, 1.0f, 1.0f } } },
+		{ "diamond",   { ShapeType::Diamond,         { 1.0f, 0.0f, 1.0f, 1.0f }, { 6, 1 } } },
+		{ "pyramid",   { ShapeType::Pyramid,         { 1.0f, 1.0f, 1.0f } } },
+		{ "torus",     { ShapeType::Torus,           { 0.1f, 1.0f },             { 20, 20 } } },
+		{ "wedge",     { ShapeType::Wedge,           { 1.0f, 1.0f, 2.0f } } },
+	};
 
-	SubmeshGeometry boxSubmesh;
-	boxSubmesh.IndexCount = (UINT)box.Indices32.size();
-	boxSubmesh.StartIndexLocation = boxIndexOffset;
-	boxSubmesh.BaseVertexLocation = boxVertexOffset;
+	GeometryCache::Key key;
+	key.Add("shapeGeo").Add((std::uint32_t)sizeof(Vertex));
+	for(auto& shape : shapes)
+	{
+		key.Add(shape.Name).Add((std::uint32_t)shape.Desc.Type);
+		for(float param : shape.Desc.Params)
+			key.Add(param);
+		for(std::uint32_t count : shape.Desc.Counts)
+			key.Add(count);
+
+		// Change the tag whenever GetHillsHeight/GetHillsNormal change.
+		if(shape.FollowHills)
+			key.Add("hills-v1");
+	}
 
-    SubmeshGeometry wedgeSubmesh;
-    wedgeSubmesh.IndexCount = (UINT)wedge.Indices32.size();
-    wedgeSubmesh.StartIndexLocation = wedgeIndexOffset;
-    wedgeSubmesh.BaseVertexLocation = wedgeVertexOffset;
+	auto geo = std::make_unique<MeshGeometry>();
+	geo->Name = "shapeGeo";
 
-	SubmeshGeometry gridSubmesh;
-	gridSubmesh.IndexCount = (UINT)grid.Indices32.size();
-	gridSubmesh.StartIndexLocation = gridIndexOffset;
-	gridSubmesh.BaseVertexLocation = gridVertexOffset;
+	const std::wstring cacheFile = L"Cache\\shapeGeo.bin";
+	if(!GeometryCache::Load(cacheFile, key.Hash(), *geo))
+	{
+		//
+		// We are concatenating all the geometry into one big vertex/index buffer.  So
+		// define the regions in the buffer each submesh covers.
+		//
 
-    SubmeshGeometry sandDunesSubmesh;
-    sandDunesSubmesh.IndexCount = (UINT)sandDunes.Indices32.size();
-    sandDunesSubmesh.StartIndexLocation = sandDunesIndexOffset;
-    sandDunesSubmesh.BaseVertexLocation = sandDunesVertexOffset;
+		GeometryGenerator geoGen;
+		std::vector<Vertex> vertices;
 
-	SubmeshGeometry sphereSubmesh;
-	sphereSubmesh.IndexCount = (UINT)sphere.Indices32.size();
-	sphereSubmesh.StartIndexLocation = sphereIndexOffset;
-	sphereSubmesh.BaseVertexLocation = sphereVertexOffset;
+		// Indices are kept local to their submesh (BaseVertexLocation supplies the
+		// offset), so they only need 32 bits if a single batch is that large.
+		std::vector<std::uint32_t> indices;
+		std::uint32_t maxIndex = 0;
 
-	SubmeshGeometry cylinderSubmesh;
-	cylinderSubmesh.IndexCount = (UINT)cylinder.Indices32.size();
-	cylinderSubmesh.StartIndexLocation = cylinderIndexOffset;
-	cylinderSubmesh.BaseVertexLocation = cylinderVertexOffset;
+		for(auto& shape : shapes)
+		{
+			// Meshes too large for 16-bit indices are drawn as several batches
+			// instead of promoting the whole buffer to 32-bit indices.
+			std::vector<GeometryGenerator::MeshData> batches =
+				geoGen.SplitForIndices16(geoGen.CreateShape(shape.Desc));
+
+			SubmeshGeometry submesh;
+			submesh.StartIndexLocation = (UINT)indices.size();
+			submesh.BaseVertexLocation = (INT)vertices.size();
+			if(batches.size() > 1)
+			{
+				submesh.FirstBatch = (UINT)geo->Batches.size();
+				submesh.BatchCount = (UINT)batches.size();
+			}
+
+			for(auto& mesh : batches)
+			{
+				SubmeshGeometry batch;
+				batch.IndexCount = (UINT)mesh.Indices32.size();
+				batch.StartIndexLocation = (UINT)indices.size();
+				batch.BaseVertexLocation = (INT)vertices.size();
+
+				// Extract the vertex elements we are interested in and pack the
+				// vertices of all the meshes into one vertex buffer.
+				for(auto& v : mesh.Vertices)
+				{
+					Vertex vertex;
+					vertex.Pos = v.Position;
+					vertex.Normal = v.Normal;
+					vertex.TexC = v.TexC;
+
+					if(shape.FollowHills)
+					{
+						vertex.Pos.y = GetHillsHeight(v.Position.x, v.Position.z);
+						vertex.Normal = GetHillsNormal(v.Position.x, v.Position.z);
+					}
+
+					vertices.push_back(vertex);
+				}
+
+				for(std::uint32_t i : mesh.Indices32)
+					maxIndex = std::max<std::uint32_t>(maxIndex, i);
+				indices.insert(indices.end(), std::begin(mesh.Indices32), std::end(mesh.Indices32));
+
+				d3dUtil::ComputeBounds(&vertices[batch.BaseVertexLocation].Pos,
+					(UINT)mesh.Vertices.size(), sizeof(Vertex), batch.Bounds, batch.Sphere);
+
+				submesh.IndexCount += batch.IndexCount;
+				if(submesh.BatchCount > 0)
+					geo->Batches.push_back(batch);
+			}
+
+			// Bounds are taken after the hills displacement, over every batch.
+			d3dUtil::ComputeBounds(&vertices[submesh.BaseVertexLocation].Pos,
+				(UINT)vertices.size() - submesh.BaseVertexLocation, sizeof(Vertex), submesh.Bounds, submesh.Sphere);
+
+			geo->DrawArgs[shape.Name] = submesh;
+		}
 
-    SubmeshGeometry coneSubmesh;
-    coneSubmesh.IndexCount = (UINT)cone.Indices32.size();
-    coneSubmesh.StartIndexLocation = coneIndexOffset;
-    coneSubmesh.BaseVertexLocation = coneVertexOffset;
+		const bool use16 = maxIndex <= 0xffff;
+		const UINT indexSize = use16 ? sizeof(std::uint16_t) : sizeof(std::uint32_t);
 
-    SubmeshGeometry triPrismSubmesh;
-    triPrismSubmesh.IndexCount = (UINT)triPrism.Indices32.size();
-    triPrismSubmesh.StartIndexLocation = triPrismIndexOffset;
-    triPrismSubmesh.BaseVertexLocation = triPrismVertexOffset;
+		const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
+		const UINT ibByteSize = (UINT)indices.size()  * indexSize;
 
-    SubmeshGeometry diamondSubmesh;
-    diamondSubmesh.IndexCount = (UINT)diamond.Indices32.size();
-    diamondSubmesh.StartIndexLocation = diamondIndexOffset;
-    diamondSubmesh.BaseVertexLocation = diamondVertexOffset;
+		ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
+		CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
 
-    SubmeshGeometry pyramidSubmesh;
-    pyramidSubmesh.IndexCount = (UINT)pyramid.Indices32.size();
-    pyramidSubmesh.StartIndexLocation = pyramidIndexOffset;
-    pyramidSubmesh.BaseVertexLocation = pyramidVertexOffset;  
+		ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
+		if(use16)
+		{
+			std::uint16_t* dst = (std::uint16_t*)geo->IndexBufferCPU->GetBufferPointer();
+			for(size_t i = 0; i < indices.size(); ++i)
+				dst[i] = (std::uint16_t)indices[i];
+		}
+		else
+		{
+			CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+		}
 
-    SubmeshGeometry torusSubmesh;
-    torusSubmesh.IndexCount = (UINT)torus.Indices32.size();
-    torusSubmesh.StartIndexLocation = torusIndexOffset;
-    torusSubmesh.BaseVertexLocation = torusVertexOffset;
+		geo->VertexByteStride = sizeof(Vertex);
+		geo->VertexBufferByteSize = vbByteSize;
+		geo->IndexFormat = use16 ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+		geo->IndexBufferByteSize = ibByteSize;
 
+		GeometryCache::Save(cacheFile, key.Hash(), *geo);
+	}
 
+	UploadGeometry(*geo);
 
-	//
-	// Extract the vertex elements we are interested in and pack the
-	// vertices of all the meshes into one vertex buffer.
-	//
+	mGeometries.Add(geo->Name, std::move(geo));
+}
 
-	auto totalVertexCount =
-		box.Vertices.size() +
-		grid.Vertices.size() +
-		sandDunes.Vertices.size() +
-		sphere.Vertices.size() +
-		cylinder.Vertices.size() +
-		cone.Vertices.size() +
-		triPrism.Vertices.size() +
-		diamond.Vertices.size() +
-		pyramid.Vertices.size() +
-		torus.Vertices.size() +
-		wedge.Vertices.size();
-	
-      
-	std::vector<Vertex> vertices(totalVertexCount);
+void ShapesApp::BuildTreeSpritesGeometry()
+{
+	const float m_size = 15.0f;
+	const float m_halfHeight = m_size/2.4f; 
 
-	UINT k = 0;
-	for(size_t i = 0; i < box.Vertices.size(); ++i, ++k)
+	// Density regions, as minimum spacing between trees: the groves beside the
+	// castle, then the forest all around the sand.  Keep them apart from each
+	// other and off the castle and the maze.
+	const ScatterRegion regions[] =
 	{
-		vertices[k].Pos = box.Vertices[i].Position;
-        vertices[k].Normal = box.Vertices[i].Normal;
-        vertices[k].TexC = box.Vertices[i].TexC;
-	}
+		{ -40.0f,  -60.0f,  -30.0f,  30.0f, 6.0f }, // left grove
+		{  30.0f,  -60.0f,   40.0f,  30.0f, 6.0f }, // right grove
+		{ -40.0f,  -80.0f,   40.0f, -70.0f, 6.0f }, // front grove
+		{ -40.0f,   40.0f,   40.0f,  50.0f, 6.0f }, // back grove
+		{ -700.0f, -700.0f, -50.0f, 700.0f, 3.4f }, // forest, west
+		{  50.0f,  -700.0f, 700.0f, 700.0f, 3.4f }, // forest, east
+		{ -50.0f,  -700.0f,  50.0f, -105.0f, 3.4f }, // forest, south
+		{ -50.0f,    85.0f,  50.0f, 700.0f, 3.4f }, // forest, north
+	};
+	const std::uint32_t seed = 3111;
+	const float chunkSize = 32.0f;
 
-	for(size_t i = 0; i < grid.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = grid.Vertices[i].Position;
-		vertices[k].Normal = grid.Vertices[i].Normal;
-		vertices[k].TexC = grid.Vertices[i].TexC;
-	}
-    for (size_t i = 0; i < sandDunes.Vertices.size(); ++i, ++k)
-    {
-		auto& p = sandDunes.Vertices[i].Position;
-		vertices[k].Pos = p;
-		vertices[k].Pos.y = GetHillsHeight(p.x, p.z);
-		vertices[k].Normal = GetHillsNormal(p.x, p.z);
-		vertices[k].TexC = sandDunes.Vertices[i].TexC;
-    }
+	mTreeGrid = ScatterGrid::Cover(regions, _countof(regions), chunkSize);
 
-	for(size_t i = 0; i < sphere.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = sphere.Vertices[i].Position;
-		vertices[k].Normal = sphere.Vertices[i].Normal;
-		vertices[k].TexC = sphere.Vertices[i].TexC;
-	}
+	GeometryCache::Key key;
+	key.Add("treeSpritesGeo").Add((std::uint32_t)sizeof(TreeSpriteVertex))
+		.Add(seed).Add(chunkSize).Add(m_size);
+	for(const ScatterRegion& region : regions)
+		key.Add(&region, sizeof(region));
+
+	for(const BoundingBox& ground : mGroundBoxes)
+		key.Add(&ground, sizeof(ground));
+
+	// Change the tag whenever ScatterPoissonDisk changes.
+	key.Add("scatter-v2");
+
+	auto geo = std::make_unique<MeshGeometry>();
+	geo->Name = "treeSpritesGeo";
 
-	for(size_t i = 0; i < cylinder.Vertices.size(); ++i, ++k)
+	const std::wstring cacheFile = L"Cache\\treeSpritesGeo.bin";
+	if(!GeometryCache::Load(cacheFile, key.Hash(), *geo))
 	{
-		vertices[k].Pos = cylinder.Vertices[i].Position;
-		vertices[k].Normal = cylinder.Vertices[i].Normal;
-		vertices[k].TexC = cylinder.Vertices[i].TexC;
-	}
+		std::vector<XMFLOAT2> points;
+		ScatterPoissonDisk(regions, _countof(regions), seed, points);
 
-    for (size_t i = 0; i < cone.Vertices.size(); ++i, ++k)
-    {
-        vertices[k].Pos = cone.Vertices[i].Position;
-		vertices[k].Normal = cone.Vertices[i].Normal;
-		vertices[k].TexC = cone.Vertices[i].TexC;
-    }
+		std::vector<std::uint32_t> order, chunkStart;
+		SortIntoChunks(mTreeGrid, points, order, chunkStart);
 
-    for (size_t i = 0; i < triPrism.Vertices.size(); ++i, ++k)
-    {
-        vertices[k].Pos = triPrism.Vertices[i].Position;
-		vertices[k].Normal = triPrism.Vertices[i].Normal;
-		vertices[k].TexC = triPrism.Vertices[i].TexC;
-    }
+		// Trees are stored chunk by chunk, standing on the ground.
+		std::vector<TreeSpriteVertex> vertices(points.size());
+		for(size_t i = 0; i < vertices.size(); ++i)
+		{
+			const XMFLOAT2& p = points[order[i]];
+			vertices[i].Pos = XMFLOAT3(p.x, GetGroundHeight(p.x, p.y) + m_halfHeight, p.y);
+			vertices[i].Size = XMFLOAT2(m_size, m_size);
+		}
 
-    for (size_t i = 0; i < diamond.Vertices.size(); ++i, ++k)
-    {
-        vertices[k].Pos = diamond.Vertices[i].Position;
-		vertices[k].Normal = diamond.Vertices[i].Normal;
-		vertices[k].TexC = diamond.Vertices[i].TexC;
-    }
+		// One range per grid chunk, empty ones included, so the chunk index
+		// is the position in Batches.  The "points" submesh does not refer to
+		// them: UpdateTreeSprites streams the visible chunks instead.  The
+		// points are billboard centers; grow the bounds by half a sprite so
+		// they cover the quads the geometry shader expands them into.
+		auto growBounds = [&](SubmeshGeometry& submesh)
+		{
+			submesh.Bounds.Extents.x += 0.5f*m_size;
+			submesh.Bounds.Extents.y += 0.5f*m_size;
+			submesh.Bounds.Extents.z += 0.5f*m_size;
+			submesh.Sphere.Radius += 0.5f*sqrtf(2.0f)*m_size;
+		};
 
-    for (size_t i = 0; i < pyramid.Vertices.size(); ++i, ++k)
-    {
-        vertices[k].Pos = pyramid.Vertices[i].Position;
-		vertices[k].Normal = pyramid.Vertices[i].Normal;
-		vertices[k].TexC = pyramid.Vertices[i].TexC;
-    }
+		for(std::uint32_t c = 0; c < mTreeGrid.ChunkCount(); ++c)
+		{
+			SubmeshGeometry chunk;
+			chunk.IndexCount = chunkStart[c + 1] - chunkStart[c];
+			chunk.BaseVertexLocation = (INT)chunkStart[c];
+			if(chunk.IndexCount > 0)
+			{
+				d3dUtil::ComputeBounds(&vertices[chunkStart[c]].Pos, chunk.IndexCount, sizeof(TreeSpriteVertex), chunk.Bounds, chunk.Sphere);
+				growBounds(chunk);
+			}
+			geo->Batches.push_back(chunk);
+		}
 
-     for (size_t i = 0; i < torus.Vertices.size(); ++i, ++k)
-    {
-        vertices[k].Pos = torus.Vertices[i].Position;
-		vertices[k].Normal = torus.Vertices[i].Normal;
-		vertices[k].TexC = torus.Vertices[i].TexC;
-    }
-     for (size_t i = 0; i < wedge.Vertices.size(); ++i, ++k)
-     {
-         vertices[k].Pos = wedge.Vertices[i].Position;
-		 vertices[k].Normal = wedge.Vertices[i].Normal;
-		 vertices[k].TexC = wedge.Vertices[i].TexC;
-     }
+		// The stream is drawn in order, with up to two padding sprites in front
+		// of each chunk, see UpdateTreeSprites.
+		std::vector<std::uint32_t> indices(vertices.size() + 2 * (size_t)mTreeGrid.ChunkCount());
+		for(size_t i = 0; i < indices.size(); ++i)
+			indices[i] = (std::uint32_t)i;
 
+		const UINT vbByteSize = (UINT)vertices.size() * sizeof(TreeSpriteVertex);
+		const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint32_t);
 
+		ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
+		CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
 
-	std::vector<std::uint16_t> indices;
-	indices.insert(indices.end(), std::begin(box.GetIndices16()), std::end(box.GetIndices16()));
-	indices.insert(indices.end(), std::begin(grid.GetIndices16()), std::end(grid.GetIndices16()));
-    indices.insert(indices.end(), std::begin(sandDunes.GetIndices16()), std::end(sandDunes.GetIndices16()));
-	indices.insert(indices.end(), std::begin(sphere.GetIndices16()), std::end(sphere.GetIndices16()));
-	indices.insert(indices.end(), std::begin(cylinder.GetIndices16()), std::end(cylinder.GetIndices16()));
-	indices.insert(indices.end(), std::begin(cone.GetIndices16()), std::end(cone.GetIndices16()));
-	indices.insert(indices.end(), std::begin(triPrism.GetIndices16()), std::end(triPrism.GetIndices16()));
-	indices.insert(indices.end(), std::begin(diamond.GetIndices16()), std::end(diamond.GetIndices16()));
-	indices.insert(indices.end(), std::begin(pyramid.GetIndices16()), std::end(pyramid.GetIndices16()));
-	indices.insert(indices.end(), std::begin(torus.GetIndices16()), std::end(torus.GetIndices16()));
-    indices.insert(indices.end(), std::begin(wedge.GetIndices16()), std::end(wedge.GetIndices16()));
-
-
-    const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
-    const UINT ibByteSize = (UINT)indices.size()  * sizeof(std::uint16_t);
+		ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
+		CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
-	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "shapeGeo";
+		geo->VertexByteStride = sizeof(TreeSpriteVertex);
+		geo->VertexBufferByteSize = vbByteSize;
+		geo->IndexFormat = DXGI_FORMAT_R32_UINT;
+		geo->IndexBufferByteSize = ibByteSize;
 
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
+		SubmeshGeometry submesh;
+		submesh.IndexCount = (UINT)vertices.size();
+		submesh.StartIndexLocation = 0;
+		submesh.BaseVertexLocation = 0;
 
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+		d3dUtil::ComputeBounds(&vertices[0].Pos, (UINT)vertices.size(), sizeof(TreeSpriteVertex), submesh.Bounds, submesh.Sphere);
+		growBounds(submesh);
 
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
+		geo->DrawArgs["points"] = submesh;
 
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+		GeometryCache::Save(cacheFile, key.Hash(), *geo);
+	}
+	assert(geo->Batches.size() == mTreeGrid.ChunkCount());
 
-	geo->VertexByteStride = sizeof(Vertex);
-	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-	geo->IndexBufferByteSize = ibByteSize;
+	// Only the indices live on the GPU, the vertices of the visible chunks are
+	// streamed into the upload ring every frame.
+	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
+		mCommandList.Get(), geo->IndexBufferCPU->GetBufferPointer(), geo->IndexBufferByteSize, geo->IndexBufferUploader);
 
-	geo->DrawArgs["box"] = boxSubmesh;
-	geo->DrawArgs["grid"] = gridSubmesh;
-    geo->DrawArgs["sandDunes"] = sandDunesSubmesh;
-	geo->DrawArgs["sphere"] = sphereSubmesh;
-	geo->DrawArgs["cylinder"] = cylinderSubmesh;
-	geo->DrawArgs["cone"] = coneSubmesh;
-	geo->DrawArgs["prism"] = triPrismSubmesh;
-	geo->DrawArgs["diamond"] = diamondSubmesh;
-	geo->DrawArgs["pyramid"] = pyramidSubmesh;
-	geo->DrawArgs["torus"] = torusSubmesh;
-    geo->DrawArgs["wedge"] = wedgeSubmesh;
-
-	mGeometries[geo->Name] = std::move(geo);
+	mTreeStreamCapacity = geo->IndexBufferByteSize / sizeof(std::uint32_t);
+	mTreeSpritesGeo = geo.get();
+	mGeometries.Add("treeSpritesGeo", std::move(geo));
 }
 
-void ShapesApp::BuildTreeSpritesGeometry()
+// Streams the trees of the chunks in view into the upload ring and points the
+// tree sprite geometry at them, so the draw only
+// touches visible trees.  Only the grid chunks under the frustum's footprint
+// are visited, so the cost follows the view, not the size of the forest.
+void ShapesApp::UpdateTreeSprites()
 {
-	
-	struct TreeSpriteVertex
-	{
-		XMFLOAT3 Pos;
-		XMFLOAT2 Size;
-	};
+	if(mTreeSpritesRitem == nullptr)
+		return;
 
-	const float m_size = 15.0f;
-	const float m_halfHeight = m_size/2.4f; 
+	MeshGeometry* geo = mTreeSpritesGeo;
+	const TreeSpriteVertex* trees = static_cast<const TreeSpriteVertex*>(geo->VertexBufferCPU->GetBufferPointer());
 
-	static const int treeCount = 30;
-	std::array<TreeSpriteVertex, treeCount> vertices;
-	//left side 
-	for(UINT i = 0; i < treeCount*0.3; ++i)
+	std::uint32_t firstX = 0, firstZ = 0;
+	std::uint32_t lastX = mTreeGrid.Width - 1, lastZ = mTreeGrid.Height - 1;
+	bool inView = !mVisibleRitems[(int)RenderLayer::AlphaTestedTreeSprites].empty();
+	if(inView && mFrustumCullingEnabled)
 	{
-		vertices[i].Pos = GetTreePosition(-40, -30, -60, 30, m_halfHeight);
-		vertices[i].Size = XMFLOAT2(m_size, m_size);
-	}
-	//right side
-	for(UINT i = treeCount*0.3; i < treeCount * 0.6; ++i)
-	{
-		vertices[i].Pos = vertices[i].Pos = GetTreePosition(30, 40, -60, 30, m_halfHeight);
-		vertices[i].Size = XMFLOAT2(m_size, m_size);
-	}
+		XMFLOAT3 corners[BoundingFrustum::CORNER_COUNT];
+		mWorldFrustum.GetCorners(corners);
 
+		XMFLOAT2 minXZ(corners[0].x, corners[0].z), maxXZ(corners[0].x, corners[0].z);
+		for(const XMFLOAT3& corner : corners)
+		{
+			minXZ = XMFLOAT2(std::min<float>(minXZ.x, corner.x), std::min<float>(minXZ.y, corner.z));
+			maxXZ = XMFLOAT2(std::max<float>(maxXZ.x, corner.x), std::max<float>(maxXZ.y, corner.z));
+		}
 
-	//front side
-	for (UINT i = treeCount * 0.6; i < treeCount * 0.8; ++i)
-	{
-		vertices[i].Pos = vertices[i].Pos = GetTreePosition(-40, 40, -70, -80, m_halfHeight);
-		vertices[i].Size = XMFLOAT2(m_size, m_size);
+		inView = mTreeGrid.ChunkRange(minXZ.x, minXZ.y, maxXZ.x, maxXZ.y, firstX, firstZ, lastX, lastZ);
 	}
 
-
-	//back side
-	for (UINT i = treeCount * 0.8; i < treeCount; ++i)
+	// The sprite shader picks a tree's texture from its primitive ID mod 3.
+	// Zero-size padding sprites, which the geometry shader expands to nothing,
+	// keep every tree at the same position mod 3 as in the full list, so trees
+	// do not change texture as chunks come and go.
+	const TreeSpriteVertex pad = { XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT2(0.0f, 0.0f) };
+
+	// Find the visible chunks and the stream length first, so the ring only
+	// gives out what this frame uses.
+	mVisibleTreeChunks.clear();
+	UINT count = 0;
+	for(std::uint32_t z = firstZ; inView && z <= lastZ; ++z)
 	{
-		vertices[i].Pos = vertices[i].Pos = GetTreePosition(-40, 40, 40, 50, m_halfHeight);
-		vertices[i].Size = XMFLOAT2(m_size, m_size);
+		for(std::uint32_t x = firstX; x <= lastX; ++x)
+		{
+			const UINT index = z * mTreeGrid.Width + x;
+			const SubmeshGeometry& chunk = geo->Batches[index];
+			if(chunk.IndexCount == 0)
+				continue;
+			if(mFrustumCullingEnabled && !mWorldFrustum.Intersects(chunk.Bounds))
+				continue;
+
+			while(count % 3 != (UINT)chunk.BaseVertexLocation % 3)
+				++count;
+			count += chunk.IndexCount;
+			mVisibleTreeChunks.push_back(index);
+		}
 	}
-	
-	
 
-	std::array<std::uint16_t, treeCount> indices =
-	{
-		0, 1, 2, 3, 4, 5, 6, 7,
-		8, 9, 10, 11, 12, 13, 14, 15,
-		16, 17, 18, 19 ,20, 21, 22, 
-		23, 24, 25, 26, 27, 28, 29
-	};
+	UploadRing::Allocation stream = mUploadRing->Allocate(std::max<UINT>(count, 1) * sizeof(TreeSpriteVertex));
+	TreeSpriteVertex* out = reinterpret_cast<TreeSpriteVertex*>(stream.CpuAddress);
 
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(TreeSpriteVertex);
-	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
-
-	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "treeSpritesGeo";
-
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
-
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
-
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+	UINT written = 0;
+	for(UINT index : mVisibleTreeChunks)
+	{
+		const SubmeshGeometry& chunk = geo->Batches[index];
+		while(written % 3 != (UINT)chunk.BaseVertexLocation % 3)
+			out[written++] = pad;
 
-	geo->VertexByteStride = sizeof(TreeSpriteVertex);
-	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-	geo->IndexBufferByteSize = ibByteSize;
+		memcpy(out + written, trees + chunk.BaseVertexLocation, chunk.IndexCount * sizeof(TreeSpriteVertex));
+		written += chunk.IndexCount;
+	}
+	assert(written == count);
 
-	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
-	submesh.StartIndexLocation = 0;
-	submesh.BaseVertexLocation = 0;
+	geo->VertexBufferGPU = stream.Resource;
+	geo->VertexBufferOffset = stream.Offset;
+	geo->VertexBufferByteSize = std::max<UINT>(count, 1) * sizeof(TreeSpriteVertex);
+	mTreeSpritesRitem->IndexCount = count;
+}
 
-	geo->DrawArgs["points"] = submesh;
+//Creates the GPU vertex/index buffers from the CPU copies, whether they were just
+//generated or loaded from the geometry cache.
+void ShapesApp::UploadGeometry(MeshGeometry& geo)
+{
+	geo.VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
+		mCommandList.Get(), geo.VertexBufferCPU->GetBufferPointer(), geo.VertexBufferByteSize, geo.VertexBufferUploader);
 
-	mGeometries["treeSpritesGeo"] = std::move(geo);
+	geo.IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
+		mCommandList.Get(), geo.IndexBufferCPU->GetBufferPointer(), geo.IndexBufferByteSize, geo.IndexBufferUploader);
 }
 
 void ShapesApp::BuildPSOs()
@@ -1312,13 +1983,13 @@ void ShapesApp::BuildPSOs()
 	opaquePsoDesc.pRootSignature = mRootSignature.Get();
 	opaquePsoDesc.VS =
 	{
-		reinterpret_cast<BYTE*>(mShaders["standardVS"]->GetBufferPointer()),
-		mShaders["standardVS"]->GetBufferSize()
+		reinterpret_cast<BYTE*>(mShaders.Get("standardVS")->GetBufferPointer()),
+		mShaders.Get("standardVS")->GetBufferSize()
 	};
 	opaquePsoDesc.PS =
 	{
-		reinterpret_cast<BYTE*>(mShaders["opaquePS"]->GetBufferPointer()),
-		mShaders["opaquePS"]->GetBufferSize()
+		reinterpret_cast<BYTE*>(mShaders.Get("opaquePS")->GetBufferPointer()),
+		mShaders.Get("opaquePS")->GetBufferSize()
 	};
 	opaquePsoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
 	opaquePsoDesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
@@ -1332,7 +2003,21 @@ void ShapesApp::BuildPSOs()
 	opaquePsoDesc.SampleDesc.Count = m4xMsaaState ? 4 : 1;
 	opaquePsoDesc.SampleDesc.Quality = m4xMsaaState ? (m4xMsaaQuality - 1) : 0;
 	opaquePsoDesc.DSVFormat = mDepthStencilFormat;
-	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&opaquePsoDesc, IID_PPV_ARGS(&mPSOs["opaque"])));
+	mOpaquePSO = mPSOs.Intern("opaque");
+	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&opaquePsoDesc, IID_PPV_ARGS(&mPSOs[mOpaquePSO])));
+
+	//
+	// PSO for instanced opaque objects
+	//
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC opaqueInstancedPsoDesc = opaquePsoDesc;
+	opaqueInstancedPsoDesc.VS =
+	{
+		reinterpret_cast<BYTE*>(mShaders.Get("instancedVS")->GetBufferPointer()),
+		mShaders.Get("instancedVS")->GetBufferSize()
+	};
+	mOpaqueInstancedPSO = mPSOs.Intern("opaqueInstanced");
+	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&opaqueInstancedPsoDesc, IID_PPV_ARGS(&mPSOs[mOpaqueInstancedPSO])));
 
 	//
 	// PSO for transparent objects
@@ -1355,7 +2040,8 @@ void ShapesApp::BuildPSOs()
 	//transparentPsoDesc.BlendState.AlphaToCoverageEnable = true;
 
 	transparentPsoDesc.BlendState.RenderTarget[0] = transparencyBlendDesc;
-	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&transparentPsoDesc, IID_PPV_ARGS(&mPSOs["transparent"])));
+	mTransparentPSO = mPSOs.Intern("transparent");
+	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&transparentPsoDesc, IID_PPV_ARGS(&mPSOs[mTransparentPSO])));
 
 	//
 	// PSO for alpha tested objects
@@ -1364,11 +2050,12 @@ void ShapesApp::BuildPSOs()
 	D3D12_GRAPHICS_PIPELINE_STATE_DESC alphaTestedPsoDesc = opaquePsoDesc;
 	alphaTestedPsoDesc.PS =
 	{
-		reinterpret_cast<BYTE*>(mShaders["alphaTestedPS"]->GetBufferPointer()),
-		mShaders["alphaTestedPS"]->GetBufferSize()
+		reinterpret_cast<BYTE*>(mShaders.Get("alphaTestedPS")->GetBufferPointer()),
+		mShaders.Get("alphaTestedPS")->GetBufferSize()
 	};
 	alphaTestedPsoDesc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
-	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&alphaTestedPsoDesc, IID_PPV_ARGS(&mPSOs["alphaTested"])));
+	mAlphaTestedPSO = mPSOs.Intern("alphaTested");
+	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&alphaTestedPsoDesc, IID_PPV_ARGS(&mPSOs[mAlphaTestedPSO])));
 
 	//
 	// PSO for tree sprites
@@ -1376,25 +2063,32 @@ void ShapesApp::BuildPSOs()
 	D3D12_GRAPHICS_PIPELINE_STATE_DESC treeSpritePsoDesc = opaquePsoDesc;
 	treeSpritePsoDesc.VS =
 	{
-		reinterpret_cast<BYTE*>(mShaders["treeSpriteVS"]->GetBufferPointer()),
-		mShaders["treeSpriteVS"]->GetBufferSize()
+		reinterpret_cast<BYTE*>(mShaders.Get("treeSpriteVS")->GetBufferPointer()),
+		mShaders.Get("treeSpriteVS")->GetBufferSize()
 	};
 	treeSpritePsoDesc.GS =
 	{
-		reinterpret_cast<BYTE*>(mShaders["treeSpriteGS"]->GetBufferPointer()),
-		mShaders["treeSpriteGS"]->GetBufferSize()
+		reinterpret_cast<BYTE*>(mShaders.Get("treeSpriteGS")->GetBufferPointer()),
+		mShaders.Get("treeSpriteGS")->GetBufferSize()
 	};
 	treeSpritePsoDesc.PS =
 	{
-		reinterpret_cast<BYTE*>(mShaders["treeSpritePS"]->GetBufferPointer()),
-		mShaders["treeSpritePS"]->GetBufferSize()
+		reinterpret_cast<BYTE*>(mShaders.Get("treeSpritePS")->GetBufferPointer()),
+		mShaders.Get("treeSpritePS")->GetBufferSize()
 	};
 	//step1
 	treeSpritePsoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_POINT;
 	treeSpritePsoDesc.InputLayout = { mTreeSpriteInputLayout.data(), (UINT)mTreeSpriteInputLayout.size() };
 	treeSpritePsoDesc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
 
-	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&treeSpritePsoDesc, IID_PPV_ARGS(&mPSOs["treeSprites"])));
+	mTreeSpritesPSO = mPSOs.Intern("treeSprites");
+	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&treeSpritePsoDesc, IID_PPV_ARGS(&mPSOs[mTreeSpritesPSO])));
+
+	mSegmentPSOs[(int)DrawSegment::Opaque] = mOpaquePSO;
+	mSegmentPSOs[(int)DrawSegment::InstanceGroups] = mOpaqueInstancedPSO;
+	mSegmentPSOs[(int)DrawSegment::AlphaTested] = mAlphaTestedPSO;
+	mSegmentPSOs[(int)DrawSegment::TreeSprites] = mTreeSpritesPSO;
+	mSegmentPSOs[(int)DrawSegment::Transparent] = mTransparentPSO;
 }
 
 void ShapesApp::BuildFrameResources()
@@ -1402,471 +2096,455 @@ void ShapesApp::BuildFrameResources()
     for(int i = 0; i < gNumFrameResources; ++i)
     {
         mFrameResources.push_back(std::make_unique<FrameResource>(md3dDevice.Get(),
-            1, (UINT)mAllRitems.size(), (UINT)mMaterials.size()));
+            (UINT)mAllRitems.size(), mMaterials.Size(), (UINT)mRecordCmdLists.size(),
+            std::max<UINT>(1, (UINT)mLocalLights.size())));
+
+        // The lights never change, so each frame resource gets them once.
+        if(!mLocalLights.empty())
+            mFrameResources.back()->LocalLightBuffer->CopyData(0, mLocalLights.data(), (UINT)mLocalLights.size());
     }
+
+	// Most one frame can put in the upload ring: the pass constants, every
+	// instance, the full tree stream and the longest cluster lists, plus a
+	// placement alignment per allocation.  The frames in flight rarely all
+	// need that much, so the ring starts at two such frames and grows if they do.
+	// Object constants only change with their items and stay in each frame
+	// resource's ObjectCB.
+	const UINT64 alignment = D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT;
+	const UINT64 frameBytes = d3dUtil::CalcConstantBufferByteSize(sizeof(PassConstants)) +
+		(UINT64)mInstanceCount * sizeof(ObjectConstants) +
+		(UINT64)mTreeStreamCapacity * sizeof(TreeSpriteVertex) +
+		LightClusters::ClusterCount * sizeof(LightCluster) +
+		(UINT64)mLightClusters.MaxLightIndices() * sizeof(std::uint32_t) + 5 * alignment;
+	mUploadRing = std::make_unique<UploadRing>(md3dDevice.Get(), 2 * frameBytes);
+
+	// Create the extra recording lists against the first frame resource's
+	// allocators and close them right away; Draw resets them with the current
+	// frame resource's allocators.
+	for(size_t i = 0; i < mRecordCmdLists.size(); ++i)
+	{
+		ThrowIfFailed(md3dDevice->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT,
+			mFrameResources[0]->RecordCmdListAllocs[i].Get(), nullptr,
+			IID_PPV_ARGS(mRecordCmdLists[i].GetAddressOf())));
+		ThrowIfFailed(mRecordCmdLists[i]->Close());
+	}
 }
 
-void ShapesApp::BuildMaterials()
+// Starts the worker threads, used by the occlusion rasterizer and to record
+// command lists alongside the main thread.  One list per thread; the lists themselves are created in BuildFrameResources once
+// their allocators exist.
+void ShapesApp::BuildRecordLists()
 {
-	auto bricks0 = std::make_unique<Material>();
-	bricks0->Name = "bricks0";
-	bricks0->MatCBIndex = 0;
-	bricks0->DiffuseSrvHeapIndex = 0;
-	bricks0->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	bricks0->FresnelR0 = XMFLOAT3(1.2f, 1.2f, 0.2f);
-	bricks0->Roughness = 0.5f;
-
-	
+	UINT hardwareThreads = std::thread::hardware_concurrency();
+	UINT workerCount = std::min<UINT>(hardwareThreads > 1 ? hardwareThreads - 1 : 0, MaxRecordLists - 1);
 
-	auto stone0 = std::make_unique<Material>();
-	stone0->Name = "stone0";
-	stone0->MatCBIndex = 1;
-	stone0->DiffuseSrvHeapIndex = 1;
-	stone0->DiffuseAlbedo = XMFLOAT4(0.8f, 0.8f, 1.0f, 1.0f);
-	stone0->FresnelR0 = XMFLOAT3(0.2f, 0.2f, 0.2f);
-	stone0->Roughness = 0.9f;
-
-	auto sand0 = std::make_unique<Material>();
-	sand0->Name = "sand0";
-	sand0->MatCBIndex = 2;
-	sand0->DiffuseSrvHeapIndex = 2;
-	sand0->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	sand0->FresnelR0 = XMFLOAT3(0.6f, 0.6f, 0.6f);
-	sand0->Roughness = 0.95f;
-
-	auto redbrick0 = std::make_unique<Material>();
-	redbrick0->Name = "redbrick0";
-	redbrick0->MatCBIndex = 3;
-	redbrick0->DiffuseSrvHeapIndex = 3;
-	redbrick0->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	redbrick0->FresnelR0 = XMFLOAT3(0.6f, 0.6f, 0.6f);
-	redbrick0->Roughness = 0.3f;
-
-	auto Water0 = std::make_unique<Material>();
-	Water0->Name = "water0";
-	Water0->MatCBIndex = 4;
-	Water0->DiffuseSrvHeapIndex = 4;
-	Water0->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 0.5f);
-	Water0->FresnelR0 = XMFLOAT3(1.0f, 1.0f, 1.0f);
-	Water0->Roughness = 0.0f;
-
-	auto Ice0 = std::make_unique<Material>();
-	Ice0->Name = "ice0";
-	Ice0->MatCBIndex = 5;
-	Ice0->DiffuseSrvHeapIndex = 5;
-	Ice0->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 0.8f);
-	Ice0->FresnelR0 = XMFLOAT3(1.0f, 1.0f, 1.0f);
-	Ice0->Roughness = 0.1f;
-
-	auto grass0 = std::make_unique<Material>();
-	grass0->Name = "grass0";
-	grass0->MatCBIndex = 6;
-	grass0->DiffuseSrvHeapIndex = 6;
-	grass0->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	grass0->FresnelR0 = XMFLOAT3(0.2f, 0.2f, 0.2f);
-	grass0->Roughness = 0.7f;
-
-	auto wirefence = std::make_unique<Material>();
-	wirefence->Name = "wirefence";
-	wirefence->MatCBIndex = 7;
-	wirefence->DiffuseSrvHeapIndex = 7;
-	wirefence->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	wirefence->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
-	wirefence->Roughness = 0.25f;
-
-	auto treeSprites = std::make_unique<Material>();
-	treeSprites->Name = "treeSprites";
-	treeSprites->MatCBIndex = 8;
-	treeSprites->DiffuseSrvHeapIndex = 8;
-	treeSprites->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	treeSprites->FresnelR0 = XMFLOAT3(0.01f, 0.01f, 0.01f);
-	treeSprites->Roughness = 0.125f;
-
-	auto treeSprite = std::make_unique<Material>();
-	treeSprite->Name = "treeSprite";
-	treeSprite->MatCBIndex = 9;
-	treeSprite->DiffuseSrvHeapIndex = 9;
-	treeSprite->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	treeSprite->FresnelR0 = XMFLOAT3(0.01f, 0.01f, 0.01f);
-	treeSprite->Roughness = 0.125f;
+	mWorkerPool = std::make_unique<WorkerPool>(workerCount);
+	mRecordCmdLists.resize(workerCount);
+}
 
-	
+// Creates the materials and render items described by Scenes\maze.scene.  The
+// compiled form is mapped and walked record by record; names are only looked
+// up once per material and per distinct mesh, never per item.
+bool ShapesApp::LoadScene()
+{
+	SceneFile scene;
+	std::string error;
+	if(!scene.Open(L"Scenes\\maze.scene", L"Cache\\maze.scnb", RenderLayerNames, (UINT)RenderLayer::Count, error))
+	{
+		MessageBox(nullptr, AnsiToWString(error).c_str(), L"Scene Failed", MB_OK);
+		return false;
+	}
 
-	mMaterials["bricks0"] = std::move(bricks0);
-	mMaterials["stone0"] = std::move(stone0);
-	mMaterials["redbrick0"] = std::move(redbrick0);
-	mMaterials["ice0"] = std::move(Ice0);
-	mMaterials["water0"] = std::move(Water0);
-	mMaterials["sand0"] = std::move(sand0);
-	mMaterials["wirefence"] = std::move(wirefence);
-	mMaterials["treeSprites"] = std::move(treeSprites);	
-	mMaterials["treeSprite"] = std::move(treeSprite);
-	mMaterials["grass0"] = std::move(grass0);
+	// Material handles and texture indices go into the draw sort key.
+	if(mMaterials.Size() + scene.MaterialCount() > DrawSortKey::MaterialLimit)
+	{
+		MessageBox(nullptr, L"Scene has too many materials for the draw sort key.", L"Scene Failed", MB_OK);
+		return false;
+	}
 
-}
+	std::vector<Material*> materials(scene.MaterialCount());
+	for(UINT i = 0; i < scene.MaterialCount(); ++i)
+	{
+		const SceneFile::SceneMaterial& src = scene.Materials()[i];
+		if(src.DiffuseSrvHeapIndex >= DrawSortKey::TextureLimit)
+		{
+			std::string message = std::string("Material ") + src.Name + " texture index does not fit the draw sort key.";
+			MessageBox(nullptr, AnsiToWString(message).c_str(), L"Scene Failed", MB_OK);
+			return false;
+		}
 
+		auto mat = std::make_unique<Material>();
+		mat->Name = src.Name;
+		mat->DiffuseSrvHeapIndex = src.DiffuseSrvHeapIndex;
+		mat->DiffuseAlbedo = src.DiffuseAlbedo;
+		mat->FresnelR0 = src.FresnelR0;
+		mat->Roughness = src.Roughness;
 
+		// Material handles are dense, so they double as the MaterialCB slot.
+		materials[i] = mat.get();
+		materials[i]->MatCBIndex = mMaterials.Add(src.Name, std::move(mat));
+	}
 
-//makes building render items simpler, reduces repeated chunks of code
-//the itemType is the key used to access the submesh
-void ShapesApp::SetRenderItemInfo(RenderItem& Ritem, std::string itemType, XMMATRIX transform, std::string material, RenderLayer layer)
-{
-    Ritem.ObjCBIndex = objCBIndex++;
-    XMStoreFloat4x4(&Ritem.World, transform);
-    Ritem.Mat = mMaterials[material].get();
-    Ritem.Mat->NormalSrvHeapIndex = 1;
-    Ritem.Geo = mGeometries["shapeGeo"].get();
-    Ritem.PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-    Ritem.IndexCount = Ritem.Geo->DrawArgs[itemType].IndexCount;
-    Ritem.StartIndexLocation = Ritem.Geo->DrawArgs[itemType].StartIndexLocation;
-    Ritem.BaseVertexLocation = Ritem.Geo->DrawArgs[itemType].BaseVertexLocation;
-    
+	mWaterMat = mMaterials.Find("water0");
+	mMaterialChanges.Resize(mMaterials.Size());
 
-     mRitemLayer[(int)layer].push_back(&Ritem);
-   
-}
+	// The graph is copied out of the mapping, items are assigned their cells below.
+	mPortalGraph.Init(scene.Cells(), scene.CellCount(), scene.Portals(), scene.PortalCount(),
+		scene.CellMinY(), scene.CellMaxY());
 
-void ShapesApp::BuildRenderItems()
-{
+	mLightConstants.AmbientLight = { 0.25f, 0.25f, 0.25f, 1.0f };
+	mLightConstants.DirLightCount = 0;
 
-	float nintydegrees = XM_2PI / 4;
-	float x1, z1;  //using trig to change b/w x axis and z axix
-	x1 = z1 = 20;
-	float radius = sqrt(x1 * x1 + z1 * z1);
+	for(UINT i = 0; i < scene.LightCount(); ++i)
+	{
+		const SceneFile::SceneLight& src = scene.Lights()[i];
 
-   
+		Light light;
+		light.Strength = src.Strength;
+		light.Direction = src.Direction;
+		light.Position = src.Position;
+		light.FalloffStart = src.FalloffStart;
+		light.FalloffEnd = src.FalloffEnd;
 
-    auto gridRitem = std::make_unique<RenderItem>();
-	XMMATRIX gridWorld = XMMatrixScaling(90.0f, 1.8f, 180.0f) * XMMatrixTranslation(0, 0, -10);
-    SetRenderItemInfo(*gridRitem, "box",gridWorld, "sand0", RenderLayer::Opaque);
-	XMStoreFloat4x4(&gridRitem->TexTransform, XMMatrixScaling(20.0f,40.0f, 20.0f));
+		if(src.Type == SceneFile::LightDirectional)
+		{
+			mLightConstants.Lights[mLightConstants.DirLightCount++] = light;
+			continue;
+		}
 
-	mAllRitems.push_back(std::move(gridRitem));
+		// The shaders take lights with SpotPower 0 for point lights.  A spot
+		// light's cone for the clustering ends where pow(cos, SpotPower) drops
+		// below 1/256, too dim to show.
+		ClusterLight bounds;
+		bounds.Position = src.Position;
+		bounds.Range = src.FalloffEnd;
+		bounds.Direction = src.Direction;
+		bounds.ConeAngle = 0.0f;
+		light.SpotPower = 0.0f;
+		if(src.Type == SceneFile::LightSpot)
+		{
+			bounds.ConeAngle = acosf(powf(1.0f / 256.0f, 1.0f / src.SpotPower));
+			light.SpotPower = src.SpotPower;
+		}
 
-   
+		mLocalLights.push_back(light);
+		mClusterLights.push_back(bounds);
+	}
 
-    //towers
-    for (int i = 0; i < 4; ++i)
-    {
-		float theta = i * nintydegrees + XM_2PI / 8; //90+45 =135
-		float sRadius = radius * sinf(theta);
-		float cRadius = radius * cosf(theta);
+	mLightChanges.Resize(1);
+	mLightChanges.MarkDirty(0);
 
-        auto towerRitem = std::make_unique<RenderItem>();
-        auto ttopRitem = std::make_unique<RenderItem>();
-        auto donutRitem = std::make_unique<RenderItem>();
-        
-       
+	// Parents come before their children in the file, so they have been added
+	// by the time a child refers to them.
+	std::vector<TransformHierarchy::Node> nodes(scene.NodeCount());
+	for(UINT i = 0; i < scene.NodeCount(); ++i)
+	{
+		const SceneFile::SceneNode& src = scene.Nodes()[i];
+		TransformHierarchy::Node parent = src.Parent == SceneFile::NoNode ? TransformHierarchy::NoNode : nodes[src.Parent];
 
-        XMMATRIX towerWorld = XMMatrixScaling(4.0f, 4.0f, 4.0f) * XMMatrixTranslation(cRadius, 3.5f, sRadius);
-		XMStoreFloat4x4(&towerRitem->TexTransform, XMMatrixScaling(4.0f, 4.0f, 4.0f));
+		nodes[i] = mTransforms.Add(parent, src.Local);
+	}
 
-        XMMATRIX ttopWorld = XMMatrixScaling(5.0f, 4.0f, 5.0f) * XMMatrixTranslation(cRadius, 8.5f, sRadius);
-		XMStoreFloat4x4(&ttopRitem->TexTransform, XMMatrixScaling(5.0f, 4.0f, 5.0f));
+	// The trees stand on the ground items, so their geometry is built once the
+	// ground is known, before the scene's treeSpritesGeo item is resolved.
+	// Ground items have no parent, their world matrix is final.
+	for(UINT i = 0; i < scene.ItemCount(); ++i)
+	{
+		const SceneFile::SceneItem& src = scene.Items()[i];
+		if((src.Flags & SceneFile::ItemGround) == 0)
+			continue;
+
+		const SceneFile::SceneMesh& mesh = scene.Meshes()[src.Mesh];
+		NameHandle geo = mGeometries.Find(mesh.Geometry);
+		if(geo == InvalidNameHandle || mGeometries[geo]->DrawArgs.count(mesh.Submesh) == 0)
+			continue; // reported with the other meshes below
+
+		BoundingBox ground;
+		mGeometries[geo]->DrawArgs[mesh.Submesh].Bounds.Transform(ground, XMLoadFloat4x4(&src.World));
+		mGroundBoxes.push_back(ground);
+	}
+	BuildTreeSpritesGeometry();
 
-        XMMATRIX donutWorld = XMMatrixScaling(2.5f, 3.0f, 2.5f) * XMMatrixTranslation(cRadius, 7.0f, sRadius);
-		XMStoreFloat4x4(&donutRitem->TexTransform, XMMatrixScaling(2.5f, 3.0f, 2.5f));
+	std::vector<MeshGeometry*> meshGeos(scene.MeshCount());
+	std::vector<const SubmeshGeometry*> meshSubmeshes(scene.MeshCount());
+	for(UINT i = 0; i < scene.MeshCount(); ++i)
+	{
+		const SceneFile::SceneMesh& src = scene.Meshes()[i];
 
+		NameHandle geo = mGeometries.Find(src.Geometry);
+		if(geo == InvalidNameHandle || mGeometries[geo]->DrawArgs.count(src.Submesh) == 0)
+		{
+			std::string message = std::string("Scene references unknown mesh ") + src.Geometry + "/" + src.Submesh + ".";
+			MessageBox(nullptr, AnsiToWString(message).c_str(), L"Scene Failed", MB_OK);
+			return false;
+		}
 
-        SetRenderItemInfo(*towerRitem, "cylinder", towerWorld, "redbrick0", RenderLayer::Opaque);
+		meshGeos[i] = mGeometries[geo].get();
+		meshSubmeshes[i] = &meshGeos[i]->DrawArgs[src.Submesh];
+	}
 
-        SetRenderItemInfo(*ttopRitem, "cone", ttopWorld, "redbrick0", RenderLayer::Opaque);
+	// Static opaque items are merged by BuildStaticBatches instead of becoming
+	// render items of their own.  Their occluder boxes get hierarchy nodes of
+	// their own so they still follow the node the batch hangs off.
+	std::vector<StaticBatchSource> staticSources;
+	std::vector<UINT8> staticOccluders;
+	std::vector<StaticBatchGroup> staticGroups;
 
-		SetRenderItemInfo(*donutRitem, "torus", donutWorld, "sand0", RenderLayer::Opaque);
+	mAllRitems.reserve(mAllRitems.size() + scene.ItemCount());
+	for(UINT i = 0; i < scene.ItemCount(); ++i)
+	{
+		const SceneFile::SceneItem& src = scene.Items()[i];
+		const SubmeshGeometry& submesh = *meshSubmeshes[src.Mesh];
+		MeshGeometry* geo = meshGeos[src.Mesh];
+		const TransformHierarchy::Node parent = src.Node == SceneFile::NoNode ? TransformHierarchy::NoNode : nodes[src.Node];
+		const bool occluder = (src.Flags & SceneFile::ItemOccluder) != 0;
+
+		if(src.Flags & SceneFile::ItemCollidable)
+			mCollisionBoxes.push_back(src.CollisionBox);
+
+		// Merging needs the standard vertex layout and single-draw submeshes.
+		if((src.Flags & SceneFile::ItemStatic) && src.Layer == (UINT)RenderLayer::Opaque &&
+			src.PrimitiveType == D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST &&
+			geo->VertexByteStride == sizeof(Vertex) && submesh.BatchCount == 0)
+		{
+			const bool indices32 = geo->IndexFormat == DXGI_FORMAT_R32_UINT;
+
+			StaticBatchSource source;
+			source.Vertices = static_cast<const Vertex*>(geo->VertexBufferCPU->GetBufferPointer()) + submesh.BaseVertexLocation;
+			source.Indices = static_cast<const BYTE*>(geo->IndexBufferCPU->GetBufferPointer()) +
+				(size_t)submesh.StartIndexLocation * (indices32 ? sizeof(std::uint32_t) : sizeof(std::uint16_t));
+			source.IndexCount = submesh.IndexCount;
+			source.Indices32 = indices32;
+			source.Transform = src.World;
+			source.TexTransform = src.TexTransform;
+
+			source.Group = (UINT)staticGroups.size();
+			for(UINT g = 0; g < (UINT)staticGroups.size(); ++g)
+			{
+				if(staticGroups[g].Mat == materials[src.Material] && staticGroups[g].Node == parent)
+					source.Group = g;
+			}
+			if(source.Group == (UINT)staticGroups.size())
+				staticGroups.push_back({ materials[src.Material], parent });
+
+			staticSources.push_back(source);
+			staticOccluders.push_back(occluder ? 1 : 0);
+
+			if(occluder)
+				mOccluders.push_back({ submesh.Bounds, mTransforms.Add(parent, src.World) });
+			continue;
+		}
 
-       
-   
+		auto ritem = std::make_unique<RenderItem>();
+		ritem->ObjCBIndex = objCBIndex++;
+		ritem->Mat = materials[src.Material];
+		ritem->Geo = geo;
+		ritem->PrimitiveType = (D3D12_PRIMITIVE_TOPOLOGY)src.PrimitiveType;
+		ritem->IndexCount = submesh.IndexCount;
+		ritem->StartIndexLocation = submesh.StartIndexLocation;
+		ritem->BaseVertexLocation = submesh.BaseVertexLocation;
+		ritem->FirstBatch = submesh.FirstBatch;
+		ritem->BatchCount = submesh.BatchCount;
+		ritem->TexTransform = src.TexTransform;
+
+		ritem->StoreHandle = mRitemStore.Add(ritem.get(), src.Layer, ritem->ObjCBIndex, submesh.Bounds);
+		ritem->Transform = mTransforms.Add(parent, src.World, ritem->StoreHandle);
+
+		if(occluder)
+		{
+			mRitemStore.Occluder[ritem->StoreHandle] = 1;
+			mOccluders.push_back({ submesh.Bounds, ritem->Transform });
+		}
 
-        mAllRitems.push_back(std::move(towerRitem));
-        mAllRitems.push_back(std::move(ttopRitem));
-        mAllRitems.push_back(std::move(donutRitem));
-        
+		mRitemLayer[src.Layer].push_back(ritem.get());
+		mAllRitems.push_back(std::move(ritem));
+	}
 
-       
-    }
+	BuildStaticBatches(staticSources, staticOccluders, staticGroups);
 
-	//frontwall
-	for (int i = 0; i < 2; i++)
+	// Every geometry is registered by now, staticGeo last.
+	if(mGeometries.Size() > DrawSortKey::GeometryLimit)
 	{
+		MessageBox(nullptr, L"Scene has too many geometries for the draw sort key.", L"Scene Failed", MB_OK);
+		return false;
+	}
 
-		float theta = i * nintydegrees;
+	for(RenderItem* ri : mRitemLayer[(int)RenderLayer::AlphaTestedTreeSprites])
+	{
+		if(ri->Geo == mTreeSpritesGeo)
+			mTreeSpritesRitem = ri;
+	}
 
+	// Build marks every node, so this places all the items and assigns their cells.
+	mTransforms.Build();
+	UpdateTransforms();
 
-		if (i < 2)
-		{
-			auto FrontWallRitem = std::make_unique<RenderItem>();
-			auto walltopRitem = std::make_unique<RenderItem>();
+	return true;
+}
 
-			XMMATRIX FrontWallWorld = XMMatrixScaling(16.0f, 5.0f, 1.0f) * XMMatrixTranslation(  -12 + 24*i , 2.5f, -20.0f);
-			XMStoreFloat4x4(&FrontWallRitem->TexTransform, XMMatrixScaling(8.0f, 2.0f, 1.0f));
+// Merges the static items LoadScene collected into staticGeo, one opaque
+// render item per batch.  Each batch hangs off its group's node with an
+// identity local transform, so it still moves with the node, and counts as an
+// occluder if any of its items is one: it is drawn into the occlusion buffer
+// and must not be tested against itself.
+void ShapesApp::BuildStaticBatches(const std::vector<StaticBatchSource>& sources, const std::vector<UINT8>& occluders,
+	const std::vector<StaticBatchGroup>& groups)
+{
+	if(sources.empty())
+		return;
 
-			XMMATRIX walltopWorld = XMMatrixScaling(40.0f, 1.0f, 2.0f) * XMMatrixTranslation(0.0f, 5.3f, -20.0f);
-			XMStoreFloat4x4(&walltopRitem->TexTransform, XMMatrixScaling(20.0f, 0.5f, 1.0f));
+	std::vector<Vertex> vertices;
+	std::vector<std::uint16_t> indices;
+	std::vector<StaticBatch> batches;
+	std::vector<UINT> sourceOrder;
+	MergeStaticBatches(sources.data(), (UINT)sources.size(), StaticBatchCellSize,
+		vertices, indices, batches, sourceOrder);
 
-			SetRenderItemInfo(*FrontWallRitem, "box", FrontWallWorld, "bricks0", RenderLayer::Opaque);
-			SetRenderItemInfo(*walltopRitem, "prism", walltopWorld, "bricks0", RenderLayer::Opaque);
+	auto geo = std::make_unique<MeshGeometry>();
+	geo->Name = "staticGeo";
 
-			mAllRitems.push_back(std::move(FrontWallRitem));
-			mAllRitems.push_back(std::move(walltopRitem));
-		}
-	}
+	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
+	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
 
+	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
+	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
 
-	//walls
-	for (int i = 0; i < 3; i++)
-	{
-		float theta = i * nintydegrees;
-		float sinR = x1 * sinf(theta);
-		float cosR = x1 * cosf(theta);
+	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
+	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
-		if (i<3)
-		{
-			auto wallRitem = std::make_unique<RenderItem>();
-			auto walltopRitem = std::make_unique<RenderItem>();
+	geo->VertexByteStride = sizeof(Vertex);
+	geo->VertexBufferByteSize = vbByteSize;
+	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
+	geo->IndexBufferByteSize = ibByteSize;
 
-			XMMATRIX wallWorld = XMMatrixScaling(1.0f, 5.0f, 40.0f) * XMMatrixRotationY(theta) * XMMatrixTranslation(cosR, 2.5f, sinR);
-			XMStoreFloat4x4(&wallRitem->TexTransform, XMMatrixScaling(20.0f, 2.5f, 1.0f));
+	UploadGeometry(*geo);
 
-			XMMATRIX walltopWorld = XMMatrixScaling(2.0f, 1.0f, 40.0f) * XMMatrixRotationY(theta) * XMMatrixTranslation(cosR, 5.0f, sinR);
-			XMStoreFloat4x4(&walltopRitem->TexTransform, XMMatrixScaling(20.0f, 0.5f, 1.0f));
+	for(const StaticBatch& batch : batches)
+	{
+		const StaticBatchGroup& group = groups[batch.Group];
 
-			SetRenderItemInfo(*wallRitem, "box", wallWorld, "bricks0", RenderLayer::Opaque);
-			SetRenderItemInfo(*walltopRitem, "box", walltopWorld, "bricks0", RenderLayer::Opaque);
+		auto ritem = std::make_unique<RenderItem>();
+		ritem->ObjCBIndex = objCBIndex++;
+		ritem->Mat = group.Mat;
+		ritem->Geo = geo.get();
+		ritem->IndexCount = batch.Submesh.IndexCount;
+		ritem->StartIndexLocation = batch.Submesh.StartIndexLocation;
+		ritem->BaseVertexLocation = batch.Submesh.BaseVertexLocation;
 
-			mAllRitems.push_back(std::move(wallRitem));
-			mAllRitems.push_back(std::move(walltopRitem));
+		ritem->StoreHandle = mRitemStore.Add(ritem.get(), (UINT)RenderLayer::Opaque, ritem->ObjCBIndex, batch.Submesh.Bounds);
+		ritem->Transform = mTransforms.Add(group.Node, MathHelper::Identity4x4(), ritem->StoreHandle);
 
+		for(UINT k = batch.FirstSource; k < batch.FirstSource + batch.SourceCount; ++k)
+		{
+			if(occluders[sourceOrder[k]])
+				mRitemStore.Occluder[ritem->StoreHandle] = 1;
 		}
+
+		mRitemLayer[(int)RenderLayer::Opaque].push_back(ritem.get());
+		mAllRitems.push_back(std::move(ritem));
 	}
 
-	//mazewalls
-	auto wall2Ritem = std::make_unique<RenderItem>();
-	XMMATRIX wall2World = XMMatrixScaling(1.0f, 4.0f, 40.0f) * XMMatrixTranslation(25.0f, 2.5f, -40.0f);
-	SetRenderItemInfo(*wall2Ritem, "box", wall2World, "grass0", RenderLayer::Opaque);
-	SetMazeWallCollision(*wall2Ritem, 1.0f, 4.0f, 40.0f, 25.0f, 2.5f, -40.0);
-	
-	
-	auto wall3Ritem = std::make_unique<RenderItem>();
-	XMMATRIX wall3World = XMMatrixScaling(1.0f, 4.0f, 40.0f) * XMMatrixTranslation(-25.0f, 2.5f, -40.0f);
-	SetRenderItemInfo(*wall3Ritem, "box", wall3World, "grass0", RenderLayer::Opaque);
-	SetMazeWallCollision(*wall3Ritem, 1.0f, 4.0f, 40.0f, -25.0f, 2.5f, -40.0f);
-	
-	auto wall4Ritem = std::make_unique<RenderItem>();
-	XMMATRIX wall4World = XMMatrixScaling(4.0f, 4.0f, 1.0f) * XMMatrixTranslation(23.5f, 2.5f, -19.5f);
-	SetRenderItemInfo(*wall4Ritem, "box", wall4World, "grass0", RenderLayer::Opaque);
-	SetMazeWallCollision(*wall4Ritem, 4.0f, 4.0f, 1.0f, 23.5f, 2.5f, -19.5f);
-	
-	auto wall5Ritem = std::make_unique<RenderItem>();
-	XMMATRIX wall5World = XMMatrixScaling(4.0f, 4.0f, 1.0f) * XMMatrixTranslation(-23.5f, 2.5f, -19.5f);
-	SetRenderItemInfo(*wall5Ritem, "box", wall5World, "grass0", RenderLayer::Opaque);
-	SetMazeWallCollision(*wall5Ritem, 4.0f, 4.0f, 1.0f, -23.5f, 2.5f, -19.5f);
-
-	auto wall6Ritem = std::make_unique<RenderItem>();
-	XMMATRIX wall6World = XMMatrixScaling(23.0f, 4.0f, 1.0f) * XMMatrixTranslation(-14.0f, 2.5f, -60.0f);
-	SetRenderItemInfo(*wall6Ritem, "box", wall6World, "grass0", RenderLayer::Opaque);
-	SetMazeWallCollision(*wall6Ritem, 23.0f, 4.0f, 1.0f, -14.0f, 2.5f, -60.0f);
-
-	auto wall7Ritem = std::make_unique<RenderItem>();
-	XMMATRIX wall7World = XMMatrixScaling(23.0f, 4.0f, 1.0f) * XMMatrixTranslation(14.0f, 2.5f, -60.0f);
-	SetRenderItemInfo(*wall7Ritem, "box", wall7World, "grass0", RenderLayer::Opaque);
-	SetMazeWallCollision(*wall7Ritem, 23.0f, 4.0f, 1.0f, 14.0f, 2.5f, -60.0f);
-
-	auto wall8Ritem = std::make_unique<RenderItem>();
-	XMMATRIX wall8World = XMMatrixScaling(40.0f, 4.0f, 1.0f) * XMMatrixTranslation(0.0f, 2.5f, -55.5f);
-	SetRenderItemInfo(*wall8Ritem, "box", wall8World, "grass0", RenderLayer::Opaque);
-	SetMazeWallCollision(*wall8Ritem, 40.0f, 4.0f, 1.0f, 0.0f, 2.5f, -55.5f);
-
-	auto wall9Ritem = std::make_unique<RenderItem>();
-	XMMATRIX wall9World = XMMatrixScaling(21.0f, 4.0f, 1.0f) * XMMatrixTranslation(14.0f, 2.5f, -50.0f);
-	SetRenderItemInfo(*wall9Ritem, "box", wall9World, "grass0", RenderLayer::Opaque);
-	SetMazeWallCollision(*wall9Ritem, 21.0f, 4.0f, 1.0f, 14.0f, 2.5f, -50.0f);
-
-	auto wall10Ritem = std::make_unique<RenderItem>();
-	XMMATRIX wall10World = XMMatrixScaling(24.0f, 4.0f, 1.0f) * XMMatrixTranslation(13.0f, 2.5f, -40.0f);
-	SetRenderItemInfo(*wall10Ritem, "box", wall10World, "grass0", RenderLayer::Opaque);
-	SetMazeWallCollision(*wall10Ritem, 24.0f, 4.0f, 1.0f, 13.0f, 2.5f, -40.0f);
-
-	auto wall11Ritem = std::make_unique<RenderItem>();
-	XMMATRIX wall11World = XMMatrixScaling(27.0f, 4.0f, 1.0f) * XMMatrixTranslation(3.5f, 2.5f, -30.0f);
-	SetRenderItemInfo(*wall11Ritem, "box", wall11World, "grass0", RenderLayer::Opaque);
-	SetMazeWallCollision(*wall11Ritem, 27.0f, 4.0f, 1.0f, 3.5f, 2.5f, -30.0f);
-
-	auto wall12Ritem = std::make_unique<RenderItem>();
-	XMMATRIX wall12World = XMMatrixScaling(10.5f, 4.0f, 1.0f) * XMMatrixTranslation(-20.0f, 2.5f, -35.0f);
-	SetRenderItemInfo(*wall12Ritem, "box", wall12World, "grass0", RenderLayer::Opaque);
-	SetMazeWallCollision(*wall12Ritem, 10.5f, 4.0f, 1.0f, -20.0f, 2.5f, -35.0f);
-
-	auto wall13Ritem = std::make_unique<RenderItem>();
-	XMMATRIX wall13World = XMMatrixScaling(5.0f, 4.0f, 1.0f) * XMMatrixTranslation(-12.0f, 2.5f, -50.0f);
-	SetRenderItemInfo(*wall13Ritem, "box", wall13World, "grass0", RenderLayer::Opaque);
-	SetMazeWallCollision(*wall13Ritem, 5.0f, 4.0f, 1.0f, -12.0f, 2.5f, -50.0f);
-
-	auto wall14Ritem = std::make_unique<RenderItem>();
-	XMMATRIX wall14World = XMMatrixScaling(5.5f, 4.0f, 1.0f) * XMMatrixTranslation(-22.5f, 2.5f, -47.0f);
-	SetRenderItemInfo(*wall14Ritem, "box", wall14World, "grass0", RenderLayer::Opaque);
-	SetMazeWallCollision(*wall14Ritem, 5.5f, 4.0f, 1.0f, -22.5f, 2.5f, -47.0f);
-
-	auto wall15Ritem = std::make_unique<RenderItem>();
-	XMMATRIX wall15World = XMMatrixScaling(1.0f, 4.0f, 15.0f) * XMMatrixTranslation(-19.5f, 2.5f, -47.5f);
-	SetRenderItemInfo(*wall15Ritem, "box", wall15World, "grass0", RenderLayer::Opaque);
-	SetMazeWallCollision(*wall15Ritem, 1.0f, 4.0f, 15.0f, -19.5f, 2.5f, -47.5f);
-
-	auto wall16Ritem = std::make_unique<RenderItem>();
-	XMMATRIX wall16World = XMMatrixScaling(1.0f, 4.0f, 16.0f) * XMMatrixTranslation(-14.5f, 2.5f, -42.5f);
-	SetRenderItemInfo(*wall16Ritem, "box", wall16World, "grass0", RenderLayer::Opaque);
-	SetMazeWallCollision(*wall16Ritem, 1.0f, 4.0f, 16.0f, -14.5f, 2.5f, -42.5f);
-
-	auto wall17Ritem = std::make_unique<RenderItem>();
-	XMMATRIX wall17World = XMMatrixScaling(1.0f, 4.0f, 20.0f) * XMMatrixTranslation(-9.5f, 2.5f, -40.5f);
-	SetRenderItemInfo(*wall17Ritem, "box", wall17World, "grass0", RenderLayer::Opaque);
-	SetMazeWallCollision(*wall17Ritem, 1.0f, 4.0f, 20.0f, -9.5f, 2.5f, -40.5f);
-
-	auto wall18Ritem = std::make_unique<RenderItem>();
-	XMMATRIX wall18World = XMMatrixScaling(1.0f, 4.0f, 20.0f) * XMMatrixTranslation(-3.5f, 2.5f, -40.5f);
-	SetRenderItemInfo(*wall18Ritem, "box", wall18World, "grass0", RenderLayer::Opaque);
-	SetMazeWallCollision(*wall18Ritem, 1.0f, 4.0f, 20.0f, -3.5f, 2.5f, -40.5f);
-
-	auto wall19Ritem = std::make_unique<RenderItem>();
-	XMMATRIX wall19World = XMMatrixScaling(23.0f, 4.0f, 1.0f) * XMMatrixTranslation(8.5f, 2.5f, -45.0f);
-	SetRenderItemInfo(*wall19Ritem, "box", wall19World, "grass0", RenderLayer::Opaque);
-	SetMazeWallCollision(*wall19Ritem, 23.0f, 4.0f, 1.0f, 8.5f, 2.5f, -45.0f);
-
-	auto wall20Ritem = std::make_unique<RenderItem>();
-	XMMATRIX wall20World = XMMatrixScaling(1.0f, 4.0f, 5.0f) * XMMatrixTranslation(1.5f, 2.5f, -37.5f);
-	SetRenderItemInfo(*wall20Ritem, "box", wall20World, "grass0", RenderLayer::Opaque);
-	SetMazeWallCollision(*wall20Ritem, 1.0f, 4.0f, 5.0f, 1.5f, 2.5f, -37.5f);
-
-	auto wall21Ritem = std::make_unique<RenderItem>();
-	XMMATRIX wall21World = XMMatrixScaling(1.0f, 4.0f, 5.0f) * XMMatrixTranslation(6.5f, 2.5f, -32.5f);
-	SetRenderItemInfo(*wall21Ritem, "box", wall21World, "grass0", RenderLayer::Opaque);
-	SetMazeWallCollision(*wall21Ritem, 1.0f, 4.0f, 5.0f, 6.5f, 2.5f, -32.5f);
-
-	auto wall22Ritem = std::make_unique<RenderItem>();
-	XMMATRIX wall22World = XMMatrixScaling(1.0f, 4.0f, 5.0f) * XMMatrixTranslation(11.5f, 2.5f, -37.5f);
-	SetRenderItemInfo(*wall22Ritem, "box", wall22World, "grass0", RenderLayer::Opaque);
-	SetMazeWallCollision(*wall22Ritem, 1.0f, 4.0f, 5.0f, 11.5f, 2.5f, -37.5f);
-
-	auto wall23Ritem = std::make_unique<RenderItem>();
-	XMMATRIX wall23World = XMMatrixScaling(1.0f, 4.0f, 5.0f) * XMMatrixTranslation(6.5f, 2.5f, -22.5f);
-	SetRenderItemInfo(*wall23Ritem, "box", wall23World, "grass0", RenderLayer::Opaque);
-	SetMazeWallCollision(*wall23Ritem, 1.0f, 4.0f, 5.0f, 6.5f, 2.5f, -22.5f);
-
-	auto wall24Ritem = std::make_unique<RenderItem>();
-	XMMATRIX wall24World = XMMatrixScaling(1.0f, 4.0f, 5.0f) * XMMatrixTranslation(16.5f, 2.5f, -27.5f);
-	SetRenderItemInfo(*wall24Ritem, "box", wall24World, "grass0", RenderLayer::Opaque);
-	SetMazeWallCollision(*wall24Ritem, 1.0f, 4.0f, 5.0f, 16.5f, 2.5f, -27.5f);
-
-	auto wall25Ritem = std::make_unique<RenderItem>();
-	XMMATRIX wall25World = XMMatrixScaling(1.0f, 4.0f, 5.0f) * XMMatrixTranslation(-6.5f, 2.5f, -22.5f);
-	SetRenderItemInfo(*wall25Ritem, "box", wall25World, "grass0", RenderLayer::Opaque);
-	SetMazeWallCollision(*wall25Ritem, 1.0f, 4.0f, 5.0f, -6.5f, 2.5f, -22.5f);
-
-	auto wall26Ritem = std::make_unique<RenderItem>();
-	XMMATRIX wall26World = XMMatrixScaling(10.0f, 4.0f, 1.0f) * XMMatrixTranslation(-11.0f, 2.5f, -25.0f);
-	SetRenderItemInfo(*wall26Ritem, "box", wall26World, "grass0", RenderLayer::Opaque);
-	SetMazeWallCollision(*wall26Ritem, 10.0f, 4.0f, 1.0f, -11.0f, 2.5f, -25.0f);
-
-	auto wall27Ritem = std::make_unique<RenderItem>();
-	XMMATRIX wall27World = XMMatrixScaling(1.0f, 4.0f, 5.0f) * XMMatrixTranslation(-16.0f, 2.5f, -27.0f);
-	SetRenderItemInfo(*wall27Ritem, "box", wall27World, "grass0", RenderLayer::Opaque);
-	SetMazeWallCollision(*wall27Ritem, 1.0f, 4.0f, 5.0f, -16.0f, 2.5f, -27.0f);
-
-	mAllRitems.push_back(std::move(wall2Ritem));
-	mAllRitems.push_back(std::move(wall3Ritem));
-	mAllRitems.push_back(std::move(wall4Ritem));
-	mAllRitems.push_back(std::move(wall5Ritem));
-	mAllRitems.push_back(std::move(wall6Ritem));
-	mAllRitems.push_back(std::move(wall7Ritem));
-	mAllRitems.push_back(std::move(wall8Ritem));
-	mAllRitems.push_back(std::move(wall9Ritem));
-	mAllRitems.push_back(std::move(wall10Ritem));
-	mAllRitems.push_back(std::move(wall11Ritem));
-	mAllRitems.push_back(std::move(wall12Ritem));
-	mAllRitems.push_back(std::move(wall13Ritem));
-	mAllRitems.push_back(std::move(wall14Ritem));
-	mAllRitems.push_back(std::move(wall15Ritem));
-	mAllRitems.push_back(std::move(wall16Ritem));
-	mAllRitems.push_back(std::move(wall17Ritem));
-	mAllRitems.push_back(std::move(wall18Ritem));
-	mAllRitems.push_back(std::move(wall19Ritem));
-	mAllRitems.push_back(std::move(wall20Ritem));
-	mAllRitems.push_back(std::move(wall21Ritem));
-	mAllRitems.push_back(std::move(wall22Ritem));
-	mAllRitems.push_back(std::move(wall23Ritem));
-	mAllRitems.push_back(std::move(wall24Ritem));
-	mAllRitems.push_back(std::move(wall25Ritem));
-	mAllRitems.push_back(std::move(wall26Ritem));
-	mAllRitems.push_back(std::move(wall27Ritem));
-
-
-	//battlements
-	for (int i = 0; i < 21; i++)
-	{
-		auto brick1Ritem = std::make_unique<RenderItem>();
-		auto brick2Ritem = std::make_unique<RenderItem>();
-		auto brick3Ritem = std::make_unique<RenderItem>();
-		auto brick4Ritem = std::make_unique<RenderItem>();
-
-		XMMATRIX brick1World = XMMatrixScaling(1.0f, 1.5f, 1.0f) * XMMatrixTranslation(-20.0f, 5.5f, 20.0f - 2 * i);
-		XMMATRIX brick2World = XMMatrixScaling(1.0f, 1.5f, 1.0f) * XMMatrixTranslation(20.0f, 5.5f, 20.0f - 2 * i);
-		XMMATRIX brick3World = XMMatrixScaling(1.0f, 1.5f, 1.0f) * XMMatrixTranslation(20.0f - 2 * i, 5.5f, 20.0f);
-		XMMATRIX brick4World = XMMatrixScaling(1.0f, 1.5f, 1.0f) * XMMatrixTranslation(20.0f - 2 * i, 5.5f, -20.0f);
-
-		SetRenderItemInfo(*brick1Ritem, "box", brick1World, "stone0", RenderLayer::Opaque);
-		SetRenderItemInfo(*brick2Ritem, "box", brick2World, "stone0", RenderLayer::Opaque);
-		SetRenderItemInfo(*brick3Ritem, "box", brick3World, "stone0", RenderLayer::Opaque);
-		SetRenderItemInfo(*brick4Ritem, "box", brick4World, "stone0", RenderLayer::Opaque);
-
-		mAllRitems.push_back(std::move(brick1Ritem));
-		mAllRitems.push_back(std::move(brick2Ritem));
-		mAllRitems.push_back(std::move(brick3Ritem));
-		mAllRitems.push_back(std::move(brick4Ritem));
+	mGeometries.Add(geo->Name, std::move(geo));
+}
+
+
+// Records command list listIndex with the draws PartitionDraws gave it.  Runs
+// on a WorkerPool thread: it only reads the frame's state and writes to its own
+// command list, allocator and mRecordStats entry.
+void ShapesApp::RecordCommandList(UINT listIndex)
+{
+	ID3D12GraphicsCommandList* cmdList = mCommandList.Get();
+	ID3D12CommandAllocator* cmdListAlloc = mCurrFrameResource->CmdListAlloc.Get();
+	if(listIndex > 0)
+	{
+		cmdList = mRecordCmdLists[listIndex - 1].Get();
+		cmdListAlloc = mCurrFrameResource->RecordCmdListAllocs[listIndex - 1].Get();
 	}
 
-	auto diamondRitem = std::make_unique<RenderItem>();
-	XMMATRIX DiamondWorld = XMMatrixScaling(1.0f, 1.0f, 1.0f) * XMMatrixTranslation(0.0f, 4.5f, 0.0f);
-	SetRenderItemInfo(*diamondRitem, "diamond", DiamondWorld, "ice0", RenderLayer::Transparent);
-	mAllRitems.push_back(std::move(diamondRitem));
+	CommandListRecorder recorder(*this, cmdList, cmdListAlloc, mRecordStats[listIndex]);
+	RecordDrawList(mRecordRanges, listIndex, recorder);
+}
+
+// The first list also transitions and clears the back buffer.
+void CommandListRecorder::Begin(std::uint32_t segment, bool firstList)
+{
+    // Reuse the memory associated with command recording.
+    // We can only reset when the associated command lists have finished execution on the GPU.
+    ThrowIfFailed(mCmdListAlloc->Reset());
 
-	auto wedgeRitem = std::make_unique<RenderItem>();
-	XMMATRIX wedgeWorld = XMMatrixScaling(5.0f, 1.0f, 5.0f) * XMMatrixRotationY(-nintydegrees) * XMMatrixTranslation(0.0f, 1.2f, -23.0f);
-	SetRenderItemInfo(*wedgeRitem, "wedge", wedgeWorld, "wirefence", RenderLayer::Transparent);
-	mAllRitems.push_back(std::move(wedgeRitem));
+    // A command list can be reset after it has been added to the command queue via ExecuteCommandList.
+    // Reusing the command list reuses memory.
+    ThrowIfFailed(mCmdList->Reset(mCmdListAlloc, mApp.mPSOs[mApp.mSegmentPSOs[segment]].Get()));
 
-	auto pyramidRitem = std::make_unique<RenderItem>();
-	XMMATRIX pyramidWorld = XMMatrixScaling(4.0f, 4.0f, 4.0f) * XMMatrixRotationY(-nintydegrees) * XMMatrixTranslation(0.0f, 1.5f, 0.0f);
-	SetRenderItemInfo(*pyramidRitem, "pyramid", pyramidWorld, "stone0", RenderLayer::Transparent);
-	mAllRitems.push_back(std::move(pyramidRitem));
+    mCmdList->RSSetViewports(1, &mApp.mScreenViewport);
+    mCmdList->RSSetScissorRects(1, &mApp.mScissorRect);
 
+	if(firstList)
+	{
+		// Indicate a state transition on the resource usage.
+		mCmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mApp.CurrentBackBuffer(),
+			D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET));
 
-	auto waterRitem = std::make_unique<RenderItem>();
-	XMMATRIX WaterWorld = XMMatrixScaling(5.0f, 5.0f, 5.0f) * XMMatrixTranslation( 1.5, -1.5 ,  1.5);
-	XMStoreFloat4x4(&waterRitem->TexTransform, XMMatrixScaling(5.0f, 5.0f, 1.0f));
-	SetRenderItemInfo(*waterRitem, "grid", WaterWorld, "water0", RenderLayer::Transparent);
-	mAllRitems.push_back(std::move(waterRitem));
+		// Clear the back buffer and depth buffer.
+		mCmdList->ClearRenderTargetView(mApp.CurrentBackBufferView(), Colors::LightSteelBlue, 0, nullptr);
+		mCmdList->ClearDepthStencilView(mApp.DepthStencilView(), D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
+	}
 
-	
+    // Specify the buffers we are going to render to.
+    mCmdList->OMSetRenderTargets(1, &mApp.CurrentBackBufferView(), true, &mApp.DepthStencilView());
 
+    ID3D12DescriptorHeap* descriptorHeaps[] = { mApp.mSrvDescriptorHeap.Get() };
+    mCmdList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
 
-	auto treeSpritesRitem = std::make_unique<RenderItem>();
-	treeSpritesRitem->World = MathHelper::Identity4x4();
-	treeSpritesRitem->ObjCBIndex = objCBIndex++;
-	treeSpritesRitem->Mat = mMaterials["treeSprite"].get();
-	treeSpritesRitem->Geo = mGeometries["treeSpritesGeo"].get();
-	treeSpritesRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_POINTLIST;
-	treeSpritesRitem->IndexCount = treeSpritesRitem->Geo->DrawArgs["points"].IndexCount;
-	treeSpritesRitem->StartIndexLocation = treeSpritesRitem->Geo->DrawArgs["points"].StartIndexLocation;
-	treeSpritesRitem->BaseVertexLocation = treeSpritesRitem->Geo->DrawArgs["points"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTestedTreeSprites].push_back(treeSpritesRitem.get());
-	mAllRitems.push_back(std::move(treeSpritesRitem));
+    mCmdList->SetGraphicsRootSignature(mApp.mRootSignature.Get());
 
+	FrameResource* frame = mApp.mCurrFrameResource;
+    mCmdList->SetGraphicsRootConstantBufferView(2, frame->PassCBAddress);
+	mCmdList->SetGraphicsRootConstantBufferView(9, frame->LightCB->Resource()->GetGPUVirtualAddress());
 
+	mCmdList->SetGraphicsRootShaderResourceView(6, frame->LocalLightBuffer->Resource()->GetGPUVirtualAddress());
+	mCmdList->SetGraphicsRootShaderResourceView(7, frame->LightClusterAddress);
+	mCmdList->SetGraphicsRootShaderResourceView(8, frame->LightIndexAddress);
 
+	// Nothing is bound on the freshly reset command list apart from the first segment's PSO.
+	mState = DrawStateCache();
+	mState.PipelineChanges = 1;
 }
 
+void CommandListRecorder::SetSegment(std::uint32_t segment)
+{
+	mApp.SetPipelineState(mCmdList, mState, mApp.mSegmentPSOs[segment]);
+}
+
+void CommandListRecorder::Draw(std::uint32_t segment, std::uint32_t first, std::uint32_t count)
+{
+	if(segment == (std::uint32_t)DrawSegment::InstanceGroups)
+	{
+		mApp.DrawInstanceGroups(mCmdList, mState, first, count);
+	}
+	else
+	{
+		const std::vector<RenderItem*>& ritems = mApp.mVisibleRitems[(int)DrawSegmentLayers[segment]];
+		mApp.DrawRenderItems(mCmdList, mState, ritems.data() + first, count);
+	}
+}
+
+// The last list transitions the back buffer back for presenting.
+void CommandListRecorder::End(bool lastList)
+{
+	if(lastList)
+	{
+		// Indicate a state transition on the resource usage.
+		mCmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mApp.CurrentBackBuffer(),
+			D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
+	}
+
+    // Done recording commands.
+    ThrowIfFailed(mCmdList->Close());
+}
 
 //The DrawRenderItems method is invoked in the main Draw call:
-void ShapesApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
+void ShapesApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, DrawStateCache& state, RenderItem* const* ritems, UINT count)
 {
     UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
     UINT matCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(MaterialConstants));
@@ -1875,29 +2553,163 @@ void ShapesApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::v
     auto matCB = mCurrFrameResource->MaterialCB->Resource();
 
     // For each render item...
-    for(size_t i = 0; i < ritems.size(); ++i)
+    for(UINT i = 0; i < count; ++i)
     {
         auto ri = ritems[i];
 
-        cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
-        cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
-        cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
-
-		CD3DX12_GPU_DESCRIPTOR_HANDLE tex(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-		tex.Offset(ri->Mat->DiffuseSrvHeapIndex, mCbvSrvDescriptorSize);
+        // The items arrive sorted by state, so only bind what differs from the previous draw.
+        if(ri->Geo != state.Geo)
+        {
+            cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
+            cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
+            state.Geo = ri->Geo;
+            ++state.GeometryChanges;
+        }
+
+        if(ri->PrimitiveType != state.PrimitiveType)
+        {
+            cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
+            state.PrimitiveType = ri->PrimitiveType;
+            ++state.TopologyChanges;
+        }
+
+        if(ri->Mat->DiffuseSrvHeapIndex != state.DiffuseSrvHeapIndex)
+        {
+            CD3DX12_GPU_DESCRIPTOR_HANDLE tex(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
+            tex.Offset(ri->Mat->DiffuseSrvHeapIndex, mCbvSrvDescriptorSize);
+            cmdList->SetGraphicsRootDescriptorTable(0, tex);
+            state.DiffuseSrvHeapIndex = ri->Mat->DiffuseSrvHeapIndex;
+            ++state.TextureChanges;
+        }
+
+        if(ri->Mat->MatCBIndex != state.MatCBIndex)
+        {
+            D3D12_GPU_VIRTUAL_ADDRESS matCBAddress = matCB->GetGPUVirtualAddress() + ri->Mat->MatCBIndex * matCBByteSize;
+            cmdList->SetGraphicsRootConstantBufferView(3, matCBAddress);
+            state.MatCBIndex = ri->Mat->MatCBIndex;
+            ++state.MaterialChanges;
+        }
 
         D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objectCB->GetGPUVirtualAddress() + ri->ObjCBIndex * objCBByteSize;
-        D3D12_GPU_VIRTUAL_ADDRESS matCBAddress = matCB->GetGPUVirtualAddress() + ri->Mat->MatCBIndex * matCBByteSize;
-
-		cmdList->SetGraphicsRootDescriptorTable(0, tex);
         cmdList->SetGraphicsRootConstantBufferView(1, objCBAddress);
-        cmdList->SetGraphicsRootConstantBufferView(3, matCBAddress);
+        ++state.ObjectChanges;
+
+        if(ri->BatchCount > 0)
+        {
+            for(UINT b = 0; b < ri->BatchCount; ++b)
+            {
+                const SubmeshGeometry& batch = ri->Geo->Batches[ri->FirstBatch + b];
+                cmdList->DrawIndexedInstanced(batch.IndexCount, 1, batch.StartIndexLocation, batch.BaseVertexLocation, 0);
+                ++state.DrawCalls;
+            }
+        }
+        else
+        {
+            cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+            ++state.DrawCalls;
+        }
+    }
+
+}
+
+void ShapesApp::DrawInstanceGroups(ID3D12GraphicsCommandList* cmdList, DrawStateCache& state, UINT firstGroup, UINT groupCount)
+{
+    UINT matCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(MaterialConstants));
+
+    auto matCB = mCurrFrameResource->MaterialCB->Resource();
 
-        cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+    cmdList->SetGraphicsRootShaderResourceView(4, mCurrFrameResource->InstanceDataAddress);
+
+    for(UINT g = firstGroup; g < firstGroup + groupCount; ++g)
+    {
+        const InstanceGroup& group = mInstanceGroups[g];
+        if(group.Visible.empty())
+            continue;
+
+        auto ri = group.Prototype;
+
+        if(ri->Geo != state.Geo)
+        {
+            cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
+            cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
+            state.Geo = ri->Geo;
+            ++state.GeometryChanges;
+        }
+
+        if(ri->PrimitiveType != state.PrimitiveType)
+        {
+            cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
+            state.PrimitiveType = ri->PrimitiveType;
+            ++state.TopologyChanges;
+        }
+
+        if(ri->Mat->DiffuseSrvHeapIndex != state.DiffuseSrvHeapIndex)
+        {
+            CD3DX12_GPU_DESCRIPTOR_HANDLE tex(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
+            tex.Offset(ri->Mat->DiffuseSrvHeapIndex, mCbvSrvDescriptorSize);
+            cmdList->SetGraphicsRootDescriptorTable(0, tex);
+            state.DiffuseSrvHeapIndex = ri->Mat->DiffuseSrvHeapIndex;
+            ++state.TextureChanges;
+        }
+
+        if(ri->Mat->MatCBIndex != state.MatCBIndex)
+        {
+            D3D12_GPU_VIRTUAL_ADDRESS matCBAddress = matCB->GetGPUVirtualAddress() + ri->Mat->MatCBIndex * matCBByteSize;
+            cmdList->SetGraphicsRootConstantBufferView(3, matCBAddress);
+            state.MatCBIndex = ri->Mat->MatCBIndex;
+            ++state.MaterialChanges;
+        }
+
+        cmdList->SetGraphicsRoot32BitConstant(5, group.FirstInstance, 0);
+        ++state.ObjectChanges;
+
+        cmdList->DrawIndexedInstanced(ri->IndexCount, (UINT)group.Visible.size(),
+            ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+        ++state.DrawCalls;
     }
+}
+void ShapesApp::SetPipelineState(ID3D12GraphicsCommandList* cmdList, DrawStateCache& state, NameHandle pso)
+{
+	cmdList->SetPipelineState(mPSOs[pso].Get());
+	++state.PipelineChanges;
+}
 
+void ShapesApp::UpdateWindowCaption()
+{
+	const DrawStateCache& stats = mDrawState;
+	const DrawStateCache& shown = mCaptionStats;
+
+	// Only rebuild the string when a number changed, CalculateFrameStats
+	// appends the fps to it once a second.
+	if (mVisibleCount == mCaptionVisibleCount && mCulledCount == mCaptionCulledCount &&
+		mOccludedCount == mCaptionOccludedCount &&
+		stats.DrawCalls == shown.DrawCalls && stats.PipelineChanges == shown.PipelineChanges &&
+		stats.GeometryChanges == shown.GeometryChanges && stats.TopologyChanges == shown.TopologyChanges &&
+		stats.TextureChanges == shown.TextureChanges && stats.MaterialChanges == shown.MaterialChanges &&
+		stats.ObjectChanges == shown.ObjectChanges)
+	{
+		return;
+	}
+
+	mCaptionStats = stats;
+	mCaptionVisibleCount = mVisibleCount;
+	mCaptionCulledCount = mCulledCount;
+	mCaptionOccludedCount = mOccludedCount;
+
+	mMainWndCaption = L"d3d App    visible: " + std::to_wstring(mVisibleCount) +
+		L"   culled: " + std::to_wstring(mCulledCount) +
+		L" (" + std::to_wstring(mOccludedCount) + L" occluded)" +
+		L"   draws: " + std::to_wstring(stats.DrawCalls) +
+		L"   pso/geo/topo/tex/mat/obj: " + std::to_wstring(stats.PipelineChanges) +
+		L"/" + std::to_wstring(stats.GeometryChanges) +
+		L"/" + std::to_wstring(stats.TopologyChanges) +
+		L"/" + std::to_wstring(stats.TextureChanges) +
+		L"/" + std::to_wstring(stats.MaterialChanges) +
+		L"/" + std::to_wstring(stats.ObjectChanges);
 }
 
+
+
 std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> ShapesApp::GetStaticSamplers()
 {
     // Applications usually only need a handful of samplers.  So just define them all up front
@@ -1975,22 +2787,109 @@ XMFLOAT3 ShapesApp::GetHillsNormal(float x, float z)const
 	return n;
 }
 
-XMFLOAT3 ShapesApp::GetTreePosition(float minX, float maxX, float minZ, float maxZ, float treeHeightOffset)const
+// Height of the ground at (x, z): the top of the sand the castle stands on, or
+// the forest floor around it.  Keep in step with the ground items in
+// Scenes\maze.scene.
+// Top of the highest ground item over (x, z), 0 where there is none.  The
+// ground items are flat boxes and grids, so the top of their bounds is their
+// surface.
+float ShapesApp::GetGroundHeight(float x, float z)const
+{
+	float height = 0.0f;
+	bool found = false;
+	for(const BoundingBox& ground : mGroundBoxes)
+	{
+		if(fabsf(x - ground.Center.x) > ground.Extents.x || fabsf(z - ground.Center.z) > ground.Extents.z)
+			continue;
+
+		const float top = ground.Center.y + ground.Extents.y;
+		height = found ? std::max(height, top) : top;
+		found = true;
+	}
+	return height;
+}
+
+void ShapesApp::BuildCollisionBVH()
 {
-	XMFLOAT3 pos(0.0f, -1.0f, 0.0f);
+	mCollisionBVH.Build(mCollisionBoxes.data(), (UINT)mCollisionBoxes.size());
+}
 
+void ShapesApp::BuildInstanceGroups()
+{
+	// Opaque items can share a draw when everything DrawRenderItems binds apart
+	// from the object constants matches.  Split submeshes keep their own draws.
+	std::vector<std::vector<RenderItem*>> candidates;
+	for (RenderItem* ri : mRitemLayer[(int)RenderLayer::Opaque])
+	{
+		if (ri->BatchCount > 0)
+			continue;
 
-		pos.x = MathHelper::RandF(minX, maxX);
-		pos.z = MathHelper::RandF(minZ, maxZ);
-		pos.y = 8.0f;
+		bool placed = false;
+		for (auto& members : candidates)
+		{
+			const RenderItem* proto = members[0];
+			if (proto->Geo == ri->Geo && proto->Mat == ri->Mat &&
+				proto->PrimitiveType == ri->PrimitiveType &&
+				proto->IndexCount == ri->IndexCount &&
+				proto->StartIndexLocation == ri->StartIndexLocation &&
+				proto->BaseVertexLocation == ri->BaseVertexLocation)
+			{
+				members.push_back(ri);
+				placed = true;
+				break;
+			}
+		}
+
+		if (!placed)
+			candidates.push_back({ ri });
+	}
 
-	return pos;
+	mInstanceGroups.clear();
+	mInstanceCount = 0;
+	for (auto& members : candidates)
+	{
+		// A lone item gains nothing from instancing.
+		if (members.size() < 2)
+			continue;
+
+		InstanceGroup group;
+		group.Prototype = members[0];
+		group.Visible.reserve(members.size());
+		for (RenderItem* ri : members)
+			ri->InstanceGroupIndex = (int)mInstanceGroups.size();
+
+		mInstanceCount += (UINT)members.size();
+		mInstanceGroups.push_back(std::move(group));
+	}
 }
 
-void ShapesApp::SetMazeWallCollision(RenderItem& Ritem, float xLen, float yLen, float zLen, float xPos, float yPos, float zPos)
+void ShapesApp::BuildSortKeys()
 {
-	Ritem.bounds.Center = { xPos, 2.5f  ,zPos };
-	Ritem.bounds.Extents = { xLen/2, 2.5f  ,zLen/2 };
+	// Render items only point at their geometry, so map the pointers back to
+	// the geometries' registry handles, which are small dense ids.
+	std::unordered_map<const MeshGeometry*, std::uint64_t> geoIds;
+	for (NameHandle h = 0; h < mGeometries.Size(); ++h)
+		geoIds[mGeometries[h].get()] = h;
+
+	for (int i = 0; i < (int)RenderLayer::Count; ++i)
+	{
+		for (RenderItem* ri : mRitemLayer[i])
+		{
+			// LoadScene registered every geometry and checked the field
+			// ranges, so these only catch items added around it.
+			auto geoId = geoIds.find(ri->Geo);
+			assert(geoId != geoIds.end() && geoId->second < DrawSortKey::GeometryLimit);
+			assert((UINT)ri->Mat->DiffuseSrvHeapIndex < DrawSortKey::TextureLimit &&
+				(UINT)ri->Mat->MatCBIndex < DrawSortKey::MaterialLimit);
+
+			ri->SortKey =
+				((std::uint64_t)i << DrawSortKey::LayerShift) |
+				(geoId->second << DrawSortKey::GeometryShift) |
+				((std::uint64_t)(ri->PrimitiveType & 0x7) << DrawSortKey::TopologyShift) |
+				((std::uint64_t)ri->Mat->DiffuseSrvHeapIndex << DrawSortKey::TextureShift) |
+				((std::uint64_t)ri->Mat->MatCBIndex << DrawSortKey::MaterialShift);
+		}
+	}
 }
 
 
@@ -0,0 +1,80 @@
+//***************************************************************************************
+// MappedFile.h
+//
+// Read-only memory mapping of a whole file.  Used by the binary caches so
+// loading is a bounds check and a few memcpys instead of stream reads.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+
+class MappedFile
+{
+public:
+	MappedFile() = default;
+
+	explicit MappedFile(const std::wstring& filename)
+	{
+		Open(filename);
+	}
+
+	MappedFile(const MappedFile& rhs) = delete;
+	MappedFile& operator=(const MappedFile& rhs) = delete;
+
+	~MappedFile()
+	{
+		Close();
+	}
+
+	// Maps filename, closing any previously mapped file.  Returns false if the
+	// file is missing, empty or cannot be mapped.
+	bool Open(const std::wstring& filename)
+	{
+		Close();
+
+		mFile = CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+			OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if(mFile == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER size;
+		if(!GetFileSizeEx(mFile, &size) || size.QuadPart == 0)
+			return false;
+
+		mMapping = CreateFileMappingW(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if(mMapping == nullptr)
+			return false;
+
+		mData = static_cast<const BYTE*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+		if(mData == nullptr)
+			return false;
+
+		mSize = static_cast<size_t>(size.QuadPart);
+		return true;
+	}
+
+	void Close()
+	{
+		if(mData != nullptr)
+			UnmapViewOfFile(mData);
+		if(mMapping != nullptr)
+			CloseHandle(mMapping);
+		if(mFile != INVALID_HANDLE_VALUE)
+			CloseHandle(mFile);
+
+		mFile = INVALID_HANDLE_VALUE;
+		mMapping = nullptr;
+		mData = nullptr;
+		mSize = 0;
+	}
+
+	const BYTE* Data()const { return mData; }
+	size_t Size()const { return mSize; }
+
+private:
+	HANDLE mFile = INVALID_HANDLE_VALUE;
+	HANDLE mMapping = nullptr;
+	const BYTE* mData = nullptr;
+	size_t mSize = 0;
+};
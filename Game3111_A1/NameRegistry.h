@@ -0,0 +1,87 @@
+//***************************************************************************************
+// NameRegistry.h
+//
+// Interns names to dense integer handles over contiguous storage.  Strings are
+// only hashed when an entry is added or looked up by name, which happens while
+// loading; per-frame code keeps the handle and indexes the storage directly,
+// and iterating the registry walks a vector in handle order.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+
+using NameHandle = UINT;
+const NameHandle InvalidNameHandle = 0xffffffff;
+
+template<typename T>
+class NameRegistry
+{
+public:
+	///<summary>
+	/// Handle of name, adding a default-constructed entry the first time the
+	/// name is seen.  Handles are assigned 0, 1, 2... in interning order and
+	/// never change.
+	///</summary>
+	NameHandle Intern(const std::string& name)
+	{
+		auto it = mHandles.find(name);
+		if(it != mHandles.end())
+			return it->second;
+
+		NameHandle handle = (NameHandle)mItems.size();
+		mHandles.emplace(name, handle);
+		mNames.push_back(name);
+		mItems.emplace_back();
+		return handle;
+	}
+
+	// Interns name and stores value under it, replacing any previous value.
+	// Taking value by reference lets callers pass a name that lives inside the
+	// value, e.g. Add(tex->Name, std::move(tex)); it is only moved from after
+	// the name has been copied.
+	NameHandle Add(const std::string& name, T&& value)
+	{
+		NameHandle handle = Intern(name);
+		mItems[handle] = std::move(value);
+		return handle;
+	}
+
+	// Handle of name, or InvalidNameHandle if it was never interned.
+	NameHandle Find(const std::string& name)const
+	{
+		auto it = mHandles.find(name);
+		return it != mHandles.end() ? it->second : InvalidNameHandle;
+	}
+
+	// Load-time lookup by name, interning it like unordered_map::operator[].
+	T& Get(const std::string& name)
+	{
+		return mItems[Intern(name)];
+	}
+
+	T& operator[](NameHandle handle)
+	{
+		assert(handle < mItems.size());
+		return mItems[handle];
+	}
+
+	const T& operator[](NameHandle handle)const
+	{
+		assert(handle < mItems.size());
+		return mItems[handle];
+	}
+
+	const std::string& Name(NameHandle handle)const { return mNames[handle]; }
+	UINT Size()const { return (UINT)mItems.size(); }
+
+	typename std::vector<T>::iterator begin() { return mItems.begin(); }
+	typename std::vector<T>::iterator end() { return mItems.end(); }
+	typename std::vector<T>::const_iterator begin()const { return mItems.begin(); }
+	typename std::vector<T>::const_iterator end()const { return mItems.end(); }
+
+private:
+	std::unordered_map<std::string, NameHandle> mHandles;
+	std::vector<std::string> mNames;
+	std::vector<T> mItems;
+};
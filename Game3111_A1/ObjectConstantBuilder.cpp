@@ -0,0 +1,104 @@
+//***************************************************************************************
+// ObjectConstantBuilder.cpp
+//***************************************************************************************
+
+#include "ObjectConstantBuilder.h"
+
+using namespace DirectX;
+
+namespace
+{
+	static_assert(sizeof(ObjectConstants) % 16 == 0, "ObjectConstants is copied as whole float4s");
+
+	// Copies the constants into the mapped slot, which is 256 byte aligned.
+	void StreamConstants(const ObjectConstants& src, ObjectConstants* dst)
+	{
+#if defined(_XM_SSE_INTRINSICS_)
+		const float* from = reinterpret_cast<const float*>(&src);
+		float* to = reinterpret_cast<float*>(dst);
+		for(size_t i = 0; i < sizeof(ObjectConstants) / sizeof(float); i += 4)
+			_mm_stream_ps(to + i, _mm_loadu_ps(from + i));
+#else
+		memcpy(dst, &src, sizeof(ObjectConstants));
+#endif
+	}
+}
+
+void ObjectConstantBuilder::Add(const XMFLOAT4X4& world, const XMFLOAT4X4& texTransform,
+	ObjectConstants& cached, ObjectConstants* mapped)
+{
+	mItems[mCount++] = { &world, &texTransform, &cached, mapped };
+	if(mCount == 4)
+		BuildGroup();
+}
+
+void ObjectConstantBuilder::Flush()
+{
+	if(mCount > 0)
+		BuildGroup();
+
+#if defined(_XM_SSE_INTRINSICS_)
+	_mm_sfence();
+#endif
+}
+
+void ObjectConstantBuilder::BuildGroup()
+{
+	// A partial group repeats its last item in the unused lanes; those lanes
+	// are computed but never written.
+	XMMATRIX world[4];
+	for(std::uint32_t k = 0; k < 4; ++k)
+		world[k] = XMLoadFloat4x4(mItems[k < mCount ? k : mCount - 1].World);
+
+	// m[r][c] is element (r, c) of the four world matrices, item k in lane k.
+	XMVECTOR m[3][3];
+	for(int r = 0; r < 3; ++r)
+	{
+		XMMATRIX t = XMMatrixTranspose(XMMATRIX(world[0].r[r], world[1].r[r], world[2].r[r], world[3].r[r]));
+		m[r][0] = t.r[0];
+		m[r][1] = t.r[1];
+		m[r][2] = t.r[2];
+	}
+
+	// Row i of the cofactor matrix is the cross product of the other two rows,
+	// and the determinant is row 0 dotted with its cofactors.
+	XMVECTOR c[3][3];
+	for(int i = 0; i < 3; ++i)
+	{
+		const XMVECTOR* a = m[(i + 1) % 3];
+		const XMVECTOR* b = m[(i + 2) % 3];
+		c[i][0] = XMVectorNegativeMultiplySubtract(a[2], b[1], XMVectorMultiply(a[1], b[2]));
+		c[i][1] = XMVectorNegativeMultiplySubtract(a[0], b[2], XMVectorMultiply(a[2], b[0]));
+		c[i][2] = XMVectorNegativeMultiplySubtract(a[1], b[0], XMVectorMultiply(a[0], b[1]));
+	}
+
+	XMVECTOR det = XMVectorMultiply(m[0][0], c[0][0]);
+	det = XMVectorMultiplyAdd(m[0][1], c[0][1], det);
+	det = XMVectorMultiplyAdd(m[0][2], c[0][2], det);
+	XMVECTOR invDet = XMVectorReciprocal(det);
+
+	// The shaders take the transpose of the normal matrix, which is the
+	// inverse of the upper 3x3: row i holds column i of the cofactors.
+	// Transposing back to one item per vector gives item k's row i in tw[i].r[k].
+	XMMATRIX tw[3];
+	for(int i = 0; i < 3; ++i)
+	{
+		tw[i] = XMMatrixTranspose(XMMATRIX(
+			XMVectorMultiply(c[0][i], invDet),
+			XMVectorMultiply(c[1][i], invDet),
+			XMVectorMultiply(c[2][i], invDet),
+			XMVectorZero()));
+	}
+
+	for(std::uint32_t k = 0; k < mCount; ++k)
+	{
+		ObjectConstants& cached = *mItems[k].Cached;
+		XMStoreFloat4x4(&cached.World, XMMatrixTranspose(world[k]));
+		XMStoreFloat4x4(&cached.TWorld, XMMATRIX(tw[0].r[k], tw[1].r[k], tw[2].r[k], g_XMIdentityR3));
+		XMStoreFloat4x4(&cached.TexTransform, XMMatrixTranspose(XMLoadFloat4x4(mItems[k].TexTransform)));
+
+		StreamConstants(cached, mItems[k].Mapped);
+	}
+
+	mCount = 0;
+}
@@ -0,0 +1,53 @@
+//***************************************************************************************
+// ObjectConstantBuilder.h
+//
+// Builds the ObjectConstants of items whose world matrices changed, four items
+// at a time.  The normal matrix, the inverse transpose of the world matrix's
+// upper 3x3, is the matrix of its cofactors over its determinant: three cross
+// products and a dot product instead of a general 4x4 inverse.  The rows of
+// the four items are transposed so that each vector holds one matrix element
+// of all four items, and every multiply works on the whole group.
+//
+// The constants are kept in the item's cached copy and written straight into
+// its slot of the mapped ObjectCB, filled whole and in order with streaming
+// stores, see the write-combined note in UploadBuffer.
+//***************************************************************************************
+
+#pragma once
+
+#include "FrameResource.h"
+
+class ObjectConstantBuilder
+{
+public:
+	ObjectConstantBuilder() = default;
+	ObjectConstantBuilder(const ObjectConstantBuilder& rhs) = delete;
+	ObjectConstantBuilder& operator=(const ObjectConstantBuilder& rhs) = delete;
+
+	///<summary>
+	/// Queues an item.  cached receives its World, TWorld and TexTransform and
+	/// keeps its MaterialIndex; mapped is its slot in the upload buffer, which
+	/// gets all of cached.  Groups are built as soon as four items are queued.
+	///</summary>
+	void Add(const DirectX::XMFLOAT4X4& world, const DirectX::XMFLOAT4X4& texTransform,
+		ObjectConstants& cached, ObjectConstants* mapped);
+
+	// Builds the items still queued and fences the streaming stores.  Call
+	// after the last Add, before the upload buffer is read by the GPU.
+	void Flush();
+
+private:
+	void BuildGroup();
+
+private:
+	struct Item
+	{
+		const DirectX::XMFLOAT4X4* World;
+		const DirectX::XMFLOAT4X4* TexTransform;
+		ObjectConstants* Cached;
+		ObjectConstants* Mapped;
+	};
+
+	Item mItems[4];
+	std::uint32_t mCount = 0;
+};
@@ -0,0 +1,326 @@
+//***************************************************************************************
+// OcclusionBuffer.cpp
+//***************************************************************************************
+
+#include "OcclusionBuffer.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX;
+
+OcclusionBuffer::OcclusionBuffer(std::uint32_t width, std::uint32_t height)
+	: mWidth((std::max<std::uint32_t>(width, 4) + 3) & ~3u),
+	  mHeight(std::max<std::uint32_t>(height, 1))
+{
+	XMStoreFloat4x4(&mViewProj, XMMatrixIdentity());
+
+	std::uint32_t w = mWidth;
+	std::uint32_t h = mHeight;
+	for(;;)
+	{
+		mLevels.emplace_back(w * h, 1.0f);
+		mLevelWidths.push_back(w);
+		mLevelHeights.push_back(h);
+
+		if(w == 1 && h == 1)
+			break;
+		w = (w + 1) / 2;
+		h = (h + 1) / 2;
+	}
+}
+
+void OcclusionBuffer::Begin(FXMMATRIX viewProj)
+{
+	XMStoreFloat4x4(&mViewProj, viewProj);
+	mTriangles.clear();
+}
+
+void OcclusionBuffer::AddOccluder(const BoundingBox& localBox, CXMMATRIX world)
+{
+	XMMATRIX toClip = XMMatrixMultiply(world, XMLoadFloat4x4(&mViewProj));
+
+	// Corner i takes the max extent on x, y, z where bit 0, 1, 2 of i is set.
+	XMVECTOR corners[8];
+	for(int i = 0; i < 8; ++i)
+	{
+		XMVECTOR corner = XMVectorSet(
+			localBox.Center.x + ((i & 1) ? localBox.Extents.x : -localBox.Extents.x),
+			localBox.Center.y + ((i & 2) ? localBox.Extents.y : -localBox.Extents.y),
+			localBox.Center.z + ((i & 4) ? localBox.Extents.z : -localBox.Extents.z),
+			1.0f);
+		corners[i] = XMVector4Transform(corner, toClip);
+	}
+
+	// Both triangles of every face; the nearer face wins the depth test, so
+	// winding and back faces do not matter.
+	static const int faces[6][4] =
+	{
+		{ 0, 2, 6, 4 }, { 1, 3, 7, 5 },
+		{ 0, 1, 5, 4 }, { 2, 3, 7, 6 },
+		{ 0, 1, 3, 2 }, { 4, 5, 7, 6 },
+	};
+	for(const int* f : faces)
+	{
+		AddClippedTriangle(corners[f[0]], corners[f[1]], corners[f[2]]);
+		AddClippedTriangle(corners[f[0]], corners[f[2]], corners[f[3]]);
+	}
+}
+
+// Clips a clip-space triangle against the near plane z = 0, which leaves a
+// triangle or a quad with every w positive.
+void OcclusionBuffer::AddClippedTriangle(FXMVECTOR a, FXMVECTOR b, FXMVECTOR c)
+{
+	XMVECTOR in[3] = { a, b, c };
+	XMVECTOR out[4];
+	int count = 0;
+
+	for(int i = 0; i < 3; ++i)
+	{
+		XMVECTOR cur = in[i];
+		XMVECTOR next = in[(i + 1) % 3];
+		float dCur = XMVectorGetZ(cur);
+		float dNext = XMVectorGetZ(next);
+
+		if(dCur >= 0.0f)
+			out[count++] = cur;
+		if((dCur >= 0.0f) != (dNext >= 0.0f))
+			out[count++] = XMVectorLerp(cur, next, dCur / (dCur - dNext));
+	}
+
+	if(count >= 3)
+		AddScreenTriangle(out[0], out[1], out[2]);
+	if(count == 4)
+		AddScreenTriangle(out[0], out[2], out[3]);
+}
+
+void OcclusionBuffer::AddScreenTriangle(FXMVECTOR a, FXMVECTOR b, FXMVECTOR c)
+{
+	const float width = (float)mWidth;
+	const float height = (float)mHeight;
+
+	Triangle tri;
+	XMVECTOR clip[3] = { a, b, c };
+	for(int i = 0; i < 3; ++i)
+	{
+		XMFLOAT4 p;
+		XMStoreFloat4(&p, clip[i]);
+		float invW = 1.0f / p.w;
+		tri.V[i].x = (p.x * invW * 0.5f + 0.5f) * width;
+		tri.V[i].y = (0.5f - p.y * invW * 0.5f) * height;
+		tri.V[i].z = p.z * invW;
+	}
+
+	// Order the vertices so that the area, and with it every edge function
+	// inside the triangle, is positive.
+	const XMFLOAT3* v = tri.V;
+	float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+	if(std::fabs(area) < 1e-6f)
+		return;
+	if(area < 0.0f)
+		std::swap(tri.V[1], tri.V[2]);
+
+	float minX = std::min(std::min(v[0].x, v[1].x), v[2].x);
+	float maxX = std::max(std::max(v[0].x, v[1].x), v[2].x);
+	tri.MinY = std::min(std::min(v[0].y, v[1].y), v[2].y);
+	tri.MaxY = std::max(std::max(v[0].y, v[1].y), v[2].y);
+
+	if(maxX < 0.0f || minX >= width || tri.MaxY < 0.0f || tri.MinY >= height)
+		return;
+
+	mTriangles.push_back(tri);
+}
+
+void OcclusionBuffer::Rasterize(WorkerPool* pool)
+{
+	// Bands of at least 16 rows, one per thread.
+	std::uint32_t bandCount = 1;
+	if(pool != nullptr && !mTriangles.empty())
+		bandCount = std::min<std::uint32_t>(pool->ThreadCount() + 1, std::max<std::uint32_t>(mHeight / 16, 1));
+
+	if(bandCount == 1)
+	{
+		RasterizeBand(0, mHeight);
+	}
+	else
+	{
+		pool->Run(bandCount, [this, bandCount](unsigned band)
+		{
+			std::uint32_t first = mHeight * band / bandCount;
+			std::uint32_t end = mHeight * (band + 1) / bandCount;
+			RasterizeBand(first, end - first);
+		});
+	}
+
+	BuildHierarchy();
+}
+
+void OcclusionBuffer::RasterizeBand(std::uint32_t firstRow, std::uint32_t rowCount)
+{
+	std::vector<float>& depth = mLevels[0];
+	std::fill(depth.begin() + firstRow * mWidth, depth.begin() + (firstRow + rowCount) * mWidth, 1.0f);
+
+	const std::uint32_t endRow = firstRow + rowCount;
+	for(const Triangle& tri : mTriangles)
+	{
+		if(tri.MaxY >= (float)firstRow && tri.MinY < (float)endRow)
+			RasterizeTriangle(tri, firstRow, endRow);
+	}
+}
+
+// Evaluates the three edge functions and the depth plane for four pixel
+// centers of a row at once, stepping four pixels per iteration.
+void OcclusionBuffer::RasterizeTriangle(const Triangle& tri, std::uint32_t firstRow, std::uint32_t endRow)
+{
+	const XMFLOAT3* v = tri.V;
+
+	// Edge k runs between the two vertices other than k and is positive on
+	// the side of vertex k: e(x, y) = A x + B y + C.
+	float edgeA[3], edgeB[3], edgeC[3];
+	for(int k = 0; k < 3; ++k)
+	{
+		const XMFLOAT3& p = v[(k + 1) % 3];
+		const XMFLOAT3& q = v[(k + 2) % 3];
+		edgeA[k] = p.y - q.y;
+		edgeB[k] = q.x - p.x;
+		edgeC[k] = p.x * q.y - q.x * p.y;
+	}
+
+	// The edge functions sum to the doubled area and weight their vertex, so
+	// the depth plane follows from them directly.
+	float invArea = 1.0f / (edgeC[0] + edgeC[1] + edgeC[2]);
+	float depthA = (edgeA[0] * v[0].z + edgeA[1] * v[1].z + edgeA[2] * v[2].z) * invArea;
+	float depthB = (edgeB[0] * v[0].z + edgeB[1] * v[1].z + edgeB[2] * v[2].z) * invArea;
+	float depthC = (edgeC[0] * v[0].z + edgeC[1] * v[1].z + edgeC[2] * v[2].z) * invArea;
+
+	float minX = std::min(std::min(v[0].x, v[1].x), v[2].x);
+	float maxX = std::max(std::max(v[0].x, v[1].x), v[2].x);
+	int x0 = std::max(0, (int)std::floor(minX)) & ~3;
+	int x1 = std::min((int)mWidth - 1, (int)std::floor(maxX));
+	int y0 = std::max((int)firstRow, (int)std::floor(tri.MinY));
+	int y1 = std::min((int)endRow - 1, (int)std::floor(tri.MaxY));
+
+	const XMVECTOR laneX = XMVectorSet(0.5f, 1.5f, 2.5f, 3.5f);
+	const XMVECTOR zero = XMVectorZero();
+
+	XMVECTOR stepE0 = XMVectorReplicate(4.0f * edgeA[0]);
+	XMVECTOR stepE1 = XMVectorReplicate(4.0f * edgeA[1]);
+	XMVECTOR stepE2 = XMVectorReplicate(4.0f * edgeA[2]);
+	XMVECTOR stepZ = XMVectorReplicate(4.0f * depthA);
+
+	float* depth = mLevels[0].data();
+	for(int y = y0; y <= y1; ++y)
+	{
+		float py = (float)y + 0.5f;
+		XMVECTOR px = XMVectorAdd(XMVectorReplicate((float)x0), laneX);
+
+		XMVECTOR e0 = XMVectorMultiplyAdd(XMVectorReplicate(edgeA[0]), px, XMVectorReplicate(edgeB[0] * py + edgeC[0]));
+		XMVECTOR e1 = XMVectorMultiplyAdd(XMVectorReplicate(edgeA[1]), px, XMVectorReplicate(edgeB[1] * py + edgeC[1]));
+		XMVECTOR e2 = XMVectorMultiplyAdd(XMVectorReplicate(edgeA[2]), px, XMVectorReplicate(edgeB[2] * py + edgeC[2]));
+		XMVECTOR z = XMVectorMultiplyAdd(XMVectorReplicate(depthA), px, XMVectorReplicate(depthB * py + depthC));
+
+		float* row = depth + y * mWidth;
+		for(int x = x0; x <= x1; x += 4)
+		{
+			XMVECTOR inside = XMVectorAndInt(
+				XMVectorAndInt(XMVectorGreaterOrEqual(e0, zero), XMVectorGreaterOrEqual(e1, zero)),
+				XMVectorGreaterOrEqual(e2, zero));
+
+			XMFLOAT4* dst = reinterpret_cast<XMFLOAT4*>(row + x);
+			XMVECTOR old = XMLoadFloat4(dst);
+			XMStoreFloat4(dst, XMVectorSelect(old, XMVectorMin(old, z), inside));
+
+			e0 = XMVectorAdd(e0, stepE0);
+			e1 = XMVectorAdd(e1, stepE1);
+			e2 = XMVectorAdd(e2, stepE2);
+			z = XMVectorAdd(z, stepZ);
+		}
+	}
+}
+
+void OcclusionBuffer::BuildHierarchy()
+{
+	for(size_t level = 1; level < mLevels.size(); ++level)
+	{
+		const std::vector<float>& src = mLevels[level - 1];
+		std::vector<float>& dst = mLevels[level];
+		const std::uint32_t srcW = mLevelWidths[level - 1];
+		const std::uint32_t srcH = mLevelHeights[level - 1];
+		const std::uint32_t dstW = mLevelWidths[level];
+		const std::uint32_t dstH = mLevelHeights[level];
+
+		for(std::uint32_t y = 0; y < dstH; ++y)
+		{
+			const std::uint32_t sy0 = y * 2;
+			const std::uint32_t sy1 = std::min(sy0 + 1, srcH - 1);
+			for(std::uint32_t x = 0; x < dstW; ++x)
+			{
+				const std::uint32_t sx0 = x * 2;
+				const std::uint32_t sx1 = std::min(sx0 + 1, srcW - 1);
+				dst[y * dstW + x] = std::max(
+					std::max(src[sy0 * srcW + sx0], src[sy0 * srcW + sx1]),
+					std::max(src[sy1 * srcW + sx0], src[sy1 * srcW + sx1]));
+			}
+		}
+	}
+}
+
+bool OcclusionBuffer::IsVisible(const BoundingBox& worldBox)const
+{
+	XMMATRIX viewProj = XMLoadFloat4x4(&mViewProj);
+
+	float minX = FLT_MAX, minY = FLT_MAX, minZ = FLT_MAX;
+	float maxX = -FLT_MAX, maxY = -FLT_MAX;
+	for(int i = 0; i < 8; ++i)
+	{
+		XMVECTOR corner = XMVectorSet(
+			worldBox.Center.x + ((i & 1) ? worldBox.Extents.x : -worldBox.Extents.x),
+			worldBox.Center.y + ((i & 2) ? worldBox.Extents.y : -worldBox.Extents.y),
+			worldBox.Center.z + ((i & 4) ? worldBox.Extents.z : -worldBox.Extents.z),
+			1.0f);
+
+		XMFLOAT4 p;
+		XMStoreFloat4(&p, XMVector4Transform(corner, viewProj));
+
+		// Part of the box is in front of the near plane, where nothing was rasterized.
+		if(p.z < 0.0f)
+			return true;
+
+		float invW = 1.0f / p.w;
+		float x = (p.x * invW * 0.5f + 0.5f) * (float)mWidth;
+		float y = (0.5f - p.y * invW * 0.5f) * (float)mHeight;
+		minX = std::min(minX, x);
+		maxX = std::max(maxX, x);
+		minY = std::min(minY, y);
+		maxY = std::max(maxY, y);
+		minZ = std::min(minZ, p.z * invW);
+	}
+
+	// Off screen; the frustum test is in charge of those.
+	if(maxX < 0.0f || minX >= (float)mWidth || maxY < 0.0f || minY >= (float)mHeight)
+		return true;
+
+	int x0 = std::max(0, (int)std::floor(minX));
+	int x1 = std::min((int)mWidth - 1, (int)std::floor(maxX));
+	int y0 = std::max(0, (int)std::floor(minY));
+	int y1 = std::min((int)mHeight - 1, (int)std::floor(maxY));
+
+	// Coarsest level at which the rectangle still spans at most 4x4 texels.
+	size_t level = 0;
+	while(level + 1 < mLevels.size() && ((x1 >> level) - (x0 >> level) > 3 || (y1 >> level) - (y0 >> level) > 3))
+		++level;
+
+	const std::vector<float>& depth = mLevels[level];
+	const std::uint32_t levelWidth = mLevelWidths[level];
+	for(int ty = y0 >> level; ty <= (y1 >> level); ++ty)
+	{
+		for(int tx = x0 >> level; tx <= (x1 >> level); ++tx)
+		{
+			if(minZ <= depth[ty * levelWidth + tx])
+				return true;
+		}
+	}
+	return false;
+}
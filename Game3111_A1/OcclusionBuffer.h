@@ -0,0 +1,93 @@
+//***************************************************************************************
+// OcclusionBuffer.h
+//
+// Low-resolution software depth buffer used to cull render items hidden behind
+// large occluders such as the maze walls.  Each frame the nearest occluder
+// boxes are rasterized on the CPU, four pixels at a time, into a small depth
+// buffer whose rows are split into bands rasterized in parallel.  A max-depth
+// hierarchy (hierarchical Z) is built over it, and an item is occluded when
+// the nearest point of its world box lies behind the farthest occluder depth
+// everywhere its screen rectangle covers.
+//
+// Depth is post-projection z / w in [0, 1], 1 where nothing was drawn.
+//***************************************************************************************
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <cstdint>
+#include <vector>
+
+class WorkerPool;
+
+class OcclusionBuffer
+{
+public:
+	// width is rounded up to a multiple of 4, the rasterizer writes 4 pixels at a time.
+	OcclusionBuffer(std::uint32_t width = 256, std::uint32_t height = 128);
+	OcclusionBuffer(const OcclusionBuffer& rhs) = delete;
+	OcclusionBuffer& operator=(const OcclusionBuffer& rhs) = delete;
+
+	///<summary>
+	/// Starts a frame seen through viewProj (row vectors, as DirectXMath uses).
+	/// Forgets the occluders of the previous frame.
+	///</summary>
+	void Begin(DirectX::FXMMATRIX viewProj);
+
+	///<summary>
+	/// Queues the box localBox transformed by world as an occluder.  The box
+	/// must lie entirely inside the occluder's geometry, e.g. the bounds of a
+	/// box mesh, or items behind it would be culled wrongly.
+	///</summary>
+	void AddOccluder(const DirectX::BoundingBox& localBox, DirectX::CXMMATRIX world);
+
+	///<summary>
+	/// Rasterizes the queued occluders and builds the depth hierarchy.  The
+	/// rows are split into bands run as WorkerPool tasks; pool may be null to
+	/// rasterize on the calling thread only.
+	///</summary>
+	void Rasterize(WorkerPool* pool);
+
+	///<summary>
+	/// False if worldBox is certainly hidden behind the occluders.  Boxes
+	/// crossing the near plane or leaving the screen count as visible.
+	///</summary>
+	bool IsVisible(const DirectX::BoundingBox& worldBox)const;
+
+	std::uint32_t Width()const { return mWidth; }
+	std::uint32_t Height()const { return mHeight; }
+	std::uint32_t OccluderTriangleCount()const { return (std::uint32_t)mTriangles.size(); }
+
+	// Depth of pixel (x, y) of the full-resolution level.
+	float Depth(std::uint32_t x, std::uint32_t y)const { return mLevels[0][y * mWidth + x]; }
+
+private:
+	// Triangle in screen space: x, y in pixels, z the depth.
+	struct Triangle
+	{
+		DirectX::XMFLOAT3 V[3];
+		float MinY;
+		float MaxY;
+	};
+
+	void AddClippedTriangle(DirectX::FXMVECTOR a, DirectX::FXMVECTOR b, DirectX::FXMVECTOR c);
+	void AddScreenTriangle(DirectX::FXMVECTOR a, DirectX::FXMVECTOR b, DirectX::FXMVECTOR c);
+	void RasterizeBand(std::uint32_t firstRow, std::uint32_t rowCount);
+	void RasterizeTriangle(const Triangle& tri, std::uint32_t firstRow, std::uint32_t endRow);
+	void BuildHierarchy();
+
+private:
+	std::uint32_t mWidth;
+	std::uint32_t mHeight;
+
+	DirectX::XMFLOAT4X4 mViewProj;
+
+	std::vector<Triangle> mTriangles;
+
+	// Level 0 is the depth buffer itself, level i + 1 holds the maximum of
+	// each 2x2 block of level i.  Levels shrink down to a single texel.
+	std::vector<std::vector<float>> mLevels;
+	std::vector<std::uint32_t> mLevelWidths;
+	std::vector<std::uint32_t> mLevelHeights;
+};
@@ -0,0 +1,363 @@
+//***************************************************************************************
+// PortalGraph.cpp
+//***************************************************************************************
+
+#include "PortalGraph.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <map>
+#include <tuple>
+
+using namespace DirectX;
+
+namespace
+{
+	const int FreeSpace = -1;
+	const int WallSpace = -2;
+}
+
+void PortalGraph::Extract(const BoundingBox* walls, std::uint32_t wallCount, float gridStep,
+	std::vector<PortalCell>& cells, std::vector<CellPortal>& portals, float& minY, float& maxY)
+{
+	cells.clear();
+	portals.clear();
+
+	PortalCell outside = {};
+	cells.push_back(outside);
+
+	minY = maxY = 0.0f;
+	if(wallCount == 0)
+		return;
+
+	float minX = FLT_MAX, minZ = FLT_MAX;
+	float maxX = -FLT_MAX, maxZ = -FLT_MAX;
+	minY = FLT_MAX;
+	maxY = FLT_MAX;
+	for(std::uint32_t w = 0; w < wallCount; ++w)
+	{
+		const BoundingBox& box = walls[w];
+		minX = std::min(minX, box.Center.x - box.Extents.x);
+		maxX = std::max(maxX, box.Center.x + box.Extents.x);
+		minZ = std::min(minZ, box.Center.z - box.Extents.z);
+		maxZ = std::max(maxZ, box.Center.z + box.Extents.z);
+		minY = std::min(minY, box.Center.y - box.Extents.y);
+		maxY = std::min(maxY, box.Center.y + box.Extents.y);
+	}
+
+	const int nx = std::max(1, (int)std::ceil((maxX - minX) / gridStep - 1e-4f));
+	const int nz = std::max(1, (int)std::ceil((maxZ - minZ) / gridStep - 1e-4f));
+
+	// Grid of cell ids, marking every grid square a wall overlaps at all.
+	std::vector<int> grid(nx * nz, FreeSpace);
+	for(std::uint32_t w = 0; w < wallCount; ++w)
+	{
+		const BoundingBox& box = walls[w];
+		int i0 = std::max(0, (int)std::floor((box.Center.x - box.Extents.x - minX) / gridStep + 1e-4f));
+		int i1 = std::min(nx, (int)std::ceil((box.Center.x + box.Extents.x - minX) / gridStep - 1e-4f));
+		int j0 = std::max(0, (int)std::floor((box.Center.z - box.Extents.z - minZ) / gridStep + 1e-4f));
+		int j1 = std::min(nz, (int)std::ceil((box.Center.z + box.Extents.z - minZ) / gridStep - 1e-4f));
+		for(int j = j0; j < j1; ++j)
+		{
+			for(int i = i0; i < i1; ++i)
+				grid[j * nx + i] = WallSpace;
+		}
+	}
+
+	// Cover the free squares with rectangles, each grown as wide as it goes
+	// and then as deep as the whole width allows.
+	for(int j = 0; j < nz; ++j)
+	{
+		for(int i = 0; i < nx; ++i)
+		{
+			if(grid[j * nx + i] != FreeSpace)
+				continue;
+
+			int width = 1;
+			while(i + width < nx && grid[j * nx + i + width] == FreeSpace)
+				++width;
+
+			int depth = 1;
+			for(; j + depth < nz; ++depth)
+			{
+				const int* row = &grid[(j + depth) * nx + i];
+				if(std::any_of(row, row + width, [](int id) { return id != FreeSpace; }))
+					break;
+			}
+
+			const int id = (int)cells.size();
+			for(int dj = 0; dj < depth; ++dj)
+				std::fill_n(&grid[(j + dj) * nx + i], width, id);
+
+			PortalCell cell = {};
+			cell.MinX = minX + i * gridStep;
+			cell.MinZ = minZ + j * gridStep;
+			cell.MaxX = minX + (i + width) * gridStep;
+			cell.MaxZ = minZ + (j + depth) * gridStep;
+			cells.push_back(cell);
+		}
+	}
+
+	// Every grid edge between squares of two different cells is part of a
+	// portal, squares past the grid belonging to the outside.  Two rectangles
+	// share at most one segment of a line, so the edges are merged per cell
+	// pair and line.  Keyed by source cell first, which groups the portals.
+	typedef std::tuple<int, int, int, int> EdgeKey; // from, to, axis (0 = x line, 1 = z line), line
+	std::map<EdgeKey, std::pair<int, int>> spans;
+
+	auto cellAt = [&](int i, int j)
+	{
+		if(i < 0 || i >= nx || j < 0 || j >= nz)
+			return (int)OutsideCell;
+		return grid[j * nx + i];
+	};
+
+	auto addEdge = [&](int a, int b, int axis, int line, int k)
+	{
+		if(a == WallSpace || b == WallSpace || a == b)
+			return;
+
+		for(int dir = 0; dir < 2; ++dir)
+		{
+			EdgeKey key = dir == 0 ? EdgeKey(a, b, axis, line) : EdgeKey(b, a, axis, line);
+			auto it = spans.find(key);
+			if(it == spans.end())
+				spans.emplace(key, std::make_pair(k, k + 1));
+			else
+			{
+				it->second.first = std::min(it->second.first, k);
+				it->second.second = std::max(it->second.second, k + 1);
+			}
+		}
+	};
+
+	for(int j = 0; j < nz; ++j)
+	{
+		for(int i = -1; i < nx; ++i)
+			addEdge(cellAt(i, j), cellAt(i + 1, j), 0, i + 1, j);
+	}
+	for(int i = 0; i < nx; ++i)
+	{
+		for(int j = -1; j < nz; ++j)
+			addEdge(cellAt(i, j), cellAt(i, j + 1), 1, j + 1, i);
+	}
+
+	for(const auto& span : spans)
+	{
+		const int from = std::get<0>(span.first);
+		const int axis = std::get<2>(span.first);
+		const int line = std::get<3>(span.first);
+
+		CellPortal portal;
+		portal.Cell = (std::uint32_t)std::get<1>(span.first);
+		if(axis == 0)
+		{
+			float x = minX + line * gridStep;
+			portal.Min = XMFLOAT3(x, minY, minZ + span.second.first * gridStep);
+			portal.Max = XMFLOAT3(x, maxY, minZ + span.second.second * gridStep);
+		}
+		else
+		{
+			float z = minZ + line * gridStep;
+			portal.Min = XMFLOAT3(minX + span.second.first * gridStep, minY, z);
+			portal.Max = XMFLOAT3(minX + span.second.second * gridStep, maxY, z);
+		}
+
+		PortalCell& cell = cells[from];
+		if(cell.PortalCount == 0)
+			cell.FirstPortal = (std::uint32_t)portals.size();
+		++cell.PortalCount;
+		portals.push_back(portal);
+	}
+
+	// The outside has no rectangle of its own; give it the bounds of the rest.
+	cells[OutsideCell].MinX = minX;
+	cells[OutsideCell].MinZ = minZ;
+	cells[OutsideCell].MaxX = minX + nx * gridStep;
+	cells[OutsideCell].MaxZ = minZ + nz * gridStep;
+}
+
+void PortalGraph::Init(const PortalCell* cells, std::uint32_t cellCount,
+	const CellPortal* portals, std::uint32_t portalCount, float minY, float maxY)
+{
+	mCells.assign(cells, cells + cellCount);
+	mPortals.assign(portals, portals + portalCount);
+	mMinY = minY;
+	mMaxY = maxY;
+
+	if(!mCells.empty())
+	{
+		mMinX = mCells[OutsideCell].MinX;
+		mMinZ = mCells[OutsideCell].MinZ;
+		mMaxX = mCells[OutsideCell].MaxX;
+		mMaxZ = mCells[OutsideCell].MaxZ;
+	}
+
+	mCellVisible.assign(mCells.size(), 0);
+	mCellRects.resize(mCells.size());
+}
+
+std::uint32_t PortalGraph::FindCell(const XMFLOAT3& p)const
+{
+	if(mCells.size() < 2 || p.y > mMaxY)
+		return NoCell;
+
+	if(p.x < mMinX || p.x > mMaxX || p.z < mMinZ || p.z > mMaxZ)
+		return OutsideCell;
+
+	for(std::uint32_t c = 1; c < mCells.size(); ++c)
+	{
+		const PortalCell& cell = mCells[c];
+		if(p.x >= cell.MinX && p.x <= cell.MaxX && p.z >= cell.MinZ && p.z <= cell.MaxZ)
+			return c;
+	}
+
+	return NoCell;
+}
+
+std::uint32_t PortalGraph::CellOf(const BoundingBox& box)const
+{
+	if(box.Center.y + box.Extents.y > mMaxY)
+		return NoCell;
+
+	for(std::uint32_t c = 1; c < mCells.size(); ++c)
+	{
+		const PortalCell& cell = mCells[c];
+		if(box.Center.x - box.Extents.x >= cell.MinX && box.Center.x + box.Extents.x <= cell.MaxX &&
+			box.Center.z - box.Extents.z >= cell.MinZ && box.Center.z + box.Extents.z <= cell.MaxZ)
+		{
+			return c;
+		}
+	}
+
+	return NoCell;
+}
+
+bool PortalGraph::Traverse(const XMFLOAT3& eye, FXMMATRIX viewProj)
+{
+	const std::uint32_t start = FindCell(eye);
+	if(start == NoCell)
+		return false;
+
+	std::fill(mCellVisible.begin(), mCellVisible.end(), (std::uint8_t)0);
+	mStack.clear();
+
+	Rect screen = { -1.0f, -1.0f, 1.0f, 1.0f };
+	mCellVisible[start] = 1;
+	mCellRects[start] = screen;
+	mVisibleCellCount = 1;
+
+	Visit first = { start, screen };
+	mStack.push_back(first);
+
+	// A cell is entered again only through a part of the screen it was not
+	// seen through before, which ends the traversal on any maze; the budget
+	// is a backstop that falls back to everything visible.
+	size_t budget = 4 * mPortals.size() + 16;
+
+	while(!mStack.empty())
+	{
+		Visit visit = mStack.back();
+		mStack.pop_back();
+
+		const PortalCell& cell = mCells[visit.Cell];
+		for(std::uint32_t p = cell.FirstPortal; p < cell.FirstPortal + cell.PortalCount; ++p)
+		{
+			const CellPortal& portal = mPortals[p];
+
+			Rect rect;
+			Projection projection = ProjectPortal(portal, viewProj, rect);
+			if(projection == Projection::Hidden)
+				continue;
+
+			if(projection == Projection::Clipped)
+			{
+				// Too close to project, keep looking through the whole rectangle.
+				rect = visit.Bounds;
+			}
+			else
+			{
+				rect.MinX = std::max(rect.MinX, visit.Bounds.MinX);
+				rect.MinY = std::max(rect.MinY, visit.Bounds.MinY);
+				rect.MaxX = std::min(rect.MaxX, visit.Bounds.MaxX);
+				rect.MaxY = std::min(rect.MaxY, visit.Bounds.MaxY);
+				if(rect.MinX >= rect.MaxX || rect.MinY >= rect.MaxY)
+					continue;
+			}
+
+			Rect& seen = mCellRects[portal.Cell];
+			if(mCellVisible[portal.Cell])
+			{
+				if(rect.MinX >= seen.MinX && rect.MinY >= seen.MinY && rect.MaxX <= seen.MaxX && rect.MaxY <= seen.MaxY)
+					continue;
+
+				seen.MinX = std::min(seen.MinX, rect.MinX);
+				seen.MinY = std::min(seen.MinY, rect.MinY);
+				seen.MaxX = std::max(seen.MaxX, rect.MaxX);
+				seen.MaxY = std::max(seen.MaxY, rect.MaxY);
+			}
+			else
+			{
+				mCellVisible[portal.Cell] = 1;
+				seen = rect;
+				++mVisibleCellCount;
+			}
+
+			if(budget-- == 0)
+			{
+				std::fill(mCellVisible.begin(), mCellVisible.end(), (std::uint8_t)1);
+				mVisibleCellCount = (std::uint32_t)mCells.size();
+				return true;
+			}
+
+			Visit next = { portal.Cell, rect };
+			mStack.push_back(next);
+		}
+	}
+
+	return true;
+}
+
+PortalGraph::Projection PortalGraph::ProjectPortal(const CellPortal& portal, FXMMATRIX viewProj, Rect& rect)const
+{
+	// The portal is flat along x or z, so its corners pair the two xz ends
+	// with the bottom and the top.
+	const XMFLOAT3& a = portal.Min;
+	const XMFLOAT3& b = portal.Max;
+	XMVECTOR corners[4] =
+	{
+		XMVectorSet(a.x, a.y, a.z, 1.0f),
+		XMVectorSet(b.x, a.y, b.z, 1.0f),
+		XMVectorSet(a.x, b.y, a.z, 1.0f),
+		XMVectorSet(b.x, b.y, b.z, 1.0f),
+	};
+
+	rect.MinX = rect.MinY = FLT_MAX;
+	rect.MaxX = rect.MaxY = -FLT_MAX;
+
+	int behindEye = 0;
+	bool clipped = false;
+	for(const XMVECTOR& corner : corners)
+	{
+		XMFLOAT4 p;
+		XMStoreFloat4(&p, XMVector4Transform(corner, viewProj));
+
+		if(p.w <= 0.0f)
+			++behindEye;
+		if(p.z < 0.0f)
+		{
+			clipped = true;
+			continue;
+		}
+
+		rect.MinX = std::min(rect.MinX, p.x / p.w);
+		rect.MaxX = std::max(rect.MaxX, p.x / p.w);
+		rect.MinY = std::min(rect.MinY, p.y / p.w);
+		rect.MaxY = std::max(rect.MaxY, p.y / p.w);
+	}
+
+	if(behindEye == 4)
+		return Projection::Hidden;
+	return clipped ? Projection::Clipped : Projection::Visible;
+}
@@ -0,0 +1,129 @@
+//***************************************************************************************
+// PortalGraph.h
+//
+// Cell-and-portal visibility for the maze.  The free space between the
+// axis-aligned maze walls is cut into rectangular cells; the openings where
+// two cells touch are portals.  Cell 0 stands for everything outside the
+// walls' bounds, so lines of sight leaving the maze and entering it again are
+// followed too.
+//
+// The graph is extracted once when the scene is compiled (see SceneFile) and
+// traversed every frame from the camera's cell: each portal seen through the
+// current screen rectangle narrows it to the portal's projection, and only
+// the cells reached that way can be seen.  The cost depends on the visible
+// cells and portals, not on the size of the maze.
+//
+// This relies on the eye and the items assigned to cells staying below the
+// lowest wall top, otherwise lines of sight pass over the walls; Traverse
+// gives up when the eye is above it and CellOf only assigns items below it.
+//***************************************************************************************
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <cstdint>
+#include <vector>
+
+// Rectangle of free space in the xz plane.  Its portals are
+// Portals[FirstPortal, FirstPortal + PortalCount).
+struct PortalCell
+{
+	float MinX;
+	float MinZ;
+	float MaxX;
+	float MaxZ;
+	std::uint32_t FirstPortal;
+	std::uint32_t PortalCount;
+};
+
+// Vertical opening from Min to Max (flat along x or z) leading into Cell.
+struct CellPortal
+{
+	DirectX::XMFLOAT3 Min;
+	DirectX::XMFLOAT3 Max;
+	std::uint32_t Cell;
+};
+
+class PortalGraph
+{
+public:
+	static const std::uint32_t NoCell = 0xffffffff;
+	static const std::uint32_t OutsideCell = 0;
+
+	///<summary>
+	/// Builds the cells and portals around the walls, given as world boxes.
+	/// Free space is found on a grid of gridStep units, so openings narrower
+	/// than about two steps are taken as closed.  minY and maxY receive the
+	/// height range portals span: the lowest wall bottom and the lowest top.
+	///</summary>
+	static void Extract(const DirectX::BoundingBox* walls, std::uint32_t wallCount, float gridStep,
+		std::vector<PortalCell>& cells, std::vector<CellPortal>& portals, float& minY, float& maxY);
+
+	// Copies the output of Extract.
+	void Init(const PortalCell* cells, std::uint32_t cellCount,
+		const CellPortal* portals, std::uint32_t portalCount, float minY, float maxY);
+
+	std::uint32_t CellCount()const { return (std::uint32_t)mCells.size(); }
+
+	///<summary>
+	/// Cell containing point p: OutsideCell outside the walls' bounds, NoCell
+	/// inside a wall or above the lowest wall top.
+	///</summary>
+	std::uint32_t FindCell(const DirectX::XMFLOAT3& p)const;
+
+	///<summary>
+	/// Cell that fully contains box and whose walls hide it, or NoCell.  Items
+	/// in NoCell are not culled by the portals.
+	///</summary>
+	std::uint32_t CellOf(const DirectX::BoundingBox& box)const;
+
+	///<summary>
+	/// Finds the cells visible from eye through viewProj (row vectors, as
+	/// DirectXMath uses).  Returns false if eye is in no cell, in which case
+	/// the portals cannot tell what is visible.
+	///</summary>
+	bool Traverse(const DirectX::XMFLOAT3& eye, DirectX::FXMMATRIX viewProj);
+
+	// Valid after Traverse returned true.
+	bool IsCellVisible(std::uint32_t cell)const { return mCellVisible[cell] != 0; }
+	std::uint32_t VisibleCellCount()const { return mVisibleCellCount; }
+
+private:
+	// Rectangle in normalized device coordinates.
+	struct Rect
+	{
+		float MinX;
+		float MinY;
+		float MaxX;
+		float MaxY;
+	};
+
+	struct Visit
+	{
+		std::uint32_t Cell;
+		Rect Bounds;
+	};
+
+	enum class Projection { Hidden, Clipped, Visible };
+	Projection ProjectPortal(const CellPortal& portal, DirectX::FXMMATRIX viewProj, Rect& rect)const;
+
+private:
+	std::vector<PortalCell> mCells;
+	std::vector<CellPortal> mPortals;
+	float mMinY = 0.0f;
+	float mMaxY = 0.0f;
+
+	// Bounds of all cells but OutsideCell.
+	float mMinX = 0.0f;
+	float mMinZ = 0.0f;
+	float mMaxX = 0.0f;
+	float mMaxZ = 0.0f;
+
+	// Per frame: whether each cell was reached and the union of the screen
+	// rectangles it was reached through.
+	std::vector<std::uint8_t> mCellVisible;
+	std::vector<Rect> mCellRects;
+	std::vector<Visit> mStack;
+	std::uint32_t mVisibleCellCount = 0;
+};
@@ -0,0 +1,80 @@
+//***************************************************************************************
+// RadixSort.cpp
+//***************************************************************************************
+
+#include "RadixSort.h"
+#include <cstddef>
+#include <utility>
+
+void RadixSort(std::vector<SortEntry>& entries, std::vector<SortEntry>& scratch)
+{
+	const size_t count = entries.size();
+	if(count < 2)
+		return;
+
+	scratch.resize(count);
+
+	std::uint32_t histograms[8][256] = {};
+	for(const SortEntry& e : entries)
+	{
+		std::uint64_t key = e.Key;
+		for(int pass = 0; pass < 8; ++pass)
+		{
+			++histograms[pass][key & 0xff];
+			key >>= 8;
+		}
+	}
+
+	SortEntry* src = entries.data();
+	SortEntry* dst = scratch.data();
+	for(int pass = 0; pass < 8; ++pass)
+	{
+		std::uint32_t* histogram = histograms[pass];
+
+		// All keys share this byte, the pass would not move anything.
+		if(histogram[(src[0].Key >> (pass * 8)) & 0xff] == count)
+			continue;
+
+		std::uint32_t offset = 0;
+		for(int bucket = 0; bucket < 256; ++bucket)
+		{
+			std::uint32_t n = histogram[bucket];
+			histogram[bucket] = offset;
+			offset += n;
+		}
+
+		for(size_t i = 0; i < count; ++i)
+		{
+			const SortEntry& e = src[i];
+			dst[histogram[(e.Key >> (pass * 8)) & 0xff]++] = e;
+		}
+
+		std::swap(src, dst);
+	}
+
+	// An odd number of passes leaves the result in scratch.
+	if(src != entries.data())
+		entries.swap(scratch);
+}
+
+bool InsertionSortBounded(std::vector<SortEntry>& entries, std::size_t maxMoves)
+{
+	std::size_t moves = 0;
+	for(size_t i = 1; i < entries.size(); ++i)
+	{
+		SortEntry e = entries[i];
+
+		size_t j = i;
+		while(j > 0 && entries[j - 1].Key > e.Key)
+		{
+			entries[j] = entries[j - 1];
+			--j;
+		}
+		entries[j] = e;
+
+		moves += i - j;
+		if(moves > maxMoves)
+			return false;
+	}
+	return true;
+}
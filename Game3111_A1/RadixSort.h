@@ -0,0 +1,47 @@
+//***************************************************************************************
+// RadixSort.h
+//
+// LSD radix sort of 64-bit keys carrying a 32-bit payload, used to order the
+// visible render items by their draw sort keys every frame, plus an insertion
+// sort for keys that are already almost in order.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+struct SortEntry
+{
+	std::uint64_t Key;
+	std::uint32_t Value;
+};
+
+///<summary>
+/// Stable ascending sort of entries by Key, eight bits per pass.  One counting
+/// pass builds all eight histograms, and byte positions where every key
+/// agrees are skipped, so keys that only differ in a few bytes sort in a few
+/// passes.  scratch is resized to entries.size() and can be reused across
+/// calls to keep the sort allocation-free once warmed up.
+///</summary>
+void RadixSort(std::vector<SortEntry>& entries, std::vector<SortEntry>& scratch);
+
+///<summary>
+/// Stable ascending insertion sort of entries by Key that gives up once it has
+/// shifted more than maxMoves entries in total.  Returns false in that case,
+/// leaving entries a permutation of the input that still needs sorting.  Keys
+/// that were sorted last frame and moved little since, e.g. depths under a
+/// slowly moving camera, sort here in about one pass.
+///</summary>
+bool InsertionSortBounded(std::vector<SortEntry>& entries, std::size_t maxMoves);
+
+// Maps a float to an unsigned key that orders the same way, negative values
+// included, so floats can be radix sorted.
+inline std::uint32_t FloatSortKey(float f)
+{
+	std::uint32_t bits;
+	std::memcpy(&bits, &f, sizeof(bits));
+	return (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+}
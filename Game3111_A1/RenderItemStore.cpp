@@ -0,0 +1,99 @@
+//***************************************************************************************
+// RenderItemStore.cpp
+//***************************************************************************************
+
+#include "RenderItemStore.h"
+
+using namespace DirectX;
+
+namespace
+{
+	float& Lane(std::vector<XMFLOAT4A>& v, RenderItemStore::Handle h)
+	{
+		return (&v[h >> 2].x)[h & 3];
+	}
+
+	float Lane(const std::vector<XMFLOAT4A>& v, RenderItemStore::Handle h)
+	{
+		return (&v[h >> 2].x)[h & 3];
+	}
+}
+
+RenderItemStore::Handle RenderItemStore::Add(RenderItem* item, UINT layer, UINT objCBIndex, const BoundingBox& localBounds)
+{
+	Handle h = Count();
+
+	if((h & 3) == 0)
+	{
+		XMFLOAT4A zero(0.0f, 0.0f, 0.0f, 0.0f);
+		CenterX.push_back(zero);
+		CenterY.push_back(zero);
+		CenterZ.push_back(zero);
+		ExtentX.push_back(zero);
+		ExtentY.push_back(zero);
+		ExtentZ.push_back(zero);
+	}
+
+	World.push_back(MathHelper::Identity4x4());
+	Changes.Resize(h + 1);
+	ObjCBIndex.push_back(objCBIndex);
+	Layer.push_back((UINT8)layer);
+	Occluder.push_back(0);
+	Cell.push_back(PortalGraph::NoCell);
+	Constants.push_back(ObjectConstants());
+	LocalBounds.push_back(localBounds);
+	Items.push_back(item);
+
+	SetWorld(h, XMMatrixIdentity());
+	return h;
+}
+
+void RenderItemStore::Clear()
+{
+	CenterX.clear();
+	CenterY.clear();
+	CenterZ.clear();
+	ExtentX.clear();
+	ExtentY.clear();
+	ExtentZ.clear();
+	World.clear();
+	Changes.Resize(0);
+	ObjCBIndex.clear();
+	Layer.clear();
+	Occluder.clear();
+	Cell.clear();
+	Constants.clear();
+	LocalBounds.clear();
+	Items.clear();
+}
+
+void RenderItemStore::SetWorld(Handle h, FXMMATRIX world)
+{
+	assert(h < Count());
+
+	XMStoreFloat4x4(&World[h], world);
+
+	BoundingBox box;
+	LocalBounds[h].Transform(box, world);
+	Lane(CenterX, h) = box.Center.x;
+	Lane(CenterY, h) = box.Center.y;
+	Lane(CenterZ, h) = box.Center.z;
+	Lane(ExtentX, h) = box.Extents.x;
+	Lane(ExtentY, h) = box.Extents.y;
+	Lane(ExtentZ, h) = box.Extents.z;
+
+	Changes.MarkDirty(h);
+}
+
+BoundingBox RenderItemStore::GetWorldBounds(Handle h)const
+{
+	BoundingBox box;
+	box.Center = GetWorldCenter(h);
+	box.Extents = XMFLOAT3(Lane(ExtentX, h), Lane(ExtentY, h), Lane(ExtentZ, h));
+	return box;
+}
+
+XMFLOAT3 RenderItemStore::GetWorldCenter(Handle h)const
+{
+	return XMFLOAT3(Lane(CenterX, h), Lane(CenterY, h), Lane(CenterZ, h));
+}
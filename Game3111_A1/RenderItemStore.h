@@ -0,0 +1,86 @@
+//***************************************************************************************
+// RenderItemStore.h
+//
+// Structure-of-arrays storage for the data of the render items that is touched
+// every frame: world transforms, world-space bounds, change tracking and object
+// constant buffer slots.  The loops that run over every item each frame (object
+// constant upload, frustum culling) stream through these arrays instead of
+// chasing one heap-allocated RenderItem per item.  Data only needed to draw a
+// visible item (geometry, material, draw ranges, texture transform) stays on
+// RenderItem.
+//
+// Items are only ever appended, so a Handle, the item's index in the arrays,
+// stays valid until Clear.
+//***************************************************************************************
+
+#pragma once
+
+#include "FrameResource.h"
+#include "ChangeTracker.h"
+#include "PortalGraph.h"
+
+struct RenderItem;
+
+class RenderItemStore
+{
+public:
+	using Handle = UINT;
+	static const Handle InvalidHandle = 0xffffffff;
+
+	///<summary>
+	/// Appends an item with an identity world matrix.  localBounds is the box of
+	/// its geometry in model space, layer its RenderLayer.
+	///</summary>
+	Handle Add(RenderItem* item, UINT layer, UINT objCBIndex, const DirectX::BoundingBox& localBounds);
+
+	void Clear();
+
+	// Sets the world matrix, refreshes the world-space bounds and marks the
+	// object constants dirty.  Anything that moves a render item goes through here.
+	void SetWorld(Handle h, DirectX::FXMMATRIX world);
+
+	// Marks the object constants dirty so every frame resource gets the update.
+	// Call it after changing anything that feeds them, e.g. TexTransform.
+	void MarkDirty(Handle h) { Changes.MarkDirty(h); }
+
+	UINT Count()const { return (UINT)Items.size(); }
+
+	DirectX::BoundingBox GetWorldBounds(Handle h)const;
+	DirectX::XMFLOAT3 GetWorldCenter(Handle h)const;
+
+public:
+	// World-space AABBs, four items per element so the culling can test them
+	// without gathering: item h is lane h % 4 of element h / 4.  Unused lanes of
+	// the last element are zero.
+	std::vector<DirectX::XMFLOAT4A> CenterX;
+	std::vector<DirectX::XMFLOAT4A> CenterY;
+	std::vector<DirectX::XMFLOAT4A> CenterZ;
+	std::vector<DirectX::XMFLOAT4A> ExtentX;
+	std::vector<DirectX::XMFLOAT4A> ExtentY;
+	std::vector<DirectX::XMFLOAT4A> ExtentZ;
+
+	std::vector<DirectX::XMFLOAT4X4> World;
+
+	// Items whose constants still have to reach each frame resource's ObjectCB.
+	ChangeTracker Changes;
+
+	std::vector<UINT> ObjCBIndex;
+	std::vector<UINT8> Layer;
+
+	// Nonzero for items drawn into the OcclusionBuffer, or static batches holding
+	// such items, which are not tested against it.
+	std::vector<UINT8> Occluder;
+
+	// Maze cell that hides the item unless it is visible through the portals,
+	// PortalGraph::NoCell for items the portals do not cull.  Reassigned
+	// whenever the item moves, see ShapesApp::UpdateTransforms.
+	std::vector<UINT> Cell;
+
+	// Constants last written to ObjectCB, reused by the instanced draws.
+	std::vector<ObjectConstants> Constants;
+
+	// Model-space bounds, only read when the item moves.
+	std::vector<DirectX::BoundingBox> LocalBounds;
+
+	std::vector<RenderItem*> Items;
+};
@@ -0,0 +1,575 @@
+//***************************************************************************************
+// SceneFile.cpp
+//***************************************************************************************
+
+#include "SceneFile.h"
+
+using namespace DirectX;
+
+namespace
+{
+	// File layout:
+	//   SceneHeader
+	//   SceneMaterial[MaterialCount]
+	//   SceneMesh[MeshCount]
+	//   SceneItem[ItemCount]
+	//   PortalCell[CellCount]
+	//   CellPortal[PortalCount]
+	//   SceneNode[NodeCount]
+	//   SceneLight[LightCount]
+	// Every record is fixed size and 4-byte aligned, so the arrays are used
+	// straight out of the mapping.
+
+	const char SceneMagic[4] = { 'S', 'C', 'N', 'B' };
+
+	struct SceneHeader
+	{
+		char Magic[4];
+		std::uint32_t Version;
+		std::uint64_t SourceSize;
+		std::uint64_t SourceWriteTime;
+		std::uint32_t MaterialCount;
+		std::uint32_t MeshCount;
+		std::uint32_t ItemCount;
+		std::uint32_t LayerCount;
+		std::uint32_t CellCount;
+		std::uint32_t PortalCount;
+		float CellMinY;
+		float CellMaxY;
+		std::uint32_t NodeCount;
+		std::uint32_t LightCount;
+	};
+
+	std::uint64_t SourceSize(const WIN32_FILE_ATTRIBUTE_DATA& data)
+	{
+		return ((std::uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+	}
+
+	std::uint64_t SourceWriteTime(const WIN32_FILE_ATTRIBUTE_DATA& data)
+	{
+		return ((std::uint64_t)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+	}
+
+	bool CopyName(char* dst, size_t dstSize, const std::string& src)
+	{
+		if(src.empty() || src.size() >= dstSize)
+			return false;
+
+		memset(dst, 0, dstSize);
+		memcpy(dst, src.c_str(), src.size());
+		return true;
+	}
+
+	bool ReadFloats(std::istringstream& in, float* values, int count)
+	{
+		for(int i = 0; i < count; ++i)
+		{
+			if(!(in >> values[i]))
+				return false;
+		}
+
+		return true;
+	}
+
+	// Reads the values of a transform attribute into scale, rotate or
+	// translate.  Returns false if key is not a transform attribute.
+	bool ReadTransform(const std::string& key, std::istringstream& in,
+		float* scale, float* rotate, float* translate, bool& ok)
+	{
+		if(key == "scale")
+			ok = ReadFloats(in, scale, 3);
+		else if(key == "rotate")
+			ok = ReadFloats(in, rotate, 3);
+		else if(key == "translate")
+			ok = ReadFloats(in, translate, 3);
+		else
+			return false;
+
+		return true;
+	}
+
+	XMMATRIX ComposeTransform(const float* scale, const float* rotate, const float* translate)
+	{
+		return
+			XMMatrixScaling(scale[0], scale[1], scale[2]) *
+			XMMatrixRotationRollPitchYaw(XMConvertToRadians(rotate[0]), XMConvertToRadians(rotate[1]), XMConvertToRadians(rotate[2])) *
+			XMMatrixTranslation(translate[0], translate[1], translate[2]);
+	}
+}
+
+bool SceneFile::Open(const std::wstring& textFile, const std::wstring& binaryFile,
+	const char* const* layerNames, UINT layerCount, std::string& error)
+{
+	WIN32_FILE_ATTRIBUTE_DATA source;
+	const bool haveSource = GetFileAttributesExW(textFile.c_str(), GetFileExInfoStandard, &source) != 0;
+
+	if(Map(binaryFile, haveSource ? &source : nullptr, layerCount))
+		return true;
+
+	if(!haveSource)
+	{
+		error = "Scene file not found.";
+		return false;
+	}
+
+	if(!Compile(textFile, binaryFile, layerNames, layerCount, error))
+		return false;
+
+	if(!Map(binaryFile, &source, layerCount))
+	{
+		error = "Compiled scene could not be loaded.";
+		return false;
+	}
+
+	return true;
+}
+
+bool SceneFile::Map(const std::wstring& binaryFile, const WIN32_FILE_ATTRIBUTE_DATA* source, UINT layerCount)
+{
+	mMaterials = nullptr;
+	mMeshes = nullptr;
+	mItems = nullptr;
+	mNodes = nullptr;
+	mLights = nullptr;
+	mCells = nullptr;
+	mPortals = nullptr;
+	mMaterialCount = mMeshCount = mItemCount = mNodeCount = mLightCount = mCellCount = mPortalCount = 0;
+
+	if(!mFile.Open(binaryFile) || mFile.Size() < sizeof(SceneHeader))
+		return false;
+
+	SceneHeader header;
+	memcpy(&header, mFile.Data(), sizeof(SceneHeader));
+
+	if(memcmp(header.Magic, SceneMagic, sizeof(SceneMagic)) != 0 ||
+		header.Version != Version ||
+		header.LayerCount != layerCount)
+	{
+		mFile.Close();
+		return false;
+	}
+
+	// Without the text file there is nothing to be stale against.
+	if(source != nullptr &&
+		(header.SourceSize != SourceSize(*source) || header.SourceWriteTime != SourceWriteTime(*source)))
+	{
+		mFile.Close();
+		return false;
+	}
+
+	const size_t materialOffset = sizeof(SceneHeader);
+	const size_t meshOffset = materialOffset + (size_t)header.MaterialCount * sizeof(SceneMaterial);
+	const size_t itemOffset = meshOffset + (size_t)header.MeshCount * sizeof(SceneMesh);
+	const size_t cellOffset = itemOffset + (size_t)header.ItemCount * sizeof(SceneItem);
+	const size_t portalOffset = cellOffset + (size_t)header.CellCount * sizeof(PortalCell);
+	const size_t nodeOffset = portalOffset + (size_t)header.PortalCount * sizeof(CellPortal);
+	const size_t lightOffset = nodeOffset + (size_t)header.NodeCount * sizeof(SceneNode);
+	const size_t expectedSize = lightOffset + (size_t)header.LightCount * sizeof(SceneLight);
+	if(mFile.Size() != expectedSize)
+	{
+		mFile.Close();
+		return false;
+	}
+
+	const SceneMaterial* materials = reinterpret_cast<const SceneMaterial*>(mFile.Data() + materialOffset);
+	const SceneMesh* meshes = reinterpret_cast<const SceneMesh*>(mFile.Data() + meshOffset);
+	const SceneItem* items = reinterpret_cast<const SceneItem*>(mFile.Data() + itemOffset);
+	const PortalCell* cells = reinterpret_cast<const PortalCell*>(mFile.Data() + cellOffset);
+	const CellPortal* portals = reinterpret_cast<const CellPortal*>(mFile.Data() + portalOffset);
+	const SceneNode* nodes = reinterpret_cast<const SceneNode*>(mFile.Data() + nodeOffset);
+	const SceneLight* lights = reinterpret_cast<const SceneLight*>(mFile.Data() + lightOffset);
+
+	// The names are used as C strings and the indices unchecked by the caller,
+	// so reject anything a truncated or foreign file could get wrong.
+	bool valid = true;
+	for(UINT i = 0; i < header.MaterialCount; ++i)
+		valid = valid && materials[i].Name[sizeof(materials[i].Name) - 1] == '\0';
+	for(UINT i = 0; i < header.MeshCount; ++i)
+	{
+		valid = valid && meshes[i].Geometry[sizeof(meshes[i].Geometry) - 1] == '\0' &&
+			meshes[i].Submesh[sizeof(meshes[i].Submesh) - 1] == '\0';
+	}
+	for(UINT i = 0; i < header.ItemCount; ++i)
+	{
+		valid = valid && items[i].Mesh < header.MeshCount &&
+			items[i].Material < header.MaterialCount &&
+			items[i].Layer < layerCount &&
+			(items[i].Node == NoNode || items[i].Node < header.NodeCount);
+	}
+	for(UINT i = 0; i < header.NodeCount; ++i)
+	{
+		valid = valid && nodes[i].Name[sizeof(nodes[i].Name) - 1] == '\0' &&
+			(nodes[i].Parent == NoNode || nodes[i].Parent < i);
+	}
+	std::uint32_t directionalCount = 0;
+	for(UINT i = 0; i < header.LightCount; ++i)
+	{
+		valid = valid && lights[i].Type <= LightSpot;
+		if(lights[i].Type == LightDirectional)
+			++directionalCount;
+	}
+	valid = valid && directionalCount <= MaxDirectionalLights;
+	for(UINT i = 0; i < header.CellCount; ++i)
+	{
+		valid = valid && cells[i].FirstPortal <= header.PortalCount &&
+			cells[i].PortalCount <= header.PortalCount - cells[i].FirstPortal;
+	}
+	for(UINT i = 0; i < header.PortalCount; ++i)
+		valid = valid && portals[i].Cell < header.CellCount;
+
+	if(!valid)
+	{
+		mFile.Close();
+		return false;
+	}
+
+	mMaterials = materials;
+	mMeshes = meshes;
+	mItems = items;
+	mNodes = nodes;
+	mLights = lights;
+	mCells = cells;
+	mPortals = portals;
+	mMaterialCount = header.MaterialCount;
+	mMeshCount = header.MeshCount;
+	mItemCount = header.ItemCount;
+	mNodeCount = header.NodeCount;
+	mLightCount = header.LightCount;
+	mCellCount = header.CellCount;
+	mPortalCount = header.PortalCount;
+	mCellMinY = header.CellMinY;
+	mCellMaxY = header.CellMaxY;
+
+	return true;
+}
+
+bool SceneFile::Compile(const std::wstring& textFile, const std::wstring& binaryFile,
+	const char* const* layerNames, UINT layerCount, std::string& error)
+{
+	WIN32_FILE_ATTRIBUTE_DATA source;
+	std::ifstream fin(textFile);
+	if(!fin || !GetFileAttributesExW(textFile.c_str(), GetFileExInfoStandard, &source))
+	{
+		error = "Scene file could not be opened.";
+		return false;
+	}
+
+	std::vector<SceneMaterial> materials;
+	std::vector<SceneMesh> meshes;
+	std::vector<SceneItem> items;
+	std::vector<SceneNode> nodes;
+	std::vector<SceneLight> lights;
+	std::uint32_t directionalCount = 0;
+	std::unordered_map<std::string, std::uint32_t> materialIndices;
+	std::unordered_map<std::string, std::uint32_t> meshIndices;
+	std::unordered_map<std::string, std::uint32_t> nodeIndices;
+
+	std::string line;
+	int lineNumber = 0;
+	while(std::getline(fin, line))
+	{
+		++lineNumber;
+
+		size_t comment = line.find('#');
+		if(comment != std::string::npos)
+			line.erase(comment);
+
+		std::istringstream in(line);
+		std::string command;
+		if(!(in >> command))
+			continue;
+
+		auto fail = [&](const std::string& message)
+		{
+			error = "Scene line " + std::to_string(lineNumber) + ": " + message;
+			return false;
+		};
+
+		if(command == "material")
+		{
+			// material <name> <diffuse srv> <albedo r g b a> <fresnel r g b> <roughness>
+			std::string name;
+			SceneMaterial mat = {};
+			float values[8];
+			if(!(in >> name >> mat.DiffuseSrvHeapIndex) || !ReadFloats(in, values, 8))
+				return fail("expected material <name> <diffuse srv> <albedo r g b a> <fresnel r g b> <roughness>");
+			if(!CopyName(mat.Name, sizeof(mat.Name), name))
+				return fail("material name too long");
+			if(materialIndices.count(name) != 0)
+				return fail("material '" + name + "' defined twice");
+
+			mat.DiffuseAlbedo = XMFLOAT4(values[0], values[1], values[2], values[3]);
+			mat.FresnelR0 = XMFLOAT3(values[4], values[5], values[6]);
+			mat.Roughness = values[7];
+
+			materialIndices[name] = (std::uint32_t)materials.size();
+			materials.push_back(mat);
+		}
+		else if(command == "node")
+		{
+			// node <name> [scale x y z] [rotate x y z] [translate x y z] [parent <node>]
+			std::string name;
+			if(!(in >> name))
+				return fail("expected node <name>");
+
+			SceneNode node = {};
+			node.Parent = NoNode;
+			if(!CopyName(node.Name, sizeof(node.Name), name))
+				return fail("node name too long");
+			if(nodeIndices.count(name) != 0)
+				return fail("node '" + name + "' defined twice");
+
+			float scale[3] = { 1.0f, 1.0f, 1.0f };
+			float rotate[3] = { 0.0f, 0.0f, 0.0f };
+			float translate[3] = { 0.0f, 0.0f, 0.0f };
+
+			std::string key;
+			while(in >> key)
+			{
+				bool ok = true;
+				if(key == "parent")
+				{
+					std::string parent;
+					auto found = (in >> parent) ? nodeIndices.find(parent) : nodeIndices.end();
+					if(found == nodeIndices.end())
+						return fail("unknown parent node '" + parent + "'");
+					node.Parent = found->second;
+				}
+				else if(!ReadTransform(key, in, scale, rotate, translate, ok))
+					return fail("unknown node attribute '" + key + "'");
+
+				if(!ok)
+					return fail("bad values for '" + key + "'");
+			}
+
+			XMStoreFloat4x4(&node.Local, ComposeTransform(scale, rotate, translate));
+
+			nodeIndices[name] = (std::uint32_t)nodes.size();
+			nodes.push_back(node);
+		}
+		else if(command == "light")
+		{
+			// light directional <direction x y z> <strength r g b>
+			// light point <position x y z> <strength r g b> <falloff start> <falloff end>
+			// light spot <position x y z> <direction x y z> <strength r g b> <falloff start>
+			//      <falloff end> <spot power>
+			std::string type;
+			SceneLight light = {};
+			float values[12];
+			in >> type;
+			if(type == "directional")
+			{
+				if(!ReadFloats(in, values, 6))
+					return fail("expected light directional <direction x y z> <strength r g b>");
+				if(++directionalCount > MaxDirectionalLights)
+					return fail("at most " + std::to_string(MaxDirectionalLights) + " directional lights");
+
+				light.Type = LightDirectional;
+				XMStoreFloat3(&light.Direction, XMVector3Normalize(XMVectorSet(values[0], values[1], values[2], 0.0f)));
+				light.Strength = XMFLOAT3(values[3], values[4], values[5]);
+			}
+			else if(type == "point")
+			{
+				if(!ReadFloats(in, values, 8))
+					return fail("expected light point <position x y z> <strength r g b> <falloff start> <falloff end>");
+
+				light.Type = LightPoint;
+				light.Position = XMFLOAT3(values[0], values[1], values[2]);
+				light.Strength = XMFLOAT3(values[3], values[4], values[5]);
+				light.FalloffStart = values[6];
+				light.FalloffEnd = values[7];
+			}
+			else if(type == "spot")
+			{
+				if(!ReadFloats(in, values, 12))
+					return fail("expected light spot <position x y z> <direction x y z> <strength r g b> <falloff start> <falloff end> <spot power>");
+				if(values[11] <= 0.0f)
+					return fail("spot power must be positive");
+
+				light.Type = LightSpot;
+				light.Position = XMFLOAT3(values[0], values[1], values[2]);
+				XMStoreFloat3(&light.Direction, XMVector3Normalize(XMVectorSet(values[3], values[4], values[5], 0.0f)));
+				light.Strength = XMFLOAT3(values[6], values[7], values[8]);
+				light.FalloffStart = values[9];
+				light.FalloffEnd = values[10];
+				light.SpotPower = values[11];
+			}
+			else
+				return fail("unknown light type '" + type + "'");
+
+			if(light.Type != LightDirectional && !(light.FalloffStart < light.FalloffEnd))
+				return fail("falloff start must be less than falloff end");
+
+			lights.push_back(light);
+		}
+		else if(command == "item")
+		{
+			// item <layer> <geometry> <submesh> <material> [scale x y z] [rotate x y z]
+			//      [translate x y z] [tex x y z] [collide cx cy cz ex ey ez] [occluder] [points]
+			//      [static] [ground] [parent <node>]
+			std::string layer, geometry, submesh, material;
+			if(!(in >> layer >> geometry >> submesh >> material))
+				return fail("expected item <layer> <geometry> <submesh> <material>");
+
+			SceneItem item = {};
+			item.PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+			item.Node = NoNode;
+
+			item.Layer = layerCount;
+			for(UINT i = 0; i < layerCount; ++i)
+			{
+				if(layer == layerNames[i])
+					item.Layer = i;
+			}
+			if(item.Layer == layerCount)
+				return fail("unknown layer '" + layer + "'");
+
+			auto mat = materialIndices.find(material);
+			if(mat == materialIndices.end())
+				return fail("unknown material '" + material + "'");
+			item.Material = mat->second;
+
+			std::string meshKey = geometry + "/" + submesh;
+			auto mesh = meshIndices.find(meshKey);
+			if(mesh == meshIndices.end())
+			{
+				SceneMesh entry = {};
+				if(!CopyName(entry.Geometry, sizeof(entry.Geometry), geometry) ||
+					!CopyName(entry.Submesh, sizeof(entry.Submesh), submesh))
+				{
+					return fail("geometry or submesh name too long");
+				}
+
+				mesh = meshIndices.emplace(meshKey, (std::uint32_t)meshes.size()).first;
+				meshes.push_back(entry);
+			}
+			item.Mesh = mesh->second;
+
+			float scale[3] = { 1.0f, 1.0f, 1.0f };
+			float rotate[3] = { 0.0f, 0.0f, 0.0f };
+			float translate[3] = { 0.0f, 0.0f, 0.0f };
+			float tex[3] = { 1.0f, 1.0f, 1.0f };
+			float collide[6];
+
+			std::string key;
+			while(in >> key)
+			{
+				bool ok = true;
+				if(key == "tex")
+					ok = ReadFloats(in, tex, 3);
+				else if(key == "collide")
+				{
+					ok = ReadFloats(in, collide, 6);
+					item.Flags |= ItemCollidable;
+					item.CollisionBox.Center = XMFLOAT3(collide[0], collide[1], collide[2]);
+					item.CollisionBox.Extents = XMFLOAT3(collide[3], collide[4], collide[5]);
+				}
+				else if(key == "occluder")
+					item.Flags |= ItemOccluder;
+				else if(key == "static")
+					item.Flags |= ItemStatic;
+				else if(key == "ground")
+					item.Flags |= ItemGround;
+				else if(key == "points")
+					item.PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_POINTLIST;
+				else if(key == "parent")
+				{
+					std::string parent;
+					auto found = (in >> parent) ? nodeIndices.find(parent) : nodeIndices.end();
+					if(found == nodeIndices.end())
+						return fail("unknown parent node '" + parent + "'");
+					item.Node = found->second;
+				}
+				else if(!ReadTransform(key, in, scale, rotate, translate, ok))
+					return fail("unknown item attribute '" + key + "'");
+
+				if(!ok)
+					return fail("bad values for '" + key + "'");
+			}
+
+			// Collision boxes are in world space and never move, so they cannot
+			// follow a node.
+			if((item.Flags & ItemCollidable) && item.Node != NoNode)
+				return fail("collidable items cannot have a parent");
+
+			// Same for the ground, which the trees are placed on once.
+			if((item.Flags & ItemGround) && item.Node != NoNode)
+				return fail("ground items cannot have a parent");
+
+			XMStoreFloat4x4(&item.World, ComposeTransform(scale, rotate, translate));
+			XMStoreFloat4x4(&item.TexTransform, XMMatrixScaling(tex[0], tex[1], tex[2]));
+
+			items.push_back(item);
+		}
+		else
+		{
+			return fail("unknown command '" + command + "'");
+		}
+	}
+
+	// The collision boxes are the maze walls.
+	std::vector<BoundingBox> walls;
+	for(const SceneItem& item : items)
+	{
+		if(item.Flags & ItemCollidable)
+			walls.push_back(item.CollisionBox);
+	}
+
+	std::vector<PortalCell> cells;
+	std::vector<CellPortal> portals;
+	float cellMinY, cellMaxY;
+	PortalGraph::Extract(walls.data(), (std::uint32_t)walls.size(), CellGridStep, cells, portals, cellMinY, cellMaxY);
+
+	SceneHeader header = {};
+	memcpy(header.Magic, SceneMagic, sizeof(SceneMagic));
+	header.Version = Version;
+	header.SourceSize = SourceSize(source);
+	header.SourceWriteTime = SourceWriteTime(source);
+	header.MaterialCount = (std::uint32_t)materials.size();
+	header.MeshCount = (std::uint32_t)meshes.size();
+	header.ItemCount = (std::uint32_t)items.size();
+	header.LayerCount = layerCount;
+	header.CellCount = (std::uint32_t)cells.size();
+	header.PortalCount = (std::uint32_t)portals.size();
+	header.CellMinY = cellMinY;
+	header.CellMaxY = cellMaxY;
+	header.NodeCount = (std::uint32_t)nodes.size();
+	header.LightCount = (std::uint32_t)lights.size();
+
+	// Same temp-then-rename as GeometryCache::Save so a half-written binary is
+	// never picked up.
+	std::wstring tempFilename = binaryFile + L".tmp";
+	{
+		std::ofstream fout(tempFilename, std::ios::binary | std::ios::trunc);
+		if(!fout)
+		{
+			error = "Compiled scene could not be written.";
+			return false;
+		}
+
+		fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		fout.write(reinterpret_cast<const char*>(materials.data()), materials.size() * sizeof(SceneMaterial));
+		fout.write(reinterpret_cast<const char*>(meshes.data()), meshes.size() * sizeof(SceneMesh));
+		fout.write(reinterpret_cast<const char*>(items.data()), items.size() * sizeof(SceneItem));
+		fout.write(reinterpret_cast<const char*>(cells.data()), cells.size() * sizeof(PortalCell));
+		fout.write(reinterpret_cast<const char*>(portals.data()), portals.size() * sizeof(CellPortal));
+		fout.write(reinterpret_cast<const char*>(nodes.data()), nodes.size() * sizeof(SceneNode));
+		fout.write(reinterpret_cast<const char*>(lights.data()), lights.size() * sizeof(SceneLight));
+
+		if(!fout)
+		{
+			fout.close();
+			DeleteFileW(tempFilename.c_str());
+			error = "Compiled scene could not be written.";
+			return false;
+		}
+	}
+
+	if(!MoveFileExW(tempFilename.c_str(), binaryFile.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		error = "Compiled scene could not be written.";
+		return false;
+	}
+
+	return true;
+}
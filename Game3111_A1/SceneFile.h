@@ -0,0 +1,168 @@
+//***************************************************************************************
+// SceneFile.h
+//
+// Scene description loaded at startup instead of being built in code.  Scenes
+// are authored as text (see Scenes/maze.scene for the syntax) and compiled to a
+// binary of fixed-size records next to the geometry cache.  Compiling also
+// extracts the maze cells and portals from the collision boxes of the walls,
+// see PortalGraph.  Nodes group items under a shared transform, see
+// TransformHierarchy.  Lights are listed in world space; point and spot lights
+// are assigned to clusters every frame, see LightClusters.  Later runs map the
+// binary and hand the records out as arrays, so loading does no string parsing
+// per item: names only appear in the small material and mesh tables, which the
+// caller resolves once.
+//
+// The binary is recompiled whenever the text file's size or write time no
+// longer matches the stamp stored in its header.  If only the binary exists it
+// is used as is.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include "MappedFile.h"
+#include "PortalGraph.h"
+
+class SceneFile
+{
+public:
+
+	// Bump whenever the file layout or the meaning of the records changes.
+	static const std::uint32_t Version = 6;
+
+	// Grid resolution of the cell extraction, in world units.
+	static constexpr float CellGridStep = 0.25f;
+
+	// SceneItem::Flags
+	static const std::uint32_t ItemCollidable = 0x1;
+	static const std::uint32_t ItemOccluder = 0x2;
+	static const std::uint32_t ItemStatic = 0x4;
+	static const std::uint32_t ItemGround = 0x8;
+
+	// SceneNode::Parent and SceneItem::Node when there is none.
+	static const std::uint32_t NoNode = 0xffffffff;
+
+	// SceneLight::Type
+	static const std::uint32_t LightDirectional = 0;
+	static const std::uint32_t LightPoint = 1;
+	static const std::uint32_t LightSpot = 2;
+
+	// Directional lights go to the pass constants, one per entry of the
+	// shaders' shadowFactor.
+	static const std::uint32_t MaxDirectionalLights = 3;
+
+	struct SceneMaterial
+	{
+		char Name[32];
+		std::uint32_t DiffuseSrvHeapIndex;
+		DirectX::XMFLOAT4 DiffuseAlbedo;
+		DirectX::XMFLOAT3 FresnelR0;
+		float Roughness;
+	};
+
+	// Geometry and submesh an item draws, by name in ShapesApp::mGeometries.
+	struct SceneMesh
+	{
+		char Geometry[32];
+		char Submesh[32];
+	};
+
+	// Transform shared by the items and nodes attached to it.  Parents come
+	// before their children.
+	struct SceneNode
+	{
+		char Name[32];
+		DirectX::XMFLOAT4X4 Local;   // relative to Parent
+		std::uint32_t Parent;        // index into Nodes(), or NoNode
+	};
+
+	struct SceneItem
+	{
+		DirectX::XMFLOAT4X4 World;   // relative to Node
+		DirectX::XMFLOAT4X4 TexTransform;
+		std::uint32_t Mesh;          // index into Meshes()
+		std::uint32_t Material;      // index into Materials()
+		std::uint32_t Layer;         // index into the layer names passed to Open
+		std::uint32_t PrimitiveType; // D3D12_PRIMITIVE_TOPOLOGY
+		std::uint32_t Flags;
+		std::uint32_t Node;          // index into Nodes(), or NoNode
+		DirectX::BoundingBox CollisionBox;
+	};
+
+	// Same terms as the Light the shaders read.
+	struct SceneLight
+	{
+		std::uint32_t Type;
+		DirectX::XMFLOAT3 Strength;
+		DirectX::XMFLOAT3 Position;  // point and spot lights
+		DirectX::XMFLOAT3 Direction; // directional and spot lights, normalized
+		float FalloffStart;          // point and spot lights
+		float FalloffEnd;            // point and spot lights
+		float SpotPower;             // spot lights
+	};
+
+	SceneFile() = default;
+	SceneFile(const SceneFile& rhs) = delete;
+	SceneFile& operator=(const SceneFile& rhs) = delete;
+
+	///<summary>
+	/// Maps binaryFile, compiling textFile into it first if the binary is missing
+	/// or stale.  layerNames are the names the text uses for the render layers,
+	/// in RenderLayer order.  On failure returns false and describes the problem
+	/// in error.
+	///</summary>
+	bool Open(const std::wstring& textFile, const std::wstring& binaryFile,
+		const char* const* layerNames, UINT layerCount, std::string& error);
+
+	///<summary>
+	/// Parses textFile and writes the binary form to binaryFile.
+	///</summary>
+	static bool Compile(const std::wstring& textFile, const std::wstring& binaryFile,
+		const char* const* layerNames, UINT layerCount, std::string& error);
+
+	const SceneMaterial* Materials()const { return mMaterials; }
+	UINT MaterialCount()const { return mMaterialCount; }
+
+	const SceneMesh* Meshes()const { return mMeshes; }
+	UINT MeshCount()const { return mMeshCount; }
+
+	const SceneItem* Items()const { return mItems; }
+	UINT ItemCount()const { return mItemCount; }
+
+	const SceneNode* Nodes()const { return mNodes; }
+	UINT NodeCount()const { return mNodeCount; }
+
+	const SceneLight* Lights()const { return mLights; }
+	UINT LightCount()const { return mLightCount; }
+
+	// Output of PortalGraph::Extract for the collidable items.
+	const PortalCell* Cells()const { return mCells; }
+	UINT CellCount()const { return mCellCount; }
+	const CellPortal* Portals()const { return mPortals; }
+	UINT PortalCount()const { return mPortalCount; }
+	float CellMinY()const { return mCellMinY; }
+	float CellMaxY()const { return mCellMaxY; }
+
+private:
+	bool Map(const std::wstring& binaryFile, const WIN32_FILE_ATTRIBUTE_DATA* source, UINT layerCount);
+
+private:
+	MappedFile mFile;
+
+	const SceneMaterial* mMaterials = nullptr;
+	const SceneMesh* mMeshes = nullptr;
+	const SceneItem* mItems = nullptr;
+	const SceneNode* mNodes = nullptr;
+	const SceneLight* mLights = nullptr;
+	const PortalCell* mCells = nullptr;
+	const CellPortal* mPortals = nullptr;
+	UINT mMaterialCount = 0;
+	UINT mMeshCount = 0;
+	UINT mItemCount = 0;
+	UINT mNodeCount = 0;
+	UINT mLightCount = 0;
+	UINT mCellCount = 0;
+	UINT mPortalCount = 0;
+	float mCellMinY = 0.0f;
+	float mCellMaxY = 0.0f;
+};
@@ -2,7 +2,9 @@
 // Contains API for shader lighting.
 //***************************************************************************************
 
-//Putting the Light array in the per-pass constant buffer means we cannot have more than sixteen(the maximum number of lights we support) lights per rendering pass.
+// Directional lights live in the per-pass constant buffer, which holds at most
+// MaxLights of them.  Point and spot lights are read from structured buffers
+// through the light clusters instead, see ComputeClusterLighting.
 #define MaxLights 16
 
 struct Light
@@ -134,36 +136,65 @@ float3 ComputeSpotLight(Light L, Material mat, float3 pos, float3 normal, float3
     return BlinnPhong(lightStrength, lightVec, normal, toEye, mat);
 }
 
-float4 ComputeLighting(Light gLights[MaxLights], Material mat,
+//---------------------------------------------------------------------------------------
+// Evaluates the directional lights gLights[0, dirLightCount), at most three.
+//---------------------------------------------------------------------------------------
+float4 ComputeLighting(Light gLights[MaxLights], uint dirLightCount, Material mat,
                        float3 pos, float3 normal, float3 toEye,
                        float3 shadowFactor)
 {
     float3 result = 0.0f;
 
-    int i = 0;
-
-#if (NUM_DIR_LIGHTS > 0)
-    for(i = 0; i < NUM_DIR_LIGHTS; ++i)
+    for(uint i = 0; i < dirLightCount; ++i)
     {
         result += shadowFactor[i] * ComputeDirectionalLight(gLights[i], mat, normal, toEye);
     }
-#endif
 
-#if (NUM_POINT_LIGHTS > 0)
-    for(i = NUM_DIR_LIGHTS; i < NUM_DIR_LIGHTS+NUM_POINT_LIGHTS; ++i)
-    {
-        result += ComputePointLight(gLights[i], mat, pos, normal, toEye);
-    }
-#endif
+    return float4(result, 0.0f);
+}
+
+// Point and spot lights are assigned to a grid of view-space clusters on the
+// CPU every frame, see LightClusters.  A cluster's lights are
+// lightIndices[Offset, Offset + Count), indices into the light buffer, where
+// point lights have SpotPower 0.
+struct LightCluster
+{
+    uint Offset;
+    uint Count;
+};
+
+//---------------------------------------------------------------------------------------
+// Index of the cluster holding the pixel at pixel (SV_Position.xy) and view
+// depth viewZ.  clusterCounts are the tiles along x and y and the depth slices.
+//---------------------------------------------------------------------------------------
+uint ClusterIndex(float2 pixel, float viewZ, uint3 clusterCounts,
+                  float2 tileScale, float depthScale, float depthBias)
+{
+    uint2 tile = min(uint2(pixel * tileScale), clusterCounts.xy - 1);
+    uint slice = (uint)clamp(floor(log(viewZ) * depthScale + depthBias), 0.0f, clusterCounts.z - 1.0f);
 
-#if (NUM_SPOT_LIGHTS > 0)
-    for(i = NUM_DIR_LIGHTS + NUM_POINT_LIGHTS; i < NUM_DIR_LIGHTS + NUM_POINT_LIGHTS + NUM_SPOT_LIGHTS; ++i)
+    return (slice * clusterCounts.y + tile.y) * clusterCounts.x + tile.x;
+}
+
+//---------------------------------------------------------------------------------------
+// Evaluates the point and spot lights of one cluster.
+//---------------------------------------------------------------------------------------
+float3 ComputeClusterLighting(StructuredBuffer<Light> lights, StructuredBuffer<uint> lightIndices,
+                              LightCluster cluster, Material mat,
+                              float3 pos, float3 normal, float3 toEye)
+{
+    float3 result = 0.0f;
+
+    for(uint i = 0; i < cluster.Count; ++i)
     {
-        result += ComputeSpotLight(gLights[i], mat, pos, normal, toEye);
+        Light L = lights[lightIndices[cluster.Offset + i]];
+        if(L.SpotPower > 0.0f)
+            result += ComputeSpotLight(L, mat, pos, normal, toEye);
+        else
+            result += ComputePointLight(L, mat, pos, normal, toEye);
     }
-#endif 
 
-    return float4(result, 0.0f);
+    return result;
 }
 
 
@@ -2,19 +2,6 @@
 // TreeSprite.hlsl.
 //***************************************************************************************
 
-// Defaults for number of lights.
-#ifndef NUM_DIR_LIGHTS
-    #define NUM_DIR_LIGHTS 1
-#endif
-
-#ifndef NUM_POINT_LIGHTS
-    #define NUM_POINT_LIGHTS 7
-#endif
-
-#ifndef NUM_SPOT_LIGHTS
-    #define NUM_SPOT_LIGHTS 1
-#endif
-
 // Include structures and functions for lighting.
 #include "LightingUtil.hlsl"
 //step5
@@ -56,20 +43,31 @@ cbuffer cbPass : register(b1)
     float gFarZ;
     float gTotalTime;
     float gDeltaTime;
-    float4 gAmbientLight;
 
-	float4 gFogColor;
-	float gFogStart;
-	float gFogRange;
-	float2 cbPerObjectPad2;
+    uint3 gClusterCounts;
+    float cbPassPad2;
+    float2 gClusterTileScale;
+    float gClusterDepthScale;
+    float gClusterDepthBias;
+};
+
+// Lights that rarely change, uploaded separately from cbPass.
+cbuffer cbLights : register(b4)
+{
+    float4 gAmbientLight;
 
-    // Indices [0, NUM_DIR_LIGHTS) are directional lights;
-    // indices [NUM_DIR_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHTS) are point lights;
-    // indices [NUM_DIR_LIGHTS+NUM_POINT_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHT+NUM_SPOT_LIGHTS)
-    // are spot lights for a maximum of MaxLights per object.
+    // Indices [0, gDirLightCount) are directional lights.  Point and spot
+    // lights come from the light clusters.
     Light gLights[MaxLights];
+
+    uint gDirLightCount;
 };
 
+// Point and spot lights and the light lists of the clusters, see LightingUtil.hlsl.
+StructuredBuffer<Light> gLocalLights : register(t1, space1);
+StructuredBuffer<LightCluster> gLightClusters : register(t2, space1);
+StructuredBuffer<uint> gLightIndices : register(t3, space1);
+
 cbuffer cbMaterial : register(b2)
 {
 	float4   gDiffuseAlbedo;
@@ -199,15 +197,16 @@ float4 PS(GeoOut pin) : SV_Target
     const float shininess = 1.0f - gRoughness;
     Material mat = { diffuseAlbedo, gFresnelR0, shininess };
     float3 shadowFactor = 1.0f;
-    float4 directLight = ComputeLighting(gLights, mat, pin.PosW,
+    float4 directLight = ComputeLighting(gLights, gDirLightCount, mat, pin.PosW,
         pin.NormalW, toEyeW, shadowFactor);
 
-    float4 litColor = ambient + directLight;
+    float viewZ = mul(float4(pin.PosW, 1.0f), gView).z;
+    uint cluster = ClusterIndex(pin.PosH.xy, viewZ, gClusterCounts,
+        gClusterTileScale, gClusterDepthScale, gClusterDepthBias);
+    directLight.rgb += ComputeClusterLighting(gLocalLights, gLightIndices, gLightClusters[cluster],
+        mat, pin.PosW, pin.NormalW, toEyeW);
 
-#ifdef FOG
-	float fogAmount = saturate((distToEye - gFogStart) / gFogRange);
-	litColor = lerp(litColor, gFogColor, fogAmount);
-#endif
+    float4 litColor = ambient + directLight;
 
     // Common convention to take alpha from diffuse albedo.
     litColor.a = diffuseAlbedo.a;
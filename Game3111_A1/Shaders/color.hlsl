@@ -4,19 +4,6 @@
 // 
 //***************************************************************************************
 
-// Defaults for number of lights.
-#ifndef NUM_DIR_LIGHTS
-#define NUM_DIR_LIGHTS 1
-#endif
-
-#ifndef NUM_POINT_LIGHTS
-#define NUM_POINT_LIGHTS 9
-#endif
-
-#ifndef NUM_SPOT_LIGHTS
-#define NUM_SPOT_LIGHTS 1
-#endif
-
 // Include structures and functions for lighting.
 #include "LightingUtil.hlsl"
 
@@ -55,15 +42,31 @@ cbuffer cbPass : register(b1)
     float gFarZ;
     float gTotalTime;
     float gDeltaTime;
+
+    uint3 gClusterCounts;
+    float cbPassPad2;
+    float2 gClusterTileScale;
+    float gClusterDepthScale;
+    float gClusterDepthBias;
+};
+
+// Lights that rarely change, uploaded separately from cbPass.
+cbuffer cbLights : register(b4)
+{
     float4 gAmbientLight;
 
-    // Indices [0, NUM_DIR_LIGHTS) are directional lights;
-    // indices [NUM_DIR_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHTS) are point lights;
-    // indices [NUM_DIR_LIGHTS+NUM_POINT_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHT+NUM_SPOT_LIGHTS)
-    // are spot lights for a maximum of MaxLights per object.
+    // Indices [0, gDirLightCount) are directional lights.  Point and spot
+    // lights come from the light clusters.
     Light gLights[MaxLights];
+
+    uint gDirLightCount;
 };
 
+// Point and spot lights and the light lists of the clusters, see LightingUtil.hlsl.
+StructuredBuffer<Light> gLocalLights : register(t1, space1);
+StructuredBuffer<LightCluster> gLightClusters : register(t2, space1);
+StructuredBuffer<uint> gLightIndices : register(t3, space1);
+
 cbuffer cbMaterial : register(b2)
 {
     float4   gDiffuseAlbedo;
@@ -72,6 +75,29 @@ cbuffer cbMaterial : register(b2)
     float4x4 gMatTransform;
 };
 
+#ifdef INSTANCED
+// Same layout as cbPerObject plus the ObjectConstants padding.
+struct InstanceData
+{
+    float4x4 World;
+    float4x4 TWorld;
+    float4x4 TexTransform;
+    uint     MaterialIndex;
+    uint     InstPad0;
+    uint     InstPad1;
+    uint     InstPad2;
+};
+
+StructuredBuffer<InstanceData> gInstanceData : register(t0, space1);
+
+// SV_InstanceID starts at 0 for every draw, so each draw passes where its
+// instances start in gInstanceData.
+cbuffer cbInstance : register(b3)
+{
+    uint gBaseInstance;
+};
+#endif
+
 struct VertexIn
 {
     float3 PosL    : POSITION;
@@ -87,22 +113,37 @@ struct VertexOut
     float2 TexC    : TEXCOORD;
 };
 
-VertexOut VS(VertexIn vin)
+VertexOut VS(VertexIn vin
+#ifdef INSTANCED
+    , uint instanceID : SV_InstanceID
+#endif
+    )
 {
     VertexOut vout = (VertexOut)0.0f;
 
+#ifdef INSTANCED
+    InstanceData instData = gInstanceData[gBaseInstance + instanceID];
+    float4x4 world = instData.World;
+    float4x4 normalWorld = instData.TWorld;
+    float4x4 texTransform = instData.TexTransform;
+#else
+    float4x4 world = gWorld;
+    float4x4 normalWorld = tWorld;
+    float4x4 texTransform = gTexTransform;
+#endif
+
     // Transform to world space.
-    float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
+    float4 posW = mul(float4(vin.PosL, 1.0f), world);
     vout.PosW = posW.xyz;
      
     // Assumes nonuniform scaling; otherwise, need to use inverse-transpose of world matrix.
-    vout.NormalW = mul(vin.NormalL, (float3x3)tWorld);
+    vout.NormalW = mul(vin.NormalL, (float3x3)normalWorld);
 
     // Transform to homogeneous clip space.
     vout.PosH = mul(posW, gViewProj);
 
     // Output vertex attributes for interpolation across triangle.
-    float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), gTexTransform);
+    float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), texTransform);
     vout.TexC = mul(texC, gMatTransform).xy;
 
     return vout;
@@ -133,9 +174,15 @@ float4 PS(VertexOut pin) : SV_Target
     const float shininess = 1.0f - gRoughness;
     Material mat = { diffuseAlbedo, gFresnelR0, shininess };
     float3 shadowFactor = 1.0f;
-    float4 directLight = ComputeLighting(gLights, mat, pin.PosW,
+    float4 directLight = ComputeLighting(gLights, gDirLightCount, mat, pin.PosW,
         pin.NormalW, toEyeW, shadowFactor);
 
+    float viewZ = mul(float4(pin.PosW, 1.0f), gView).z;
+    uint cluster = ClusterIndex(pin.PosH.xy, viewZ, gClusterCounts,
+        gClusterTileScale, gClusterDepthScale, gClusterDepthBias);
+    directLight.rgb += ComputeClusterLighting(gLocalLights, gLightIndices, gLightClusters[cluster],
+        mat, pin.PosW, pin.NormalW, toEyeW);
+
     float4 litColor = ambient + directLight;
 
     // Common convention to take alpha from diffuse albedo.
@@ -0,0 +1,201 @@
+//***************************************************************************************
+// StaticBatch.cpp
+//***************************************************************************************
+
+#include "StaticBatch.h"
+#include "GeometryGenerator.h"
+
+using namespace DirectX;
+
+namespace
+{
+	UINT SourceIndex(const StaticBatchSource& src, UINT i)
+	{
+		return src.Indices32 ? static_cast<const std::uint32_t*>(src.Indices)[i] :
+			static_cast<const std::uint16_t*>(src.Indices)[i];
+	}
+
+	// Where a source goes: its group, then its grid cell.
+	struct Placement
+	{
+		UINT Group;
+		int CellX;
+		int CellZ;
+		UINT VertexCount;
+	};
+
+	Vertex TransformVertex(const Vertex& in, FXMMATRIX transform, CXMMATRIX normalTransform, CXMMATRIX texTransform)
+	{
+		Vertex out;
+		XMStoreFloat3(&out.Pos, XMVector3TransformCoord(XMLoadFloat3(&in.Pos), transform));
+		XMStoreFloat3(&out.Normal, XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&in.Normal), normalTransform)));
+		XMStoreFloat2(&out.TexC, XMVector4Transform(XMVectorSet(in.TexC.x, in.TexC.y, 0.0f, 1.0f), texTransform));
+		return out;
+	}
+}
+
+void MergeStaticBatches(const StaticBatchSource* sources, UINT sourceCount, float cellSize,
+	std::vector<Vertex>& vertices, std::vector<std::uint16_t>& indices,
+	std::vector<StaticBatch>& batches, std::vector<UINT>& sourceOrder)
+{
+	const UINT MaxBatchVertices = GeometryGenerator::MaxVertices16;
+
+	// The vertex count is not stored with a submesh, the indices tell it.  The
+	// cell comes from the center of the transformed bounds.
+	std::vector<Placement> placements(sourceCount);
+	for(UINT s = 0; s < sourceCount; ++s)
+	{
+		const StaticBatchSource& src = sources[s];
+
+		UINT vertexCount = 0;
+		for(UINT i = 0; i < src.IndexCount; ++i)
+			vertexCount = std::max<UINT>(vertexCount, SourceIndex(src, i) + 1);
+
+		BoundingBox bounds;
+		BoundingSphere sphere;
+		d3dUtil::ComputeBounds(&src.Vertices[0].Pos, vertexCount, sizeof(Vertex), bounds, sphere);
+		bounds.Transform(bounds, XMLoadFloat4x4(&src.Transform));
+
+		placements[s].Group = src.Group;
+		placements[s].CellX = (int)floorf(bounds.Center.x / cellSize);
+		placements[s].CellZ = (int)floorf(bounds.Center.z / cellSize);
+		placements[s].VertexCount = vertexCount;
+	}
+
+	const UINT firstOrder = (UINT)sourceOrder.size();
+	const UINT firstBatch = (UINT)batches.size();
+	for(UINT s = 0; s < sourceCount; ++s)
+		sourceOrder.push_back(s);
+
+	std::stable_sort(sourceOrder.begin() + firstOrder, sourceOrder.end(), [&](UINT a, UINT b)
+	{
+		const Placement& pa = placements[a];
+		const Placement& pb = placements[b];
+		if(pa.Group != pb.Group)
+			return pa.Group < pb.Group;
+		if(pa.CellZ != pb.CellZ)
+			return pa.CellZ < pb.CellZ;
+		return pa.CellX < pb.CellX;
+	});
+
+	StaticBatch* batch = nullptr;
+	const Placement* batchPlacement = nullptr;
+	UINT batchVertices = 0;
+
+	// Starts a new batch with source k in it.
+	auto openBatch = [&](UINT k, const Placement& place)
+	{
+		batches.emplace_back();
+		batch = &batches.back();
+		batch->Group = place.Group;
+		batch->Submesh.StartIndexLocation = (UINT)indices.size();
+		batch->Submesh.BaseVertexLocation = (INT)vertices.size();
+		batch->FirstSource = k;
+		batch->SourceCount = 1;
+		batchPlacement = &place;
+		batchVertices = 0;
+	};
+
+	// remap[v] is the index of source vertex v inside the batch stamped in
+	// owner[v], for sources split like GeometryGenerator::SplitForIndices16.
+	const UINT unassigned = 0xffffffff;
+	std::vector<UINT> remap;
+	std::vector<UINT> owner;
+
+	for(UINT k = firstOrder; k < (UINT)sourceOrder.size(); ++k)
+	{
+		const UINT s = sourceOrder[k];
+		const StaticBatchSource& src = sources[s];
+		const Placement& place = placements[s];
+
+		if(batch == nullptr ||
+			place.Group != batchPlacement->Group ||
+			place.CellX != batchPlacement->CellX ||
+			place.CellZ != batchPlacement->CellZ ||
+			batchVertices + place.VertexCount > MaxBatchVertices)
+		{
+			openBatch(k, place);
+		}
+		else
+		{
+			++batch->SourceCount;
+		}
+
+		XMMATRIX transform = XMLoadFloat4x4(&src.Transform);
+		XMMATRIX normalTransform = MathHelper::InverseTranspose(transform);
+		XMMATRIX texTransform = XMLoadFloat4x4(&src.TexTransform);
+
+		// A mirroring transform turns the triangles inside out; swap two
+		// corners of each to keep them front facing.
+		const bool flip = XMVectorGetX(XMMatrixDeterminant(transform)) < 0.0f;
+
+		if(place.VertexCount <= MaxBatchVertices)
+		{
+			for(UINT v = 0; v < place.VertexCount; ++v)
+				vertices.push_back(TransformVertex(src.Vertices[v], transform, normalTransform, texTransform));
+
+			for(UINT i = 0; i < src.IndexCount; ++i)
+			{
+				UINT corner = i;
+				if(flip && i % 3 != 0)
+					corner = i % 3 == 1 ? i + 1 : i - 1;
+				indices.push_back((std::uint16_t)(batchVertices + SourceIndex(src, corner)));
+			}
+
+			batchVertices += place.VertexCount;
+			batch->Submesh.IndexCount += src.IndexCount;
+			continue;
+		}
+
+		// Too big for any batch: hand out its triangles in order, copying the
+		// vertices each one needs into the open batch and starting another
+		// batch, which shares the source, once the next one does not fit.
+		remap.assign(place.VertexCount, 0);
+		owner.assign(place.VertexCount, unassigned);
+		for(UINT t = 0; t + 2 < src.IndexCount; t += 3)
+		{
+			UINT tri[3] = { SourceIndex(src, t), SourceIndex(src, t + 1), SourceIndex(src, t + 2) };
+			if(flip)
+				std::swap(tri[1], tri[2]);
+
+			UINT stamp = (UINT)batches.size() - 1;
+			UINT newVertices = 0;
+			for(UINT c = 0; c < 3; ++c)
+			{
+				bool seenInTri = (c > 0 && tri[c] == tri[0]) || (c > 1 && tri[c] == tri[1]);
+				if(owner[tri[c]] != stamp && !seenInTri)
+					++newVertices;
+			}
+
+			if(batchVertices + newVertices > MaxBatchVertices)
+			{
+				openBatch(k, place);
+				++stamp;
+			}
+
+			for(UINT c = 0; c < 3; ++c)
+			{
+				UINT v = tri[c];
+				if(owner[v] != stamp)
+				{
+					owner[v] = stamp;
+					remap[v] = batchVertices++;
+					vertices.push_back(TransformVertex(src.Vertices[v], transform, normalTransform, texTransform));
+				}
+
+				indices.push_back((std::uint16_t)remap[v]);
+			}
+
+			batch->Submesh.IndexCount += 3;
+		}
+	}
+
+	// Bounds of the new batches, which end where the next one starts.
+	for(UINT b = firstBatch; b < (UINT)batches.size(); ++b)
+	{
+		SubmeshGeometry& submesh = batches[b].Submesh;
+		const UINT end = b + 1 < (UINT)batches.size() ? (UINT)batches[b + 1].Submesh.BaseVertexLocation : (UINT)vertices.size();
+		d3dUtil::ComputeBounds(&vertices[submesh.BaseVertexLocation].Pos, end - submesh.BaseVertexLocation,
+			sizeof(Vertex), submesh.Bounds, submesh.Sphere);
+	}
+}
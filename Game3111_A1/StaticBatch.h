@@ -0,0 +1,61 @@
+//***************************************************************************************
+// StaticBatch.h
+//
+// Merges immovable render items into a few large draws.  Items of the same
+// group (in ShapesApp: same material and transform node) are pre-transformed
+// into the group's space and packed into shared vertex/index ranges, so they
+// cost one draw and one set of object constants per batch instead of one per
+// item.  Their texture transforms are baked into the texture coordinates.
+//
+// A group is cut into batches on a grid in the xz plane, so each batch covers
+// a bounded area and can still be frustum and occlusion culled, and a batch is
+// closed before it outgrows 16-bit indices.  A source too large for one batch
+// is split by triangles across several, the way SplitForIndices16 splits a mesh.
+//***************************************************************************************
+
+#pragma once
+
+#include "FrameResource.h"
+
+// One item to merge: a submesh of a geometry with the standard Vertex layout.
+struct StaticBatchSource
+{
+	// The submesh's vertices, i.e. already offset by BaseVertexLocation, and
+	// its IndexCount indices, 32 bits each if Indices32 and 16 otherwise.
+	const Vertex* Vertices = nullptr;
+	const void* Indices = nullptr;
+	UINT IndexCount = 0;
+	bool Indices32 = false;
+
+	// Model to group space, and the texture transform baked into TexC.
+	DirectX::XMFLOAT4X4 Transform = MathHelper::Identity4x4();
+	DirectX::XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
+
+	// Sources only merge with sources of the same group.
+	UINT Group = 0;
+};
+
+struct StaticBatch
+{
+	UINT Group = 0;
+
+	// Draw range into the merged buffers, with bounds in group space.
+	SubmeshGeometry Submesh;
+
+	// The merged sources are SourceOrder[FirstSource, FirstSource + SourceCount).
+	// A source split across batches is listed by each of them.
+	UINT FirstSource = 0;
+	UINT SourceCount = 0;
+};
+
+///<summary>
+/// Merges sources[0..sourceCount) into batches of at most
+/// GeometryGenerator::MaxVertices16 vertices, splitting each group on a grid
+/// of cellSize units by the center of each source's bounds.  Appends the
+/// merged geometry to vertices and indices, with indices relative to each
+/// batch's BaseVertexLocation, and lists the sources of each batch in
+/// sourceOrder.
+///</summary>
+void MergeStaticBatches(const StaticBatchSource* sources, UINT sourceCount, float cellSize,
+	std::vector<Vertex>& vertices, std::vector<std::uint16_t>& indices,
+	std::vector<StaticBatch>& batches, std::vector<UINT>& sourceOrder);
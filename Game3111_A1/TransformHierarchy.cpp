@@ -0,0 +1,162 @@
+//***************************************************************************************
+// TransformHierarchy.cpp
+//***************************************************************************************
+
+#include "TransformHierarchy.h"
+
+#include <algorithm>
+#include <cassert>
+
+using namespace DirectX;
+
+TransformHierarchy::Node TransformHierarchy::Add(Node parent, const XMFLOAT4X4& local, std::uint32_t payload)
+{
+	assert(parent == NoNode || parent < Count());
+
+	// Until Build the slots are simply the ids in order of addition.
+	Node node = Count();
+	mParent.push_back(parent);
+	mPayload.push_back(payload);
+	mLocal.push_back(local);
+	mSlot.push_back(node);
+	return node;
+}
+
+void TransformHierarchy::Build()
+{
+	const std::uint32_t count = Count();
+
+	// Children of every node, in order of addition, as one array of ranges.
+	std::vector<std::uint32_t> childStart(count + 1, 0);
+	for(Node n = 0; n < count; ++n)
+	{
+		if(mParent[n] != NoNode)
+			++childStart[mParent[n] + 1];
+	}
+	for(std::uint32_t n = 0; n < count; ++n)
+		childStart[n + 1] += childStart[n];
+
+	std::vector<std::uint32_t> children(childStart[count]);
+	std::vector<std::uint32_t> fill(childStart.begin(), childStart.end() - 1);
+	for(Node n = 0; n < count; ++n)
+	{
+		if(mParent[n] != NoNode)
+			children[fill[mParent[n]]++] = n;
+	}
+
+	// Depth-first walk from each root; a node's subtree ends where the walk
+	// returns to it.
+	std::vector<std::uint32_t> order;
+	std::vector<std::uint32_t> subtreeEnd(count);
+	std::vector<std::uint32_t> stack;
+	order.reserve(count);
+	for(Node root = 0; root < count; ++root)
+	{
+		if(mParent[root] != NoNode)
+			continue;
+
+		// Entries are ids, or ~id once all children of id have been walked.
+		stack.push_back(root);
+		while(!stack.empty())
+		{
+			std::uint32_t entry = stack.back();
+			stack.pop_back();
+
+			if(entry >= count)
+			{
+				subtreeEnd[~entry] = (std::uint32_t)order.size();
+				continue;
+			}
+
+			mSlot[entry] = (std::uint32_t)order.size();
+			order.push_back(entry);
+
+			stack.push_back(~entry);
+			for(std::uint32_t c = childStart[entry + 1]; c > childStart[entry]; --c)
+				stack.push_back(children[c - 1]);
+		}
+	}
+	assert(order.size() == count);
+
+	std::vector<std::uint32_t> parent(count), payload(count);
+	std::vector<XMFLOAT4X4> local(count);
+	mSubtreeEnd.resize(count);
+	for(std::uint32_t slot = 0; slot < count; ++slot)
+	{
+		Node n = order[slot];
+		parent[slot] = mParent[n] == NoNode ? NoNode : mSlot[mParent[n]];
+		payload[slot] = mPayload[n];
+		local[slot] = mLocal[n];
+		mSubtreeEnd[slot] = subtreeEnd[n];
+	}
+
+	mParent.swap(parent);
+	mPayload.swap(payload);
+	mLocal.swap(local);
+	mWorld.resize(count);
+	mMarked.assign(count, 0);
+
+	mDirty.clear();
+	for(std::uint32_t slot = 0; slot < count; ++slot)
+	{
+		if(mParent[slot] == NoNode)
+		{
+			mMarked[slot] = 1;
+			mDirty.push_back(slot);
+		}
+	}
+}
+
+void TransformHierarchy::SetLocal(Node node, CXMMATRIX local)
+{
+	std::uint32_t slot = mSlot[node];
+	XMStoreFloat4x4(&mLocal[slot], local);
+
+	if(!mMarked[slot])
+	{
+		mMarked[slot] = 1;
+		mDirty.push_back(slot);
+	}
+}
+
+XMMATRIX TransformHierarchy::GetLocal(Node node)const
+{
+	return XMLoadFloat4x4(&mLocal[mSlot[node]]);
+}
+
+XMMATRIX TransformHierarchy::GetWorld(Node node)const
+{
+	return XMLoadFloat4x4(&mWorld[mSlot[node]]);
+}
+
+void TransformHierarchy::Update()
+{
+	mChanged.clear();
+	if(mDirty.empty())
+		return;
+
+	// Walk the marked subtrees front to back; a marked node inside a subtree
+	// already walked is covered by it.
+	std::sort(mDirty.begin(), mDirty.end());
+
+	std::uint32_t walkedEnd = 0;
+	for(std::uint32_t root : mDirty)
+	{
+		mMarked[root] = 0;
+		if(root < walkedEnd)
+			continue;
+
+		walkedEnd = mSubtreeEnd[root];
+		for(std::uint32_t slot = root; slot < walkedEnd; ++slot)
+		{
+			XMMATRIX world = XMLoadFloat4x4(&mLocal[slot]);
+			if(mParent[slot] != NoNode)
+				world = XMMatrixMultiply(world, XMLoadFloat4x4(&mWorld[mParent[slot]]));
+
+			XMStoreFloat4x4(&mWorld[slot], world);
+			mChanged.push_back(slot);
+		}
+	}
+
+	mDirty.clear();
+}
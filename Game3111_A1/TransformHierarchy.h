@@ -0,0 +1,75 @@
+//***************************************************************************************
+// TransformHierarchy.h
+//
+// Parent/child transforms kept in flat arrays in depth-first order, so every
+// parent comes before its children and each subtree is one contiguous range.
+// Changing a node's local matrix marks its subtree; Update then recomputes the
+// world matrices of the marked subtrees only, in one forward pass where every
+// parent's world matrix is already final when its children read it.
+//
+// Nodes are added while loading, in any order as long as a parent is added
+// before its children, and Build lays them out depth first.  The Node ids
+// returned by Add stay valid; Update reports the nodes it recomputed along
+// with the payload given to Add, e.g. the render item to move.
+//***************************************************************************************
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+
+class TransformHierarchy
+{
+public:
+	using Node = std::uint32_t;
+	static const Node NoNode = 0xffffffff;
+	static const std::uint32_t NoPayload = 0xffffffff;
+
+	///<summary>
+	/// Adds a node with the given local matrix, relative to parent or to the
+	/// world for NoNode.  Only valid before Build.
+	///</summary>
+	Node Add(Node parent, const DirectX::XMFLOAT4X4& local, std::uint32_t payload = NoPayload);
+
+	///<summary>
+	/// Lays the nodes out depth first and marks them all for the first Update.
+	///</summary>
+	void Build();
+
+	std::uint32_t Count()const { return (std::uint32_t)mLocal.size(); }
+
+	// Sets the local matrix and marks the node's subtree for the next Update.
+	void SetLocal(Node node, DirectX::CXMMATRIX local);
+
+	DirectX::XMMATRIX GetLocal(Node node)const;
+
+	// World matrix as of the last Update.
+	DirectX::XMMATRIX GetWorld(Node node)const;
+
+	///<summary>
+	/// Recomputes the world matrices of the marked subtrees.  Afterwards
+	/// Changed lists the slots recomputed, in depth-first order.
+	///</summary>
+	void Update();
+
+	const std::vector<std::uint32_t>& Changed()const { return mChanged; }
+	std::uint32_t Payload(std::uint32_t slot)const { return mPayload[slot]; }
+	const DirectX::XMFLOAT4X4& World(std::uint32_t slot)const { return mWorld[slot]; }
+
+private:
+	// Indexed by depth-first slot.
+	std::vector<std::uint32_t> mParent;     // slot of the parent, NoNode for roots
+	std::vector<std::uint32_t> mSubtreeEnd; // one past the last slot of the subtree
+	std::vector<std::uint32_t> mPayload;
+	std::vector<DirectX::XMFLOAT4X4> mLocal;
+	std::vector<DirectX::XMFLOAT4X4> mWorld;
+	std::vector<std::uint8_t> mMarked;
+
+	// Slot of each Node id returned by Add.
+	std::vector<std::uint32_t> mSlot;
+
+	// Marked subtree roots, and the slots the last Update recomputed.
+	std::vector<std::uint32_t> mDirty;
+	std::vector<std::uint32_t> mChanged;
+};
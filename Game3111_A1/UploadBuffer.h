@@ -33,6 +33,7 @@ public:
 
         // We do not need to unmap until we are done with the resource.  However, we must not write to
         // the resource while it is in use by the GPU (so we must use synchronization techniques).
+        // Upload heap memory is write-combined: write it sequentially and do not read it back.
     }
 
     UploadBuffer(const UploadBuffer& rhs) = delete;
@@ -55,6 +56,20 @@ public:
         memcpy(&mMappedData[elementIndex*mElementByteSize], &data, sizeof(T));
     }
 
+    // Copies count consecutive elements at once.  Only for buffers that are not
+    // constant buffers, whose elements are packed without padding.
+    void CopyData(int firstElement, const T* data, UINT count)
+    {
+        assert(!mIsConstantBuffer);
+        memcpy(&mMappedData[firstElement*mElementByteSize], data, count*sizeof(T));
+    }
+
+    // Element elementIndex in the mapped memory, for filling it in place.
+    T* MappedElement(int elementIndex)
+    {
+        return reinterpret_cast<T*>(&mMappedData[elementIndex*mElementByteSize]);
+    }
+
 private:
     Microsoft::WRL::ComPtr<ID3D12Resource> mUploadBuffer;
     BYTE* mMappedData = nullptr;
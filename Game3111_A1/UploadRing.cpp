@@ -0,0 +1,105 @@
+//***************************************************************************************
+// UploadRing.cpp
+//***************************************************************************************
+
+#include "UploadRing.h"
+
+UploadRing::UploadRing(ID3D12Device* device, UINT64 capacity)
+	: mDevice(device)
+{
+	CreateBuffer(capacity);
+}
+
+UploadRing::~UploadRing()
+{
+	if(mBuffer != nullptr)
+		mBuffer->Unmap(0, nullptr);
+
+	mMappedData = nullptr;
+}
+
+void UploadRing::BeginFrame(UINT64 completedFence)
+{
+	while(!mFrames.empty() && mFrames.front().Fence <= completedFence)
+	{
+		mTail = mFrames.front().Head;
+		mFrames.pop_front();
+	}
+
+	mRetired.erase(std::remove_if(mRetired.begin(), mRetired.end(),
+		[completedFence](const RetiredBuffer& r) { return r.Fence != 0 && r.Fence <= completedFence; }),
+		mRetired.end());
+}
+
+UploadRing::Allocation UploadRing::Allocate(UINT64 byteSize, UINT64 alignment)
+{
+	assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+	assert(alignment <= D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+
+	// An allocation that would run past the end of the buffer starts over at
+	// offset 0, leaving the rest of the lap unused.
+	const UINT64 offset = mHead % mCapacity;
+	UINT64 start = (offset + alignment - 1) & ~(alignment - 1);
+	if(start + byteSize > mCapacity)
+		start = mCapacity;
+
+	const UINT64 head = mHead - offset + start + byteSize;
+	if(head - mTail > mCapacity)
+	{
+		// The frames in flight hold the rest.  Switch to a bigger buffer and
+		// keep this one until the current frame, its last user, completes.
+		UINT64 capacity = 2 * mCapacity;
+		while(capacity < byteSize)
+			capacity *= 2;
+
+		mBuffer->Unmap(0, nullptr);
+		mRetired.push_back({ mBuffer, 0 });
+		CreateBuffer(capacity);
+		return Allocate(byteSize, alignment);
+	}
+
+	mHead = head;
+	start %= mCapacity;
+
+	Allocation a;
+	a.CpuAddress = mMappedData + start;
+	a.GpuAddress = mBuffer->GetGPUVirtualAddress() + start;
+	a.Offset = start;
+	a.Resource = mBuffer.Get();
+	return a;
+}
+
+void UploadRing::EndFrame(UINT64 fence)
+{
+	mFrames.push_back({ fence, mHead });
+
+	for(RetiredBuffer& r : mRetired)
+	{
+		if(r.Fence == 0)
+			r.Fence = fence;
+	}
+}
+
+void UploadRing::CreateBuffer(UINT64 capacity)
+{
+	// Whole placement units, so every alignment up to that stays valid at offset 0.
+	const UINT64 unit = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+	mCapacity = std::max<UINT64>(unit, (capacity + unit - 1) / unit * unit);
+
+	mBuffer = nullptr;
+	ThrowIfFailed(mDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(mCapacity),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&mBuffer)));
+
+	ThrowIfFailed(mBuffer->Map(0, nullptr, reinterpret_cast<void**>(&mMappedData)));
+
+	// Nothing in the new buffer is in use; what the frames in flight wrote
+	// lives in the buffers they retired.
+	mHead = 0;
+	mTail = 0;
+	mFrames.clear();
+}
@@ -0,0 +1,90 @@
+//***************************************************************************************
+// UploadRing.h
+//
+// Linear sub-allocator for data rewritten every frame (pass constants,
+// instance data, streamed vertices, light lists).  All of it comes out of one
+// persistently mapped upload buffer used as a ring: allocations advance the
+// head, and the space of a frame is handed back once the fence value it was
+// submitted with has completed.  Each frame only takes what it writes, so
+// variable amounts of per-frame data need no fixed-size buffers sized for
+// the worst case in every frame resource.
+//
+// If the frames in flight fill the ring, it is replaced by one twice as big;
+// the old buffer is kept until the GPU is done with the frames that used it.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+
+#include <deque>
+
+class UploadRing
+{
+public:
+	struct Allocation
+	{
+		BYTE* CpuAddress;
+		D3D12_GPU_VIRTUAL_ADDRESS GpuAddress;
+
+		// Where the allocation starts in Resource.
+		UINT64 Offset;
+		ID3D12Resource* Resource;
+	};
+
+	UploadRing(ID3D12Device* device, UINT64 capacity);
+	UploadRing(const UploadRing& rhs) = delete;
+	UploadRing& operator=(const UploadRing& rhs) = delete;
+	~UploadRing();
+
+	///<summary>
+	/// Hands back the space of the frames whose fence value completedFence has
+	/// reached.  Call once per frame before the first Allocate.
+	///</summary>
+	void BeginFrame(UINT64 completedFence);
+
+	///<summary>
+	/// Takes byteSize bytes aligned to alignment, a power of two.  The memory
+	/// is an upload heap, see the note in UploadBuffer.  The default alignment
+	/// suits constant buffers as well as root SRVs and vertex buffers.
+	///</summary>
+	Allocation Allocate(UINT64 byteSize, UINT64 alignment = D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+
+	///<summary>
+	/// Marks everything allocated since BeginFrame as in use until the queue
+	/// reaches fence, the value signaled after the frame's command lists.
+	///</summary>
+	void EndFrame(UINT64 fence);
+
+	UINT64 Capacity()const { return mCapacity; }
+
+private:
+	void CreateBuffer(UINT64 capacity);
+
+private:
+	struct FrameEnd
+	{
+		UINT64 Fence;
+		UINT64 Head;
+	};
+
+	struct RetiredBuffer
+	{
+		Microsoft::WRL::ComPtr<ID3D12Resource> Buffer;
+		UINT64 Fence; // 0 until the frame that replaced it ends
+	};
+
+	ID3D12Device* mDevice = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mBuffer;
+	BYTE* mMappedData = nullptr;
+	UINT64 mCapacity = 0;
+
+	// Bytes ever allocated and ever handed back; their difference is the
+	// space in use, and the head modulo the capacity is the next offset.
+	UINT64 mHead = 0;
+	UINT64 mTail = 0;
+
+	// Head at the end of each frame still in flight, oldest first.
+	std::deque<FrameEnd> mFrames;
+	std::vector<RetiredBuffer> mRetired;
+};
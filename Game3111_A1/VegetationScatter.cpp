@@ -0,0 +1,208 @@
+//***************************************************************************************
+// VegetationScatter.cpp
+//***************************************************************************************
+
+#include "VegetationScatter.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <random>
+
+using namespace DirectX;
+
+namespace
+{
+	// Candidates tried around an active point before it is retired.
+	const int MaxAttempts = 30;
+
+	// std::mt19937 is specified exactly, unlike the standard distributions,
+	// so the same seed places the same points with every C runtime.
+	float Random01(std::mt19937& rng)
+	{
+		return (float)(rng() >> 8) * (1.0f / 16777216.0f);
+	}
+
+	// Uniform over the annulus between one and two spacings, by rejection from
+	// the square around it.  cosf and sinf round differently from one C
+	// runtime to the next; this only adds and multiplies.
+	XMFLOAT2 AnnulusOffset(std::mt19937& rng, float spacing)
+	{
+		for(;;)
+		{
+			float x = 4.0f * Random01(rng) - 2.0f;
+			float z = 4.0f * Random01(rng) - 2.0f;
+			float distSq = x * x + z * z;
+			if(distSq >= 1.0f && distSq < 4.0f)
+				return XMFLOAT2(x * spacing, z * spacing);
+		}
+	}
+
+	void ScatterRegionPoints(const ScatterRegion& region, std::mt19937& rng, std::vector<XMFLOAT2>& points)
+	{
+		const float width = region.MaxX - region.MinX;
+		const float depth = region.MaxZ - region.MinZ;
+		if(width <= 0.0f || depth <= 0.0f || region.Spacing <= 0.0f)
+			return;
+
+		// A cell this size holds at most one point, so only the 5x5 cells
+		// around a candidate can hold points closer than the spacing.
+		const float cellSize = region.Spacing / sqrtf(2.0f);
+		const int gridW = std::max<int>(1, (int)ceilf(width / cellSize));
+		const int gridH = std::max<int>(1, (int)ceilf(depth / cellSize));
+		std::vector<std::uint32_t> grid((size_t)gridW * gridH, 0xffffffff);
+
+		const std::uint32_t firstPoint = (std::uint32_t)points.size();
+		std::vector<std::uint32_t> active;
+
+		auto cellOf = [&](const XMFLOAT2& p, int& cx, int& cz)
+		{
+			cx = std::min<int>(gridW - 1, (int)((p.x - region.MinX) / cellSize));
+			cz = std::min<int>(gridH - 1, (int)((p.y - region.MinZ) / cellSize));
+		};
+
+		auto add = [&](const XMFLOAT2& p)
+		{
+			int cx, cz;
+			cellOf(p, cx, cz);
+			grid[(size_t)cz * gridW + cx] = (std::uint32_t)points.size();
+			active.push_back((std::uint32_t)points.size());
+			points.push_back(p);
+		};
+
+		const float spacingSq = region.Spacing * region.Spacing;
+		auto isFree = [&](const XMFLOAT2& p)
+		{
+			int cx, cz;
+			cellOf(p, cx, cz);
+			for(int z = std::max<int>(0, cz - 2); z <= std::min<int>(gridH - 1, cz + 2); ++z)
+			{
+				for(int x = std::max<int>(0, cx - 2); x <= std::min<int>(gridW - 1, cx + 2); ++x)
+				{
+					std::uint32_t other = grid[(size_t)z * gridW + x];
+					if(other == 0xffffffff)
+						continue;
+
+					float dx = points[other].x - p.x;
+					float dz = points[other].y - p.y;
+					if(dx * dx + dz * dz < spacingSq)
+						return false;
+				}
+			}
+			return true;
+		};
+
+		add(XMFLOAT2(region.MinX + Random01(rng) * width, region.MinZ + Random01(rng) * depth));
+
+		while(!active.empty())
+		{
+			const std::uint32_t pick = (std::uint32_t)(Random01(rng) * active.size());
+			const XMFLOAT2 center = points[active[pick]];
+
+			bool placed = false;
+			for(int attempt = 0; attempt < MaxAttempts && !placed; ++attempt)
+			{
+				XMFLOAT2 offset = AnnulusOffset(rng, region.Spacing);
+				XMFLOAT2 p(center.x + offset.x, center.y + offset.y);
+
+				if(p.x < region.MinX || p.x >= region.MaxX || p.y < region.MinZ || p.y >= region.MaxZ)
+					continue;
+
+				if(isFree(p))
+				{
+					add(p);
+					placed = true;
+				}
+			}
+
+			if(!placed)
+			{
+				active[pick] = active.back();
+				active.pop_back();
+			}
+		}
+
+		assert(points.size() > firstPoint);
+	}
+}
+
+ScatterGrid ScatterGrid::Cover(const ScatterRegion* regions, std::uint32_t regionCount, float chunkSize)
+{
+	ScatterGrid grid;
+	grid.ChunkSize = chunkSize;
+	if(regionCount == 0)
+		return grid;
+
+	float minX = regions[0].MinX, minZ = regions[0].MinZ;
+	float maxX = regions[0].MaxX, maxZ = regions[0].MaxZ;
+	for(std::uint32_t i = 1; i < regionCount; ++i)
+	{
+		minX = std::min<float>(minX, regions[i].MinX);
+		minZ = std::min<float>(minZ, regions[i].MinZ);
+		maxX = std::max<float>(maxX, regions[i].MaxX);
+		maxZ = std::max<float>(maxZ, regions[i].MaxZ);
+	}
+
+	grid.OriginX = minX;
+	grid.OriginZ = minZ;
+	grid.Width = std::max<std::uint32_t>(1, (std::uint32_t)ceilf((maxX - minX) / chunkSize));
+	grid.Height = std::max<std::uint32_t>(1, (std::uint32_t)ceilf((maxZ - minZ) / chunkSize));
+	return grid;
+}
+
+std::uint32_t ScatterGrid::ChunkOf(float x, float z)const
+{
+	int cx = (int)floorf((x - OriginX) / ChunkSize);
+	int cz = (int)floorf((z - OriginZ) / ChunkSize);
+	cx = std::min<int>(std::max<int>(cx, 0), (int)Width - 1);
+	cz = std::min<int>(std::max<int>(cz, 0), (int)Height - 1);
+	return (std::uint32_t)cz * Width + (std::uint32_t)cx;
+}
+
+bool ScatterGrid::ChunkRange(float minX, float minZ, float maxX, float maxZ,
+	std::uint32_t& firstX, std::uint32_t& firstZ, std::uint32_t& lastX, std::uint32_t& lastZ)const
+{
+	float x0 = floorf((minX - OriginX) / ChunkSize);
+	float z0 = floorf((minZ - OriginZ) / ChunkSize);
+	float x1 = floorf((maxX - OriginX) / ChunkSize);
+	float z1 = floorf((maxZ - OriginZ) / ChunkSize);
+	if(x1 < 0.0f || z1 < 0.0f || x0 >= (float)Width || z0 >= (float)Height)
+		return false;
+
+	firstX = (std::uint32_t)std::max<float>(x0, 0.0f);
+	firstZ = (std::uint32_t)std::max<float>(z0, 0.0f);
+	lastX = (std::uint32_t)std::min<float>(x1, (float)(Width - 1));
+	lastZ = (std::uint32_t)std::min<float>(z1, (float)(Height - 1));
+	return true;
+}
+
+void ScatterPoissonDisk(const ScatterRegion* regions, std::uint32_t regionCount, std::uint32_t seed,
+	std::vector<XMFLOAT2>& points)
+{
+	for(std::uint32_t i = 0; i < regionCount; ++i)
+	{
+		// Seeding per region keeps a region's points the same when others change.
+		std::mt19937 rng(seed + i);
+		ScatterRegionPoints(regions[i], rng, points);
+	}
+}
+
+void SortIntoChunks(const ScatterGrid& grid, const std::vector<XMFLOAT2>& points,
+	std::vector<std::uint32_t>& order, std::vector<std::uint32_t>& chunkStart)
+{
+	// Counting sort on the chunk index.
+	std::vector<std::uint32_t> chunks(points.size());
+	chunkStart.assign(grid.ChunkCount() + 1, 0);
+	for(size_t i = 0; i < points.size(); ++i)
+	{
+		chunks[i] = grid.ChunkOf(points[i].x, points[i].y);
+		++chunkStart[chunks[i] + 1];
+	}
+	for(std::uint32_t c = 0; c < grid.ChunkCount(); ++c)
+		chunkStart[c + 1] += chunkStart[c];
+
+	std::vector<std::uint32_t> next(chunkStart.begin(), chunkStart.end() - 1);
+	order.resize(points.size());
+	for(size_t i = 0; i < points.size(); ++i)
+		order[next[chunks[i]]++] = (std::uint32_t)i;
+}
@@ -0,0 +1,73 @@
+//***************************************************************************************
+// VegetationScatter.h
+//
+// Blue-noise placement of vegetation.  Each density region is filled with a
+// Poisson-disk distribution (Bridson's algorithm): no two points of a region
+// are closer than the region's spacing, yet the region is covered evenly,
+// without the clumps and holes of uniform random placement.
+//
+// The points are then bucketed into a grid of square chunks so a renderer can
+// cull whole chunks.  ScatterGrid::ChunkRange finds the chunks under a
+// rectangle such as the view frustum's footprint, so the cost of finding the
+// visible chunks follows the view, not the size of the forest.
+//
+// Placement only depends on the regions and the seed, so it can be cached.
+//***************************************************************************************
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+
+// Rectangle of the xz plane filled with points at least Spacing apart.
+struct ScatterRegion
+{
+	float MinX;
+	float MinZ;
+	float MaxX;
+	float MaxZ;
+	float Spacing;
+};
+
+// Square chunks covering a set of regions, numbered row by row: chunk
+// z * Width + x spans [OriginX + x * ChunkSize, OriginX + (x + 1) * ChunkSize)
+// and likewise along z.
+struct ScatterGrid
+{
+	float OriginX = 0.0f;
+	float OriginZ = 0.0f;
+	float ChunkSize = 1.0f;
+	std::uint32_t Width = 0;
+	std::uint32_t Height = 0;
+
+	// Smallest grid of chunkSize chunks covering every region.
+	static ScatterGrid Cover(const ScatterRegion* regions, std::uint32_t regionCount, float chunkSize);
+
+	std::uint32_t ChunkCount()const { return Width * Height; }
+
+	// Chunk containing (x, z), clamped to the grid.
+	std::uint32_t ChunkOf(float x, float z)const;
+
+	///<summary>
+	/// Columns [firstX, lastX] and rows [firstZ, lastZ] of the chunks
+	/// overlapping the rectangle.  Returns false if it misses the grid.
+	///</summary>
+	bool ChunkRange(float minX, float minZ, float maxX, float maxZ,
+		std::uint32_t& firstX, std::uint32_t& firstZ, std::uint32_t& lastX, std::uint32_t& lastZ)const;
+};
+
+///<summary>
+/// Appends a Poisson-disk distribution over each region to points, as (x, z)
+/// pairs.  Regions are filled independently, so they should not overlap.
+///</summary>
+void ScatterPoissonDisk(const ScatterRegion* regions, std::uint32_t regionCount, std::uint32_t seed,
+	std::vector<DirectX::XMFLOAT2>& points);
+
+///<summary>
+/// Groups points by chunk.  order receives the point indices chunk by chunk,
+/// keeping their relative order within a chunk, and chunk c's points are
+/// order[chunkStart[c], chunkStart[c + 1]).
+///</summary>
+void SortIntoChunks(const ScatterGrid& grid, const std::vector<DirectX::XMFLOAT2>& points,
+	std::vector<std::uint32_t>& order, std::vector<std::uint32_t>& chunkStart);
@@ -0,0 +1,102 @@
+//***************************************************************************************
+// WorkerPool.cpp
+//***************************************************************************************
+
+#include "WorkerPool.h"
+
+WorkerPool::WorkerPool(unsigned threadCount)
+{
+	mThreads.reserve(threadCount);
+	for(unsigned i = 0; i < threadCount; ++i)
+		mThreads.emplace_back(&WorkerPool::WorkerMain, this);
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQuit = true;
+	}
+	mWorkReady.notify_all();
+
+	for(std::thread& thread : mThreads)
+		thread.join();
+}
+
+void WorkerPool::Run(unsigned taskCount, const std::function<void(unsigned)>& task)
+{
+	if(taskCount == 0)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mTask = &task;
+		mTaskCount = taskCount;
+		mNextTask = 1;
+		mPending = taskCount - 1;
+		mError = nullptr;
+	}
+
+	if(taskCount > 1)
+		mWorkReady.notify_all();
+
+	RunTask(0);
+
+	// Help with whatever the workers have not picked up yet, then wait for
+	// the ones still running.
+	std::unique_lock<std::mutex> lock(mMutex);
+	while(mNextTask < mTaskCount)
+	{
+		unsigned index = mNextTask++;
+		lock.unlock();
+		RunTask(index);
+		lock.lock();
+		--mPending;
+	}
+
+	mWorkDone.wait(lock, [this] { return mPending == 0; });
+
+	mTask = nullptr;
+	mTaskCount = 0;
+	mNextTask = 0;
+
+	std::exception_ptr error = mError;
+	mError = nullptr;
+	lock.unlock();
+
+	if(error)
+		std::rethrow_exception(error);
+}
+
+void WorkerPool::WorkerMain()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	for(;;)
+	{
+		mWorkReady.wait(lock, [this] { return mQuit || mNextTask < mTaskCount; });
+		if(mQuit)
+			return;
+
+		unsigned index = mNextTask++;
+		lock.unlock();
+		RunTask(index);
+		lock.lock();
+
+		if(--mPending == 0)
+			mWorkDone.notify_all();
+	}
+}
+
+void WorkerPool::RunTask(unsigned index)
+{
+	try
+	{
+		(*mTask)(index);
+	}
+	catch(...)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if(!mError)
+			mError = std::current_exception();
+	}
+}
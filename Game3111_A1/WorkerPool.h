@@ -0,0 +1,57 @@
+//***************************************************************************************
+// WorkerPool.h
+//
+// Fixed set of persistent worker threads that run one batch of indexed tasks
+// at a time, used to record command lists in parallel.  The calling thread
+// takes part in the batch, so a pool without workers simply runs everything
+// inline.
+//***************************************************************************************
+
+#pragma once
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkerPool
+{
+public:
+	explicit WorkerPool(unsigned threadCount);
+	WorkerPool(const WorkerPool& rhs) = delete;
+	WorkerPool& operator=(const WorkerPool& rhs) = delete;
+	~WorkerPool();
+
+	unsigned ThreadCount()const { return (unsigned)mThreads.size(); }
+
+	///<summary>
+	/// Runs task(0) .. task(taskCount - 1) and returns once all of them have
+	/// finished.  Task 0 always runs on the calling thread; the rest go to
+	/// whichever thread is free first.  If tasks throw, the first exception is
+	/// rethrown here after the batch has completed.
+	///</summary>
+	void Run(unsigned taskCount, const std::function<void(unsigned)>& task);
+
+private:
+	void WorkerMain();
+
+	// Runs one task and records its exception, if any.  Called without the lock.
+	void RunTask(unsigned index);
+
+private:
+	std::vector<std::thread> mThreads;
+
+	std::mutex mMutex;
+	std::condition_variable mWorkReady;
+	std::condition_variable mWorkDone;
+
+	// Current batch, guarded by mMutex.
+	const std::function<void(unsigned)>* mTask = nullptr;
+	unsigned mTaskCount = 0;
+	unsigned mNextTask = 0;
+	unsigned mPending = 0;
+	std::exception_ptr mError;
+	bool mQuit = false;
+};
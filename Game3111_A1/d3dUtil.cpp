@@ -126,3 +126,66 @@ std::wstring DxException::ToString()const
 
 
 
+
+void d3dUtil::ComputeBounds(
+    const void* positions,
+    UINT count,
+    UINT stride,
+    DirectX::BoundingBox& box,
+    DirectX::BoundingSphere& sphere)
+{
+    using namespace DirectX;
+
+    if(count == 0)
+    {
+        box = BoundingBox(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, 0.0f));
+        sphere = BoundingSphere(XMFLOAT3(0.0f, 0.0f, 0.0f), 0.0f);
+        return;
+    }
+
+    const BYTE* p = static_cast<const BYTE*>(positions);
+
+    // Reduce with two independent min/max pairs so consecutive iterations
+    // do not wait on each other.
+    XMVECTOR vMin0 = XMVectorReplicate(+MathHelper::Infinity);
+    XMVECTOR vMax0 = XMVectorReplicate(-MathHelper::Infinity);
+    XMVECTOR vMin1 = vMin0;
+    XMVECTOR vMax1 = vMax0;
+
+    UINT i = 0;
+    for(; i + 1 < count; i += 2)
+    {
+        XMVECTOR p0 = XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(p + i*stride));
+        XMVECTOR p1 = XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(p + (i+1)*stride));
+
+        vMin0 = XMVectorMin(vMin0, p0);
+        vMax0 = XMVectorMax(vMax0, p0);
+        vMin1 = XMVectorMin(vMin1, p1);
+        vMax1 = XMVectorMax(vMax1, p1);
+    }
+
+    if(i < count)
+    {
+        XMVECTOR p0 = XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(p + i*stride));
+        vMin0 = XMVectorMin(vMin0, p0);
+        vMax0 = XMVectorMax(vMax0, p0);
+    }
+
+    XMVECTOR vMin = XMVectorMin(vMin0, vMin1);
+    XMVECTOR vMax = XMVectorMax(vMax0, vMax1);
+
+    XMVECTOR center = 0.5f*(vMin + vMax);
+    XMStoreFloat3(&box.Center, center);
+    XMStoreFloat3(&box.Extents, 0.5f*(vMax - vMin));
+
+    // Second pass for the radius about the box center.
+    XMVECTOR maxDistSq = XMVectorZero();
+    for(i = 0; i < count; ++i)
+    {
+        XMVECTOR v = XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(p + i*stride)) - center;
+        maxDistSq = XMVectorMax(maxDistSq, XMVector3LengthSq(v));
+    }
+
+    sphere.Center = box.Center;
+    sphere.Radius = XMVectorGetX(XMVectorSqrt(maxDistSq));
+}
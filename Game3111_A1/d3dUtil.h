@@ -127,6 +127,16 @@ public:
 		const D3D_SHADER_MACRO* defines,
 		const std::string& entrypoint,
 		const std::string& target);
+
+	// Computes the AABB and a bounding sphere of count positions, each a
+	// XMFLOAT3 found every stride bytes starting at positions.  The sphere is
+	// centered on the box, which is tight enough for culling.
+	static void ComputeBounds(
+		const void* positions,
+		UINT count,
+		UINT stride,
+		DirectX::BoundingBox& box,
+		DirectX::BoundingSphere& sphere);
 };
 
 class DxException
@@ -153,9 +163,16 @@ struct SubmeshGeometry
 	UINT StartIndexLocation = 0;
 	INT BaseVertexLocation = 0;
 
-	// Bounding box of the geometry defined by this submesh. 
-	// This is used in later chapters of the book.
+	// A submesh with more vertices than 16-bit indices can address is split
+	// into BatchCount draws stored at MeshGeometry::Batches[FirstBatch...].
+	// BatchCount is 0 for the usual single-draw submesh.
+	UINT FirstBatch = 0;
+	UINT BatchCount = 0;
+
+	// Bounding volumes of the geometry defined by this submesh, in model space.
+	// Filled in when the geometry is built, see d3dUtil::ComputeBounds.
 	DirectX::BoundingBox Bounds;
+	DirectX::BoundingSphere Sphere;
 };
 
 struct MeshGeometry
@@ -183,7 +200,9 @@ struct MeshGeometry
 
 
 
-	// Data about the buffers.
+	// Data about the buffers.  VertexBufferOffset is where the vertices start in
+	// VertexBufferGPU, for vertices streamed into a shared upload buffer.
+	UINT64 VertexBufferOffset = 0;
 	UINT VertexByteStride = 0;
 	UINT VertexBufferByteSize = 0;
 	DXGI_FORMAT IndexFormat = DXGI_FORMAT_R16_UINT;
@@ -198,11 +217,14 @@ struct MeshGeometry
 
 	std::unordered_map<std::string, SubmeshGeometry> DrawArgs;
 
+	// Draw ranges of the split submeshes, see SubmeshGeometry::FirstBatch.
+	std::vector<SubmeshGeometry> Batches;
+
 	D3D12_VERTEX_BUFFER_VIEW VertexBufferView()const
 
 	{
 		D3D12_VERTEX_BUFFER_VIEW vbv;
-		vbv.BufferLocation = VertexBufferGPU->GetGPUVirtualAddress();
+		vbv.BufferLocation = VertexBufferGPU->GetGPUVirtualAddress() + VertexBufferOffset;
 		vbv.StrideInBytes = VertexByteStride;
 		vbv.SizeInBytes = VertexBufferByteSize;
 
@@ -283,11 +305,8 @@ struct Material
 	// Index into SRV heap for normal texture.
 	int NormalSrvHeapIndex = -1;
 
-	// Dirty flag indicating the material has changed and we need to update the constant buffer.
-	// Because we have a material constant buffer for each FrameResource, we have to apply the
-	// update to each FrameResource.  Thus, when we modify a material we should set 
-	// NumFramesDirty = gNumFrameResources so that each frame resource gets the update.
-	int NumFramesDirty = gNumFrameResources;
+	// Changes to the fields below only reach the constant buffers once the material
+	// is marked in ShapesApp::mMaterialChanges.
 
 	// Material constant buffer data used for shading.
 	DirectX::XMFLOAT4 DiffuseAlbedo = { 1.0f, 1.0f, 1.0f, 1.0f };